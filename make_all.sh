@@ -136,6 +136,16 @@ apply_patch_file "$SRC_DIR/src/patches/circle_usb_descriptor_patch.diff"
 apply_patch_file "$SRC_DIR/src/patches/circle_xbox360_gamepad_patch.diff"
 apply_patch_file "$SRC_DIR/src/patches/circle_tcpconnection_patch.diff"
 apply_patch_file "$SRC_DIR/src/patches/circle_ethernet_patch.diff"
+# Only the Ethernet cartridge bridge needs the frame tap. If the patch no
+# longer fits this Circle, build without it rather than stop; the
+# Makefile then leaves the bridge's receive side out.
+tap_patch_file="$SRC_DIR/src/patches/circle_netdevlayer_tap_patch.diff"
+if patch -p1 --dry-run -s < "$tap_patch_file" >/dev/null
+then
+       apply_patch_file "$tap_patch_file"
+else
+       echo "WARNING: $tap_patch_file does not apply, the Ethernet cartridge will not receive" >&2
+fi
 if [ "$KASAN" = "1" ]
 then
        apply_patch_file "$SRC_DIR/src/patches/circle_kasan_patch.diff"
@@ -0,0 +1,96 @@
+#!/bin/bash
+
+# Builds every machine for the build machine with no display, for
+# benchmarking. See tools/HEADLESS_BENCH.md.
+#
+# This configures VICE in place for the host, replacing any objects
+# left by make_all.sh. Run make_all.sh again before building kernel
+# images.
+
+SRC_DIR=`pwd`
+COMMON_HOME="$SRC_DIR/third_party/common"
+
+if [ ! -f sdcard/config.txt ]
+then
+echo Must be run from BMC64 root dir.
+exit 1
+fi
+
+for tool in flex xa
+do
+if ! command -v $tool >/dev/null 2>&1
+then
+       echo "Missing required build dependency: $tool" >&2
+       exit 1
+fi
+done
+
+export AUTOMAKE=automake
+
+cd $SRC_DIR/third_party/vice-3.3
+
+echo "Running autogen for VICE..."
+if ! ./autogen.sh
+then
+       echo "VICE autogen failed!" >&2
+       exit 1
+fi
+
+for resid_dir in src/resid src/teensy-resid
+do
+       if ! (cd "$resid_dir" && aclocal && autoconf -f && automake -a -c -f)
+       then
+              echo "Failed to regenerate VICE $resid_dir build files" >&2
+              exit 1
+       fi
+done
+
+cd src/resid
+if ! CXXFLAGS="-O2 -g -std=c++11" ./configure
+then
+       echo "Failed to configure resid" >&2
+       exit 1
+fi
+cd ../..
+
+# fork is hidden so the printer driver does not want the unix coproc
+# code, which is not part of the raspi arch.
+if ! ac_cv_func_fork=no LEX=flex LEXLIB= ac_cv_lib_lex='none needed' ac_cv_search_yywrap='none required' \
+       CFLAGS="-O2 -g -I$COMMON_HOME" CXXFLAGS="-O2 -g -std=c++11 -fno-exceptions" \
+       ./configure --disable-realdevice --disable-ipv6 --disable-ssi2001 --disable-catweasel --disable-hardsid --disable-parsid --disable-portaudio --disable-ahi --disable-bundle --disable-lame --disable-rs232 --disable-midi --disable-hidmgr --disable-hidutils --without-oss --without-alsa --without-pulse --without-zlib --without-png --disable-sdlui --disable-sdlui2 --enable-raspiui --enable-raspiheadless
+then
+       echo "Failed to configure VICE" >&2
+       exit 1
+fi
+
+make clean || true
+find . -type f \( -name '*.o' -o -name '*.a' -o -name '*.lo' \) -delete
+
+cd src
+make libarchdep && make libhvsc
+if [ "$?" != "0" ]
+then
+       exit 1
+fi
+cd ..
+
+# These will fail to link. tools/headless does the linking.
+make x64
+make x128
+make xvic
+make xplus4
+make xpet
+
+echo ==============================================================
+echo Link errors above are expected
+echo ==============================================================
+
+# autoconf's backups and the build tool for infocontrib.h are not
+# needed once configured and built. The objects stay: tools/headless
+# links them.
+find . -name 'configure~' -delete
+rm -f src/geninfocontrib
+
+cd $SRC_DIR/tools/headless
+make clean
+make
@@ -0,0 +1,571 @@
+// bmccapture.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Records the emulated picture and sound to the SD card. The container
+// is described in tools/CAPTURE.md; tools/capture_convert.py turns it
+// into a video.
+//
+// Three parties, none of which makes the emulation core wait:
+// - The emulation core copies each frame's indexed pixels and palette
+//   into one of four frame slots and the sound into blocks of samples,
+//   dropping what does not fit.
+// - The encoder, on the helper core that also draws half of each
+//   software CRT frame, codes the frames as the frame stream does and
+//   appends them and the sound to a 4 MB write buffer. A frame that may
+//   not fit is dropped before it is coded, so the next is still a
+//   correct delta.
+// - The writer task on core 0 writes the buffer to the file in 64 KB
+//   pieces, each at a 64 KB offset, holding the FatFs lock only for the
+//   write.
+
+#include "bmccapture.h"
+#include "framecoder.h"
+#include "spsc_ring.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <ff.h>
+#ifndef RASPI_HEADLESS
+#include "circle_glue.h"
+#endif
+
+#include <circle/logger.h>
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+#include <circle/timer.h>
+#include <circle/types.h>
+
+namespace {
+
+// Ring sizes must be powers of two.
+const unsigned kFrameSlots = 4;
+const unsigned kAudioBlocks = 32;
+const unsigned kAudioBlockSamples = 4096;
+const unsigned kChunkSize = 64 * 1024;
+const unsigned kChunks = 64;
+const unsigned kBufferSize = kChunkSize * kChunks;
+// f_sync after this many chunks, so a pulled card loses seconds, not
+// the whole recording.
+const unsigned kSyncChunks = 16;
+// Rows a helper poll codes before it looks for CRT work again.
+const unsigned kRowsPerPoll = 32;
+const unsigned kMaxCaptures = 1000;
+const char FromBmcCapture[] = "bmc-capture";
+
+enum MessageType {
+  kMessageAudio = 0x03,
+  kMessageEnd = 0x04,
+  kMessageStart = 0x10,
+};
+
+const unsigned kStartSize = 16;
+const unsigned kEndSize = 20;
+// Room always left in the write buffer for the end message.
+const unsigned kReserve = FrameCoder::kHeaderSize + kEndSize;
+
+// Each is set by one party: Start and Stop run on the emulation core,
+// the encoder finishes, the writer closes.
+enum CaptureState {
+  kIdle,
+  kRecording,
+  kStopping,   // the encoder drains what the emulation core captured
+  kFlushing,   // the writer writes the rest and closes the file
+};
+
+struct FrameSlot {
+  u32 frame;
+  unsigned width;
+  unsigned height;
+  u16 palette[FrameCoder::kPaletteSize];
+  u8 *pixels;
+};
+
+struct AudioBlock {
+  u32 first;   // per channel, since the start
+  unsigned count;
+  s16 samples[kAudioBlockSamples];
+};
+
+class BmcCapture;
+
+class CaptureTask : public CTask {
+public:
+  explicit CaptureTask(BmcCapture *capture) : capture_(capture) {
+    SetName("bmc-capture");
+  }
+
+  void Run() override;
+
+private:
+  BmcCapture *capture_;
+};
+
+class BmcCapture {
+public:
+  BmcCapture()
+      : task_(0), state_(kIdle), buffer_(0), number_(0), failed_(false),
+        rate_(44100), channels_(1), recording_(false), frame_(0),
+        audioTotal_(0), audioBlock_(0), helper_(false), encoderBusy_(0),
+        coder_(0), staging_(0), encoding_(0), encodeUs_(0), put_(0),
+        produced_(0), written_(0), chunks_(0) {
+    memset(&stats_, 0, sizeof stats_);
+  }
+
+  void StartTask() {
+    if (task_ == 0) {
+      task_ = new CaptureTask(this);
+    }
+  }
+
+  void SetSoundFormat(unsigned rate, unsigned channels) {
+    rate_ = rate;
+    channels_ = channels == 0 ? 1 : channels;
+  }
+
+  // Emulation core side. Opens the next free capture file in dir, which
+  // ends in a slash.
+  int Start(const char *dir, double fps) {
+    if (task_ == 0 || __atomic_load_n(&state_, __ATOMIC_ACQUIRE) != kIdle) {
+      return -1;
+    }
+    // Allocated on first use; the slots alone are 1.3 MB.
+    if (buffer_ == 0) {
+      for (unsigned index = 0; index < kFrameSlots; ++index) {
+        frames_.At(index)->pixels =
+            new u8[FrameCoder::kMaxWidth * FrameCoder::kMaxHeight];
+      }
+      coder_ = new FrameCoder();
+      staging_ = new u8[FrameCoder::kMaxBytes];
+      buffer_ = new u8[kBufferSize];
+    }
+
+    FRESULT result = FR_EXIST;
+    for (number_ = 0; number_ < kMaxCaptures; ++number_) {
+      snprintf(path_, sizeof path_, "%scapture%03u.bmv", dir, number_);
+      CGlueFatFsLock();
+      result = f_open(&file_, path_, FA_WRITE | FA_CREATE_NEW);
+      CGlueFatFsUnlock();
+      if (result != FR_EXIST) {
+        break;
+      }
+    }
+    if (result != FR_OK) {
+      CLogger::Get()->Write(FromBmcCapture, LogError,
+                            "cannot create %s (%d)", path_, result);
+      return -1;
+    }
+
+    memset(&stats_, 0, sizeof stats_);
+    failed_ = false;
+    frame_ = 0;
+    audioTotal_ = 0;
+    coder_->Reset();
+    put_ = produced_ = written_ = 0;
+    chunks_ = 0;
+
+    u8 start[FrameCoder::kHeaderSize + kStartSize];
+    FrameCoder::PutHeader(start, kMessageStart, kStartSize);
+    u8 *body = start + FrameCoder::kHeaderSize;
+    memcpy(body, "BMCA", 4);
+    FrameCoder::Put16(body + 4, 1);
+    FrameCoder::Put16(body + 6, channels_);
+    FrameCoder::Put32(body + 8, rate_);
+    FrameCoder::Put32(body + 12, (u32)(fps * 1000 + 0.5));
+    Put(start, sizeof start);
+    Publish();
+
+    recording_ = true;
+    __atomic_store_n(&state_, kRecording, __ATOMIC_RELEASE);
+    CLogger::Get()->Write(FromBmcCapture, LogNotice, "recording to %s",
+                          path_);
+    return (int)number_;
+  }
+
+  void Stop() {
+    if (__atomic_load_n(&state_, __ATOMIC_ACQUIRE) != kRecording) {
+      return;
+    }
+    recording_ = false;
+    if (audioBlock_ != 0) {
+      audio_.Commit();
+      audioBlock_ = 0;
+    }
+    __atomic_store_n(&state_, kStopping, __ATOMIC_RELEASE);
+  }
+
+  bool Active() {
+    return __atomic_load_n(&state_, __ATOMIC_ACQUIRE) != kIdle;
+  }
+
+  bool Wanted() {
+    if (!recording_) {
+      return false;
+    }
+    ++stats_.frames;
+    ++frame_;
+    return true;
+  }
+
+  void Frame(const u8 *pixels, int pitch, int x, int y, int w, int h,
+             const u16 *palette) {
+    u64 start = CTimer::GetClockTicks64();
+    ++stats_.captured;
+    if (w <= 0 || h <= 0 || (unsigned)w > FrameCoder::kMaxWidth ||
+        (unsigned)h > FrameCoder::kMaxHeight) {
+      ++stats_.tooLarge;
+      return;
+    }
+    FrameSlot *slot = frames_.Reserve();
+    if (slot == 0) {
+      ++stats_.captureDrops;
+      return;
+    }
+    slot->frame = frame_ - 1;
+    slot->width = w;
+    slot->height = h;
+    memcpy(slot->palette, palette, sizeof slot->palette);
+    const u8 *row = pixels + y * pitch + x;
+    for (int line = 0; line < h; ++line) {
+      memcpy(slot->pixels + line * w, row, w);
+      row += pitch;
+    }
+    frames_.Commit();
+#ifndef RASPI_HEADLESS
+    asm volatile("dsb\n\tsev" ::: "memory");
+#endif
+    unsigned elapsed = (unsigned)(CTimer::GetClockTicks64() - start);
+    stats_.captureUs += elapsed;
+    if (elapsed > stats_.maxCaptureUs) {
+      stats_.maxCaptureUs = elapsed;
+    }
+  }
+
+  void Audio(const s16 *samples, unsigned count) {
+    if (!recording_) {
+      return;
+    }
+    stats_.audioSamples += count;
+    while (count > 0) {
+      if (audioBlock_ == 0) {
+        audioBlock_ = audio_.Reserve();
+        if (audioBlock_ == 0) {
+          // The next block starts after the gap, which the converter
+          // fills with silence.
+          stats_.audioDrops += count;
+          audioTotal_ += count;
+          return;
+        }
+        audioBlock_->first = (u32)(audioTotal_ / channels_);
+        audioBlock_->count = 0;
+      }
+      unsigned room = kAudioBlockSamples - audioBlock_->count;
+      unsigned part = count < room ? count : room;
+      memcpy(audioBlock_->samples + audioBlock_->count, samples,
+             part * sizeof *samples);
+      audioBlock_->count += part;
+      audioTotal_ += part;
+      samples += part;
+      count -= part;
+      if (audioBlock_->count == kAudioBlockSamples) {
+        audio_.Commit();
+        audioBlock_ = 0;
+      }
+    }
+  }
+
+  // Helper core side.
+  int HelperPoll() {
+    if (!helper_) {
+      __atomic_store_n(&helper_, true, __ATOMIC_RELEASE);
+    }
+    return Encode(kRowsPerPoll);
+  }
+
+  void GetStats(CaptureStats *stats) { *stats = stats_; }
+
+  // Writer task side.
+  void Write() {
+    for (;;) {
+      unsigned state = __atomic_load_n(&state_, __ATOMIC_ACQUIRE);
+      if (state == kIdle) {
+        CScheduler::Get()->MsSleep(20);
+        continue;
+      }
+      if (!__atomic_load_n(&helper_, __ATOMIC_ACQUIRE)) {
+        Encode(FrameCoder::kMaxHeight);
+      }
+      unsigned waiting = __atomic_load_n(&produced_, __ATOMIC_ACQUIRE) -
+                         written_;
+      if (waiting >= kChunkSize) {
+        WriteChunk(kChunkSize);
+        continue;
+      }
+      if (state == kFlushing) {
+        if (waiting > 0) {
+          WriteChunk(waiting);
+        }
+        Close();
+        __atomic_store_n(&state_, kIdle, __ATOMIC_RELEASE);
+        continue;
+      }
+      CScheduler::Get()->MsSleep(2);
+    }
+  }
+
+private:
+  unsigned Free() const {
+    return kBufferSize - (put_ - __atomic_load_n(&written_, __ATOMIC_ACQUIRE));
+  }
+
+  // Encoder side. Appends to the write buffer; Publish hands it to the
+  // writer.
+  void Put(const void *data, unsigned length) {
+    unsigned at = put_ & (kBufferSize - 1);
+    unsigned first = kBufferSize - at < length ? kBufferSize - at : length;
+    memcpy(buffer_ + at, data, first);
+    memcpy(buffer_, (const u8 *)data + first, length - first);
+    put_ += length;
+  }
+
+  void Publish() { __atomic_store_n(&produced_, put_, __ATOMIC_RELEASE); }
+
+  // Codes sound first and then frames, at most rows rows a call. The
+  // writer task stands in for a missing helper, so both may call.
+  int Encode(unsigned rows) {
+    unsigned state = __atomic_load_n(&state_, __ATOMIC_ACQUIRE);
+    if (state != kRecording && state != kStopping) {
+      return 0;
+    }
+    if (__atomic_exchange_n(&encoderBusy_, 1, __ATOMIC_ACQUIRE)) {
+      return 0;
+    }
+    int done = encoding_ == 0 ? EncodeAudio() : 0;
+    if (done == 0) {
+      done = EncodeFrame(rows);
+    }
+    if (done == 0 && state == kStopping && encoding_ == 0 &&
+        frames_.Front() == 0 && audio_.Front() == 0) {
+      Finish();
+      done = 1;
+    }
+    __atomic_store_n(&encoderBusy_, 0, __ATOMIC_RELEASE);
+    return done;
+  }
+
+  int EncodeAudio() {
+    AudioBlock *block = audio_.Front();
+    if (block == 0) {
+      return 0;
+    }
+    unsigned length = 4 + block->count * 2;
+    if (Free() < FrameCoder::kHeaderSize + length + kReserve) {
+      stats_.audioEncodeDrops += block->count;
+    } else {
+      u8 header[FrameCoder::kHeaderSize + 4];
+      FrameCoder::PutHeader(header, kMessageAudio, length);
+      FrameCoder::Put32(header + FrameCoder::kHeaderSize, block->first);
+      Put(header, sizeof header);
+      // The Pi and the container are both little endian.
+      Put(block->samples, block->count * 2);
+      Publish();
+    }
+    audio_.Release();
+    return 1;
+  }
+
+  int EncodeFrame(unsigned rows) {
+    u64 start = CTimer::GetClockTicks64();
+    if (encoding_ == 0) {
+      encoding_ = frames_.Front();
+      if (encoding_ == 0) {
+        return 0;
+      }
+      if (Free() < FrameCoder::kMaxBytes + kReserve) {
+        // The card is behind. Nothing was coded, so the next frame is
+        // still a correct delta.
+        ++stats_.encodeDrops;
+        encoding_ = 0;
+        frames_.Release();
+        return 1;
+      }
+      coder_->Begin(encoding_->pixels, encoding_->width, encoding_->height,
+                    encoding_->palette, encoding_->frame, false, staging_);
+      encodeUs_ = 0;
+    }
+
+    bool done = coder_->Continue(rows);
+    encodeUs_ += (unsigned)(CTimer::GetClockTicks64() - start);
+    if (!done) {
+      return 1;
+    }
+    encoding_ = 0;
+    frames_.Release();
+    Put(staging_, coder_->Length());
+    Publish();
+
+    ++stats_.encoded;
+    if (coder_->KeyFrame()) {
+      ++stats_.keyFrames;
+    }
+    stats_.encodeUs += encodeUs_;
+    if (encodeUs_ > stats_.maxEncodeUs) {
+      stats_.maxEncodeUs = encodeUs_;
+    }
+    return 1;
+  }
+
+  void Finish() {
+    u8 end[FrameCoder::kHeaderSize + kEndSize];
+    FrameCoder::PutHeader(end, kMessageEnd, kEndSize);
+    u8 *body = end + FrameCoder::kHeaderSize;
+    FrameCoder::Put32(body, stats_.frames);
+    FrameCoder::Put32(body + 4, stats_.encoded);
+    FrameCoder::Put32(body + 8, stats_.captureDrops);
+    FrameCoder::Put32(body + 12, stats_.encodeDrops);
+    FrameCoder::Put32(body + 16,
+                      (u32)(stats_.audioDrops + stats_.audioEncodeDrops));
+    Put(end, sizeof end);
+    Publish();
+    __atomic_store_n(&state_, kFlushing, __ATOMIC_RELEASE);
+  }
+
+  // Writer side. A failed write is counted and its data dropped, so a
+  // full card ends the recording's content, not the emulation.
+  void WriteChunk(unsigned length) {
+    u64 start = CTimer::GetClockTicks64();
+    UINT count = 0;
+    CGlueFatFsLock();
+    FRESULT result =
+        f_write(&file_, buffer_ + (written_ & (kBufferSize - 1)), length,
+                &count);
+    if (result == FR_OK && ++chunks_ % kSyncChunks == 0) {
+      result = f_sync(&file_);
+    }
+    CGlueFatFsUnlock();
+    unsigned elapsed = (unsigned)(CTimer::GetClockTicks64() - start);
+
+    if ((result != FR_OK || count != length) && !failed_) {
+      failed_ = true;
+      CLogger::Get()->Write(FromBmcCapture, LogError,
+                            "cannot write %s (%d), is the card full?", path_,
+                            result);
+    }
+    if (!failed_) {
+      stats_.bytesWritten += length;
+    }
+    ++stats_.writes;
+    stats_.writeUs += elapsed;
+    if (elapsed > stats_.maxWriteUs) {
+      stats_.maxWriteUs = elapsed;
+    }
+    __atomic_store_n(&written_, written_ + length, __ATOMIC_RELEASE);
+  }
+
+  void Close() {
+    CGlueFatFsLock();
+    f_close(&file_);
+    CGlueFatFsUnlock();
+
+    const CaptureStats &stats = stats_;
+    CLogger::Get()->Write(
+        FromBmcCapture, LogNotice,
+        "%s: %u frames, %u written, %u dropped at capture, %u by the "
+        "card, %llu of %llu samples dropped, %llu KB",
+        path_, stats.frames, stats.encoded, stats.captureDrops,
+        stats.encodeDrops, stats.audioDrops + stats.audioEncodeDrops,
+        stats.audioSamples,
+        stats.bytesWritten / 1024);
+    CLogger::Get()->Write(
+        FromBmcCapture, LogNotice,
+        "capture %llu us/frame (max %u), encode %llu us/frame (max %u), "
+        "write %llu us/64 KB (max %u)",
+        stats.captured == 0 ? 0 : stats.captureUs / stats.captured,
+        stats.maxCaptureUs,
+        stats.encoded == 0 ? 0 : stats.encodeUs / stats.encoded,
+        stats.maxEncodeUs,
+        stats.writes == 0 ? 0 : stats.writeUs / stats.writes,
+        stats.maxWriteUs);
+  }
+
+  CaptureTask *task_;
+  unsigned state_;
+  u8 *buffer_;
+  FIL file_;
+  char path_[256];
+  unsigned number_;
+  bool failed_;
+  unsigned rate_;
+  unsigned channels_;
+
+  // Emulation core.
+  bool recording_;
+  u32 frame_;
+  unsigned long long audioTotal_;
+  AudioBlock *audioBlock_;
+  SlotRing<FrameSlot, kFrameSlots> frames_;
+  SlotRing<AudioBlock, kAudioBlocks> audio_;
+
+  // Encoder: the helper core, or the writer task without one.
+  bool helper_;
+  int encoderBusy_;
+  FrameCoder *coder_;
+  u8 *staging_;
+  FrameSlot *encoding_;
+  unsigned encodeUs_;
+  unsigned put_;
+  unsigned produced_;
+
+  // Writer task.
+  unsigned written_;
+  unsigned chunks_;
+
+  // Each counter has one writer.
+  CaptureStats stats_;
+};
+
+void CaptureTask::Run() { capture_->Write(); }
+
+BmcCapture capture;
+
+}  // namespace
+
+void StartCapture(void) { capture.StartTask(); }
+
+void CaptureSetSoundFormat(unsigned rate, unsigned channels) {
+  capture.SetSoundFormat(rate, channels);
+}
+
+bool CaptureWanted(void) { return capture.Wanted(); }
+
+void CaptureFrame(const uint8_t *pixels, int pitch, int x, int y, int w,
+                  int h, const uint16_t *palette565) {
+  capture.Frame(pixels, pitch, x, y, w, h, palette565);
+}
+
+void CaptureAudio(const int16_t *samples, size_t nr) {
+  capture.Audio(samples, nr);
+}
+
+int CaptureHelperPoll(void) { return capture.HelperPoll(); }
+
+void CaptureGetStats(CaptureStats *stats) { capture.GetStats(stats); }
+
+extern "C" int circle_capture_start(const char *dir, double fps) {
+  return capture.Start(dir, fps);
+}
+
+extern "C" void circle_capture_stop(void) { capture.Stop(); }
+
+extern "C" int circle_capture_active(void) { return capture.Active(); }
@@ -0,0 +1,61 @@
+#ifndef BMCCAPTURE_H
+#define BMCCAPTURE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Records the emulated picture and sound to a file on the SD card, for
+// tools/capture_convert.py to turn into a video. The container and the
+// converter are described in tools/CAPTURE.md. Started and stopped from
+// the menu through circle_capture_start and circle_capture_stop.
+
+// Starts the task that writes captures. Once, at boot.
+void StartCapture(void);
+
+// Emulation core, whenever VICE opens the sound device.
+void CaptureSetSoundFormat(unsigned rate, unsigned channels);
+
+// Emulation core, once a frame. True while recording; every call counts
+// a frame, captured or not.
+bool CaptureWanted(void);
+
+// Emulation core. Copies the w x h pixels at x, y and the palette if
+// there is a free slot, and otherwise drops the frame. Never waits.
+void CaptureFrame(const uint8_t *pixels, int pitch, int x, int y, int w,
+                  int h, const uint16_t *palette565);
+
+// Emulation core. Copies nr samples, or drops them when the encoder is
+// that far behind. Never waits.
+void CaptureAudio(const int16_t *samples, size_t nr);
+
+// Idle work for a helper core: codes captured sound and frames into the
+// write buffer. Returns non zero when it did something. Without a
+// helper the writer task does it.
+int CaptureHelperPoll(void);
+
+struct CaptureStats {
+  unsigned frames;         // drawn by the machine while recording
+  unsigned captured;
+  unsigned captureDrops;   // every frame slot still held by the encoder
+  unsigned tooLarge;
+  unsigned encoded;
+  unsigned encodeDrops;    // the write buffer could not take the frame
+  unsigned keyFrames;
+  unsigned long long audioSamples;
+  unsigned long long audioDrops;        // samples, no free block
+  unsigned long long audioEncodeDrops;  // the write buffer was full
+  unsigned long long bytesWritten;
+  unsigned long long captureUs;   // emulation core, copying frames
+  unsigned maxCaptureUs;
+  unsigned long long encodeUs;    // helper, coding frames
+  unsigned maxEncodeUs;
+  unsigned writes;
+  unsigned long long writeUs;     // writer task, in f_write and f_sync
+  unsigned maxWriteUs;
+};
+
+// Of the current or last capture, for the log and
+// tools/headless/capture_bench.
+void CaptureGetStats(CaptureStats *stats);
+
+#endif
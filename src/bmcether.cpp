@@ -0,0 +1,444 @@
+// bmcether.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Bridges the emulated CS8900 (TFE, RR-Net) to the Pi's Ethernet or WLAN
+// device beside Circle's own TCP/IP stack.
+//
+// The device keeps its own MAC address. Frames the C64 sends go out
+// with the Pi's address as their source, and frames for the Pi's address
+// come back with the C64's, the way a Wi-Fi client bridge does it. ARP
+// carries addresses too and is rewritten the same way. Once the C64's
+// IPv4 address is known from what it sends, unicast IPv4 and ARP meant
+// for the Pi itself are not passed on.
+
+extern "C" {
+#include "../third_party/vice-3.3/src/arch/raspi/rawnetbmc.h"
+}
+
+#include "spsc_ring.h"
+
+#include <string.h>
+
+#include <circle/logger.h>
+#include <circle/macaddress.h>
+#include <circle/net/netdevlayer.h>
+#include <circle/netdevice.h>
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+
+namespace {
+
+// Ring sizes must be powers of two.
+const unsigned kReceiveSlots = 32;
+const unsigned kTransmitSlots = 16;
+const unsigned kMacSize = 6;
+const unsigned kEtherHeaderSize = 14;
+const unsigned kEtherTypeOffset = 12;
+const unsigned kArpSenderMacOffset = 22;
+const unsigned kArpSenderIpOffset = 28;
+const unsigned kArpTargetMacOffset = 32;
+const unsigned kArpTargetIpOffset = 38;
+const unsigned kArpSize = 42;
+const unsigned kIpSourceOffset = 26;
+const unsigned kIpDestinationOffset = 30;
+const unsigned kIpSize = 34;
+const u16 kEtherTypeIp = 0x0800;
+const u16 kEtherTypeArp = 0x0806;
+const char FromBmcEther[] = "bmc-ether";
+
+struct FrameSlot {
+  unsigned length;
+  int flags;
+  int hashIndex;
+  u8 data[FRAME_BUFFER_SIZE];
+};
+
+// What the CS8900 registers say to accept. Written by the emulation
+// core and read for every frame by the network task, so it goes through
+// a sequence count instead of a lock: an odd count or one that moved
+// during the copy means a write was under way.
+struct ReceiveFilter {
+  u8 mac[kMacSize];
+  u32 hashMask[2];
+  int flags;
+};
+
+u16 GetBigEndian16(const u8 *bytes) { return (u16)(bytes[0] << 8 | bytes[1]); }
+
+// The CS8900's multicast hash: the top six bits of the Ethernet CRC
+// register after the destination address.
+int HashIndex(const u8 *mac) {
+  u32 crc = 0xffffffff;
+  for (unsigned index = 0; index < kMacSize; ++index) {
+    crc ^= mac[index];
+    for (int bit = 0; bit < 8; ++bit) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return (int)(crc >> 26);
+}
+
+bool IsBroadcast(const u8 *mac) {
+  static const u8 kBroadcast[kMacSize] = {0xff, 0xff, 0xff,
+                                          0xff, 0xff, 0xff};
+  return memcmp(mac, kBroadcast, kMacSize) == 0;
+}
+
+// The same decision as cs8900_should_accept. Only the unambiguous
+// reasons are passed on; the CS8900 works out the rest itself.
+bool Accept(const ReceiveFilter &filter, const u8 *destination,
+            int *frameFlags, int *hashIndex) {
+  int flags = filter.flags;
+  bool promiscuous = (flags & BMCETHER_RX_PROMISCUOUS) != 0;
+  bool correct = memcmp(destination, filter.mac, kMacSize) == 0;
+
+  *frameFlags = 0;
+  *hashIndex = 0;
+  if (correct && (flags & BMCETHER_RX_IA || promiscuous)) {
+    *frameFlags = BMCETHER_FRAME_CORRECT_MAC;
+    return true;
+  }
+  if (IsBroadcast(destination)) {
+    *frameFlags = BMCETHER_FRAME_BROADCAST;
+    return flags & BMCETHER_RX_BROADCAST || promiscuous;
+  }
+  int index = HashIndex(destination);
+  if (filter.hashMask[index >> 5] & (1u << (index & 31))) {
+    if (destination[0] & 0x80) {
+      return flags & BMCETHER_RX_MULTICAST || promiscuous;
+    }
+    if (!correct) {
+      *frameFlags = BMCETHER_FRAME_HASHED;
+      *hashIndex = index;
+    }
+    return flags & BMCETHER_RX_IAHASH || promiscuous;
+  }
+  return promiscuous;
+}
+
+class BmcEther;
+
+class EtherTask : public CTask {
+public:
+  explicit EtherTask(BmcEther *ether) : CTask(8 * 1024), ether_(ether) {
+    SetName("bmc-ether");
+  }
+
+  void Run() override;
+
+private:
+  BmcEther *ether_;
+};
+
+class BmcEther {
+public:
+  BmcEther()
+      : device_(0), task_(0), tapInstalled_(false), active_(false),
+        guestIp_(0), filterSequence_(0), sendFailures_(0) {
+    memset(&filter_, 0, sizeof(filter_));
+    memset(&stats_, 0, sizeof(stats_));
+    memset(hostMac_, 0, sizeof(hostMac_));
+  }
+
+  // Emulation core side.
+  bool Activate() {
+    if (device_ == 0) {
+      device_ = CNetDevice::GetNetDevice(NetDeviceTypeEthernet);
+      if (device_ == 0) {
+        device_ = CNetDevice::GetNetDevice(NetDeviceTypeWLAN);
+      }
+      if (device_ == 0) {
+        return false;
+      }
+      device_->GetMACAddress()->CopyTo(hostMac_);
+      task_ = new EtherTask(this);
+    }
+    receive_.Clear();
+    __atomic_store_n(&guestIp_, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&active_, true, __ATOMIC_RELEASE);
+    if (!tapInstalled_) {
+      tapInstalled_ = true;
+#ifdef BMC64_NO_FRAME_TAP
+      CLogger::Get()->Write(FromBmcEther, LogWarning,
+                            "Circle was built without the frame tap patch, "
+                            "nothing will be received");
+#else
+      CNetDeviceLayer::SetFrameTap(FrameTap, this);
+#endif
+    }
+    CLogger::Get()->Write(FromBmcEther, LogNotice,
+                          "bridging to %02x:%02x:%02x:%02x:%02x:%02x",
+                          hostMac_[0], hostMac_[1], hostMac_[2], hostMac_[3],
+                          hostMac_[4], hostMac_[5]);
+    return true;
+  }
+
+  void Deactivate() {
+    __atomic_store_n(&active_, false, __ATOMIC_RELEASE);
+    receive_.Clear();
+  }
+
+  void SetMac(const u8 *mac) {
+    BeginFilterWrite();
+    memcpy(filter_.mac, mac, kMacSize);
+    EndFilterWrite();
+  }
+
+  void SetHashFilter(const u32 *hashMask) {
+    BeginFilterWrite();
+    filter_.hashMask[0] = hashMask[0];
+    filter_.hashMask[1] = hashMask[1];
+    EndFilterWrite();
+  }
+
+  void SetReceive(int flags) {
+    BeginFilterWrite();
+    filter_.flags = flags;
+    EndFilterWrite();
+  }
+
+  bool Transmit(const u8 *frame, int length) {
+    FrameSlot *slot = 0;
+    if (__atomic_load_n(&active_, __ATOMIC_ACQUIRE) &&
+        length >= (int)kEtherHeaderSize && length <= FRAME_BUFFER_SIZE) {
+      slot = transmit_.Reserve();
+    }
+    if (slot == 0) {
+      Count(&stats_.tx_dropped, 1);
+      return false;
+    }
+    memcpy(slot->data, frame, length);
+    slot->length = length;
+    transmit_.Commit();
+    return true;
+  }
+
+  bool Receive(u8 *buffer, int *length, int *frameFlags, int *hashIndex) {
+    FrameSlot *slot = receive_.Front();
+    if (slot == 0) {
+      return false;
+    }
+    int copied = (int)slot->length < *length ? (int)slot->length : *length;
+    memcpy(buffer, slot->data, copied);
+    *length = copied;
+    *frameFlags = slot->flags;
+    *hashIndex = slot->hashIndex;
+    receive_.Release();
+    Count(&stats_.rx_delivered, 1);
+    Count(&stats_.rx_bytes, copied);
+    return true;
+  }
+
+  void GetStats(struct bmcether_stats *stats) {
+    stats->rx_frames = __atomic_load_n(&stats_.rx_frames, __ATOMIC_RELAXED);
+    stats->rx_filtered =
+        __atomic_load_n(&stats_.rx_filtered, __ATOMIC_RELAXED);
+    stats->rx_dropped = __atomic_load_n(&stats_.rx_dropped, __ATOMIC_RELAXED);
+    stats->rx_delivered =
+        __atomic_load_n(&stats_.rx_delivered, __ATOMIC_RELAXED);
+    stats->rx_bytes = __atomic_load_n(&stats_.rx_bytes, __ATOMIC_RELAXED);
+    stats->tx_frames = __atomic_load_n(&stats_.tx_frames, __ATOMIC_RELAXED);
+    stats->tx_dropped = __atomic_load_n(&stats_.tx_dropped, __ATOMIC_RELAXED) +
+                        __atomic_load_n(&sendFailures_, __ATOMIC_RELAXED);
+    stats->tx_bytes = __atomic_load_n(&stats_.tx_bytes, __ATOMIC_RELAXED);
+  }
+
+  // Network task side. Sends what the C64 queued, as the Pi.
+  void ServiceTransmit() {
+    FrameSlot *slot;
+    while ((slot = transmit_.Front()) != 0) {
+      u8 *frame = slot->data;
+      u8 guestMac[kMacSize];
+      ReadGuestMac(guestMac);
+      if (memcmp(frame + kMacSize, guestMac, kMacSize) == 0) {
+        memcpy(frame + kMacSize, hostMac_, kMacSize);
+      }
+      u16 type = GetBigEndian16(frame + kEtherTypeOffset);
+      if (type == kEtherTypeArp && slot->length >= kArpSize) {
+        if (memcmp(frame + kArpSenderMacOffset, guestMac, kMacSize) == 0) {
+          memcpy(frame + kArpSenderMacOffset, hostMac_, kMacSize);
+        }
+        LearnGuestIp(frame + kArpSenderIpOffset);
+      } else if (type == kEtherTypeIp && slot->length >= kIpSize) {
+        LearnGuestIp(frame + kIpSourceOffset);
+      }
+      if (device_->SendFrame(frame, slot->length)) {
+        Count(&stats_.tx_frames, 1);
+        Count(&stats_.tx_bytes, slot->length);
+      } else {
+        Count(&sendFailures_, 1);
+      }
+      transmit_.Release();
+    }
+  }
+
+private:
+  static void FrameTap(const void *frame, unsigned length, void *param) {
+    static_cast<BmcEther *>(param)->TakeFrame(
+        static_cast<const u8 *>(frame), length);
+  }
+
+  // Network task side, for every frame the device receives.
+  void TakeFrame(const u8 *frame, unsigned length) {
+    if (!__atomic_load_n(&active_, __ATOMIC_ACQUIRE)) {
+      return;
+    }
+    Count(&stats_.rx_frames, 1);
+    ReceiveFilter filter;
+    ReadFilter(&filter);
+    if (!(filter.flags & BMCETHER_RX_ENABLE) || length < kEtherHeaderSize ||
+        length > FRAME_BUFFER_SIZE) {
+      Count(&stats_.rx_filtered, 1);
+      return;
+    }
+
+    u8 destination[kMacSize];
+    bool forHost = memcmp(frame, hostMac_, kMacSize) == 0;
+    memcpy(destination, forHost ? filter.mac : frame, kMacSize);
+    int frameFlags, hashIndex;
+    if ((forHost && !ForGuest(frame, length)) ||
+        !Accept(filter, destination, &frameFlags, &hashIndex)) {
+      Count(&stats_.rx_filtered, 1);
+      return;
+    }
+
+    FrameSlot *slot = receive_.Reserve();
+    if (slot == 0) {
+      Count(&stats_.rx_dropped, 1);
+      return;
+    }
+    memcpy(slot->data, frame, length);
+    if (forHost) {
+      memcpy(slot->data, filter.mac, kMacSize);
+      if (GetBigEndian16(frame + kEtherTypeOffset) == kEtherTypeArp &&
+          length >= kArpSize &&
+          memcmp(frame + kArpTargetMacOffset, hostMac_, kMacSize) == 0) {
+        memcpy(slot->data + kArpTargetMacOffset, filter.mac, kMacSize);
+      }
+    }
+    slot->length = length;
+    slot->flags = frameFlags;
+    slot->hashIndex = hashIndex;
+    receive_.Commit();
+  }
+
+  // Unicast for the Pi's address is only the C64's if it names the
+  // C64's IPv4 address, once that is known.
+  bool ForGuest(const u8 *frame, unsigned length) {
+    u32 guestIp = __atomic_load_n(&guestIp_, __ATOMIC_RELAXED);
+    if (guestIp == 0) {
+      return true;
+    }
+    u16 type = GetBigEndian16(frame + kEtherTypeOffset);
+    if (type == kEtherTypeIp && length >= kIpSize) {
+      return memcmp(frame + kIpDestinationOffset, &guestIp, 4) == 0;
+    }
+    if (type == kEtherTypeArp && length >= kArpSize) {
+      return memcmp(frame + kArpTargetIpOffset, &guestIp, 4) == 0;
+    }
+    return true;
+  }
+
+  void LearnGuestIp(const u8 *address) {
+    u32 ip;
+    memcpy(&ip, address, 4);
+    if (ip != 0) {
+      __atomic_store_n(&guestIp_, ip, __ATOMIC_RELAXED);
+    }
+  }
+
+  void BeginFilterWrite() {
+    __atomic_store_n(&filterSequence_, filterSequence_ + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+  }
+
+  void EndFilterWrite() {
+    __atomic_store_n(&filterSequence_, filterSequence_ + 1, __ATOMIC_RELEASE);
+  }
+
+  void ReadFilter(ReceiveFilter *filter) {
+    unsigned before, after;
+    do {
+      before = __atomic_load_n(&filterSequence_, __ATOMIC_ACQUIRE);
+      memcpy(filter, &filter_, sizeof(*filter));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      after = __atomic_load_n(&filterSequence_, __ATOMIC_RELAXED);
+    } while ((before & 1) != 0 || before != after);
+  }
+
+  void ReadGuestMac(u8 *mac) {
+    ReceiveFilter filter;
+    ReadFilter(&filter);
+    memcpy(mac, filter.mac, kMacSize);
+  }
+
+  // Each counter has a single writer.
+  static void Count(uint32_t *counter, unsigned amount) {
+    __atomic_store_n(counter,
+                     __atomic_load_n(counter, __ATOMIC_RELAXED) + amount,
+                     __ATOMIC_RELAXED);
+  }
+
+  CNetDevice *device_;
+  EtherTask *task_;
+  u8 hostMac_[kMacSize];
+  bool tapInstalled_;
+  bool active_;
+  u32 guestIp_;  // network order, 0 until the C64 sends from one
+
+  unsigned filterSequence_;
+  ReceiveFilter filter_;
+
+  SlotRing<FrameSlot, kReceiveSlots> receive_;
+  SlotRing<FrameSlot, kTransmitSlots> transmit_;
+  struct bmcether_stats stats_;
+  // tx_dropped as counted by the network task.
+  uint32_t sendFailures_;
+};
+
+void EtherTask::Run() {
+  for (;;) {
+    ether_->ServiceTransmit();
+    CScheduler::Get()->MsSleep(1);
+  }
+}
+
+BmcEther ether;
+
+}  // namespace
+
+extern "C" int bmcether_activate(void) { return ether.Activate() ? 1 : 0; }
+
+extern "C" void bmcether_deactivate(void) { ether.Deactivate(); }
+
+extern "C" void bmcether_set_mac(const uint8_t mac[6]) { ether.SetMac(mac); }
+
+extern "C" void bmcether_set_hashfilter(const uint32_t hash_mask[2]) {
+  ether.SetHashFilter(hash_mask);
+}
+
+extern "C" void bmcether_set_receive(int flags) { ether.SetReceive(flags); }
+
+extern "C" int bmcether_transmit(const uint8_t *frame, int length) {
+  return ether.Transmit(frame, length) ? 1 : 0;
+}
+
+extern "C" int bmcether_receive(uint8_t *buffer, int *length,
+                                int *frame_flags, int *hash_index) {
+  return ether.Receive(buffer, length, frame_flags, hash_index) ? 1 : 0;
+}
+
+extern "C" void bmcether_get_stats(struct bmcether_stats *stats) {
+  ether.GetStats(stats);
+}
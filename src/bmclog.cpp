@@ -0,0 +1,388 @@
+// bmclog.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Serial log ring. The UART is polled, about 87 us a character at
+// 115200 baud, so a line written straight to it held the emulation core
+// for milliseconds. Lines now go into a 64 KB ring any core can append
+// to, and a task on core 0 writes them out a few characters at a time,
+// yielding in between.
+//
+// The ring is multi producer, single consumer. A producer claims room
+// by moving reserved_ on with a compare and swap, copies its line in and
+// then sets the committed bit in the record's header. The task takes
+// records in order and stops at one not yet committed. Free room is
+// kept zeroed, so a header is only ever non zero once it is written.
+
+#include "bmclog.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+#include <circle/serial.h>
+#include <circle/types.h>
+
+extern "C" {
+#include "../third_party/common/circle.h"
+}
+
+namespace {
+
+// Must be a power of two.
+const unsigned kRingSize = 64 * 1024;
+const unsigned kHeaderSize = 4;
+// Longer writes are queued as several lines.
+const unsigned kMaxRecord = 1024;
+const u32 kCommitted = 0x80000000;
+// Written to the UART between yields, about 2.8 ms at 115200 baud.
+const unsigned kPiece = 32;
+
+const char *const kSubsystemNames[CIRCLE_LOG_SUBSYSTEMS] = {
+    "BMC64", "Emulator", "Drives", "Video", "Sound", "Network",
+};
+
+const char *const kLevelNames[] = {"off", "errors", "warnings", "all"};
+
+// VICE's log names outside CIRCLE_LOG_EMULATOR. A trailing * matches
+// any name starting with the rest.
+const struct {
+  const char *name;
+  int subsystem;
+} kViceLogs[] = {
+    {"Drive", CIRCLE_LOG_DRIVES},
+    {"DriveImage", CIRCLE_LOG_DRIVES},
+    {"DriveROM", CIRCLE_LOG_DRIVES},
+    {"IECDriveROM", CIRCLE_LOG_DRIVES},
+    {"IEC128DCRDriveROM", CIRCLE_LOG_DRIVES},
+    {"IEEEDriveROM", CIRCLE_LOG_DRIVES},
+    {"TCBMDriveROM", CIRCLE_LOG_DRIVES},
+    {"VDrive*", CIRCLE_LOG_DRIVES},
+    {"Filesystem Image*", CIRCLE_LOG_DRIVES},
+    {"FSDrive", CIRCLE_LOG_DRIVES},
+    {"Disk Access", CIRCLE_LOG_DRIVES},
+    {"Disk Create", CIRCLE_LOG_DRIVES},
+    {"Attach", CIRCLE_LOG_DRIVES},
+    {"AUTOSTART", CIRCLE_LOG_DRIVES},
+    {"fdc", CIRCLE_LOG_DRIVES},
+    {"WD1770", CIRCLE_LOG_DRIVES},
+    {"Raw Image", CIRCLE_LOG_DRIVES},
+    {"VIC-II*", CIRCLE_LOG_VIDEO},
+    {"VIC", CIRCLE_LOG_VIDEO},
+    {"VDC", CIRCLE_LOG_VIDEO},
+    {"TED", CIRCLE_LOG_VIDEO},
+    {"CRTC", CIRCLE_LOG_VIDEO},
+    {"Palette", CIRCLE_LOG_VIDEO},
+    {"Color", CIRCLE_LOG_VIDEO},
+    {"Graphics Output", CIRCLE_LOG_VIDEO},
+    {"Sound", CIRCLE_LOG_SOUND},
+    {"CS8900*", CIRCLE_LOG_NETWORK},
+    {"TFEARCH", CIRCLE_LOG_NETWORK},
+    {"EthernetARCH", CIRCLE_LOG_NETWORK},
+    {"RRNETMK3", CIRCLE_LOG_NETWORK},
+    {"RS232*", CIRCLE_LOG_NETWORK},
+};
+
+int ViceSubsystem(const char *name) {
+  for (const auto &log : kViceLogs) {
+    size_t length = strlen(log.name);
+    if (log.name[length - 1] == '*'
+            ? strncmp(name, log.name, length - 1) == 0
+            : strcmp(name, log.name) == 0) {
+      return log.subsystem;
+    }
+  }
+  return CIRCLE_LOG_EMULATOR;
+}
+
+class SerialLog;
+
+class LogTask : public CTask {
+public:
+  explicit LogTask(SerialLog *log) : log_(log) { SetName("bmc-log"); }
+
+  void Run() override;
+
+private:
+  SerialLog *log_;
+};
+
+class SerialLog {
+public:
+  SerialLog()
+      : serial_(0), task_(0), async_(false), reserved_(0), read_(0),
+        reported_(0) {
+    for (unsigned subsystem = 0; subsystem < CIRCLE_LOG_SUBSYSTEMS;
+         ++subsystem) {
+      levels_[subsystem] = CIRCLE_LOG_ALL;
+    }
+    memset(ring_, 0, sizeof ring_);
+    memset(&stats_, 0, sizeof stats_);
+  }
+
+  void Init(CSerialDevice *serial) { serial_ = serial; }
+
+  void StartTask() {
+    if (task_ == 0) {
+      task_ = new LogTask(this);
+    }
+  }
+
+  int Level(int subsystem) {
+    if (subsystem < 0 || subsystem >= CIRCLE_LOG_SUBSYSTEMS) {
+      return CIRCLE_LOG_OFF;
+    }
+    return __atomic_load_n(&levels_[subsystem], __ATOMIC_RELAXED);
+  }
+
+  void SetLevel(int subsystem, int level) {
+    if (subsystem >= 0 && subsystem < CIRCLE_LOG_SUBSYSTEMS &&
+        level >= CIRCLE_LOG_OFF && level <= CIRCLE_LOG_ALL) {
+      __atomic_store_n(&levels_[subsystem], level, __ATOMIC_RELAXED);
+    }
+  }
+
+  bool Wanted(int subsystem, int level) {
+    if (serial_ != 0 && level <= Level(subsystem)) {
+      return true;
+    }
+    __atomic_fetch_add(&stats_.filtered, 1, __ATOMIC_RELAXED);
+    return false;
+  }
+
+  // Any core. A line is up to three pieces, queued as one record.
+  void Write(const char *a, size_t na, const char *b = 0, size_t nb = 0,
+             const char *c = 0, size_t nc = 0) {
+    if (serial_ == 0) {
+      return;
+    }
+    if (!__atomic_load_n(&async_, __ATOMIC_ACQUIRE)) {
+      serial_->Write(a, na);
+      if (nb) {
+        serial_->Write(b, nb);
+      }
+      if (nc) {
+        serial_->Write(c, nc);
+      }
+      return;
+    }
+    while (na > kMaxRecord) {
+      Append(a, kMaxRecord, 0, 0, 0, 0);
+      a += kMaxRecord;
+      na -= kMaxRecord;
+    }
+    Append(a, na, b, nb, c, nc);
+  }
+
+  void GetStats(LogStats *stats) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    *stats = stats_;
+  }
+
+  // Log task side.
+  void Drain() {
+    __atomic_store_n(&async_, true, __ATOMIC_RELEASE);
+    for (;;) {
+      unsigned length = Take();
+      if (length == 0) {
+        ReportDrops();
+        CScheduler::Get()->MsSleep(10);
+        continue;
+      }
+      for (unsigned at = 0; at < length; at += kPiece) {
+        unsigned piece = length - at < kPiece ? length - at : kPiece;
+        serial_->Write(line_ + at, piece);
+        CScheduler::Get()->Yield();
+      }
+      ++stats_.written;
+    }
+  }
+
+private:
+  u32 *Header(unsigned position) {
+    return (u32 *)&ring_[position & (kRingSize - 1)];
+  }
+
+  void Copy(unsigned position, const char *data, size_t length) {
+    if (length == 0) {
+      return;
+    }
+    unsigned at = position & (kRingSize - 1);
+    size_t first = kRingSize - at < length ? kRingSize - at : length;
+    memcpy(ring_ + at, data, first);
+    memcpy(ring_, data + first, length - first);
+  }
+
+  void Append(const char *a, size_t na, const char *b, size_t nb,
+              const char *c, size_t nc) {
+    // Cut to one record; only a VICE line that long loses its end.
+    if (na + nb > kMaxRecord) {
+      nb = kMaxRecord - na;
+    }
+    if (na + nb + nc > kMaxRecord) {
+      nc = kMaxRecord - na - nb;
+    }
+    size_t length = na + nb + nc;
+    unsigned need = kHeaderSize + ((length + 3) & ~3u);
+    unsigned at = __atomic_load_n(&reserved_, __ATOMIC_RELAXED);
+    do {
+      if (at + need - __atomic_load_n(&read_, __ATOMIC_ACQUIRE) >
+          kRingSize) {
+        __atomic_fetch_add(&stats_.dropped, 1, __ATOMIC_RELAXED);
+        __atomic_fetch_add(&stats_.droppedBytes, length, __ATOMIC_RELAXED);
+        return;
+      }
+    } while (!__atomic_compare_exchange_n(&reserved_, &at, at + need, true,
+                                          __ATOMIC_ACQ_REL,
+                                          __ATOMIC_RELAXED));
+
+    unsigned body = at + kHeaderSize;
+    Copy(body, a, na);
+    Copy(body + na, b, nb);
+    Copy(body + na + nb, c, nc);
+    __atomic_fetch_add(&stats_.lines, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stats_.bytes, length, __ATOMIC_RELAXED);
+    __atomic_store_n(Header(at), (u32)length | kCommitted, __ATOMIC_RELEASE);
+  }
+
+  // Copies the next committed record into line_ and frees its room.
+  // Returns its length, or 0 when there is none.
+  unsigned Take() {
+    unsigned queued = __atomic_load_n(&reserved_, __ATOMIC_RELAXED) - read_;
+    if (queued > stats_.maxQueued) {
+      stats_.maxQueued = queued;
+    }
+    u32 header = __atomic_load_n(Header(read_), __ATOMIC_ACQUIRE);
+    if (!(header & kCommitted)) {
+      return 0;
+    }
+    unsigned length = header & ~kCommitted;
+    unsigned need = kHeaderSize + ((length + 3) & ~3u);
+    unsigned body = (read_ + kHeaderSize) & (kRingSize - 1);
+    size_t first = kRingSize - body < length ? kRingSize - body : length;
+    memcpy(line_, ring_ + body, first);
+    memcpy(line_ + first, ring_, length - first);
+
+    unsigned at = read_ & (kRingSize - 1);
+    size_t clear = kRingSize - at < need ? kRingSize - at : need;
+    memset(ring_ + at, 0, clear);
+    memset(ring_, 0, need - clear);
+    __atomic_store_n(&read_, read_ + need, __ATOMIC_RELEASE);
+    return length;
+  }
+
+  void ReportDrops() {
+    unsigned dropped = __atomic_load_n(&stats_.dropped, __ATOMIC_RELAXED);
+    if (dropped == reported_) {
+      return;
+    }
+    char message[64];
+    int length = snprintf(message, sizeof message,
+                          "log: %u lines dropped, the ring was full\n",
+                          dropped - reported_);
+    reported_ = dropped;
+    serial_->Write(message, length);
+  }
+
+  CSerialDevice *serial_;
+  LogTask *task_;
+  bool async_;
+  int levels_[CIRCLE_LOG_SUBSYSTEMS];
+
+  // Producers.
+  unsigned reserved_;
+
+  // Log task.
+  unsigned read_;
+  unsigned reported_;
+  char line_[kMaxRecord];
+
+  u8 ring_[kRingSize] __attribute__((aligned(4)));
+  LogStats stats_;
+};
+
+void LogTask::Run() { log_->Drain(); }
+
+SerialLog serialLog;
+
+}  // namespace
+
+void LogInit(CSerialDevice *serial) { serialLog.Init(serial); }
+
+void StartLogWriter(void) { serialLog.StartTask(); }
+
+void LogSetLevels(const char *levels) {
+  char spec[128];
+  strncpy(spec, levels, sizeof spec - 1);
+  spec[sizeof spec - 1] = '\0';
+  char *next = spec;
+  while (next != 0 && *next != '\0') {
+    char *entry = next;
+    next = strchr(entry, ',');
+    if (next != 0) {
+      *next++ = '\0';
+    }
+    char *level = strchr(entry, ':');
+    if (level == 0) {
+      continue;
+    }
+    *level++ = '\0';
+    for (int subsystem = 0; subsystem < CIRCLE_LOG_SUBSYSTEMS; ++subsystem) {
+      if (strcasecmp(entry, kSubsystemNames[subsystem]) != 0) {
+        continue;
+      }
+      for (int value = CIRCLE_LOG_OFF; value <= CIRCLE_LOG_ALL; ++value) {
+        if (strcasecmp(level, kLevelNames[value]) == 0) {
+          serialLog.SetLevel(subsystem, value);
+        }
+      }
+    }
+  }
+}
+
+int LogWrite(int subsystem, int level, const char *text, size_t len) {
+  if (serialLog.Wanted(subsystem, level)) {
+    serialLog.Write(text, len);
+  }
+  return (int)len;
+}
+
+void LogGetStats(LogStats *stats) { serialLog.GetStats(stats); }
+
+extern "C" const char *circle_log_subsystem_name(int subsystem) {
+  if (subsystem < 0 || subsystem >= CIRCLE_LOG_SUBSYSTEMS) {
+    return "";
+  }
+  return kSubsystemNames[subsystem];
+}
+
+extern "C" int circle_log_get_level(int subsystem) {
+  return serialLog.Level(subsystem);
+}
+
+extern "C" void circle_log_set_level(int subsystem, int level) {
+  serialLog.SetLevel(subsystem, level);
+}
+
+extern "C" int circle_log_wanted(const char *name, unsigned int level) {
+  static const int kNeeded[] = {CIRCLE_LOG_ALL, CIRCLE_LOG_WARNINGS,
+                                CIRCLE_LOG_ERRORS};
+  return serialLog.Wanted(ViceSubsystem(name),
+                          kNeeded[level < 3 ? level : 0]);
+}
+
+extern "C" void circle_log_line(const char *prefix, const char *text) {
+  serialLog.Write(prefix, strlen(prefix), text, strlen(text), "\n", 1);
+}
@@ -0,0 +1,41 @@
+#ifndef BMCLOG_H
+#define BMCLOG_H
+
+#include <stddef.h>
+
+class CSerialDevice;
+
+// Serial output for stdout, stderr and VICE's log. Until the log task
+// first runs, text goes straight to the UART as it always did, so a
+// hang during boot still shows what led to it. From then on a line is
+// copied into a lock free ring, or dropped and counted when the ring is
+// full, and the task writes it out. Whoever logs never waits for the
+// UART. Levels per subsystem are the CIRCLE_LOG_* values in circle.h;
+// see tools/SERIAL_LOG.md.
+
+// From CGlueStdioInit. Without a serial device everything is dropped.
+void LogInit(CSerialDevice *serial);
+
+// Starts the task that writes the ring to the UART. Once, at boot.
+void StartLogWriter(void);
+
+// "drives:errors,video:off", from log_levels= in cmdline.txt.
+void LogSetLevels(const char *levels);
+
+// new_io.cpp's _write for stdout and stderr. Returns len.
+int LogWrite(int subsystem, int level, const char *text, size_t len);
+
+struct LogStats {
+  unsigned lines;          // queued
+  unsigned long long bytes;
+  unsigned filtered;       // below their subsystem's level
+  unsigned dropped;        // the ring was full
+  unsigned long long droppedBytes;
+  unsigned maxQueued;      // bytes in the ring, at most
+  unsigned written;        // lines the task wrote out
+};
+
+// For tools/headless/log_bench.
+void LogGetStats(LogStats *stats);
+
+#endif
@@ -2,6 +2,8 @@ extern "C" {
     #include "../third_party/vice-3.3/src/rs232drv/rs232bmc.h"
 }
 
+#include "spsc_ring.h"
+
 #include <string.h>
 
 #include <circle/logger.h>
@@ -11,20 +13,29 @@ extern "C" {
 #include <circle/net/netsubsystem.h>
 #include <circle/net/socket.h>
 #include <circle/netdevice.h>
-#include <circle/sched/mutex.h>
 #include <circle/sched/scheduler.h>
 #include <circle/sched/task.h>
 #include <circle/timer.h>
 
 namespace {
 
+// Ring sizes must be powers of two.
 const unsigned kQueueSize = 16384;
+const unsigned kEventQueueSize = 64;
 const unsigned kCommandSize = 256;
 const unsigned kSocketSendSize = 256;
 // Keep diagnostic history bounded so serial tracing cannot consume modem RAM.
 const unsigned kTraceSize = 128;
 // C64 OS reports an SSID through ATW; retain a modem-side copy for ATI3.
 const unsigned kSsidSize = 33;
+// Hostnames longer than this are resolved every time.
+const unsigned kDnsNameSize = 64;
+const unsigned kDnsCacheSize = 8;
+// Circle's resolver does not pass on the record TTL, so every answer is
+// kept for the same time.
+const u64 kDnsCacheMicroseconds = 300000000;
+// Hayes default for S7, the seconds to wait for carrier after dialing.
+const unsigned kDefaultDialWaitSeconds = 50;
 const u64 kEscapeGuardMicroseconds = 1000000;
 const u64 kTelnetCandidateMicroseconds = 100000;
 const uint8_t kTelnetIac = 255;
@@ -37,6 +48,16 @@ const uint8_t kTelnetSubnegotiationEnd = 240;
 const uint8_t kTelnetBinary = 0;
 const char FromBmcModem[] = "bmc-modem";
 
+// Port changes the emulation core hands to the network task. position is
+// where the transmit ring stood, so the task applies the event after the
+// bytes the C64 sent before it and ahead of those sent after.
+struct ModemEvent {
+  enum Type { kOpen, kClose, kReset, kStatus };
+  Type type;
+  unsigned value;
+  unsigned position;
+};
+
 class BmcModem;
 
 class NetworkTask : public CTask {
@@ -52,13 +73,30 @@ private:
   BmcModem *modem_;
 };
 
+// Resolving and connecting block the calling task until the network
+// answers, so they run here while the network task keeps serving the
+// ACIA and can give up on a dial the C64 no longer wants.
+class DialTask : public CTask {
+public:
+  explicit DialTask(BmcModem *modem)
+      : CTask(12 * 1024), modem_(modem) {
+    SetName("bmc-modem-dial");
+  }
+
+  void Run() override;
+
+private:
+  BmcModem *modem_;
+};
+
 class BmcModem {
 public:
   BmcModem()
-      : socket_(0), read_(0), write_(0), transmitLength_(0),
+      : socket_(0),
         commandLength_(0), traceWrite_(0), traceLength_(0),
-        aciaTraceWrite_(0), aciaTraceLength_(0),
-        open_(false),
+        aciaTraceCount_(0), aciaTraceCleared_(0),
+        open_(false), synchronized_(true), epoch_(0), status_(-1),
+        restartEpoch_(0), restartPosition_(0), carrier_(false),
         dataMode_(false), echo_(true),
         quiet_(false), numericResponses_(false), crlf_(true),
         dtrEnabled_(false),
@@ -67,24 +105,30 @@ public:
         telnetState_(kTelnetData), telnetCommand_(0),
         telnetDetected_(false), telnetEnabled_(true), lastTransmitTime_(0),
         escapeDeadline_(0),
-        telnetCandidateDeadline_(0) {}
+        telnetCandidateDeadline_(0),
+        dialer_(0), dialing_(false), dialPosted_(false), dialDataMode_(false),
+        dialPort_(0), dialWaitSeconds_(kDefaultDialWaitSeconds),
+        dialDeadline_(0), dialState_(kDialIdle), dialRequestPort_(0),
+        dialSocket_(0), dialResolved_(false) {}
 
   ~BmcModem() { Disconnect(); }
 
+  // Emulation core side. These only push to and pop from the rings and
+  // never wait for the network task, which does all socket, Telnet and
+  // command work.
   void Initialize() {
-    CMutexGuard guard(lock_);
     if (wifiSsid_[0] == '\0') {
       strcpy(wifiSsid_, "BMC64");
     }
     if (worker_ == 0) {
       worker_ = new NetworkTask(this);
+      dialer_ = new DialTask(this);
     }
-    Reset();
+    Restart(ModemEvent::kReset);
   }
 
   int Open(int device) {
-    CMutexGuard guard(lock_);
-    Reset();
+    Restart(ModemEvent::kOpen);
     open_ = true;
     CLogger::Get()->Write(FromBmcModem, LogNotice,
                           "opened RS232 device %d", device + 1);
@@ -92,103 +136,138 @@ public:
   }
 
   void Close(int) {
-    CMutexGuard guard(lock_);
-    Disconnect();
     open_ = false;
+    PostEvent(ModemEvent::kClose);
   }
 
-  void Reset() {
-    CMutexGuard guard(lock_);
-    Disconnect();
-    read_ = 0;
-    write_ = 0;
-    transmitLength_ = 0;
-    commandLength_ = 0;
-    dataMode_ = false;
-    echo_ = true;
-    quiet_ = false;
-    numericResponses_ = false;
-    crlf_ = true;
-    dtrEnabled_ = false;
-    commandInputActive_ = false;
-    receiveEnabled_ = true;
-    plusCount_ = 0;
-    telnetState_ = kTelnetData;
-    telnetCommand_ = 0;
-    telnetDetected_ = false;
-    telnetEnabled_ = true;
-    lastTransmitTime_ = 0;
-    escapeDeadline_ = 0;
-    telnetCandidateDeadline_ = 0;
-  }
+  void Reset() { Restart(ModemEvent::kReset); }
 
   int Put(uint8_t byte) {
-    CMutexGuard guard(lock_);
     if (!open_) {
       return -1;
     }
-
-    TraceByte(byte);
-    Pump();
-    if (dataMode_) {
-      PutData(byte);
-    } else {
-      PutCommand(byte);
-    }
-    Pump();
+    // A full ring means the task has stalled for a whole ring of
+    // characters; drop like a modem without flow control would.
+    fromAcia_.Push(byte);
     return 0;
   }
 
   void NoteAciaTransmit(uint8_t byte) {
-    CMutexGuard guard(lock_);
     // This precedes the normal serial-backend trace and identifies ACIA writes.
-    aciaTrace_[aciaTraceWrite_] = byte;
-    aciaTraceWrite_ = (aciaTraceWrite_ + 1) % kTraceSize;
-    if (aciaTraceLength_ < kTraceSize) {
-      ++aciaTraceLength_;
-    }
+    unsigned count = __atomic_load_n(&aciaTraceCount_, __ATOMIC_RELAXED);
+    aciaTrace_[count % kTraceSize] = byte;
+    __atomic_store_n(&aciaTraceCount_, count + 1, __ATOMIC_RELEASE);
   }
 
+  // Read from the network task for AT+ACIATRACE. Bytes the ACIA writes
+  // during the copy may replace the oldest ones; it is only a diagnostic.
   unsigned ReadAciaTrace(uint8_t *bytes, unsigned maximum) {
-    CMutexGuard guard(lock_);
-    unsigned length = aciaTraceLength_ < maximum ? aciaTraceLength_ : maximum;
-    unsigned index = (aciaTraceWrite_ + kTraceSize - length) % kTraceSize;
+    unsigned count = __atomic_load_n(&aciaTraceCount_, __ATOMIC_ACQUIRE);
+    unsigned length = count - aciaTraceCleared_;
+    if (length > kTraceSize) {
+      length = kTraceSize;
+    }
+    if (length > maximum) {
+      length = maximum;
+    }
     for (unsigned position = 0; position < length; ++position) {
-      bytes[position] = aciaTrace_[index];
-      index = (index + 1) % kTraceSize;
+      bytes[position] = aciaTrace_[(count - length + position) % kTraceSize];
     }
     return length;
   }
 
   void ClearAciaTrace() {
-    CMutexGuard guard(lock_);
-    aciaTraceWrite_ = 0;
-    aciaTraceLength_ = 0;
+    aciaTraceCleared_ = __atomic_load_n(&aciaTraceCount_, __ATOMIC_ACQUIRE);
   }
 
   int Get(uint8_t *byte) {
-    CMutexGuard guard(lock_);
     if (!open_ || byte == 0) {
       return -1;
     }
+    if (!Synchronized()) {
+      return 0;
+    }
+    return toAcia_.Pop(byte) ? 1 : 0;
+  }
+
+  bool HasCarrier() { return __atomic_load_n(&carrier_, __ATOMIC_ACQUIRE); }
+
+  void SetStatus(int status) {
+    // The ACIA reports status on every command register write.
+    if (status != status_) {
+      status_ = status;
+      PostEvent(ModemEvent::kStatus, static_cast<unsigned>(status));
+    }
+  }
+
+  // Serial timing is handled by the emulated ACIA; retain the backend hook.
+  void SetBps(unsigned int) {}
 
+  // Network task side.
+  void ServiceNetwork() {
+    ModemEvent event;
+    while (events_.Peek(&event)) {
+      TakeAciaBytes(event.position);
+      ApplyEvent(event);
+      events_.Pop(&event);
+    }
+    TakeAciaBytes(fromAcia_.WritePosition());
+    ServiceDial();
     Pump();
-    if (read_ == write_) {
-      return 0;
+    __atomic_store_n(&carrier_, socket_ != 0 || remoteDisconnectPending_,
+                     __ATOMIC_RELEASE);
+  }
+
+private:
+  void PostEvent(ModemEvent::Type type, unsigned value = 0) {
+    ModemEvent event = {type, value, fromAcia_.WritePosition()};
+    if (!events_.Push(event)) {
+      // The task has missed a whole ring of port changes. Send the
+      // status again next time; a later open or reset resynchronizes.
+      status_ = -1;
     }
+  }
 
-    *byte = queue_[read_];
-    read_ = (read_ + 1) % kQueueSize;
-    return 1;
+  // Open and reset start from an empty receive ring. The task records
+  // where the ring stood when it reset and Get skips to there, so
+  // nothing the task queued before the reset reaches the C64.
+  void Restart(ModemEvent::Type type) {
+    ++epoch_;
+    synchronized_ = false;
+    status_ = -1;
+    PostEvent(type, epoch_);
   }
 
-  bool HasCarrier() {
-    CMutexGuard guard(lock_);
-    return socket_ != 0 || remoteDisconnectPending_;
+  bool Synchronized() {
+    if (synchronized_) {
+      return true;
+    }
+    if (__atomic_load_n(&restartEpoch_, __ATOMIC_ACQUIRE) != epoch_) {
+      return false;
+    }
+    toAcia_.DiscardTo(restartPosition_);
+    synchronized_ = true;
+    return true;
   }
 
-  void SetStatus(int status) {
-    CMutexGuard guard(lock_);
+  void ApplyEvent(const ModemEvent &event) {
+    switch (event.type) {
+      case ModemEvent::kOpen:
+      case ModemEvent::kReset:
+        ResetState();
+        restartPosition_ = toAcia_.WritePosition();
+        __atomic_store_n(&restartEpoch_, event.value, __ATOMIC_RELEASE);
+        break;
+      case ModemEvent::kClose:
+        Disconnect();
+        break;
+      case ModemEvent::kStatus:
+        ApplyStatus(static_cast<int>(event.value));
+        break;
+    }
+  }
+
+  void ApplyStatus(int status) {
     bool dtrEnabled = (status & 0x02) != 0;
     // Treat a DTR drop as a hardware hangup, matching a physical modem.
     if (dtrEnabled_ && !dtrEnabled && socket_ != 0) {
@@ -198,32 +277,55 @@ public:
     receiveEnabled_ = (status & 0x01) != 0;
   }
 
-  // Serial timing is handled by the emulated ACIA; retain the backend hook.
-  void SetBps(unsigned int) {}
-
-  void ServiceNetwork() {
-    CMutexGuard guard(lock_);
-    Pump();
+  // Runs the bytes the C64 sent up to position through the Hayes parser.
+  void TakeAciaBytes(unsigned position) {
+    uint8_t byte;
+    while (fromAcia_.ReadPosition() != position && fromAcia_.Pop(&byte)) {
+      TraceByte(byte);
+      if (dialing_) {
+        AbortDial();
+      } else if (dataMode_) {
+        PutData(byte);
+      } else {
+        PutCommand(byte);
+      }
+    }
   }
 
-private:
-  class CMutexGuard {
-  public:
-    explicit CMutexGuard(CMutex &lock) : lock_(lock) { lock_.Acquire(); }
-    ~CMutexGuard() { lock_.Release(); }
-
-  private:
-    CMutex &lock_;
-  };
+  void ResetState() {
+    Disconnect();
+    transmit_.DiscardTo(transmit_.WritePosition());
+    commandLength_ = 0;
+    dialWaitSeconds_ = kDefaultDialWaitSeconds;
+    dataMode_ = false;
+    echo_ = true;
+    quiet_ = false;
+    numericResponses_ = false;
+    crlf_ = true;
+    dtrEnabled_ = false;
+    commandInputActive_ = false;
+    receiveEnabled_ = true;
+    plusCount_ = 0;
+    telnetState_ = kTelnetData;
+    telnetCommand_ = 0;
+    telnetDetected_ = false;
+    telnetEnabled_ = true;
+    lastTransmitTime_ = 0;
+    escapeDeadline_ = 0;
+    telnetCandidateDeadline_ = 0;
+  }
 
   void Disconnect() {
+    // A result still to come from the dial task is dropped when it lands.
+    dialing_ = false;
+    dialPosted_ = false;
     delete socket_;
     socket_ = 0;
     remoteDisconnectPending_ = false;
     dataMode_ = false;
     plusCount_ = 0;
     escapeDeadline_ = 0;
-    transmitLength_ = 0;
+    transmit_.DiscardTo(transmit_.WritePosition());
     telnetState_ = kTelnetData;
     telnetCommand_ = 0;
     telnetDetected_ = false;
@@ -258,24 +360,14 @@ private:
     Result("NO CARRIER");
   }
 
-  unsigned Available() const {
-    return (write_ + kQueueSize - read_) % kQueueSize;
-  }
+  unsigned Available() const { return toAcia_.Used(); }
 
-  unsigned Free() const { return kQueueSize - Available() - 1; }
+  unsigned Free() const { return toAcia_.Free(); }
 
-  void QueueByte(uint8_t byte) {
-    if (Free() == 0) {
-      return;
-    }
-    queue_[write_] = byte;
-    write_ = (write_ + 1) % kQueueSize;
-  }
+  void QueueByte(uint8_t byte) { toAcia_.Push(byte); }
 
   void QueueText(const char *text) {
-    while (*text != '\0') {
-      QueueByte(static_cast<uint8_t>(*text++));
-    }
+    toAcia_.Write(reinterpret_cast<const uint8_t *>(text), strlen(text));
   }
 
   void TraceByte(uint8_t byte) {
@@ -434,22 +526,21 @@ private:
 
   void QueueTransmit(uint8_t byte) {
     unsigned required = telnetDetected_ && byte == kTelnetIac ? 2 : 1;
-    if (transmitLength_ + required > sizeof transmit_) {
+    if (transmit_.Free() < required) {
       return;
     }
-    transmit_[transmitLength_++] = byte;
+    transmit_.Push(byte);
     if (required == 2) {
-      transmit_[transmitLength_++] = byte;
+      transmit_.Push(byte);
     }
   }
 
   void QueueTelnetReply(uint8_t command, uint8_t option) {
-    if (transmitLength_ + 3 > sizeof transmit_) {
+    const uint8_t reply[] = {kTelnetIac, command, option};
+    if (transmit_.Free() < sizeof reply) {
       return;
     }
-    transmit_[transmitLength_++] = kTelnetIac;
-    transmit_[transmitLength_++] = command;
-    transmit_[transmitLength_++] = option;
+    transmit_.Write(reply, sizeof reply);
   }
 
   // Telnet filtering: control sequences stay on TCP, payload reaches the C64.
@@ -463,14 +554,33 @@ private:
     }
   }
 
-  void HandleTelnetByte(uint8_t byte) {
+  // Plain runs between IACs go to the ring in one copy; only the IAC
+  // sequences themselves step through the state machine.
+  void HandleTelnetData(const uint8_t *data, unsigned length) {
+    const uint8_t *end = data + length;
     // CNP on port 6400 is a binary protocol; every byte, including 0xff,
     // belongs to its payload rather than Telnet negotiation.
     if (!telnetEnabled_) {
-      QueueByte(byte);
+      toAcia_.Write(data, length);
       return;
     }
+    while (data != end) {
+      if (telnetState_ != kTelnetData) {
+        HandleTelnetByte(*data++);
+        continue;
+      }
+      const uint8_t *iac = static_cast<const uint8_t *>(
+          memchr(data, kTelnetIac, end - data));
+      const uint8_t *run = iac != 0 ? iac : end;
+      toAcia_.Write(data, run - data);
+      data = run;
+      if (iac != 0) {
+        HandleTelnetByte(*data++);
+      }
+    }
+  }
 
+  void HandleTelnetByte(uint8_t byte) {
     // TCP transport: the scheduler task calls this independently of ACIA polls.
     switch (telnetState_) {
       case kTelnetData:
@@ -703,7 +813,7 @@ private:
           Result("ERROR");
           return;
         }
-        Reset();
+        ResetState();
         Result("OK");
         return;
       }
@@ -775,9 +885,11 @@ private:
           Result("ERROR");
           return;
         }
-        // S7 is a dial wait time and S11 is a dial-tone duration. Neither
-        // applies to BMC64's direct TCP connection backend.
-        (void)registerValue;
+        // S7 limits how long a dial may take. S11 is a dial-tone duration,
+        // which does not apply to BMC64's direct TCP connection backend.
+        if (registerNumber == 7) {
+          dialWaitSeconds_ = registerValue;
+        }
         continue;
       }
 
@@ -883,37 +995,131 @@ private:
 
     CLogger::Get()->Write(FromBmcModem, LogNotice, "dialing %s:%u", target,
                           port);
-    CIPAddress address;
-    CDNSClient dns(net);
-    if (!dns.Resolve(target, &address)) {
+    Disconnect();
+    strcpy(dialHost_, target);
+    dialPort_ = port;
+    dialDataMode_ = enterDataMode;
+    dialDeadline_ = CTimer::GetClockTicks64() +
+                    static_cast<u64>(dialWaitSeconds_) * 1000000;
+    dialing_ = true;
+  }
+
+  // The dial task takes one request at a time. A dial given up on still
+  // runs to completion there; its result is dropped and any newer request
+  // waits for it.
+  void ServiceDial() {
+    if (__atomic_load_n(&dialState_, __ATOMIC_ACQUIRE) == kDialDone) {
+      CSocket *socket = dialSocket_;
+      bool resolved = dialResolved_;
+      bool current = dialing_ && dialPosted_;
+      dialSocket_ = 0;
+      __atomic_store_n(&dialState_, kDialIdle, __ATOMIC_RELEASE);
+      if (current) {
+        FinishDial(socket, resolved);
+      } else {
+        delete socket;
+      }
+    }
+
+    if (!dialing_) {
+      return;
+    }
+    if (dialWaitSeconds_ != 0 && CTimer::GetClockTicks64() >= dialDeadline_) {
+      Disconnect();
       CLogger::Get()->Write(FromBmcModem, LogNotice,
-                            "dial failed: DNS lookup failed");
+                            "dial failed: no answer within S7");
       Result("NO CARRIER");
       return;
     }
+    if (!dialPosted_ &&
+        __atomic_load_n(&dialState_, __ATOMIC_ACQUIRE) == kDialIdle) {
+      strcpy(dialRequestHost_, dialHost_);
+      dialRequestPort_ = dialPort_;
+      dialPosted_ = true;
+      __atomic_store_n(&dialState_, kDialPending, __ATOMIC_RELEASE);
+    }
+  }
 
-    Disconnect();
-    // Preserve binary CNP data verbatim. Other ports retain ZiModem-style
-    // Telnet negotiation for traditional BBS connections.
-    telnetEnabled_ = port != 6400;
-    socket_ = new CSocket(net, IPPROTO_TCP);
-    if (socket_ == 0 || socket_->Connect(address, static_cast<u16>(port)) < 0) {
-      Disconnect();
+  void FinishDial(CSocket *socket, bool resolved) {
+    dialing_ = false;
+    dialPosted_ = false;
+    if (socket == 0) {
       CLogger::Get()->Write(FromBmcModem, LogNotice,
-                            "dial failed: TCP connection refused");
+                            resolved ? "dial failed: TCP connection refused"
+                                     : "dial failed: DNS lookup failed");
       Result("NO CARRIER");
       return;
     }
 
+    socket_ = socket;
+    // Preserve binary CNP data verbatim. Other ports retain ZiModem-style
+    // Telnet negotiation for traditional BBS connections.
+    telnetEnabled_ = dialPort_ != 6400;
     // ATC leaves command mode active; ATD immediately forwards CNP payload.
-    dataMode_ = enterDataMode;
-    if (enterDataMode) {
+    dataMode_ = dialDataMode_;
+    if (dialDataMode_) {
       lastTransmitTime_ = CTimer::GetClockTicks64();
     }
     CLogger::Get()->Write(FromBmcModem, LogNotice, "TCP connection established");
     Result("CONNECT");
   }
 
+  // A key pressed while dialing hangs up, as on a Hayes modem.
+  void AbortDial() {
+    Disconnect();
+    CLogger::Get()->Write(FromBmcModem, LogNotice, "dial aborted");
+    Result("NO CARRIER");
+  }
+
+public:
+  // Dial task side.
+  void ServiceDialRequest() {
+    if (__atomic_load_n(&dialState_, __ATOMIC_ACQUIRE) != kDialPending) {
+      return;
+    }
+    CIPAddress address;
+    CSocket *socket = 0;
+    bool resolved = Lookup(dialRequestHost_, &address);
+    if (resolved) {
+      socket = new CSocket(CNetSubSystem::Get(), IPPROTO_TCP);
+      if (socket != 0 &&
+          socket->Connect(address, static_cast<u16>(dialRequestPort_)) < 0) {
+        delete socket;
+        socket = 0;
+      }
+    }
+    dialSocket_ = socket;
+    dialResolved_ = resolved;
+    __atomic_store_n(&dialState_, kDialDone, __ATOMIC_RELEASE);
+  }
+
+private:
+  bool Lookup(const char *name, CIPAddress *address) {
+    u64 now = CTimer::GetClockTicks64();
+    DnsCacheEntry *oldest = &dnsCache_[0];
+    for (unsigned index = 0; index < kDnsCacheSize; ++index) {
+      DnsCacheEntry *entry = &dnsCache_[index];
+      if (entry->expires > now && strcmp(entry->name, name) == 0) {
+        address->Set(entry->address);
+        return true;
+      }
+      if (entry->expires < oldest->expires) {
+        oldest = entry;
+      }
+    }
+
+    CDNSClient dns(CNetSubSystem::Get());
+    if (!dns.Resolve(name, address)) {
+      return false;
+    }
+    if (strlen(name) < kDnsNameSize) {
+      strcpy(oldest->name, name);
+      oldest->address.Set(*address);
+      oldest->expires = CTimer::GetClockTicks64() + kDnsCacheMicroseconds;
+    }
+    return true;
+  }
+
   void Pump() {
     if (socket_ == 0) {
       FinishRemoteDisconnect();
@@ -927,21 +1133,18 @@ private:
   }
 
   void FlushTransmit() {
-    if (transmitLength_ == 0) {
+    const uint8_t *data;
+    unsigned sendLength = transmit_.Contiguous(&data);
+    if (sendLength == 0) {
       return;
     }
 
-    unsigned sendLength = transmitLength_;
     if (sendLength > kSocketSendSize) {
       sendLength = kSocketSendSize;
     }
-    int sent = socket_->Send(transmit_, sendLength, MSG_DONTWAIT);
+    int sent = socket_->Send(data, sendLength, MSG_DONTWAIT);
     if (sent > 0) {
-      unsigned count = static_cast<unsigned>(sent);
-      if (count < transmitLength_) {
-        memmove(transmit_, transmit_ + count, transmitLength_ - count);
-      }
-      transmitLength_ -= count;
+      transmit_.Consume(static_cast<unsigned>(sent));
     } else if (sent < 0 && sent != -NET_ERROR_WOULD_BLOCK) {
       CLogger::Get()->Write(FromBmcModem, LogNotice,
                             "socket send failed: %d", sent);
@@ -954,26 +1157,34 @@ private:
       return;
     }
 
-    unsigned free = Free();
-    if (free < FRAME_BUFFER_SIZE) {
-      return;
-    }
-
+    // Take whatever the socket holds while a whole frame still fits.
     uint8_t received[FRAME_BUFFER_SIZE];
-    int count = socket_->Receive(received, sizeof received, MSG_DONTWAIT);
-    if (count < 0 && count != -NET_ERROR_WOULD_BLOCK) {
-      CLogger::Get()->Write(FromBmcModem, LogNotice,
-                            "socket receive failed: %d", count);
-      BeginRemoteDisconnect();
-      return;
-    }
-    for (int index = 0; index < count; ++index) {
-      HandleTelnetByte(received[index]);
+    while (socket_ != 0 && Free() >= FRAME_BUFFER_SIZE) {
+      int count = socket_->Receive(received, sizeof received, MSG_DONTWAIT);
+      if (count < 0 && count != -NET_ERROR_WOULD_BLOCK) {
+        CLogger::Get()->Write(FromBmcModem, LogNotice,
+                              "socket receive failed: %d", count);
+        BeginRemoteDisconnect();
+        return;
+      }
+      if (count <= 0) {
+        return;
+      }
+      HandleTelnetData(received, static_cast<unsigned>(count));
     }
   }
 
 private:
   // Protocol parsing state.
+  enum DialState { kDialIdle, kDialPending, kDialDone };
+
+  struct DnsCacheEntry {
+    DnsCacheEntry() : expires(0) { name[0] = '\0'; }
+    char name[kDnsNameSize];
+    CIPAddress address;
+    u64 expires;
+  };
+
   enum TelnetState {
     kTelnetData,
     kTelnetCandidate,
@@ -984,25 +1195,37 @@ private:
     kTelnetSubnegotiationIac
   };
 
-  CMutex lock_;
   CSocket *socket_;
 
-  // Serial data visible to VICE and TCP data waiting to be transmitted.
-  uint8_t queue_[kQueueSize];
-  uint8_t transmit_[kQueueSize];
+  // Serial data visible to VICE, serial data from VICE and port changes,
+  // each with one end owned by the emulation core and the other by the
+  // network task.
+  SpscRing<uint8_t, kQueueSize> toAcia_;
+  SpscRing<uint8_t, kQueueSize> fromAcia_;
+  SpscRing<ModemEvent, kEventQueueSize> events_;
+
+  // TCP data waiting to be transmitted, owned by the network task.
+  SpscRing<uint8_t, kQueueSize> transmit_;
   uint8_t trace_[kTraceSize];
   uint8_t aciaTrace_[kTraceSize];
   char wifiSsid_[kSsidSize];
-  unsigned read_;
-  unsigned write_;
-  unsigned transmitLength_;
   char command_[kCommandSize];
   unsigned commandLength_;
   unsigned traceWrite_;
   unsigned traceLength_;
-  unsigned aciaTraceWrite_;
-  unsigned aciaTraceLength_;
+  // Written by the ACIA; the network task reads it.
+  unsigned aciaTraceCount_;
+  unsigned aciaTraceCleared_;
+  // Emulation core state.
   bool open_;
+  bool synchronized_;
+  unsigned epoch_;
+  int status_;
+  // Published by the network task.
+  unsigned restartEpoch_;
+  unsigned restartPosition_;
+  bool carrier_;
+  // Network task state.
   bool dataMode_;
   bool echo_;
   bool quiet_;
@@ -1021,6 +1244,26 @@ private:
   u64 lastTransmitTime_;
   u64 escapeDeadline_;
   u64 telnetCandidateDeadline_;
+
+  // Network task side of a dial: the request the C64 is waiting on.
+  DialTask *dialer_;
+  bool dialing_;
+  bool dialPosted_;
+  bool dialDataMode_;
+  char dialHost_[kCommandSize];
+  unsigned dialPort_;
+  unsigned dialWaitSeconds_;
+  u64 dialDeadline_;
+  // Handed between the tasks through dialState_. The request is written
+  // by the network task before it sets kDialPending, the result by the
+  // dial task before it sets kDialDone.
+  DialState dialState_;
+  char dialRequestHost_[kCommandSize];
+  unsigned dialRequestPort_;
+  CSocket *dialSocket_;
+  bool dialResolved_;
+  // Only the dial task uses the cache.
+  DnsCacheEntry dnsCache_[kDnsCacheSize];
 };
 
 void NetworkTask::Run() {
@@ -1030,6 +1273,13 @@ void NetworkTask::Run() {
   }
 }
 
+void DialTask::Run() {
+  for (;;) {
+    modem_->ServiceDialRequest();
+    CScheduler::Get()->MsSleep(1);
+  }
+}
+
 BmcModem modem;
 
 }  // namespace
@@ -0,0 +1,716 @@
+// bmcmonitor.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A compact binary monitor served over TCP, for inspecting a running
+// machine from another computer. The protocol is described in
+// tools/REMOTE_MONITOR.md.
+//
+// The network task owns the socket and only moves whole messages
+// between it and two rings. The emulation core runs the requests when it
+// is at an instruction boundary anyway: once a frame while the machine
+// runs, or in the monitor's input loop while it is stopped (see
+// arch/raspi/monitorarch.c). Between frames a client costs the emulation
+// nothing.
+
+extern "C" {
+#include "../third_party/vice-3.3/src/arch/raspi/monitorbmc.h"
+}
+
+#include "bmcmonitor.h"
+#include "spsc_ring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <circle/logger.h>
+#include <circle/net/error.h>
+#include <circle/net/in.h>
+#include <circle/net/ipaddress.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+
+#if defined(RASPI_C64) || defined(RASPI_C128)
+
+namespace {
+
+// Ring sizes must be powers of two.
+const unsigned kRequestSlots = 4;
+const unsigned kReplySlots = 8;
+const unsigned kHeaderSize = 8;
+// Enough for a 64K write and its address.
+const unsigned kMaxBody = 0x10000 + 8;
+const unsigned kMaxRegisters = 32;
+const unsigned kCheckpointSize = 16;
+const unsigned kProtocolVersion = 1;
+const unsigned kCurrentBank = 0xffff;
+const char FromBmcMonitor[] = "bmc-monitor";
+
+enum Command {
+  kInfo = 0x01,
+  kReadMemory = 0x02,
+  kWriteMemory = 0x03,
+  kBanks = 0x04,
+  kRegisters = 0x05,
+  kSetRegister = 0x06,
+  kAddCheckpoint = 0x07,
+  kDeleteCheckpoint = 0x08,
+  kListCheckpoints = 0x09,
+  kStop = 0x0a,
+  kContinue = 0x0b,
+  kStep = 0x0c,
+  kSnapshot = 0x0d,
+  // Sent unasked, with id 0.
+  kStopped = 0x80,
+};
+
+enum Status {
+  kOk = 0,
+  kUnknownCommand = 1,
+  kBadRequest = 2,
+  kBadAddress = 3,
+  kRunning = 4,  // only a stopped machine can do that
+  kFailed = 5,
+  kBusy = 6,
+};
+
+// A request or a reply. The header sits straight before the body so a
+// reply built in place goes out in one piece; data points at the body,
+// or for memory and snapshots at wherever the bytes already are.
+struct Message {
+  unsigned session;
+  unsigned length;
+  const u8 *data;
+  u8 bytes[kHeaderSize + kMaxBody];
+
+  u8 *Body() { return bytes + kHeaderSize; }
+};
+
+// The protocol is little endian throughout.
+void Put16(u8 *bytes, unsigned value) {
+  bytes[0] = (u8)value;
+  bytes[1] = (u8)(value >> 8);
+}
+
+void Put32(u8 *bytes, u32 value) {
+  Put16(bytes, value & 0xffff);
+  Put16(bytes + 2, value >> 16);
+}
+
+void Put64(u8 *bytes, u64 value) {
+  Put32(bytes, (u32)value);
+  Put32(bytes + 4, (u32)(value >> 32));
+}
+
+unsigned Get16(const u8 *bytes) { return bytes[0] | bytes[1] << 8; }
+
+u32 Get32(const u8 *bytes) {
+  return Get16(bytes) | (u32)Get16(bytes + 2) << 16;
+}
+
+int Bank(const u8 *bytes) {
+  unsigned bank = Get16(bytes);
+  return bank == kCurrentBank ? -1 : (int)bank;
+}
+
+class BmcMonitor;
+
+class MonitorTask : public CTask {
+public:
+  explicit MonitorTask(BmcMonitor *monitor)
+      : CTask(16 * 1024), monitor_(monitor) {
+    SetName("bmc-monitor");
+  }
+
+  void Run() override;
+
+private:
+  BmcMonitor *monitor_;
+};
+
+class BmcMonitor {
+public:
+  BmcMonitor()
+      : network_(0), task_(0), port_(0), session_(0), connected_(false),
+        received_(0), stagingStart_(0), stagingEnd_(0), snapshot_(0),
+        snapshotCapacity_(0), snapshotSending_(false) {}
+
+  void Start(CNetSubSystem *network, unsigned port) {
+    if (task_ != 0 || port == 0 || port > 65535) {
+      return;
+    }
+    network_ = network;
+    port_ = port;
+    task_ = new MonitorTask(this);
+  }
+
+  // Network task side. One client at a time; the next waits in the
+  // listen backlog.
+  void Listen() {
+    while (!network_->IsRunning()) {
+      CScheduler::Get()->MsSleep(100);
+    }
+
+    CSocket listener(network_, IPPROTO_TCP);
+    if (listener.Bind(port_) < 0 || listener.Listen() < 0) {
+      CLogger::Get()->Write(FromBmcMonitor, LogError,
+                            "cannot listen on port %u", port_);
+      return;
+    }
+    CLogger::Get()->Write(FromBmcMonitor, LogNotice, "listening on port %u",
+                          port_);
+
+    for (;;) {
+      CIPAddress address;
+      u16 port;
+      CSocket *client = listener.Accept(&address, &port);
+      if (client == 0) {
+        CScheduler::Get()->MsSleep(100);
+        continue;
+      }
+      u8 ip[4];
+      address.CopyTo(ip);
+      CLogger::Get()->Write(FromBmcMonitor, LogNotice,
+                            "client %u.%u.%u.%u:%u connected", ip[0], ip[1],
+                            ip[2], ip[3], port);
+
+      __atomic_store_n(&session_, session_ + 1, __ATOMIC_RELEASE);
+      __atomic_store_n(&connected_, true, __ATOMIC_RELEASE);
+      Serve(client);
+      __atomic_store_n(&connected_, false, __ATOMIC_RELEASE);
+      delete client;
+      CLogger::Get()->Write(FromBmcMonitor, LogNotice, "client disconnected");
+    }
+  }
+
+  // Emulation core side.
+  bool Connected() const {
+    return __atomic_load_n(&connected_, __ATOMIC_ACQUIRE);
+  }
+
+  bool Pending() { return requests_.Front() != 0; }
+
+  bool Idle() const { return !Connected() || replies_.Empty(); }
+
+  int Service(bool stopped, int *count) {
+    unsigned session = __atomic_load_n(&session_, __ATOMIC_ACQUIRE);
+    int action = BMCMONITOR_NONE;
+    Message *request;
+    while (action == BMCMONITOR_NONE && (request = requests_.Front()) != 0) {
+      if (request->session != session) {
+        requests_.Release();
+        continue;
+      }
+      Message *reply = replies_.Reserve();
+      if (reply == 0) {
+        break;
+      }
+      reply->session = session;
+      action = Execute(request, reply, stopped, count);
+      requests_.Release();
+      replies_.Commit();
+    }
+    return action;
+  }
+
+  // Dropped when the replies have backed up; the client can still ask
+  // for kInfo.
+  void NotifyStopped(int memspace) {
+    Message *reply;
+    if (!Connected() || (reply = replies_.Reserve()) == 0) {
+      return;
+    }
+    struct bmcmonitor_info info;
+    monitor_arch_info(memspace, &info);
+    u8 *out = reply->Body();
+    out[0] = (u8)memspace;
+    out[1] = 0;
+    Put16(out + 2, info.pc);
+    Put32(out + 4, info.frame);
+    Put64(out + 8, info.clock);
+    reply->session = __atomic_load_n(&session_, __ATOMIC_ACQUIRE);
+    reply->data = out;
+    reply->length = 16;
+    reply->bytes[0] = kStopped;
+    reply->bytes[1] = kOk;
+    Put16(reply->bytes + 2, 0);
+    Put32(reply->bytes + 4, reply->length);
+    replies_.Commit();
+  }
+
+private:
+  void Serve(CSocket *client) {
+    received_ = 0;
+    stagingStart_ = stagingEnd_ = 0;
+    for (;;) {
+      int received = Receive(client);
+      int sent = received < 0 ? -1 : Send(client);
+      if (sent < 0) {
+        break;
+      }
+      if (received == 0 && sent == 0) {
+        CScheduler::Get()->MsSleep(1);
+      }
+    }
+    // Let go of anything a late reply still holds.
+    Send(0);
+  }
+
+  // Moves what the socket holds into request slots while there are any.
+  // Returns the bytes read, or -1 once the client has gone or sent
+  // something that is not a request.
+  int Receive(CSocket *client) {
+    int moved = 0;
+    for (;;) {
+      if (stagingStart_ == stagingEnd_) {
+        int count = client->Receive(staging_, sizeof staging_, MSG_DONTWAIT);
+        if (count < 0 && count != -NET_ERROR_WOULD_BLOCK) {
+          return -1;
+        }
+        if (count <= 0) {
+          return moved;
+        }
+        stagingStart_ = 0;
+        stagingEnd_ = (unsigned)count;
+        moved += count;
+      }
+      Message *request = requests_.Reserve();
+      if (request == 0) {
+        return moved;
+      }
+      if (!Assemble(request)) {
+        CLogger::Get()->Write(FromBmcMonitor, LogWarning,
+                              "request too long, disconnecting");
+        return -1;
+      }
+    }
+  }
+
+  bool Assemble(Message *request) {
+    unsigned want = kHeaderSize;
+    if (received_ >= kHeaderSize) {
+      want += Get32(request->bytes + 4);
+    }
+    unsigned count = want - received_;
+    if (count > stagingEnd_ - stagingStart_) {
+      count = stagingEnd_ - stagingStart_;
+    }
+    memcpy(request->bytes + received_, staging_ + stagingStart_, count);
+    received_ += count;
+    stagingStart_ += count;
+    if (received_ < kHeaderSize) {
+      return true;
+    }
+
+    u32 length = Get32(request->bytes + 4);
+    if (length > kMaxBody) {
+      return false;
+    }
+    if (received_ == kHeaderSize + length) {
+      request->session = session_;
+      request->length = length;
+      request->data = request->Body();
+      requests_.Commit();
+      received_ = 0;
+    }
+    return true;
+  }
+
+  // Sends every finished reply. Returns how many went, or -1 once the
+  // client has gone. Without a client they are only released.
+  int Send(CSocket *client) {
+    int sent = 0;
+    Message *reply;
+    while ((reply = replies_.Front()) != 0) {
+      bool ok = true;
+      if (client != 0 && reply->session == session_) {
+        if (reply->data == reply->Body()) {
+          ok = SendAll(client, reply->bytes, kHeaderSize + reply->length);
+        } else {
+          ok = SendAll(client, reply->bytes, kHeaderSize) &&
+               SendAll(client, reply->data, reply->length);
+        }
+      }
+      if (reply->data == snapshot_) {
+        __atomic_store_n(&snapshotSending_, false, __ATOMIC_RELEASE);
+      }
+      replies_.Release();
+      if (!ok) {
+        return -1;
+      }
+      ++sent;
+    }
+    return sent;
+  }
+
+  static bool SendAll(CSocket *client, const u8 *data, unsigned length) {
+    while (length > 0) {
+      int sent = client->Send(data, length, 0);
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      length -= (unsigned)sent;
+    }
+    return true;
+  }
+
+  int Execute(const Message *request, Message *reply, bool stopped,
+              int *count) {
+    const u8 *in = request->data;
+    unsigned length = request->length;
+    int action = BMCMONITOR_NONE;
+    int status;
+
+    reply->data = reply->Body();
+    reply->length = 0;
+    switch (request->bytes[0]) {
+    case kInfo:
+      status = Info(length, stopped, reply);
+      break;
+    case kReadMemory:
+      status = ReadMemory(in, length, stopped, reply);
+      break;
+    case kWriteMemory:
+      status = WriteMemory(in, length);
+      break;
+    case kBanks:
+      status = Banks(in, length, reply);
+      break;
+    case kRegisters:
+      status = Registers(in, length, reply);
+      break;
+    case kSetRegister:
+      status = length != 8 ? kBadRequest
+               : monitor_arch_set_register(in[0], in[1], Get32(in + 4))
+                   ? kOk
+                   : kBadAddress;
+      break;
+    case kAddCheckpoint:
+      status = AddCheckpoint(in, length, reply);
+      break;
+    case kDeleteCheckpoint:
+      status = length != 4 ? kBadRequest
+               : monitor_arch_checkpoint_delete((int)Get32(in)) ? kOk
+                                                                 : kBadAddress;
+      break;
+    case kListCheckpoints:
+      status = ListCheckpoints(length, reply);
+      break;
+    case kStop:
+      if (!stopped) {
+        monitor_arch_stop();
+      }
+      status = kOk;
+      break;
+    case kContinue:
+      status = stopped ? kOk : kRunning;
+      if (status == kOk) {
+        action = BMCMONITOR_CONTINUE;
+      }
+      break;
+    case kStep:
+      status = length != 3 ? kBadRequest : stopped ? kOk : kRunning;
+      if (status == kOk) {
+        *count = Get16(in) == 0 ? 1 : (int)Get16(in);
+        action = in[2] ? BMCMONITOR_NEXT : BMCMONITOR_STEP;
+      }
+      break;
+    case kSnapshot:
+      status = Snapshot(length, reply);
+      break;
+    default:
+      status = kUnknownCommand;
+      break;
+    }
+
+    if (status != kOk) {
+      reply->data = reply->Body();
+      reply->length = 0;
+    }
+    reply->bytes[0] = request->bytes[0];
+    reply->bytes[1] = (u8)status;
+    reply->bytes[2] = request->bytes[2];
+    reply->bytes[3] = request->bytes[3];
+    Put32(reply->bytes + 4, reply->length);
+    return action;
+  }
+
+  int Info(unsigned length, bool stopped, Message *reply) {
+    if (length != 0) {
+      return kBadRequest;
+    }
+    struct bmcmonitor_info info;
+    monitor_arch_info(BMCMONITOR_MEMSPACE_COMPUTER, &info);
+    u8 *out = reply->Body();
+    Put16(out, kProtocolVersion);
+    out[2] = stopped ? 1 : 0;
+    out[3] = 0;
+    Put32(out + 4, info.machine);
+    Put32(out + 8, info.frame);
+    Put16(out + 12, info.pc);
+    Put16(out + 14, 0);
+    Put64(out + 16, info.clock);
+    reply->length = 24;
+    return kOk;
+  }
+
+  // RAM goes out from where the machine keeps it. While the machine runs
+  // it is copied once, here, so the client sees one instant; a stopped
+  // machine waits for the reply to be sent before it goes on, so the
+  // network task reads it in place.
+  int ReadMemory(const u8 *in, unsigned length, bool stopped,
+                 Message *reply) {
+    if (length != 10) {
+      return kBadRequest;
+    }
+    int memspace = in[0];
+    int bank = Bank(in + 2);
+    unsigned start = Get16(in + 4);
+    u32 count = Get32(in + 6);
+    if (count == 0 || count > 0x10000 - start) {
+      return kBadRequest;
+    }
+
+    const u8 *ram = monitor_arch_ram(memspace, bank);
+    if (ram != 0 && stopped) {
+      reply->data = ram + start;
+    } else if (ram != 0) {
+      memcpy(reply->Body(), ram + start, count);
+    } else if (!monitor_arch_read(memspace, bank, start, reply->Body(),
+                                  count)) {
+      return kBadAddress;
+    }
+    reply->length = count;
+    return kOk;
+  }
+
+  int WriteMemory(const u8 *in, unsigned length) {
+    if (length <= 6) {
+      return kBadRequest;
+    }
+    unsigned start = Get16(in + 4);
+    unsigned count = length - 6;
+    if (count > 0x10000 - start) {
+      return kBadRequest;
+    }
+    return monitor_arch_write(in[0], Bank(in + 2), start, in + 6, count)
+               ? kOk
+               : kBadAddress;
+  }
+
+  int Banks(const u8 *in, unsigned length, Message *reply) {
+    if (length != 1) {
+      return kBadRequest;
+    }
+    const char **names = monitor_arch_bank_list(in[0]);
+    if (names == 0) {
+      return kBadAddress;
+    }
+    u8 *out = reply->Body();
+    for (; *names != 0; ++names) {
+      unsigned size = strlen(*names);
+      if (size > 255 || reply->length + 3 + size > kMaxBody) {
+        break;
+      }
+      Put16(out + reply->length,
+            (unsigned)monitor_arch_bank_number(in[0], *names));
+      out[reply->length + 2] = (u8)size;
+      memcpy(out + reply->length + 3, *names, size);
+      reply->length += 3 + size;
+    }
+    return kOk;
+  }
+
+  int Registers(const u8 *in, unsigned length, Message *reply) {
+    if (length != 1) {
+      return kBadRequest;
+    }
+    struct bmcmonitor_register regs[kMaxRegisters];
+    int count = monitor_arch_registers(in[0], regs, kMaxRegisters);
+    if (count < 0) {
+      return kBadAddress;
+    }
+    u8 *out = reply->Body();
+    for (int index = 0; index < count; ++index) {
+      unsigned size = strlen(regs[index].name);
+      if (size > 255) {
+        size = 255;
+      }
+      out[reply->length] = (u8)regs[index].id;
+      out[reply->length + 1] = (u8)regs[index].bits;
+      out[reply->length + 2] = (u8)regs[index].flags;
+      out[reply->length + 3] = (u8)size;
+      Put32(out + reply->length + 4, regs[index].value);
+      memcpy(out + reply->length + 8, regs[index].name, size);
+      reply->length += 8 + size;
+    }
+    return kOk;
+  }
+
+  int AddCheckpoint(const u8 *in, unsigned length, Message *reply) {
+    if (length != 8) {
+      return kBadRequest;
+    }
+    unsigned start = Get16(in + 4);
+    unsigned end = Get16(in + 6);
+    unsigned ops = in[1];
+    if (end < start || ops == 0 ||
+        (ops & ~(BMCMONITOR_OP_LOAD | BMCMONITOR_OP_STORE |
+                 BMCMONITOR_OP_EXEC)) != 0) {
+      return kBadRequest;
+    }
+    int number = monitor_arch_checkpoint_add(in[0], start, end, ops, in[2]);
+    if (number <= 0) {
+      return kBadAddress;
+    }
+    Put32(reply->Body(), (u32)number);
+    reply->length = 4;
+    return kOk;
+  }
+
+  int ListCheckpoints(unsigned length, Message *reply) {
+    if (length != 0) {
+      return kBadRequest;
+    }
+    u8 *out = reply->Body();
+    struct bmcmonitor_checkpoint cp;
+    int after = 0;
+    while (reply->length + kCheckpointSize <= kMaxBody &&
+           monitor_arch_checkpoint_next(after, &cp)) {
+      u8 *entry = out + reply->length;
+      Put32(entry, (u32)cp.number);
+      entry[4] = (u8)cp.memspace;
+      entry[5] = (u8)cp.ops;
+      entry[6] = cp.stop ? 1 : 0;
+      entry[7] = cp.enabled ? 1 : 0;
+      Put16(entry + 8, cp.start);
+      Put16(entry + 10, cp.end);
+      Put32(entry + 12, cp.hits);
+      reply->length += kCheckpointSize;
+      after = cp.number;
+    }
+    return kOk;
+  }
+
+  // The snapshot is written the way the menu writes one and read back
+  // into a buffer that is reused once the last one has gone out.
+  int Snapshot(unsigned length, Message *reply) {
+    if (length != 0) {
+      return kBadRequest;
+    }
+    if (__atomic_load_n(&snapshotSending_, __ATOMIC_ACQUIRE)) {
+      return kBusy;
+    }
+    const char *path = monitor_arch_snapshot();
+    if (path == 0) {
+      return kFailed;
+    }
+    FILE *file = fopen(path, "rb");
+    if (file == 0) {
+      return kFailed;
+    }
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+      size = ftell(file);
+    }
+    bool ok = size > 0 && fseek(file, 0, SEEK_SET) == 0;
+    if (ok && (unsigned long)size > snapshotCapacity_) {
+      u8 *grown = (u8 *)realloc(snapshot_, size);
+      ok = grown != 0;
+      if (ok) {
+        snapshot_ = grown;
+        snapshotCapacity_ = size;
+      }
+    }
+    ok = ok && fread(snapshot_, 1, size, file) == (size_t)size;
+    fclose(file);
+    if (!ok) {
+      return kFailed;
+    }
+    __atomic_store_n(&snapshotSending_, true, __ATOMIC_RELEASE);
+    reply->data = snapshot_;
+    reply->length = (unsigned)size;
+    return kOk;
+  }
+
+  CNetSubSystem *network_;
+  MonitorTask *task_;
+  unsigned port_;
+  // Counts clients, so requests and replies left over from one are
+  // dropped rather than mixed up with the next.
+  unsigned session_;
+  bool connected_;
+
+  // Owned by the network task.
+  unsigned received_;
+  unsigned stagingStart_;
+  unsigned stagingEnd_;
+  u8 staging_[FRAME_BUFFER_SIZE];
+
+  SlotRing<Message, kRequestSlots> requests_;
+  SlotRing<Message, kReplySlots> replies_;
+
+  // Grown by the emulation core while no reply holds it.
+  u8 *snapshot_;
+  unsigned long snapshotCapacity_;
+  bool snapshotSending_;
+};
+
+void MonitorTask::Run() { monitor_->Listen(); }
+
+BmcMonitor monitor;
+
+}  // namespace
+
+void StartRemoteMonitor(CNetSubSystem *network, unsigned port) {
+  monitor.Start(network, port);
+}
+
+extern "C" int bmcmonitor_connected(void) {
+  return monitor.Connected() ? 1 : 0;
+}
+
+extern "C" int bmcmonitor_pending(void) { return monitor.Pending() ? 1 : 0; }
+
+extern "C" int bmcmonitor_service(int stopped, int *count) {
+  return monitor.Service(stopped != 0, count);
+}
+
+extern "C" void bmcmonitor_notify_stopped(int memspace) {
+  monitor.NotifyStopped(memspace);
+}
+
+extern "C" int bmcmonitor_idle(void) { return monitor.Idle() ? 1 : 0; }
+
+#else
+
+// Only the C64 and C128 bring up the network (see viceapp.cpp). The other
+// VICE machines share arch/raspi/monitorarch.c, which never sees a client
+// here.
+extern "C" int bmcmonitor_connected(void) { return 0; }
+
+extern "C" int bmcmonitor_pending(void) { return 0; }
+
+extern "C" int bmcmonitor_service(int stopped, int *count) {
+  return BMCMONITOR_NONE;
+}
+
+extern "C" void bmcmonitor_notify_stopped(int memspace) {}
+
+extern "C" int bmcmonitor_idle(void) { return 1; }
+
+#endif
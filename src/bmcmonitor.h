@@ -0,0 +1,10 @@
+#ifndef BMCMONITOR_H
+#define BMCMONITOR_H
+
+class CNetSubSystem;
+
+// Serves the remote binary monitor on port once the network is up. The
+// protocol is described in tools/REMOTE_MONITOR.md.
+void StartRemoteMonitor(CNetSubSystem *network, unsigned port);
+
+#endif
@@ -0,0 +1,1066 @@
+// bmcnetdisk.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// The NET: volume: disk images read from and written to an image server
+// on the LAN (tools/netdisk_server.py) instead of the SD card.
+//
+// Images are read in 256 byte blocks, which are D64, D71 and D81
+// sectors, through an LRU cache. A miss fetches the whole track the
+// block is on, so a drive reading a file sector by sector waits for the
+// network once a track rather than once a sector. Writes update the
+// cache and are queued; a network task sends them while the emulation
+// goes on. Everything on the emulation side runs in whichever task
+// calls new_io.cpp, which is the emulation core; the network task owns
+// the socket.
+
+#include "bmcnetdisk.h"
+#include "spsc_ring.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <circle/logger.h>
+#include <circle/net/dnsclient.h>
+#include <circle/net/in.h>
+#include <circle/net/ipaddress.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+#include <circle/timer.h>
+
+namespace {
+
+const char kVolume[] = "NET:";
+const unsigned kVolumeLength = 4;
+const unsigned kBlockSize = 256;
+// 1 MB: a D81, or a handful of D64s.
+const unsigned kCacheBlocks = 4096;
+const unsigned kHashBuckets = 1024;
+const unsigned kMaxImages = 8;
+const unsigned kMaxFiles = 8;
+const unsigned kMaxDirs = 4;
+const unsigned kMaxPath = 256;
+// Read ahead for images without a known track layout.
+const unsigned kReadAheadBlocks = 32;
+// Ring sizes must be powers of two.
+const unsigned kWriteSlots = 64;
+const unsigned kHeaderSize = 8;
+const unsigned kMaxBody = 0x10000;
+const unsigned kReplyTimeoutMs = 5000;
+const unsigned kRetryMs = 1000;
+const unsigned kSyncTimeoutMs = 5000;
+const char FromBmcNetDisk[] = "bmc-netdisk";
+
+enum Command {
+  kStat = 0x01,
+  kList = 0x02,
+  kRead = 0x03,
+  kWrite = 0x04,
+};
+
+enum Status {
+  kOk = 0,
+  kUnknownCommand = 1,
+  kBadRequest = 2,
+  kNotFound = 3,
+  kReadOnly = 4,
+  kFailed = 5,
+  // Never sent; the server could not be reached.
+  kUnreachable = 0xff,
+};
+
+enum ExchangeState { kIdle, kPending, kDone };
+
+void Put16(u8 *bytes, unsigned value) {
+  bytes[0] = (u8)value;
+  bytes[1] = (u8)(value >> 8);
+}
+
+void Put32(u8 *bytes, u32 value) {
+  Put16(bytes, value & 0xffff);
+  Put16(bytes + 2, value >> 16);
+}
+
+unsigned Get16(const u8 *bytes) { return bytes[0] | bytes[1] << 8; }
+
+u32 Get32(const u8 *bytes) {
+  return Get16(bytes) | (u32)Get16(bytes + 2) << 16;
+}
+
+int StatusError(int status) {
+  switch (status) {
+  case kNotFound:
+    return -ENOENT;
+  case kReadOnly:
+    return -EACCES;
+  default:
+    return -EIO;
+  }
+}
+
+// Sectors on each track of a D64, and of each side of a D71.
+unsigned D64Sectors(unsigned track) {
+  return track <= 17 ? 21 : track <= 24 ? 19 : track <= 30 ? 18 : 17;
+}
+
+// The run of blocks read with block: its track for the layouts VICE
+// knows by image size (with or without error bytes), else an aligned
+// run of kReadAheadBlocks.
+void TrackOf(unsigned size, unsigned block, unsigned *first,
+             unsigned *count) {
+  unsigned tracks = 0;
+  unsigned sides = 1;
+  switch (size) {
+  case 174848:
+  case 175531:
+    tracks = 35;
+    break;
+  case 196608:
+  case 197376:
+    tracks = 40;
+    break;
+  case 205312:
+  case 206114:
+    tracks = 42;
+    break;
+  case 349696:
+  case 351062:
+    tracks = 35;
+    sides = 2;
+    break;
+  case 819200:
+  case 822400:
+    *first = block / 40 * 40;
+    *count = 40;
+    return;
+  }
+  unsigned start = 0;
+  for (unsigned side = 0; side < sides; ++side) {
+    for (unsigned track = 1; track <= tracks; ++track) {
+      unsigned sectors = D64Sectors(track);
+      if (block < start + sectors) {
+        *first = start;
+        *count = sectors;
+        return;
+      }
+      start += sectors;
+    }
+  }
+  *first = block / kReadAheadBlocks * kReadAheadBlocks;
+  *count = kReadAheadBlocks;
+}
+
+struct WriteSlot {
+  u32 offset;
+  unsigned length;
+  char path[kMaxPath];
+  u8 data[kBlockSize];
+};
+
+// An image the cache holds blocks for. It stays after its last close,
+// so VICE probing an image by opening it several times and attaching it
+// again later read from the cache. Opening it checks the size again and
+// drops the blocks if it changed.
+struct Image {
+  bool inUse;
+  char path[kMaxPath];
+  unsigned size;
+  bool writable;
+  unsigned opens;
+  unsigned lastUsed;
+};
+
+struct File {
+  bool inUse;
+  int image;
+  bool writable;
+};
+
+struct Dir {
+  bool inUse;
+  u8 *listing;
+  unsigned length;
+  unsigned position;
+  char name[kMaxPath];
+};
+
+struct Block {
+  int image;  // -1 when free
+  unsigned index;
+  int hashNext;
+  int lruPrev;
+  int lruNext;
+  u8 data[kBlockSize];
+};
+
+class BmcNetDisk;
+
+class NetDiskTask : public CTask {
+public:
+  explicit NetDiskTask(BmcNetDisk *disk) : CTask(16 * 1024), disk_(disk) {
+    SetName("bmc-netdisk");
+  }
+
+  void Run() override;
+
+private:
+  BmcNetDisk *disk_;
+};
+
+class BmcNetDisk {
+public:
+  BmcNetDisk()
+      : network_(0), task_(0), port_(0), socket_(0), reachable_(true),
+        nextId_(1), exchangeState_(kIdle), exchangeCommand_(0),
+        exchangeLength_(0), replyStatus_(kOk), replyLength_(0),
+        readAhead_(true), useCounter_(0), lruHead_(-1), lruTail_(-1),
+        freeBlock_(0), listingLength_(0) {
+    host_[0] = '\0';
+    listingPath_[0] = '\0';
+    memset(&stats_, 0, sizeof stats_);
+    memset(images_, 0, sizeof images_);
+    memset(files_, 0, sizeof files_);
+    memset(dirs_, 0, sizeof dirs_);
+    for (unsigned index = 0; index < kHashBuckets; ++index) {
+      buckets_[index] = -1;
+    }
+    for (unsigned index = 0; index < kCacheBlocks; ++index) {
+      blocks_[index].image = -1;
+      blocks_[index].hashNext = -1;
+      blocks_[index].lruPrev = -1;
+      blocks_[index].lruNext = -1;
+    }
+  }
+
+  void Start(CNetSubSystem *network, const char *server) {
+    if (task_ != 0 || server == 0 || server[0] == '\0') {
+      return;
+    }
+    const char *colon = strrchr(server, ':');
+    unsigned length = colon == 0 ? 0 : (unsigned)(colon - server);
+    unsigned port = colon == 0 ? 0 : (unsigned)atoi(colon + 1);
+    if (length == 0 || length >= sizeof host_ || port == 0 || port > 65535) {
+      CLogger::Get()->Write(FromBmcNetDisk, LogError,
+                            "netdisk=%s is not host:port", server);
+      return;
+    }
+    memcpy(host_, server, length);
+    host_[length] = '\0';
+    port_ = port;
+    network_ = network;
+    task_ = new NetDiskTask(this);
+  }
+
+  bool Available() const { return task_ != 0; }
+
+  void SetReadAhead(bool enabled) { readAhead_ = enabled; }
+
+  void GetStats(NetDiskStats *stats) { *stats = stats_; }
+
+  // Emulation side.
+  int Open(const char *path, bool writable) {
+    bool directory;
+    unsigned size;
+    bool serverWritable;
+    int result = Stat(path, &directory, &size, &serverWritable, false);
+    if (result < 0) {
+      return result;
+    }
+    if (directory) {
+      return -EISDIR;
+    }
+    if (writable && !serverWritable) {
+      return -EACCES;
+    }
+
+    int file = -1;
+    for (unsigned index = 0; index < kMaxFiles; ++index) {
+      if (!files_[index].inUse) {
+        file = index;
+        break;
+      }
+    }
+    if (file < 0) {
+      return -ENFILE;
+    }
+    int image = FindImage(path + kVolumeLength, size, serverWritable);
+    if (image < 0) {
+      return -ENFILE;
+    }
+    ++images_[image].opens;
+    files_[file].inUse = true;
+    files_[file].image = image;
+    files_[file].writable = writable;
+    return file;
+  }
+
+  int Close(int file) {
+    if (!ValidFile(file)) {
+      return -EBADF;
+    }
+    Image *image = &images_[files_[file].image];
+    --image->opens;
+    files_[file].inUse = false;
+    if (image->opens == 0) {
+      CLogger::Get()->Write(
+          FromBmcNetDisk, LogNotice,
+          "%s closed: %u blocks read, %u fetched in %u requests, "
+          "%u written, %llu ms waiting",
+          image->path, stats_.blocksRead, stats_.blocksFetched,
+          stats_.fetches, stats_.blocksWritten,
+          (stats_.readWaitUs + stats_.writeWaitUs) / 1000);
+    }
+    return 0;
+  }
+
+  unsigned Size(int file) {
+    return ValidFile(file) ? images_[files_[file].image].size : 0;
+  }
+
+  int Read(int file, unsigned offset, void *buffer, unsigned length) {
+    if (!ValidFile(file)) {
+      return -EBADF;
+    }
+    int image = files_[file].image;
+    unsigned size = images_[image].size;
+    if (offset >= size) {
+      return 0;
+    }
+    if (length > size - offset) {
+      length = size - offset;
+    }
+    u8 *out = (u8 *)buffer;
+    unsigned done = 0;
+    while (done < length) {
+      unsigned position = offset + done;
+      unsigned index = position / kBlockSize;
+      unsigned within = position % kBlockSize;
+      unsigned count = kBlockSize - within;
+      if (count > length - done) {
+        count = length - done;
+      }
+      int block = Lookup(image, index);
+      if (block < 0) {
+        int result = Fetch(image, index);
+        if (result < 0) {
+          return done > 0 ? (int)done : result;
+        }
+        block = Lookup(image, index);
+      }
+      ++stats_.blocksRead;
+      memcpy(out + done, blocks_[block].data + within, count);
+      done += count;
+    }
+    return (int)done;
+  }
+
+  // Images keep their size; writes past the end are refused.
+  int Write(int file, unsigned offset, const void *buffer, unsigned length) {
+    if (!ValidFile(file)) {
+      return -EBADF;
+    }
+    if (!files_[file].writable) {
+      return -EACCES;
+    }
+    int image = files_[file].image;
+    unsigned size = images_[image].size;
+    if (offset > size || length > size - offset) {
+      return -EINVAL;
+    }
+    const u8 *in = (const u8 *)buffer;
+    unsigned done = 0;
+    while (done < length) {
+      unsigned position = offset + done;
+      unsigned index = position / kBlockSize;
+      unsigned within = position % kBlockSize;
+      unsigned count = kBlockSize - within;
+      if (count > length - done) {
+        count = length - done;
+      }
+      int block = Lookup(image, index);
+      if (block < 0) {
+        unsigned blockEnd = (index + 1) * kBlockSize;
+        bool whole = within == 0 && (count == kBlockSize ||
+                                     position + count == size ||
+                                     blockEnd > size);
+        if (whole) {
+          block = Insert(image, index);
+        } else if (Fetch(image, index) < 0) {
+          return done > 0 ? (int)done : -EIO;
+        } else {
+          block = Lookup(image, index);
+        }
+      }
+      memcpy(blocks_[block].data + within, in + done, count);
+      Queue(images_[image].path, position, in + done, count);
+      done += count;
+    }
+    return (int)done;
+  }
+
+  // Waits for every queued write, not just this file's.
+  int Sync(int file) {
+    if (!ValidFile(file)) {
+      return -EBADF;
+    }
+    u64 deadline = CTimer::GetClockTicks64() + kSyncTimeoutMs * 1000ull;
+    while (!writes_.Empty()) {
+      if (CTimer::GetClockTicks64() > deadline) {
+        return -EIO;
+      }
+      CScheduler::Get()->Yield();
+    }
+    return 0;
+  }
+
+  int Stat(const char *path, bool *directory, unsigned *size,
+           bool *writable, bool useListing) {
+    if (!Available()) {
+      return -ENODEV;
+    }
+    const char *name = path + kVolumeLength;
+    if (name[0] == '\0' || strcmp(name, "/") == 0) {
+      *directory = true;
+      *size = 0;
+      *writable = false;
+      return 0;
+    }
+    // The menu asks about every name it has just listed.
+    if (useListing && FromListing(name, directory, size)) {
+      *writable = false;
+      return 0;
+    }
+    unsigned length = strlen(name);
+    if (length >= kMaxPath) {
+      return -ENAMETOOLONG;
+    }
+    memcpy(exchangeBody_, name, length);
+    int status = Exchange(kStat, length);
+    if (status != kOk) {
+      return StatusError(status);
+    }
+    if (replyLength_ != 8) {
+      return -EIO;
+    }
+    *directory = reply_[0] != 0;
+    *writable = reply_[1] != 0;
+    *size = Get32(reply_ + 4);
+    return 0;
+  }
+
+  int OpenDir(const char *path) {
+    if (!Available()) {
+      return -ENODEV;
+    }
+    int dir = -1;
+    for (unsigned index = 0; index < kMaxDirs; ++index) {
+      if (!dirs_[index].inUse) {
+        dir = index;
+        break;
+      }
+    }
+    if (dir < 0) {
+      return -ENFILE;
+    }
+    const char *name = path + kVolumeLength;
+    if (name[0] == '\0') {
+      name = "/";
+    }
+    unsigned length = strlen(name);
+    if (length >= kMaxPath) {
+      return -ENAMETOOLONG;
+    }
+    memcpy(exchangeBody_, name, length);
+    int status = Exchange(kList, length);
+    if (status != kOk) {
+      return StatusError(status);
+    }
+
+    u8 *listing = (u8 *)malloc(replyLength_ + 1);
+    if (listing == 0) {
+      return -ENOMEM;
+    }
+    memcpy(listing, reply_, replyLength_);
+    dirs_[dir].inUse = true;
+    dirs_[dir].listing = listing;
+    dirs_[dir].length = replyLength_;
+    dirs_[dir].position = 0;
+
+    // Kept for Stat.
+    if (replyLength_ <= sizeof listing_) {
+      memcpy(listing_, reply_, replyLength_);
+      listingLength_ = replyLength_;
+      strcpy(listingPath_, name);
+    } else {
+      listingPath_[0] = '\0';
+    }
+    return dir;
+  }
+
+  const char *ReadDir(int dir) {
+    if (!ValidDir(dir)) {
+      return 0;
+    }
+    Dir *entry = &dirs_[dir];
+    if (entry->position + 6 > entry->length) {
+      return 0;
+    }
+    const u8 *bytes = entry->listing + entry->position;
+    unsigned length = bytes[5];
+    if (entry->position + 6 + length > entry->length) {
+      return 0;
+    }
+    memcpy(entry->name, bytes + 6, length);
+    entry->name[length] = '\0';
+    entry->position += 6 + length;
+    return entry->name;
+  }
+
+  void RewindDir(int dir) {
+    if (ValidDir(dir)) {
+      dirs_[dir].position = 0;
+    }
+  }
+
+  void CloseDir(int dir) {
+    if (ValidDir(dir)) {
+      free(dirs_[dir].listing);
+      dirs_[dir].listing = 0;
+      dirs_[dir].inUse = false;
+    }
+  }
+
+  // Network task side.
+  void Serve() {
+    while (!network_->IsRunning()) {
+      CScheduler::Get()->MsSleep(100);
+    }
+    for (;;) {
+      bool exchange = __atomic_load_n(&exchangeState_, __ATOMIC_ACQUIRE) ==
+                      kPending;
+      if (!exchange && writes_.Empty()) {
+        CScheduler::Get()->MsSleep(1);
+        continue;
+      }
+      if (socket_ == 0 && !Connect()) {
+        if (exchange) {
+          FinishExchange(kUnreachable, 0);
+        } else {
+          CScheduler::Get()->MsSleep(kRetryMs);
+        }
+        continue;
+      }
+      // Writes queued before the exchange was posted go first, so a
+      // read sees them.
+      if (!writes_.Empty() && !SendWrites()) {
+        Disconnect();
+        continue;
+      }
+      if (exchange && !SendExchange()) {
+        Disconnect();
+        FinishExchange(kUnreachable, 0);
+      }
+    }
+  }
+
+private:
+  bool ValidFile(int file) const {
+    return file >= 0 && (unsigned)file < kMaxFiles && files_[file].inUse;
+  }
+
+  bool ValidDir(int dir) const {
+    return dir >= 0 && (unsigned)dir < kMaxDirs && dirs_[dir].inUse;
+  }
+
+  bool FromListing(const char *name, bool *directory, unsigned *size) {
+    const char *slash = strrchr(name, '/');
+    if (slash == 0 || listingPath_[0] == '\0') {
+      return false;
+    }
+    unsigned dirLength = slash == name ? 1 : (unsigned)(slash - name);
+    if (strlen(listingPath_) != dirLength ||
+        strncmp(listingPath_, name, dirLength) != 0) {
+      return false;
+    }
+    const char *leaf = slash + 1;
+    unsigned leafLength = strlen(leaf);
+    unsigned position = 0;
+    while (position + 6 <= listingLength_) {
+      const u8 *entry = listing_ + position;
+      unsigned length = entry[5];
+      if (length == leafLength && memcmp(entry + 6, leaf, length) == 0) {
+        *size = Get32(entry);
+        *directory = entry[4] != 0;
+        return true;
+      }
+      position += 6 + length;
+    }
+    return false;
+  }
+
+  // Finds or makes the cache's record of the image at path.
+  int FindImage(const char *path, unsigned size, bool writable) {
+    int found = -1;
+    int oldest = -1;
+    for (unsigned index = 0; index < kMaxImages; ++index) {
+      Image *image = &images_[index];
+      if (image->inUse && strcmp(image->path, path) == 0) {
+        found = index;
+        break;
+      }
+      if (!image->inUse) {
+        if (oldest < 0 || images_[oldest].inUse) {
+          oldest = index;
+        }
+      } else if (image->opens == 0 &&
+                 (oldest < 0 || (images_[oldest].inUse &&
+                                 image->lastUsed < images_[oldest].lastUsed))) {
+        oldest = index;
+      }
+    }
+    if (found >= 0 && images_[found].size != size) {
+      DropBlocks(found);
+      images_[found].size = size;
+    }
+    if (found < 0) {
+      if (oldest < 0) {
+        return -1;
+      }
+      found = oldest;
+      if (images_[found].inUse) {
+        DropBlocks(found);
+      }
+      images_[found].inUse = true;
+      strcpy(images_[found].path, path);
+      images_[found].size = size;
+      images_[found].opens = 0;
+    }
+    images_[found].writable = writable;
+    images_[found].lastUsed = ++useCounter_;
+    return found;
+  }
+
+  unsigned Hash(int image, unsigned index) const {
+    return (index * 31 + (unsigned)image * 7919) & (kHashBuckets - 1);
+  }
+
+  int Lookup(int image, unsigned index) {
+    for (int block = buckets_[Hash(image, index)]; block >= 0;
+         block = blocks_[block].hashNext) {
+      if (blocks_[block].image == image && blocks_[block].index == index) {
+        Touch(block);
+        return block;
+      }
+    }
+    return -1;
+  }
+
+  void Unlink(int block) {
+    Block *entry = &blocks_[block];
+    if (entry->lruPrev >= 0) {
+      blocks_[entry->lruPrev].lruNext = entry->lruNext;
+    } else {
+      lruHead_ = entry->lruNext;
+    }
+    if (entry->lruNext >= 0) {
+      blocks_[entry->lruNext].lruPrev = entry->lruPrev;
+    } else {
+      lruTail_ = entry->lruPrev;
+    }
+    entry->lruPrev = entry->lruNext = -1;
+  }
+
+  // Most recently used at the head.
+  void Touch(int block) {
+    if (lruHead_ == block) {
+      return;
+    }
+    Unlink(block);
+    blocks_[block].lruNext = lruHead_;
+    if (lruHead_ >= 0) {
+      blocks_[lruHead_].lruPrev = block;
+    }
+    lruHead_ = block;
+    if (lruTail_ < 0) {
+      lruTail_ = block;
+    }
+  }
+
+  void RemoveFromHash(int block) {
+    int *link = &buckets_[Hash(blocks_[block].image, blocks_[block].index)];
+    while (*link != block) {
+      link = &blocks_[*link].hashNext;
+    }
+    *link = blocks_[block].hashNext;
+    blocks_[block].hashNext = -1;
+  }
+
+  // Takes a never used block, or the least recently used one. Written
+  // blocks can go too, their data is already queued.
+  int Insert(int image, unsigned index) {
+    int block;
+    if (freeBlock_ < kCacheBlocks) {
+      block = freeBlock_++;
+    } else {
+      block = lruTail_;
+      RemoveFromHash(block);
+    }
+    blocks_[block].image = image;
+    blocks_[block].index = index;
+    unsigned bucket = Hash(image, index);
+    blocks_[block].hashNext = buckets_[bucket];
+    buckets_[bucket] = block;
+    Touch(block);
+    return block;
+  }
+
+  // Dropped blocks stay in the LRU list and go first.
+  void DropBlocks(int image) {
+    for (unsigned block = 0; block < freeBlock_; ++block) {
+      if (blocks_[block].image == image) {
+        RemoveFromHash(block);
+        blocks_[block].image = -1;
+        Unlink(block);
+        if (lruTail_ >= 0) {
+          blocks_[lruTail_].lruNext = block;
+        }
+        blocks_[block].lruPrev = lruTail_;
+        lruTail_ = block;
+        if (lruHead_ < 0) {
+          lruHead_ = block;
+        }
+      }
+    }
+  }
+
+  // Reads the track holding index, less any blocks at either end that
+  // are already cached, and caches what was not.
+  int Fetch(int image, unsigned index) {
+    unsigned blocks = (images_[image].size + kBlockSize - 1) / kBlockSize;
+    unsigned first = index;
+    unsigned count = 1;
+    if (readAhead_) {
+      TrackOf(images_[image].size, index, &first, &count);
+      if (first + count > blocks) {
+        count = blocks - first;
+      }
+      while (first < index && Lookup(image, first) >= 0) {
+        ++first;
+        --count;
+      }
+      while (first + count - 1 > index &&
+             Lookup(image, first + count - 1) >= 0) {
+        --count;
+      }
+    }
+
+    const char *path = images_[image].path;
+    unsigned length = strlen(path);
+    Put32(exchangeBody_, first * kBlockSize);
+    Put32(exchangeBody_ + 4, count * kBlockSize);
+    memcpy(exchangeBody_ + 8, path, length);
+    u64 start = CTimer::GetClockTicks64();
+    int status = Exchange(kRead, 8 + length);
+    stats_.readWaitUs += CTimer::GetClockTicks64() - start;
+    if (status != kOk) {
+      return StatusError(status);
+    }
+    ++stats_.fetches;
+
+    for (unsigned block = 0; block < count; ++block) {
+      unsigned offset = block * kBlockSize;
+      if (offset >= replyLength_) {
+        break;
+      }
+      if (Lookup(image, first + block) >= 0) {
+        continue;
+      }
+      int entry = Insert(image, first + block);
+      unsigned size = replyLength_ - offset;
+      if (size > kBlockSize) {
+        size = kBlockSize;
+      }
+      memcpy(blocks_[entry].data, reply_ + offset, size);
+      memset(blocks_[entry].data + size, 0, kBlockSize - size);
+      ++stats_.blocksFetched;
+    }
+    return Lookup(image, index) >= 0 ? 0 : -EIO;
+  }
+
+  void Queue(const char *path, unsigned offset, const u8 *data,
+             unsigned length) {
+    WriteSlot *slot;
+    u64 start = CTimer::GetClockTicks64();
+    while ((slot = writes_.Reserve()) == 0) {
+      CScheduler::Get()->Yield();
+    }
+    stats_.writeWaitUs += CTimer::GetClockTicks64() - start;
+    slot->offset = offset;
+    slot->length = length;
+    strcpy(slot->path, path);
+    memcpy(slot->data, data, length);
+    writes_.Commit();
+    ++stats_.blocksWritten;
+  }
+
+  // Posts the request in exchangeBody_ to the network task and waits.
+  int Exchange(int command, unsigned length) {
+    exchangeCommand_ = command;
+    exchangeLength_ = length;
+    __atomic_store_n(&exchangeState_, kPending, __ATOMIC_RELEASE);
+    while (__atomic_load_n(&exchangeState_, __ATOMIC_ACQUIRE) != kDone) {
+      CScheduler::Get()->Yield();
+    }
+    __atomic_store_n(&exchangeState_, kIdle, __ATOMIC_RELEASE);
+    return replyStatus_;
+  }
+
+  void FinishExchange(int status, unsigned length) {
+    replyStatus_ = status;
+    replyLength_ = length;
+    __atomic_store_n(&exchangeState_, kDone, __ATOMIC_RELEASE);
+  }
+
+  bool Connect() {
+    CIPAddress address;
+    CDNSClient dns(network_);
+    if (dns.Resolve(host_, &address)) {
+      CSocket *socket = new CSocket(network_, IPPROTO_TCP);
+      if (socket->Connect(address, (u16)port_) >= 0) {
+        socket_ = socket;
+        if (!reachable_) {
+          CLogger::Get()->Write(FromBmcNetDisk, LogNotice,
+                                "image server %s:%u is back", host_, port_);
+        }
+        reachable_ = true;
+        return true;
+      }
+      delete socket;
+    }
+    if (reachable_) {
+      CLogger::Get()->Write(FromBmcNetDisk, LogWarning,
+                            "cannot reach image server %s:%u", host_, port_);
+    }
+    reachable_ = false;
+    return false;
+  }
+
+  void Disconnect() {
+    delete socket_;
+    socket_ = 0;
+  }
+
+  bool SendAll(const u8 *data, unsigned length) {
+    while (length > 0) {
+      int sent = socket_->Send(data, length, 0);
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      length -= (unsigned)sent;
+    }
+    return true;
+  }
+
+  bool ReceiveAll(u8 *data, unsigned length) {
+    u64 deadline = CTimer::GetClockTicks64() + kReplyTimeoutMs * 1000ull;
+    while (length > 0) {
+      int count = socket_->Receive(data, length, MSG_DONTWAIT);
+      if (count < 0) {
+        return false;
+      }
+      if (count == 0) {
+        if (CTimer::GetClockTicks64() > deadline) {
+          CLogger::Get()->Write(FromBmcNetDisk, LogWarning,
+                                "image server did not answer");
+          return false;
+        }
+        CScheduler::Get()->MsSleep(1);
+        continue;
+      }
+      data += count;
+      length -= (unsigned)count;
+    }
+    return true;
+  }
+
+  bool SendRequest(int command, const u8 *body, unsigned length) {
+    u8 header[kHeaderSize];
+    header[0] = (u8)command;
+    header[1] = 0;
+    Put16(header + 2, nextId_);
+    Put32(header + 4, length);
+    nextId_ = nextId_ == 0xffff ? 1 : nextId_ + 1;
+    return SendAll(header, kHeaderSize) && SendAll(body, length);
+  }
+
+  // Returns the reply's status, or -1 when the connection failed.
+  int ReceiveReply(u8 *body, unsigned capacity, unsigned *length) {
+    u8 header[kHeaderSize];
+    if (!ReceiveAll(header, kHeaderSize)) {
+      return -1;
+    }
+    u32 size = Get32(header + 4);
+    if (size > capacity || !ReceiveAll(body, size)) {
+      return -1;
+    }
+    *length = size;
+    return header[1];
+  }
+
+  // All queued writes go out back to back, then their replies are
+  // read. A write the server refuses is logged and dropped; one that
+  // did not get a reply is sent again once the server is back.
+  bool SendWrites() {
+    unsigned count = writes_.Count();
+    for (unsigned index = 0; index < count; ++index) {
+      WriteSlot *slot = writes_.Peek(index);
+      unsigned pathLength = strlen(slot->path);
+      Put32(writeBody_, slot->offset);
+      Put16(writeBody_ + 4, pathLength);
+      Put16(writeBody_ + 6, 0);
+      memcpy(writeBody_ + 8, slot->path, pathLength);
+      memcpy(writeBody_ + 8 + pathLength, slot->data, slot->length);
+      if (!SendRequest(kWrite, writeBody_, 8 + pathLength + slot->length)) {
+        return false;
+      }
+    }
+    for (unsigned index = 0; index < count; ++index) {
+      unsigned length;
+      // Not into reply_, which the emulation side may still be reading.
+      int status = ReceiveReply(writeReply_, sizeof writeReply_, &length);
+      if (status < 0) {
+        return false;
+      }
+      if (status != kOk) {
+        WriteSlot *slot = writes_.Front();
+        CLogger::Get()->Write(FromBmcNetDisk, LogError,
+                              "write to %s at %u refused (%d)", slot->path,
+                              (unsigned)slot->offset, status);
+        ++stats_.writeErrors;
+      }
+      writes_.Release();
+    }
+    return true;
+  }
+
+  bool SendExchange() {
+    if (!SendRequest(exchangeCommand_, exchangeBody_, exchangeLength_)) {
+      return false;
+    }
+    unsigned length = 0;
+    int status = ReceiveReply(reply_, sizeof reply_, &length);
+    if (status < 0) {
+      return false;
+    }
+    FinishExchange(status, status == kOk ? length : 0);
+    return true;
+  }
+
+  CNetSubSystem *network_;
+  NetDiskTask *task_;
+  char host_[64];
+  unsigned port_;
+
+  // Owned by the network task.
+  CSocket *socket_;
+  bool reachable_;
+  unsigned nextId_;
+  u8 writeBody_[8 + kMaxPath + kBlockSize];
+  u8 writeReply_[16];
+
+  // One request at a time from the emulation side. The network task
+  // fills in the reply before it sets kDone.
+  int exchangeState_;
+  int exchangeCommand_;
+  unsigned exchangeLength_;
+  u8 exchangeBody_[8 + kMaxPath];
+  int replyStatus_;
+  unsigned replyLength_;
+  u8 reply_[kMaxBody];
+
+  SlotRing<WriteSlot, kWriteSlots> writes_;
+
+  // Owned by the emulation side.
+  bool readAhead_;
+  NetDiskStats stats_;
+  Image images_[kMaxImages];
+  File files_[kMaxFiles];
+  Dir dirs_[kMaxDirs];
+  unsigned useCounter_;
+  int buckets_[kHashBuckets];
+  Block blocks_[kCacheBlocks];
+  int lruHead_;
+  int lruTail_;
+  unsigned freeBlock_;
+  char listingPath_[kMaxPath];
+  u8 listing_[8192];
+  unsigned listingLength_;
+};
+
+void NetDiskTask::Run() { disk_->Serve(); }
+
+BmcNetDisk disk;
+
+}  // namespace
+
+void StartNetDisk(CNetSubSystem *network, const char *server) {
+  disk.Start(network, server);
+}
+
+bool NetDiskIsPath(const char *path) {
+  return path != 0 && strncmp(path, kVolume, kVolumeLength) == 0;
+}
+
+int NetDiskOpen(const char *path, bool writable) {
+  return disk.Open(path, writable);
+}
+
+int NetDiskClose(int file) { return disk.Close(file); }
+
+int NetDiskRead(int file, unsigned offset, void *buffer, unsigned length) {
+  return disk.Read(file, offset, buffer, length);
+}
+
+int NetDiskWrite(int file, unsigned offset, const void *buffer,
+                 unsigned length) {
+  return disk.Write(file, offset, buffer, length);
+}
+
+int NetDiskSync(int file) { return disk.Sync(file); }
+
+unsigned NetDiskSize(int file) { return disk.Size(file); }
+
+int NetDiskStat(const char *path, bool *directory, unsigned *size,
+                bool *writable) {
+  return disk.Stat(path, directory, size, writable, true);
+}
+
+int NetDiskOpenDir(const char *path) { return disk.OpenDir(path); }
+
+const char *NetDiskReadDir(int dir) { return disk.ReadDir(dir); }
+
+void NetDiskRewindDir(int dir) { disk.RewindDir(dir); }
+
+void NetDiskCloseDir(int dir) { disk.CloseDir(dir); }
+
+void NetDiskGetStats(NetDiskStats *stats) { disk.GetStats(stats); }
+
+void NetDiskSetReadAhead(bool enabled) { disk.SetReadAhead(enabled); }
+
+extern "C" int circle_netdisk_available(void) {
+  return disk.Available() ? 1 : 0;
+}
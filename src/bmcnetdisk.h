@@ -0,0 +1,49 @@
+#ifndef BMCNETDISK_H
+#define BMCNETDISK_H
+
+class CNetSubSystem;
+
+// Disk images kept on an image server on the LAN, opened through the
+// NET: volume in new_io.cpp. The protocol and the server are described
+// in tools/NETDISK.md.
+
+// server is "host:port", or empty to leave the volume off. The
+// connection is made when the volume is first used.
+void StartNetDisk(CNetSubSystem *network, const char *server);
+
+bool NetDiskIsPath(const char *path);
+
+// Files. These return a negative errno value on failure. Writes go to
+// the cache and are sent in the background; NetDiskSync waits for them.
+int NetDiskOpen(const char *path, bool writable);
+int NetDiskClose(int file);
+int NetDiskRead(int file, unsigned offset, void *buffer, unsigned length);
+int NetDiskWrite(int file, unsigned offset, const void *buffer,
+                 unsigned length);
+int NetDiskSync(int file);
+unsigned NetDiskSize(int file);
+int NetDiskStat(const char *path, bool *directory, unsigned *size,
+                bool *writable);
+
+// Directories. NetDiskReadDir returns 0 after the last name.
+int NetDiskOpenDir(const char *path);
+const char *NetDiskReadDir(int dir);
+void NetDiskRewindDir(int dir);
+void NetDiskCloseDir(int dir);
+
+struct NetDiskStats {
+  unsigned blocksRead;     // blocks asked for by reads
+  unsigned blocksFetched;  // blocks that came from the server
+  unsigned fetches;        // read requests sent for them
+  unsigned blocksWritten;  // blocks queued for write back
+  unsigned writeErrors;
+  unsigned long long readWaitUs;  // reads waiting for the server
+  unsigned long long writeWaitUs; // writes waiting for queue space
+};
+
+// Since StartNetDisk, for the log and tools/headless/netdisk_bench.
+void NetDiskGetStats(NetDiskStats *stats);
+// Track read-ahead is on unless the bench turns it off for comparison.
+void NetDiskSetReadAhead(bool enabled);
+
+#endif
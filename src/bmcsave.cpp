@@ -0,0 +1,289 @@
+// bmcsave.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Writes saved files to the SD card in the background.
+//
+// new_io.cpp already holds a file opened write only in RAM until it is
+// closed, so a snapshot is serialized to memory as VICE writes it. What
+// froze the emulation was the close: one f_write of the whole buffer,
+// several seconds for a machine with a large RAM expansion. For the
+// file marked by circle_save_begin the close instead hands the buffer
+// and the open FatFs file to a job here, and returns.
+//
+// The emulation core is the only producer of jobs, and the only one
+// that opens files, so it can look through the jobs still waiting
+// without a lock: a slot it sees is only ever reused by itself. The
+// writer task on core 0 writes each job in 64 KB pieces, holding the
+// FatFs lock only for one piece, and yields between them so the network
+// tasks keep running.
+
+#include "bmcsave.h"
+#include "spsc_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef RASPI_HEADLESS
+#include "circle_glue.h"
+#endif
+
+#include <circle/logger.h>
+#ifdef ARM_ALLOW_MULTI_CORE
+#include <circle/multicore.h>
+#endif
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+#include <circle/timer.h>
+#include <circle/types.h>
+
+namespace {
+
+// Must be a power of two.
+const unsigned kJobs = 4;
+const unsigned kChunkSize = 64 * 1024;
+const unsigned kMaxPath = 256;
+const char FromBmcSave[] = "bmc-save";
+
+struct SaveJob {
+  FIL file;
+  char path[kMaxPath];
+  char *contents;
+  unsigned size;
+  unsigned written;  // by the writer
+  u64 taken;         // clock ticks when handed over
+};
+
+class SaveWriter;
+
+class SaveTask : public CTask {
+public:
+  explicit SaveTask(SaveWriter *writer) : writer_(writer) {
+    SetName("bmc-save");
+  }
+
+  void Run() override;
+
+private:
+  SaveWriter *writer_;
+};
+
+class SaveWriter {
+public:
+  SaveWriter() : task_(0), failed_(false) {
+    marked_[0] = '\0';
+    memset(&stats_, 0, sizeof stats_);
+  }
+
+  void StartTask() {
+    if (task_ == 0) {
+      task_ = new SaveTask(this);
+    }
+  }
+
+  // Emulation core side.
+  void Begin(const char *path) {
+    if (strlen(path) < kMaxPath) {
+      strcpy(marked_, path);
+    } else {
+      marked_[0] = '\0';
+    }
+  }
+
+  void End() { marked_[0] = '\0'; }
+
+  bool Take(const char *path, FIL *file, char *contents, unsigned size) {
+    if (task_ == 0 || marked_[0] == '\0' || strcmp(path, marked_) != 0) {
+      return false;
+    }
+    // Only the one close.
+    marked_[0] = '\0';
+    SaveJob *job = jobs_.Reserve();
+    if (job == 0) {
+      CLogger::Get()->Write(FromBmcSave, LogWarning,
+                            "%u saves still being written, writing %s now",
+                            kJobs, path);
+      return false;
+    }
+    job->file = *file;
+    strcpy(job->path, path);
+    job->contents = contents;
+    job->size = size;
+    job->taken = CTimer::GetClockTicks64();
+    __atomic_store_n(&job->written, 0, __ATOMIC_RELAXED);
+    ++stats_.taken;
+    jobs_.Commit();
+    return true;
+  }
+
+  bool Pending(const char *path) {
+    for (unsigned index = jobs_.First(); index != jobs_.Last(); ++index) {
+      if (strcmp(jobs_.At(index)->path, path) == 0) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void WaitFor(const char *path) {
+    if (!Pending(path)) {
+      return;
+    }
+    u64 start = CTimer::GetClockTicks64();
+    while (Pending(path)) {
+#ifdef ARM_ALLOW_MULTI_CORE
+      // Only core 0 has tasks, the writer among them.
+      if (CMultiCoreSupport::ThisCore() == 0) {
+        CScheduler::Get()->Yield();
+      }
+#else
+      CScheduler::Get()->Yield();
+#endif
+    }
+    CLogger::Get()->Write(FromBmcSave, LogNotice,
+                          "waited %u ms for %s to be written",
+                          (unsigned)((CTimer::GetClockTicks64() - start) /
+                                     1000),
+                          path);
+  }
+
+  // Percent of the bytes waiting to be written that are, or -1 when
+  // nothing is waiting.
+  int Progress() {
+    unsigned long long size = 0;
+    unsigned long long written = 0;
+    for (unsigned index = jobs_.First(); index != jobs_.Last(); ++index) {
+      SaveJob *job = jobs_.At(index);
+      size += job->size;
+      written += __atomic_load_n(&job->written, __ATOMIC_RELAXED);
+    }
+    if (jobs_.First() == jobs_.Last()) {
+      return -1;
+    }
+    return size == 0 ? 0 : (int)(written * 100 / size);
+  }
+
+  void GetStats(SaveStats *stats) { *stats = stats_; }
+
+  // Writer task side.
+  void Write() {
+    for (;;) {
+      SaveJob *job = jobs_.Front();
+      if (job == 0) {
+        CScheduler::Get()->MsSleep(20);
+        continue;
+      }
+      if (job->written < job->size) {
+        WriteChunk(job);
+        CScheduler::Get()->Yield();
+        continue;
+      }
+      Close(job);
+      jobs_.Release();
+    }
+  }
+
+private:
+  // A failed write ends the job; what made it to the card stays there,
+  // as it did when the emulation core wrote the file itself.
+  void WriteChunk(SaveJob *job) {
+    unsigned length = job->size - job->written;
+    if (length > kChunkSize) {
+      length = kChunkSize;
+    }
+    u64 start = CTimer::GetClockTicks64();
+    UINT count = 0;
+    CGlueFatFsLock();
+    FRESULT result =
+        f_write(&job->file, job->contents + job->written, length, &count);
+    CGlueFatFsUnlock();
+    unsigned elapsed = (unsigned)(CTimer::GetClockTicks64() - start);
+    stats_.writeUs += elapsed;
+    if (elapsed > stats_.maxWriteUs) {
+      stats_.maxWriteUs = elapsed;
+    }
+
+    if (result != FR_OK || count != length) {
+      failed_ = true;
+      CLogger::Get()->Write(FromBmcSave, LogError,
+                            "cannot write %s (%d), is the card full?",
+                            job->path, result);
+      __atomic_store_n(&job->written, job->size, __ATOMIC_RELAXED);
+      return;
+    }
+    stats_.bytes += length;
+    __atomic_store_n(&job->written, job->written + length, __ATOMIC_RELAXED);
+  }
+
+  void Close(SaveJob *job) {
+    u64 start = CTimer::GetClockTicks64();
+    CGlueFatFsLock();
+    FRESULT result = f_close(&job->file);
+    CGlueFatFsUnlock();
+    u64 now = CTimer::GetClockTicks64();
+    stats_.writeUs += now - start;
+    free(job->contents);
+    job->contents = 0;
+
+    if (result != FR_OK && !failed_) {
+      failed_ = true;
+      CLogger::Get()->Write(FromBmcSave, LogError, "cannot close %s (%d)",
+                            job->path, result);
+    }
+    if (failed_) {
+      ++stats_.failed;
+    } else {
+      ++stats_.written;
+      CLogger::Get()->Write(FromBmcSave, LogNotice,
+                            "%s: %u KB written in %u ms", job->path,
+                            job->size / 1024,
+                            (unsigned)((now - job->taken) / 1000));
+    }
+    failed_ = false;
+  }
+
+  SaveTask *task_;
+
+  // Emulation core.
+  char marked_[kMaxPath];
+  SlotRing<SaveJob, kJobs> jobs_;
+
+  // Writer task.
+  bool failed_;
+
+  // taken has one writer, the emulation core; the rest the writer task.
+  SaveStats stats_;
+};
+
+void SaveTask::Run() { writer_->Write(); }
+
+SaveWriter writer;
+
+}  // namespace
+
+void StartSaveWriter(void) { writer.StartTask(); }
+
+bool SaveTakeFile(const char *path, FIL *file, char *contents,
+                  unsigned size) {
+  return writer.Take(path, file, contents, size);
+}
+
+void SaveWaitFor(const char *path) { writer.WaitFor(path); }
+
+void SaveGetStats(SaveStats *stats) { writer.GetStats(stats); }
+
+extern "C" void circle_save_begin(const char *path) { writer.Begin(path); }
+
+extern "C" void circle_save_end(void) { writer.End(); }
+
+extern "C" int circle_save_progress(void) { return writer.Progress(); }
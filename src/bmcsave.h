@@ -0,0 +1,39 @@
+#ifndef BMCSAVE_H
+#define BMCSAVE_H
+
+#include <ff.h>
+
+// Finishes writing saved files, snapshots for now, in the background.
+// The emulator still writes the file into RAM through new_io.cpp; when
+// the file is closed its buffer and open FatFs file go to a task on
+// core 0 instead of being written there and then. The emulation core
+// marks the file it is about to save with circle_save_begin. How it
+// fits together is described in tools/BACKGROUND_SAVE.md.
+
+// Starts the task that writes saved files. Once, at boot.
+void StartSaveWriter(void);
+
+// new_io.cpp's _close, for a file opened write only. Takes the open
+// file and the malloc'd contents, which the writer then writes, closes
+// and frees, if path is the one marked by circle_save_begin and a job
+// is free. Returns false, and takes nothing, otherwise.
+bool SaveTakeFile(const char *path, FIL *file, char *contents,
+                  unsigned size);
+
+// new_io.cpp, before opening or removing path. Returns once no save of
+// path is waiting to be written, so nothing reads a file half written.
+void SaveWaitFor(const char *path);
+
+struct SaveStats {
+  unsigned taken;      // files handed to the writer
+  unsigned written;    // files written and closed
+  unsigned failed;     // files the card did not take
+  unsigned long long bytes;
+  unsigned long long writeUs;   // writer task, in f_write and f_close
+  unsigned maxWriteUs;          // one chunk
+};
+
+// For the log and tools/headless/save_bench.
+void SaveGetStats(SaveStats *stats);
+
+#endif
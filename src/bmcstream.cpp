@@ -0,0 +1,398 @@
+// bmcstream.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Streams the emulated display to one viewer over TCP, for watching a
+// machine without a capture card. The protocol is described in
+// tools/FRAME_STREAM.md.
+//
+// Three parties, none of which waits for another:
+// - The emulation core copies the visible part of the indexed frame
+//   into one of two capture slots, or drops the frame when both are
+//   still held by the encoder.
+// - The encoder, on the helper core that also draws half of each
+//   software CRT frame, codes the span of each row that changed since
+//   the last frame it sent, run length coded, into a ring of packets. When
+//   the ring is full it drops the frame before coding it, so the
+//   viewer is never out of step.
+// - The network task sends the packets. It also encodes until the
+//   helper core first polls; the helper asks for the encoder and takes
+//   it once the network task has let go of it between two frames, so
+//   the two never code at the same time.
+
+#include "bmcstream.h"
+#include "framecoder.h"
+#include "spsc_ring.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <circle/logger.h>
+#include <circle/net/error.h>
+#include <circle/net/in.h>
+#include <circle/net/ipaddress.h>
+#include <circle/net/netsubsystem.h>
+#include <circle/net/socket.h>
+#include <circle/sched/scheduler.h>
+#include <circle/sched/task.h>
+#include <circle/timer.h>
+#include <circle/types.h>
+
+namespace {
+
+// Ring sizes must be powers of two.
+const unsigned kCaptureSlots = 2;
+const unsigned kPacketSlots = 4;
+// Rows a helper poll codes before it looks for CRT work again.
+const unsigned kRowsPerPoll = 32;
+const char FromBmcStream[] = "bmc-stream";
+
+// Who runs the encoder. Only the helper moves it from kNetworkEncodes
+// to kHelperAsked and only the network task from there on.
+enum EncoderOwner { kNetworkEncodes, kHelperAsked, kHelperEncodes };
+
+struct CaptureSlot {
+  u32 frame;
+  unsigned width;
+  unsigned height;
+  u16 palette[FrameCoder::kPaletteSize];
+  u8 *pixels;
+};
+
+struct Packet {
+  unsigned session;
+  unsigned length;
+  u8 *bytes;
+};
+
+class BmcStream;
+
+class StreamTask : public CTask {
+public:
+  explicit StreamTask(BmcStream *stream) : stream_(stream) {
+    SetName("bmc-stream");
+  }
+
+  void Run() override;
+
+private:
+  BmcStream *stream_;
+};
+
+class BmcStream {
+public:
+  BmcStream()
+      : network_(0), task_(0), port_(0), divider_(1), connected_(false),
+        session_(0), frameSession_(0), frame_(0),
+        owner_(kNetworkEncodes), helperEncodes_(false),
+        networkEncodes_(true), coder_(0), encoding_(0), packet_(0), packetSession_(0),
+        encodeUs_(0), encodedSession_(0) {
+    memset(&stats_, 0, sizeof stats_);
+  }
+
+  void Start(CNetSubSystem *network, unsigned port, unsigned divider) {
+    if (task_ != 0 || port == 0 || port > 65535) {
+      return;
+    }
+    for (unsigned index = 0; index < kCaptureSlots; ++index) {
+      captures_.At(index)->pixels =
+          new u8[FrameCoder::kMaxWidth * FrameCoder::kMaxHeight];
+    }
+    for (unsigned index = 0; index < kPacketSlots; ++index) {
+      packets_.At(index)->bytes = new u8[FrameCoder::kMaxBytes];
+    }
+    coder_ = new FrameCoder();
+    network_ = network;
+    port_ = port;
+    divider_ = divider == 0 ? 1 : divider;
+    task_ = new StreamTask(this);
+  }
+
+  // Emulation core side.
+  bool Wanted() {
+    if (!__atomic_load_n(&connected_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    // Frames are numbered from when the viewer connected.
+    unsigned session = __atomic_load_n(&session_, __ATOMIC_ACQUIRE);
+    if (session != frameSession_) {
+      frameSession_ = session;
+      frame_ = 0;
+    }
+    return frame_++ % divider_ == 0;
+  }
+
+  void Capture(const u8 *pixels, int pitch, int x, int y, int w, int h,
+               const u16 *palette) {
+    u64 start = CTimer::GetClockTicks64();
+    ++stats_.captured;
+    if (w <= 0 || h <= 0 || (unsigned)w > FrameCoder::kMaxWidth ||
+        (unsigned)h > FrameCoder::kMaxHeight) {
+      ++stats_.tooLarge;
+      return;
+    }
+    CaptureSlot *slot = captures_.Reserve();
+    if (slot == 0) {
+      ++stats_.captureDrops;
+      return;
+    }
+    slot->frame = frame_ - 1;
+    slot->width = w;
+    slot->height = h;
+    memcpy(slot->palette, palette, sizeof slot->palette);
+    const u8 *row = pixels + y * pitch + x;
+    for (int line = 0; line < h; ++line) {
+      memcpy(slot->pixels + line * w, row, w);
+      row += pitch;
+    }
+    captures_.Commit();
+#ifndef RASPI_HEADLESS
+    asm volatile("dsb\n\tsev" ::: "memory");
+#endif
+    unsigned elapsed = (unsigned)(CTimer::GetClockTicks64() - start);
+    stats_.captureUs += elapsed;
+    if (elapsed > stats_.maxCaptureUs) {
+      stats_.maxCaptureUs = elapsed;
+    }
+  }
+
+  // Helper core side.
+  int HelperPoll() {
+    if (!helperEncodes_) {
+      unsigned owner = __atomic_load_n(&owner_, __ATOMIC_ACQUIRE);
+      if (owner == kNetworkEncodes) {
+        __atomic_store_n(&owner_, kHelperAsked, __ATOMIC_RELEASE);
+      }
+      if (owner != kHelperEncodes) {
+        return 0;
+      }
+      helperEncodes_ = true;
+    }
+    return Encode(kRowsPerPoll);
+  }
+
+  void GetStats(FrameStreamStats *stats) { *stats = stats_; }
+
+  // Network task side. One viewer at a time; the next waits in the
+  // listen backlog.
+  void Listen() {
+    while (!network_->IsRunning()) {
+      CScheduler::Get()->MsSleep(100);
+    }
+
+    CSocket listener(network_, IPPROTO_TCP);
+    if (listener.Bind(port_) < 0 || listener.Listen() < 0) {
+      CLogger::Get()->Write(FromBmcStream, LogError,
+                            "cannot listen on port %u", port_);
+      return;
+    }
+    CLogger::Get()->Write(FromBmcStream, LogNotice,
+                          "streaming frames on port %u", port_);
+
+    for (;;) {
+      CIPAddress address;
+      u16 port;
+      CSocket *client = listener.Accept(&address, &port);
+      if (client == 0) {
+        CScheduler::Get()->MsSleep(100);
+        continue;
+      }
+      u8 ip[4];
+      address.CopyTo(ip);
+      CLogger::Get()->Write(FromBmcStream, LogNotice,
+                            "viewer %u.%u.%u.%u:%u connected", ip[0], ip[1],
+                            ip[2], ip[3], port);
+
+      FrameStreamStats before = stats_;
+      u64 start = CTimer::GetClockTicks64();
+      // Packets coded for the last viewer are dropped and the next
+      // frame is a key frame.
+      __atomic_store_n(&session_, session_ + 1, __ATOMIC_RELEASE);
+      __atomic_store_n(&connected_, true, __ATOMIC_RELEASE);
+      Serve(client);
+      __atomic_store_n(&connected_, false, __ATOMIC_RELEASE);
+      delete client;
+      Report(before, CTimer::GetClockTicks64() - start);
+    }
+  }
+
+private:
+  // Codes the oldest captured frame into a packet, at most rows rows a
+  // call so a software CRT job on the same core is not held up for a
+  // whole frame. Returns 0 when there was nothing to do.
+  int Encode(unsigned rows) {
+    u64 start = CTimer::GetClockTicks64();
+    if (encoding_ == 0) {
+      encoding_ = captures_.Front();
+      if (encoding_ == 0) {
+        return 0;
+      }
+      packet_ = packets_.Reserve();
+      if (packet_ == 0) {
+        // The network is behind. Nothing was coded, so the next frame
+        // is still a correct delta.
+        ++stats_.encodeDrops;
+        encoding_ = 0;
+        captures_.Release();
+        return 1;
+      }
+      // A new viewer has no picture yet.
+      packetSession_ = __atomic_load_n(&session_, __ATOMIC_ACQUIRE);
+      coder_->Begin(encoding_->pixels, encoding_->width, encoding_->height,
+                    encoding_->palette, encoding_->frame,
+                    packetSession_ != encodedSession_, packet_->bytes);
+      encodedSession_ = packetSession_;
+      encodeUs_ = 0;
+    }
+
+    bool done = coder_->Continue(rows);
+    encodeUs_ += (unsigned)(CTimer::GetClockTicks64() - start);
+    if (!done) {
+      return 1;
+    }
+    encoding_ = 0;
+    captures_.Release();
+    packet_->session = packetSession_;
+    packet_->length = coder_->Length();
+    packets_.Commit();
+
+    ++stats_.encoded;
+    if (coder_->KeyFrame()) {
+      ++stats_.keyFrames;
+    }
+    stats_.encodeUs += encodeUs_;
+    if (encodeUs_ > stats_.maxEncodeUs) {
+      stats_.maxEncodeUs = encodeUs_;
+    }
+    return 1;
+  }
+
+  void Serve(CSocket *client) {
+    u8 discard[64];
+    for (;;) {
+      // Nothing is expected from the viewer; this notices it leaving.
+      int count = client->Receive(discard, sizeof discard, MSG_DONTWAIT);
+      if (count < 0 && count != -NET_ERROR_WOULD_BLOCK) {
+        return;
+      }
+      if (networkEncodes_) {
+        // A whole frame a call, so this is always between frames.
+        if (__atomic_load_n(&owner_, __ATOMIC_ACQUIRE) == kHelperAsked) {
+          networkEncodes_ = false;
+          __atomic_store_n(&owner_, kHelperEncodes, __ATOMIC_RELEASE);
+        } else {
+          Encode(FrameCoder::kMaxHeight);
+        }
+      }
+      Packet *packet = packets_.Front();
+      if (packet == 0) {
+        CScheduler::Get()->MsSleep(1);
+        continue;
+      }
+      bool ok = packet->session != session_ ||
+                SendAll(client, packet->bytes, packet->length);
+      if (packet->session == session_) {
+        stats_.bytesSent += packet->length;
+      }
+      packets_.Release();
+      if (!ok) {
+        return;
+      }
+    }
+  }
+
+  static bool SendAll(CSocket *client, const u8 *data, unsigned length) {
+    while (length > 0) {
+      int sent = client->Send(data, length, 0);
+      if (sent <= 0) {
+        return false;
+      }
+      data += sent;
+      length -= (unsigned)sent;
+    }
+    return true;
+  }
+
+  void Report(const FrameStreamStats &before, u64 elapsedUs) {
+    const FrameStreamStats &after = stats_;
+    unsigned captured = after.captured - before.captured;
+    unsigned encoded = after.encoded - before.encoded;
+    unsigned seconds = (unsigned)(elapsedUs / 1000000);
+    CLogger::Get()->Write(
+        FromBmcStream, LogNotice,
+        "viewer left after %u s: %u frames sent, %u dropped at capture, "
+        "%u by the network, %llu KB/s",
+        seconds, encoded, after.captureDrops - before.captureDrops,
+        after.encodeDrops - before.encodeDrops,
+        (after.bytesSent - before.bytesSent) / 1024 /
+            (seconds == 0 ? 1 : seconds));
+    CLogger::Get()->Write(
+        FromBmcStream, LogNotice,
+        "capture %llu us/frame (max %u), encode %llu us/frame (max %u)",
+        captured == 0 ? 0 : (after.captureUs - before.captureUs) / captured,
+        after.maxCaptureUs,
+        encoded == 0 ? 0 : (after.encodeUs - before.encodeUs) / encoded,
+        after.maxEncodeUs);
+  }
+
+  CNetSubSystem *network_;
+  StreamTask *task_;
+  unsigned port_;
+  unsigned divider_;
+  bool connected_;
+  unsigned session_;
+
+  // Emulation core.
+  unsigned frameSession_;
+  u32 frame_;
+  SlotRing<CaptureSlot, kCaptureSlots> captures_;
+
+  // Encoder: the network task until the helper core takes it over.
+  // Each side keeps its own copy of whether it has it, so neither reads
+  // owner_ once the handover is done.
+  unsigned owner_;
+  bool helperEncodes_;
+  bool networkEncodes_;
+  FrameCoder *coder_;
+  CaptureSlot *encoding_;
+  Packet *packet_;
+  unsigned packetSession_;
+  unsigned encodeUs_;
+  unsigned encodedSession_;
+  SlotRing<Packet, kPacketSlots> packets_;
+
+  // Each counter has one writer.
+  FrameStreamStats stats_;
+};
+
+void StreamTask::Run() { stream_->Listen(); }
+
+BmcStream stream;
+
+}  // namespace
+
+void StartFrameStream(CNetSubSystem *network, unsigned port,
+                      unsigned divider) {
+  stream.Start(network, port, divider);
+}
+
+bool FrameStreamWanted(void) { return stream.Wanted(); }
+
+void FrameStreamCapture(const uint8_t *pixels, int pitch, int x, int y,
+                        int w, int h, const uint16_t *palette565) {
+  stream.Capture(pixels, pitch, x, y, w, h, palette565);
+}
+
+int FrameStreamHelperPoll(void) { return stream.HelperPoll(); }
+
+void FrameStreamGetStats(FrameStreamStats *stats) { stream.GetStats(stats); }
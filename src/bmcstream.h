@@ -0,0 +1,46 @@
+#ifndef BMCSTREAM_H
+#define BMCSTREAM_H
+
+#include <stdint.h>
+
+class CNetSubSystem;
+
+// Streams the emulated display to a viewer over TCP. The protocol and
+// the viewer are described in tools/FRAME_STREAM.md.
+
+// Serves port once the network is up, sending every divider'th frame.
+void StartFrameStream(CNetSubSystem *network, unsigned port,
+                      unsigned divider);
+
+// Emulation core, once a frame. True when a viewer is connected and this
+// frame is to be sent.
+bool FrameStreamWanted(void);
+
+// Emulation core. Copies the w x h pixels at x, y and the palette if
+// there is a free slot, and otherwise drops the frame. Never waits.
+void FrameStreamCapture(const uint8_t *pixels, int pitch, int x, int y,
+                        int w, int h, const uint16_t *palette565);
+
+// Idle work for a helper core: encodes a captured frame. Returns the
+// number encoded. Without a helper the network task does it; the first
+// calls return 0 until the network task has handed the encoder over.
+int FrameStreamHelperPoll(void);
+
+struct FrameStreamStats {
+  unsigned captured;
+  unsigned captureDrops;   // both slots still held by the encoder
+  unsigned tooLarge;
+  unsigned encoded;
+  unsigned encodeDrops;    // no packet slot free, the network is behind
+  unsigned keyFrames;
+  unsigned long long bytesSent;
+  unsigned long long captureUs;  // emulation core, copying frames
+  unsigned maxCaptureUs;
+  unsigned long long encodeUs;   // helper, delta and RLE coding
+  unsigned maxEncodeUs;
+};
+
+// Since StartFrameStream, for the log and tools/headless/stream_bench.
+void FrameStreamGetStats(FrameStreamStats *stats);
+
+#endif
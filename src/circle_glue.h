@@ -17,4 +17,10 @@ void CGlueStdioInitBootStat(int num,
 	int *mBootStatSize);
 void CGlueStdioSetPartitionForVolume(const char* volume, int p, unsigned int ss);
 
+// FatFs is not reentrant. Anything that calls f_* directly, rather than
+// through stdio, from another core or task than the emulator must hold
+// this around the calls. Waits by yielding on core 0, spinning elsewhere.
+void CGlueFatFsLock(void);
+void CGlueFatFsUnlock(void);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,333 @@
+/*
+ * crt_soft.c - CPU implementation of the crt-pi shader for indexed frames
+ *
+ * The scanline, mask, bloom and gamma math follows crt-pi by davej.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include "crt_soft.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Every pixel of the shader computes
+//
+//   out = clamp(gammaOut(gammaIn(c) * weight(row) * bloom) * mask(x))
+//
+// where c is a palette colour. gammaOut(gammaIn(c) * k) factors into
+// f(c) * g(k) for all three gamma modes (off, fake, real), so the final
+// colour only depends on (palette index, row weight, mask phase). The
+// set of distinct row weights is small (the vertical scale factor for
+// integer scaling), so we precompute one RGB565 table per weight and
+// mask phase and each output pixel becomes a single table lookup.
+
+static float calc_scanline_weight(const struct crt_soft_params *p,
+                                  float dist) {
+  float w = 1.0f - dist * dist * p->scanline_weight;
+  return w > p->scanline_gap_brightness ? w : p->scanline_gap_brightness;
+}
+
+static float calc_scanline(const struct crt_soft *crt, float dy) {
+  const struct crt_soft_params *p = &crt->params;
+  float w = calc_scanline_weight(p, dy);
+  if (p->multisample) {
+    float filter_width = ((float)crt->src_h / (float)crt->dst_h) / 3.0f;
+    w += calc_scanline_weight(p, dy - filter_width);
+    w += calc_scanline_weight(p, dy + filter_width);
+    w *= 0.3333333f;
+  }
+  return w;
+}
+
+// Source row and scanline weight for output row y.
+static void map_row(const struct crt_soft *crt, int y, int *row, float *w) {
+  float t = ((float)y + 0.5f) * (float)crt->src_h / (float)crt->dst_h;
+  float temp_y = floorf(t) + 0.5f;
+  int r = (int)floorf(t);
+  if (r >= crt->src_h) r = crt->src_h - 1;
+  *row = crt->src_y + r;
+  *w = crt->params.scanlines ? calc_scanline(crt, t - temp_y) : 1.0f;
+}
+
+static int map_col(const struct crt_soft *crt, int x) {
+  int c = (int)(((float)x + 0.5f) * (float)crt->src_w / (float)crt->dst_w);
+  if (c >= crt->src_w) c = crt->src_w - 1;
+  return crt->src_x + c;
+}
+
+static float channel_in(const struct crt_soft_params *p, float c) {
+  if (!p->scanlines || !p->gamma) return c;
+  if (p->fake_gamma) return c;
+  return powf(powf(c, p->input_gamma), 1.0f / p->output_gamma);
+}
+
+static float weight_out(const struct crt_soft_params *p, float w) {
+  if (!p->scanlines) return 1.0f;
+  w *= p->bloom_factor;
+  if (!p->gamma) return w;
+  if (p->fake_gamma) return sqrtf(w);
+  return powf(w, 1.0f / p->output_gamma);
+}
+
+static void mask_for_phase(const struct crt_soft_params *p, int phase,
+                           float *m) {
+  float b = p->mask_brightness;
+  m[0] = m[1] = m[2] = 1.0f;
+  if (p->mask == 1) {
+    if (phase == 0) {
+      m[0] = b; m[2] = b;
+    } else {
+      m[1] = b;
+    }
+  } else if (p->mask == 2) {
+    m[0] = m[1] = m[2] = b;
+    m[phase] = 1.0f;
+  }
+}
+
+static void unpack_565(uint16_t c, float *rgb) {
+  rgb[0] = (float)((c >> 11) & 0x1f) / 31.0f;
+  rgb[1] = (float)((c >> 5) & 0x3f) / 63.0f;
+  rgb[2] = (float)(c & 0x1f) / 31.0f;
+}
+
+static uint16_t pack_565(const float *rgb) {
+  float c[3];
+  int i;
+  for (i = 0; i < 3; i++) {
+    c[i] = rgb[i];
+    if (c[i] > 1.0f) c[i] = 1.0f;
+    if (c[i] < 0.0f) c[i] = 0.0f;
+  }
+  return (uint16_t)(((int)(c[0] * 31.0f + 0.5f) << 11) |
+                    ((int)(c[1] * 63.0f + 0.5f) << 5) |
+                    (int)(c[2] * 31.0f + 0.5f));
+}
+
+static void build_lut(struct crt_soft *crt) {
+  const struct crt_soft_params *p = &crt->params;
+  float in[256][3];
+  int i, l, ph, ch;
+
+  if (!crt->lut) return;
+
+  for (i = 0; i < 256; i++) {
+    float rgb[3];
+    unpack_565(crt->palette[i], rgb);
+    for (ch = 0; ch < 3; ch++) {
+      in[i][ch] = channel_in(p, rgb[ch]);
+    }
+  }
+
+  uint16_t *dst = crt->lut;
+  for (l = 0; l < crt->num_levels; l++) {
+    float k = weight_out(p, crt->level_weight[l]);
+    for (ph = 0; ph < crt->num_phases; ph++) {
+      float m[3];
+      mask_for_phase(p, ph, m);
+      for (i = 0; i < 256; i++) {
+        float out[3];
+        for (ch = 0; ch < 3; ch++) {
+          out[ch] = in[i][ch] * k;
+          // The shader clamps when colour is written, after the mask.
+          out[ch] *= m[ch];
+        }
+        *dst++ = pack_565(out);
+      }
+    }
+  }
+}
+
+void crt_soft_init(struct crt_soft *crt) {
+  memset(crt, 0, sizeof(struct crt_soft));
+}
+
+void crt_soft_free(struct crt_soft *crt) {
+  free(crt->row_src);
+  free(crt->row_level);
+  free(crt->col_src);
+  free(crt->lut);
+  crt->row_src = NULL;
+  crt->row_level = NULL;
+  crt->col_src = NULL;
+  crt->lut = NULL;
+}
+
+int crt_soft_configure(struct crt_soft *crt,
+                       const struct crt_soft_params *params,
+                       int src_x, int src_y, int src_w, int src_h,
+                       int dst_x, int dst_w, int dst_h) {
+  int x, y, l;
+  uint16_t palette[256];
+
+  memcpy(palette, crt->palette, sizeof(palette));
+  crt_soft_free(crt);
+
+  crt->params = *params;
+  crt->src_x = src_x;
+  crt->src_y = src_y;
+  crt->src_w = src_w;
+  crt->src_h = src_h;
+  crt->dst_x = dst_x;
+  crt->dst_w = dst_w;
+  crt->dst_h = dst_h;
+  memcpy(crt->palette, palette, sizeof(palette));
+
+  switch (params->mask) {
+    case 1:
+      crt->num_phases = 2;
+      break;
+    case 2:
+      crt->num_phases = 3;
+      break;
+    default:
+      crt->num_phases = 1;
+      break;
+  }
+
+  crt->row_src = (uint16_t *)malloc(dst_h * sizeof(uint16_t));
+  crt->row_level = (uint8_t *)malloc(dst_h);
+  crt->col_src = (uint16_t *)malloc(dst_w * sizeof(uint16_t));
+  crt->lut = (uint16_t *)malloc(CRT_SOFT_MAX_LEVELS * crt->num_phases *
+                                256 * sizeof(uint16_t));
+  if (!crt->row_src || !crt->row_level || !crt->col_src || !crt->lut) {
+    crt_soft_free(crt);
+    return -1;
+  }
+
+  for (x = 0; x < dst_w; x++) {
+    crt->col_src[x] = map_col(crt, x);
+  }
+
+  // Collect distinct row weights. Fall back to uniform quantization if
+  // there are too many of them.
+  int quantize = 0;
+  crt->num_levels = 0;
+  for (y = 0; y < dst_h; y++) {
+    int row;
+    float w;
+    map_row(crt, y, &row, &w);
+    crt->row_src[y] = row;
+    for (l = 0; l < crt->num_levels; l++) {
+      if (fabsf(crt->level_weight[l] - w) < 1e-5f) break;
+    }
+    if (l == crt->num_levels) {
+      if (l == CRT_SOFT_MAX_LEVELS) {
+        quantize = 1;
+        break;
+      }
+      crt->level_weight[crt->num_levels++] = w;
+    }
+    crt->row_level[y] = l;
+  }
+
+  if (quantize) {
+    crt->num_levels = CRT_SOFT_MAX_LEVELS;
+    for (l = 0; l < CRT_SOFT_MAX_LEVELS; l++) {
+      crt->level_weight[l] = (float)l / (float)(CRT_SOFT_MAX_LEVELS - 1);
+    }
+    for (y = 0; y < dst_h; y++) {
+      int row;
+      float w;
+      map_row(crt, y, &row, &w);
+      crt->row_src[y] = row;
+      crt->row_level[y] =
+          (int)(w * (float)(CRT_SOFT_MAX_LEVELS - 1) + 0.5f);
+    }
+  }
+
+  build_lut(crt);
+  return 0;
+}
+
+void crt_soft_set_palette(struct crt_soft *crt, const uint16_t *pal_565) {
+  memcpy(crt->palette, pal_565, sizeof(crt->palette));
+  build_lut(crt);
+}
+
+void crt_soft_render(struct crt_soft *crt,
+                     const uint8_t *src, int src_pitch,
+                     uint16_t *dst, int dst_pitch,
+                     int y0, int y1) {
+  const int w = crt->dst_w;
+  const int np = crt->num_phases;
+  const uint16_t *col = crt->col_src;
+  int y, x;
+
+  if (!crt->lut) return;
+  if (y1 > crt->dst_h) y1 = crt->dst_h;
+
+  for (y = y0; y < y1; y++) {
+    const uint8_t *s = src + crt->row_src[y] * src_pitch;
+    const uint16_t *lut = crt->lut + crt->row_level[y] * np * 256;
+    uint16_t *d = (uint16_t *)((uint8_t *)dst + y * dst_pitch);
+
+    if (np == 1) {
+      for (x = 0; x < w; x++) {
+        d[x] = lut[s[col[x]]];
+      }
+      continue;
+    }
+
+    // Rotate the per phase tables so that index 0 lines up with output
+    // column 0, then walk the row one mask period at a time.
+    const uint16_t *lp[3];
+    int ph;
+    for (ph = 0; ph < np; ph++) {
+      lp[ph] = lut + ((crt->dst_x + ph) % np) * 256;
+    }
+
+    if (np == 2) {
+      for (x = 0; x + 2 <= w; x += 2) {
+        d[x] = lp[0][s[col[x]]];
+        d[x + 1] = lp[1][s[col[x + 1]]];
+      }
+    } else {
+      for (x = 0; x + 3 <= w; x += 3) {
+        d[x] = lp[0][s[col[x]]];
+        d[x + 1] = lp[1][s[col[x + 1]]];
+        d[x + 2] = lp[2][s[col[x + 2]]];
+      }
+    }
+    for (ph = 0; x < w; x++, ph++) {
+      d[x] = lp[ph][s[col[x]]];
+    }
+  }
+}
+
+uint16_t crt_soft_reference_pixel(struct crt_soft *crt,
+                                  const uint8_t *src, int src_pitch,
+                                  int x, int y) {
+  const struct crt_soft_params *p = &crt->params;
+  int row, ch;
+  float w, rgb[3], m[3];
+
+  map_row(crt, y, &row, &w);
+  unpack_565(crt->palette[src[row * src_pitch + map_col(crt, x)]], rgb);
+
+  if (p->scanlines) {
+    for (ch = 0; ch < 3; ch++) {
+      float c = rgb[ch];
+      if (p->gamma) {
+        c = p->fake_gamma ? c * c : powf(c, p->input_gamma);
+      }
+      c *= w * p->bloom_factor;
+      if (p->gamma) {
+        c = p->fake_gamma ? sqrtf(c) : powf(c, 1.0f / p->output_gamma);
+      }
+      rgb[ch] = c;
+    }
+  }
+
+  mask_for_phase(p, (crt->dst_x + x) % crt->num_phases, m);
+  for (ch = 0; ch < 3; ch++) {
+    rgb[ch] *= m[ch];
+  }
+  return pack_565(rgb);
+}
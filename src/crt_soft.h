@@ -0,0 +1,116 @@
+/*
+ * crt_soft.h - CPU implementation of the crt-pi shader for indexed frames
+ *
+ * The scanline, mask, bloom and gamma math follows crt-pi by davej.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#ifndef CRT_SOFT_H
+#define CRT_SOFT_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Renders an 8-bit indexed frame into an RGB565 image at the final
+// display size, applying the same scanline/mask/bloom/gamma effects as
+// the GL crt-pi shader. Used when the GL shader is not available
+// (composite output, Pi4) or not wanted. Curvature, SHARPER and
+// bilinear interpolation are not implemented; columns are sampled with
+// nearest neighbour exactly like the shader's default path.
+//
+// Everything here is plain C with no Circle dependencies so it can be
+// built and compared against reference output on any host.
+
+// Max distinct scanline weights kept exactly. With integer vertical
+// scaling the number of distinct weights equals the scale factor. If a
+// configuration needs more, weights are quantized to this many levels.
+#define CRT_SOFT_MAX_LEVELS 64
+
+struct crt_soft_params {
+  int scanlines;
+  int multisample;
+  int gamma;
+  int fake_gamma;
+  // 0 = none, 1 = green/magenta, 2 = trinitron(ish)
+  int mask;
+  float mask_brightness;
+  float scanline_weight;
+  float scanline_gap_brightness;
+  float bloom_factor;
+  float input_gamma;
+  float output_gamma;
+};
+
+struct crt_soft {
+  struct crt_soft_params params;
+
+  // Source region within the indexed frame
+  int src_x;
+  int src_y;
+  int src_w;
+  int src_h;
+
+  // Output size and horizontal screen offset (for mask alignment)
+  int dst_w;
+  int dst_h;
+  int dst_x;
+
+  uint16_t palette[256];
+
+  // Per output row: source row and scanline weight level
+  uint16_t *row_src;
+  uint8_t *row_level;
+  // Per output column: source column
+  uint16_t *col_src;
+
+  int num_levels;
+  float level_weight[CRT_SOFT_MAX_LEVELS];
+
+  // Number of mask phases (1, 2 or 3)
+  int num_phases;
+
+  // [level][phase][index] final RGB565 colours
+  uint16_t *lut;
+};
+
+// Zero the struct. Safe to call crt_soft_free afterwards.
+void crt_soft_init(struct crt_soft *crt);
+void crt_soft_free(struct crt_soft *crt);
+
+// (Re)build row/column mappings and colour tables. Returns 0 on success,
+// -1 if memory could not be allocated.
+int crt_soft_configure(struct crt_soft *crt,
+                       const struct crt_soft_params *params,
+                       int src_x, int src_y, int src_w, int src_h,
+                       int dst_x, int dst_w, int dst_h);
+
+// Replace the palette and rebuild colour tables.
+void crt_soft_set_palette(struct crt_soft *crt, const uint16_t *pal_565);
+
+// Render output rows [y0, y1). Disjoint row ranges may be rendered
+// concurrently from different cores. Pitches are in bytes.
+void crt_soft_render(struct crt_soft *crt,
+                     const uint8_t *src, int src_pitch,
+                     uint16_t *dst, int dst_pitch,
+                     int y0, int y1);
+
+// Straight float evaluation of the shader for one output pixel, without
+// lookup tables or weight quantization. Slow. tools/headless/crt_soft_bench.cc
+// compares every pixel crt_soft_render draws against it.
+uint16_t crt_soft_reference_pixel(struct crt_soft *crt,
+                                  const uint8_t *src, int src_pitch,
+                                  int x, int y);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
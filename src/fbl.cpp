@@ -20,6 +20,9 @@
 // through an gles shader instead.  So when uses_shader_ flag is true,
 // (for the emulated machine's display, for example) gles is used.
 // Otherwise, it's not (for the UI or overlays, for example).
+// When uses_soft_crt_ is true, the same CRT effects are rendered on
+// the CPU (see crt_soft.c) into RGB565 resources at display size and
+// dispmanx just places them on screen.
 
 #include "fbl.h"
 
@@ -110,8 +113,24 @@ bool FrameBufferLayer::initialized_ = false;
 DISPMANX_DISPLAY_HANDLE_T FrameBufferLayer::dispman_display_;
 EGLDisplay FrameBufferLayer::egl_display_;
 EGLContext FrameBufferLayer::egl_context_;
-static char* fshader_txt_;
-static char* vshader_txt_;
+
+// Compiled shader programs. These live in egl_context_ which is
+// created once and kept for the lifetime of the app.
+struct ShaderCacheEntry {
+  uint32_t key;
+  uint32_t last_used;
+  GLuint vshader;
+  GLuint fshader;
+  GLuint program;
+};
+static struct ShaderCacheEntry shader_cache_[SHADER_CACHE_SIZE];
+static uint32_t shader_cache_clock_;
+static int shader_cache_compiles_;
+static int shader_cache_hits_;
+
+// Most recently used keys, newest first. Persisted across boots.
+static uint32_t shader_recent_[SHADER_CACHE_SIZE];
+static int shader_recent_count_;
 
 // For testing.
 //#define LOAD_SHADER_FROM_FILE
@@ -120,6 +139,21 @@ static char* vshader_txt_;
 static char *file_shader_txt_;
 #endif
 
+// Software CRT work handed to SoftCrtHelper. The calling core renders
+// the top half of the frame while the helper renders the bottom half.
+static struct {
+  struct crt_soft *crt;
+  const uint8_t *src;
+  int src_pitch;
+  uint16_t *dst;
+  int dst_pitch;
+  int y0;
+  int y1;
+} crt_job_;
+static uint32_t crt_job_seq_;
+static uint32_t crt_job_done_;
+static int crt_helper_active_;
+
 /*
 static void check(const char* msg) {
 	int g = glGetError();
@@ -154,7 +188,11 @@ FrameBufferLayer::FrameBufferLayer() :
         tex_(-1), pal_(-1), mvp_(0),
         input_size_(0), output_size_(0), texture_size_(0), texel_size_(0),
         need_cpu_crop_(true), cropped_pixels_(0),
-        curvature_(false) {
+        curvature_(false), uses_soft_crt_(false), crt_pixels_(nullptr),
+        crt_pitch_(0), line_double_(1), dark_lines_(false),
+        lines_resource_(0), lines_element_(0) {
+  crt_soft_init(&crt_);
+
   alpha_.flags = DISPMANX_FLAGS_ALPHA_FROM_SOURCE;
   alpha_.opacity = 255;
   alpha_.mask = 0;
@@ -225,102 +263,104 @@ void FrameBufferLayer::ReCreateTexture() {
   }
 }
 
-void FrameBufferLayer::ConcatShaderDefines(char *dst) {
-  char scratch[64];
-  if (curvature_) {
-	  strcat(dst,"#define CURVATURE\n");
+// Only the define set that changes the shader's code paths is part
+// of the key. Numeric parameters are passed as uniforms
+// (PARAMETER_UNIFORM) so adjusting them never recompiles.
+uint32_t FrameBufferLayer::ShaderKey() {
+  uint32_t key = 0;
+  if (mode_ != VC_IMAGE_8BPP) key |= SHADER_KEY_RGB;
+  if (curvature_) key |= SHADER_KEY_CURVATURE;
+  if (gamma_) {
+     key |= SHADER_KEY_GAMMA;
+     if (fake_gamma_) key |= SHADER_KEY_FAKE_GAMMA;
   }
+  if (scanlines_) key |= SHADER_KEY_SCANLINES;
+  if (multisample_) key |= SHADER_KEY_MULTISAMPLE;
+  if (sharper_) key |= SHADER_KEY_SHARPER;
+  if (bilinear_interpolation_) key |= SHADER_KEY_BILINEAR;
+  key |= (mask_ & 3) << SHADER_KEY_MASK_SHIFT;
+  return key;
+}
 
-  sprintf (scratch, "#define CURVATURE_X %f\n", curvature_x_);
-  strcat(dst, scratch);
+// static
+void FrameBufferLayer::ConcatShaderDefines(char *dst, uint32_t key) {
+  char scratch[64];
 
-  sprintf (scratch, "#define CURVATURE_Y %f\n", curvature_y_);
-  strcat(dst, scratch);
+  strcat(dst, "#define PARAMETER_UNIFORM\n");
 
-  sprintf (scratch, "#define MASK_TYPE %d\n", mask_);
-  strcat(dst, scratch);
+  if (key & SHADER_KEY_CURVATURE) {
+	  strcat(dst,"#define CURVATURE\n");
+  }
 
-  sprintf (scratch, "#define MASK_BRIGHTNESS %f\n", mask_brightness_);
+  sprintf (scratch, "#define MASK_TYPE %d\n",
+           (key >> SHADER_KEY_MASK_SHIFT) & 3);
   strcat(dst, scratch);
 
-  if (gamma_) {
+  if (key & SHADER_KEY_GAMMA) {
 	  strcat (dst, "#define GAMMA\n");
-	  if (fake_gamma_) {
+	  if (key & SHADER_KEY_FAKE_GAMMA) {
 		  strcat (dst, "#define FAKE_GAMMA\n");
 	  }
   }
 
-  if (scanlines_) {
+  if (key & SHADER_KEY_SCANLINES) {
 	  strcat (dst, "#define SCANLINES\n");
   }
 
-  if (multisample_) {
+  if (key & SHADER_KEY_MULTISAMPLE) {
 	  strcat (dst, "#define MULTISAMPLE\n");
   }
 
-  sprintf (scratch, "#define SCANLINE_WEIGHT %f\n", scanline_weight_);
-  strcat(dst, scratch);
-
-  sprintf (scratch, "#define SCANLINE_GAP_BRIGHTNESS %f\n", scanline_gap_brightness_);
-  strcat(dst, scratch);
-
-  sprintf (scratch, "#define BLOOM_FACTOR %f\n", bloom_factor_);
-  strcat(dst, scratch);
-
-  sprintf (scratch, "#define INPUT_GAMMA %f\n", input_gamma_);
-  strcat(dst, scratch);
-
-  sprintf (scratch, "#define OUTPUT_GAMMA %f\n", output_gamma_);
-  strcat(dst, scratch);
-
-  if (sharper_) {
+  if (key & SHADER_KEY_SHARPER) {
 	  strcat (dst, "#define SHARPER\n");
   }
-  if (bilinear_interpolation_) {
+  if (key & SHADER_KEY_BILINEAR) {
 	  strcat (dst, "#define BILINEAR_INTERPOLATION\n");
   }
 }
 
-void FrameBufferLayer::ShaderInit() {
-
-	// Used to for size to reserve enough space at
-	// beginning of shader for dynamic defines.
-	static const char* header_template =
-           "#define FRAGMENT                    "
-           "#define CURVATURE                   "
-           "#define CURVATURE_X 0.10            "
-           "#define CURVATURE_Y 0.25            "
-           "#define MASK 1                      "
-           "#define MASK_BRIGHTNESS 0.70        "
-           "#define GAMMA                       "
-           "#define FAKE_GAMMA                  "
-           "#define SCANLINES                   "
-           "#define MULTISAMPLE                 "
-           "#define SCANLINE_WEIGHT 6.0         "
-           "#define SCANLINE_GAP_BRIGHTNESS 0.12"
-           "#define BLOOM_FACTOR 1.5            "
-           "#define INPUT_GAMMA 2.4             "
-           "#define OUTPUT_GAMMA 2.2            "
-           "#define SHARPER                     "
-           "#define BILINEAR_INTERPOLATION      ";
+// static
+int FrameBufferLayer::ShaderCacheGet(uint32_t key, bool prewarm) {
+  int i;
+  for (i = 0; i < SHADER_CACHE_SIZE; i++) {
+     if (shader_cache_[i].program && shader_cache_[i].key == key) {
+        shader_cache_[i].last_used = ++shader_cache_clock_;
+        if (!prewarm) {
+           shader_cache_hits_++;
+        }
+        return i;
+     }
+  }
 
-  // orthographic projection matrix
-  static const GLfloat mvp_ortho[16] = { 2.0f,  0.0f,  0.0f,  0.0f,
-                                         0.0f,  2.0f,  0.0f,  0.0f,
-                                         0.0f,  0.0f, -1.0f,  0.0f,
-                                         -1.0f, -1.0f,  0.0f,  1.0f };
+  // Take an empty slot or evict the least recently used program.
+  int slot = 0;
+  for (i = 0; i < SHADER_CACHE_SIZE; i++) {
+     if (!shader_cache_[i].program) {
+        slot = i;
+        break;
+     }
+     if (shader_cache_[i].last_used < shader_cache_[slot].last_used) {
+        slot = i;
+     }
+  }
 
-  if (shader_init_) {
-      return;
+  struct ShaderCacheEntry *entry = &shader_cache_[slot];
+  if (entry->program) {
+     glDetachShader(entry->program, entry->vshader);
+     glDetachShader(entry->program, entry->fshader);
+     glDeleteProgram(entry->program);
+     glDeleteShader(entry->vshader);
+     glDeleteShader(entry->fshader);
+     entry->program = 0;
   }
 
   const char *shader_txt;
-  int len;
 
 #ifdef LOAD_SHADER_FROM_FILE
+  // Note: file text is loaded once for whichever mode asks first.
   if (!file_shader_txt_) {
      FILE *f;
-     if (mode_ == VC_IMAGE_8BPP) {
+     if (!(key & SHADER_KEY_RGB)) {
         // Use indexed texture version
         f = fopen("crt-pi-idx.gls", "r");
      } else {
@@ -328,7 +368,7 @@ void FrameBufferLayer::ShaderInit() {
         f = fopen("crt-pi-rgb.gls", "r");
      }
      fseek(f, 0, SEEK_END);
-     len = ftell(f);
+     int len = ftell(f);
      fseek(f, 0, SEEK_SET);
      // Never freed.
      file_shader_txt_ = (char*) malloc(len + 1);
@@ -339,77 +379,151 @@ void FrameBufferLayer::ShaderInit() {
   shader_txt = file_shader_txt_;
 #else
   // Use statically linked shader txt.
-  if (mode_ == VC_IMAGE_8BPP) {
+  if (!(key & SHADER_KEY_RGB)) {
      shader_txt = idx_shader;
   } else {
      shader_txt = rgb_shader;
   }
 #endif
 
-  len = strlen(shader_txt);
-  if (vshader_txt_) {
-     free(vshader_txt_);
-  }
-  char vheader[] = "#define VERTEX\n";
-  vshader_txt_ = (char*) malloc(len + 1 +
-                                strlen(vheader) +
-                                strlen(header_template));
-  vshader_txt_[0] = '\0';
-  strcpy(vshader_txt_, vheader);
-  ConcatShaderDefines(vshader_txt_);
-  strcat(vshader_txt_, shader_txt);
-
-  if (fshader_txt_) {
-     free(fshader_txt_);
-  }
-  char fheader[] = "#define FRAGMENT\n";
-  fshader_txt_ = (char*) malloc(len + 1 +
-                                strlen(fheader) +
-                                strlen(header_template));
-  fshader_txt_[0] = '\0';
-  strcpy(fshader_txt_, fheader);
-  ConcatShaderDefines(fshader_txt_);
-  strcat(fshader_txt_, shader_txt);
-
-  const GLchar *vshader_source = (const GLchar*) vshader_txt_;
-  vshader_ = glCreateShader(GL_VERTEX_SHADER);
-  glShaderSource(vshader_, 1, &vshader_source, 0);
-  glCompileShader(vshader_);
+  char defines[256];
+  defines[0] = '\0';
+  ConcatShaderDefines(defines, key);
+
+  const GLchar *vshader_source[3] =
+     { "#define VERTEX\n", defines, shader_txt };
+  entry->vshader = glCreateShader(GL_VERTEX_SHADER);
+  glShaderSource(entry->vshader, 3, vshader_source, 0);
+  glCompileShader(entry->vshader);
   //check("glCompileShader");
 
-//  char log[1024];
-//  strcpy(log,"");
-//  glGetShaderInfoLog(vshader_,sizeof log,NULL,log);
-//  FILE *fp = fopen("shader1.log","w");
-//  fprintf(fp,"%s\n",log);
-//  fclose(fp);
-
-  const GLchar *fshader_source = (const GLchar*) fshader_txt_;
-  fshader_ = glCreateShader(GL_FRAGMENT_SHADER);
-  glShaderSource(fshader_, 1, &fshader_source, 0);
-  glCompileShader(fshader_);
+  const GLchar *fshader_source[3] =
+     { "#define FRAGMENT\n", defines, shader_txt };
+  entry->fshader = glCreateShader(GL_FRAGMENT_SHADER);
+  glShaderSource(entry->fshader, 3, fshader_source, 0);
+  glCompileShader(entry->fshader);
   //check("glCompileShader2");
 
-//  glGetShaderInfoLog(fshader_,sizeof log,NULL,log);
-//  fp = fopen("shader2.log","w");
-//  fprintf(fp,"%s\n",log);
-//  fclose(fp);
-
-  shader_program_ = glCreateProgram();
-  glAttachShader(shader_program_, vshader_);
-  glAttachShader(shader_program_, fshader_);
-  glLinkProgram(shader_program_);
+  entry->program = glCreateProgram();
+  glAttachShader(entry->program, entry->vshader);
+  glAttachShader(entry->program, entry->fshader);
+  glLinkProgram(entry->program);
   //check("linkProgram");
 
 //  GLint status;
-//  glGetProgramiv (shader_program_, GL_LINK_STATUS, &status);
+//  glGetProgramiv (entry->program, GL_LINK_STATUS, &status);
 //  if (status != GL_TRUE) {
-//	  glGetProgramInfoLog(shader_program_,sizeof log,NULL,log);
-//	  fp = fopen("program.log","w");
+//	  char log[1024];
+//	  glGetProgramInfoLog(entry->program,sizeof log,NULL,log);
+//	  FILE *fp = fopen("program.log","w");
 //	  fprintf(fp,"%s\n",log);
 //	  fclose(fp);
 //  }
 
+  entry->key = key;
+  entry->last_used = ++shader_cache_clock_;
+  shader_cache_compiles_++;
+  return slot;
+}
+
+// static
+void FrameBufferLayer::ShaderCacheGetStats(int *compiles, int *hits) {
+  *compiles = shader_cache_compiles_;
+  *hits = shader_cache_hits_;
+}
+
+// Remember the most recently used keys on the SD card so the next
+// boot can compile them up front.
+// static
+void FrameBufferLayer::ShaderCacheRecordUse(uint32_t key) {
+  int i;
+  if (shader_recent_count_ > 0 && shader_recent_[0] == key) {
+     return;
+  }
+  for (i = 0; i < shader_recent_count_; i++) {
+     if (shader_recent_[i] == key) break;
+  }
+  if (i == shader_recent_count_) {
+     // New key. Drop the oldest one if the list is full.
+     if (shader_recent_count_ < SHADER_CACHE_SIZE) {
+        shader_recent_count_++;
+     }
+     i = shader_recent_count_ - 1;
+  }
+  for (; i > 0; i--) {
+     shader_recent_[i] = shader_recent_[i - 1];
+  }
+  shader_recent_[0] = key;
+
+  FILE *fp = fopen(SHADER_RECENT_FILE, "w");
+  if (!fp) return;
+  for (i = 0; i < shader_recent_count_; i++) {
+     fprintf(fp, "%08x\n", (unsigned)shader_recent_[i]);
+  }
+  fclose(fp);
+}
+
+// Compile the programs used most recently (across boots) so switching
+// to them later does not stall. Needs a current context so this runs
+// the first time a shader layer is shown.
+// static
+void FrameBufferLayer::ShaderPrewarm() {
+  static bool done = false;
+  if (done) return;
+  done = true;
+
+  FILE *fp = fopen(SHADER_RECENT_FILE, "r");
+  if (!fp) return;
+  unsigned key;
+  while (shader_recent_count_ < SHADER_CACHE_SIZE &&
+            fscanf(fp, "%x", &key) == 1) {
+     shader_recent_[shader_recent_count_++] = key;
+  }
+  fclose(fp);
+
+  // Oldest first so the most recent end up least likely to be evicted.
+  for (int i = shader_recent_count_ - 1; i >= 0; i--) {
+     ShaderCacheGet(shader_recent_[i], true);
+  }
+}
+
+void FrameBufferLayer::ShaderSetParams() {
+  glUniform1f(glGetUniformLocation(shader_program_, "CURVATURE_X"),
+              curvature_x_);
+  glUniform1f(glGetUniformLocation(shader_program_, "CURVATURE_Y"),
+              curvature_y_);
+  glUniform1f(glGetUniformLocation(shader_program_, "MASK_BRIGHTNESS"),
+              mask_brightness_);
+  glUniform1f(glGetUniformLocation(shader_program_, "SCANLINE_WEIGHT"),
+              scanline_weight_);
+  glUniform1f(glGetUniformLocation(shader_program_,
+                                   "SCANLINE_GAP_BRIGHTNESS"),
+              scanline_gap_brightness_);
+  glUniform1f(glGetUniformLocation(shader_program_, "BLOOM_FACTOR"),
+              bloom_factor_);
+  glUniform1f(glGetUniformLocation(shader_program_, "INPUT_GAMMA"),
+              input_gamma_);
+  glUniform1f(glGetUniformLocation(shader_program_, "OUTPUT_GAMMA"),
+              output_gamma_);
+}
+
+void FrameBufferLayer::ShaderInit() {
+  // orthographic projection matrix
+  static const GLfloat mvp_ortho[16] = { 2.0f,  0.0f,  0.0f,  0.0f,
+                                         0.0f,  2.0f,  0.0f,  0.0f,
+                                         0.0f,  0.0f, -1.0f,  0.0f,
+                                         -1.0f, -1.0f,  0.0f,  1.0f };
+
+  if (shader_init_) {
+      return;
+  }
+
+  ShaderPrewarm();
+
+  uint32_t key = ShaderKey();
+  shader_program_ = shader_cache_[ShaderCacheGet(key, false)].program;
+  ShaderCacheRecordUse(key);
+
   glUseProgram (shader_program_);
 
   attr_vertex_ = glGetAttribLocation(shader_program_, "VertexCoord");
@@ -428,6 +542,8 @@ void FrameBufferLayer::ShaderInit() {
 	  glUniformMatrix4fv(mvp_, 1, GL_FALSE, mvp_ortho);
   }
 
+  ShaderSetParams();
+
   // This texture is the indexed bitmap data so we use LUMINANCE which
   // will show up as coordinate x in the shader. Then we use the palette
   // 256x1 texture (below) to lookup the color.
@@ -455,12 +571,11 @@ void FrameBufferLayer::ShaderDestroy() {
   if (shader_init_) {
     glDeleteBuffers(1, &vbo_);
     glDeleteTextures(1, &tex_);
+    if (mode_ == VC_IMAGE_8BPP) {
+       glDeleteTextures(1, &pal_);
+    }
+    // The program stays in the cache.
     glUseProgram (0);
-    glDetachShader(shader_program_, vshader_);
-    glDetachShader(shader_program_, fshader_);
-    glDeleteProgram(shader_program_);
-    glDeleteShader(vshader_);
-    glDeleteShader(fshader_);
     shader_init_ = false;
   }
 }
@@ -634,7 +749,7 @@ int FrameBufferLayer::Allocate(int pixelmode, uint8_t **pixels,
   }
 
   fb_width_ = width;
-  fb_height_ = height;
+  fb_height_ = height / line_double_;
 
   ret = vc_dispmanx_display_get_info(dispman_display_, &dispman_info);
   assert(ret == 0);
@@ -643,25 +758,37 @@ int FrameBufferLayer::Allocate(int pixelmode, uint8_t **pixels,
   display_height_ = dispman_info.height;
 
   if (pixels) {
-     pixels_ = (uint8_t*) malloc(fb_pitch_ * height);
+     pixels_ = (uint8_t*) malloc(fb_pitch_ * fb_height_);
      cropped_pixels_ = (uint8_t*) malloc(fb_pitch_ * fb_height_);
      *pixels = pixels_;
   }
 
-  // Allocate the VC resources along with the frame buffer
+  // Allocate the VC resources along with the frame buffer. The
+  // software CRT renders at the destination size which can be as
+  // large as the display.
+  VC_IMAGE_TYPE_T res_mode = mode_;
+  int res_width = width;
+  int res_height = fb_height_;
+  if (uses_soft_crt_) {
+     res_mode = VC_IMAGE_RGB565;
+     res_width = display_width_;
+     res_height = display_height_;
+     crt_pitch_ = ALIGN_UP(display_width_ * 2, 32);
+     crt_pixels_ = (uint16_t*) calloc(crt_pitch_ * display_height_, 1);
+  }
 
-  dispman_resource_[0] = vc_dispmanx_resource_create(mode_,
-                                                     width,
-                                                     height,
+  dispman_resource_[0] = vc_dispmanx_resource_create(res_mode,
+                                                     res_width,
+                                                     res_height,
                                                      &vc_image_ptr );
-  dispman_resource_[1] = vc_dispmanx_resource_create(mode_,
-                                                     width,
-                                                     height,
+  dispman_resource_[1] = vc_dispmanx_resource_create(res_mode,
+                                                     res_width,
+                                                     res_height,
                                                      &vc_image_ptr );
   assert(dispman_resource_[0]);
   assert(dispman_resource_[1]);
 
-  vc_dispmanx_rect_set(&copy_dst_rect_, 0, 0, width, height);
+  vc_dispmanx_rect_set(&copy_dst_rect_, 0, 0, width, fb_height_);
 
   if (pixels) {
      // Don't clobber these on realloc.
@@ -673,7 +800,7 @@ int FrameBufferLayer::Allocate(int pixelmode, uint8_t **pixels,
      src_x_ = 0;
      src_y_ = 0;
      src_w_ = width;
-     src_h_ = height;
+     src_h_ = fb_height_;
   }
 
   EGLBoolean result;
@@ -699,18 +826,25 @@ int FrameBufferLayer::Allocate(int pixelmode, uint8_t **pixels,
      result = eglChooseConfig(egl_display_, attribute_list,
                                &egl_config_, 1, &num_config);
      assert(EGL_FALSE != result);
-     egl_context_ = eglCreateContext(egl_display_, egl_config_,
+     // Created once and never destroyed so cached shader programs
+     // survive the shader being turned off and on.
+     if (egl_context_ == EGL_NO_CONTEXT) {
+        egl_context_ = eglCreateContext(egl_display_, egl_config_,
                                         EGL_NO_CONTEXT, context_attributes);
-     assert(egl_context_ != EGL_NO_CONTEXT);
+        assert(egl_context_ != EGL_NO_CONTEXT);
+     }
   }
 
   return 0;
 }
 
-int FrameBufferLayer::ReAllocate(bool shader_enable) {
+int FrameBufferLayer::ReAllocate(int shader_mode) {
   assert(allocated_);
 
-  if (uses_shader_ == shader_enable) {
+  bool shader_enable = shader_mode == FB_SHADER_GL;
+  bool soft_crt = shader_mode == FB_SHADER_SOFT && mode_ == VC_IMAGE_8BPP;
+
+  if (uses_shader_ == shader_enable && uses_soft_crt_ == soft_crt) {
      // No need to realloc if nothing changed;
      return 0;
   }
@@ -718,14 +852,16 @@ int FrameBufferLayer::ReAllocate(bool shader_enable) {
   // Free layer but keep pixels.
   FreeInternal(true);
 
-  // Change the uses shader flag.
+  // Change the uses shader flags.
   SetUsesShader(shader_enable);
+  uses_soft_crt_ = soft_crt;
 
   int pixelmode = 0;
   if (mode_ == VC_IMAGE_RGB565) pixelmode = 1;
 
   // Reallocate with same params.
-  return Allocate(pixelmode, nullptr, fb_width_, fb_height_, nullptr);
+  return Allocate(pixelmode, nullptr, fb_width_, fb_height_ * line_double_,
+                  nullptr);
 }
 
 void FrameBufferLayer::Clear() {
@@ -749,10 +885,6 @@ void FrameBufferLayer::FreeInternal(bool keepPixels) {
      Hide();
   }
 
-  if (uses_shader_) {
-     eglDestroyContext(egl_display_, egl_context_);
-  }
-
   if (!keepPixels) {
      fb_width_ = 0;
      fb_height_ = 0;
@@ -766,6 +898,10 @@ void FrameBufferLayer::FreeInternal(bool keepPixels) {
   ret = vc_dispmanx_resource_delete(dispman_resource_[1]);
   assert(ret == 0);
 
+  crt_soft_free(&crt_);
+  free(crt_pixels_);
+  crt_pixels_ = nullptr;
+
   allocated_ = false;
 }
 
@@ -878,6 +1014,14 @@ void FrameBufferLayer::Show() {
                        dst_y_ << 16,
                        dst_w_ << 16,
                        dst_h_ << 16);
+  } else if (uses_soft_crt_) {
+     // The software CRT output is already at the dest size.
+     vc_dispmanx_rect_set(&src_rect_,
+                       0,
+                       0,
+                       dst_w_ << 16,
+                       dst_h_ << 16);
+     SoftCrtConfigure();
   } else {
      // When we're using just dispmanx, we isolate and crop
      // the region in the layer we want to scale up to the
@@ -898,10 +1042,12 @@ void FrameBufferLayer::Show() {
   dispman_update = vc_dispmanx_update_start(0);
   assert( dispman_update );
 
+  // Each layer gets two dispmanx layers so the raster line mask can
+  // sit directly above it.
   rnum_ = 0;
   dispman_element_ = vc_dispmanx_element_add(dispman_update,
                                             dispman_display_,
-                                            layer_, // layer
+                                            layer_ * 2, // layer
                                             &scale_dst_rect_,
                                             dispman_resource_[rnum_],
                                             &src_rect_,
@@ -910,6 +1056,10 @@ void FrameBufferLayer::Show() {
                                             NULL,             // clamp
                                             DISPMANX_NO_ROTATE);
 
+  if (line_double_ == 2 && dark_lines_) {
+     ShowRasterLines(dispman_update);
+  }
+
   ret = vc_dispmanx_update_submit(dispman_update, NULL, NULL);
   assert( ret == 0 );
 
@@ -958,8 +1108,16 @@ void FrameBufferLayer::Hide() {
   dispman_update = vc_dispmanx_update_start(0);
   ret = vc_dispmanx_element_remove(dispman_update, dispman_element_);
   assert(ret == 0);
+  if (lines_element_) {
+     HideRasterLines(dispman_update);
+  }
   ret = vc_dispmanx_update_submit(dispman_update, NULL, NULL);
   assert(ret == 0);
+  if (lines_resource_) {
+     ret = vc_dispmanx_resource_delete(lines_resource_);
+     assert(ret == 0);
+     lines_resource_ = 0;
+  }
   showing_ = false;
 }
 
@@ -972,7 +1130,14 @@ void FrameBufferLayer::FrameReady(int to_offscreen) {
 
   // Copy data into either the offscreen resource (if swap) or the
   // on screen resource (if !swap).
-  if (!uses_shader_) {
+  if (uses_soft_crt_) {
+      SoftCrtRender();
+      vc_dispmanx_resource_write_data(dispman_resource_[rnum],
+                                      VC_IMAGE_RGB565,
+                                      crt_pitch_,
+                                      crt_pixels_,
+                                      &copy_dst_rect_);
+  } else if (!uses_shader_) {
       vc_dispmanx_resource_write_data(dispman_resource_[rnum],
                                       mode_,
                                       fb_pitch_,
@@ -1059,6 +1224,130 @@ void FrameBufferLayer::RenderGL() {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
+// The mask is one column of alternating transparent and black lines,
+// two per source line, stretched over the same destination rect as the
+// frame. It is only rebuilt when the source height changes, so it
+// costs nothing per frame.
+void FrameBufferLayer::ShowRasterLines(
+    DISPMANX_UPDATE_HANDLE_T& dispman_update) {
+  static const uint32_t lines_pal[2] = { 0x00000000, 0xFF000000 };
+  const int w = 32;
+  const int h = src_h_ * 2;
+  uint32_t vc_image_ptr;
+  VC_RECT_T rect;
+  VC_RECT_T src_rect;
+
+  uint8_t *mask = (uint8_t*) malloc(w * h);
+  if (!mask) return;
+  for (int y = 0; y < h; y++) {
+     memset(mask + y * w, y & 1, w);
+  }
+
+  lines_resource_ = vc_dispmanx_resource_create(VC_IMAGE_8BPP, w, h,
+                                                &vc_image_ptr);
+  assert(lines_resource_);
+  vc_dispmanx_resource_set_palette(lines_resource_,
+                                   (void*)lines_pal, 0, sizeof lines_pal);
+  vc_dispmanx_rect_set(&rect, 0, 0, w, h);
+  vc_dispmanx_resource_write_data(lines_resource_, VC_IMAGE_8BPP, w,
+                                  mask, &rect);
+  free(mask);
+
+  vc_dispmanx_rect_set(&src_rect, 0, 0, w << 16, h << 16);
+  lines_element_ = vc_dispmanx_element_add(dispman_update,
+                                           dispman_display_,
+                                           layer_ * 2 + 1, // layer
+                                           &scale_dst_rect_,
+                                           lines_resource_,
+                                           &src_rect,
+                                           DISPMANX_PROTECTION_NONE,
+                                           &alpha_,
+                                           NULL,             // clamp
+                                           DISPMANX_NO_ROTATE);
+}
+
+void FrameBufferLayer::HideRasterLines(
+    DISPMANX_UPDATE_HANDLE_T& dispman_update) {
+  int ret = vc_dispmanx_element_remove(dispman_update, lines_element_);
+  assert(ret == 0);
+  lines_element_ = 0;
+}
+
+void FrameBufferLayer::SoftCrtConfigure() {
+  struct crt_soft_params params;
+  params.scanlines = scanlines_;
+  params.multisample = multisample_;
+  params.gamma = gamma_;
+  params.fake_gamma = fake_gamma_;
+  params.mask = mask_;
+  params.mask_brightness = mask_brightness_;
+  params.scanline_weight = scanline_weight_;
+  params.scanline_gap_brightness = scanline_gap_brightness_;
+  params.bloom_factor = bloom_factor_;
+  params.input_gamma = input_gamma_;
+  params.output_gamma = output_gamma_;
+
+  if (crt_soft_configure(&crt_, &params,
+                         src_x_, src_y_, src_w_, src_h_,
+                         dst_x_, dst_w_, dst_h_) != 0) {
+     printf("Failed to allocate software CRT tables\n");
+  }
+
+  vc_dispmanx_rect_set(&copy_dst_rect_, 0, 0, dst_w_, dst_h_);
+}
+
+void FrameBufferLayer::SoftCrtRender() {
+  int split = dst_h_;
+  uint32_t seq = 0;
+  bool helper = __atomic_load_n(&crt_helper_active_, __ATOMIC_ACQUIRE);
+
+  if (helper) {
+     split = dst_h_ / 2;
+     crt_job_.crt = &crt_;
+     crt_job_.src = pixels_;
+     crt_job_.src_pitch = fb_pitch_;
+     crt_job_.dst = crt_pixels_;
+     crt_job_.dst_pitch = crt_pitch_;
+     crt_job_.y0 = split;
+     crt_job_.y1 = dst_h_;
+     seq = crt_job_seq_ + 1;
+     __atomic_store_n(&crt_job_seq_, seq, __ATOMIC_RELEASE);
+     asm volatile("dsb\n\tsev" ::: "memory");
+  }
+
+  crt_soft_render(&crt_, pixels_, fb_pitch_, crt_pixels_, crt_pitch_,
+                  0, split);
+
+  if (helper) {
+     while (__atomic_load_n(&crt_job_done_, __ATOMIC_ACQUIRE) != seq) {
+        asm volatile("wfe");
+     }
+  }
+}
+
+// Static
+void FrameBufferLayer::SoftCrtHelper(int (*idle_work)(void)) {
+  uint32_t seen = __atomic_load_n(&crt_job_seq_, __ATOMIC_ACQUIRE);
+  __atomic_store_n(&crt_helper_active_, 1, __ATOMIC_RELEASE);
+
+  for (;;) {
+     uint32_t seq;
+     while ((seq = __atomic_load_n(&crt_job_seq_, __ATOMIC_ACQUIRE)) == seen) {
+        // Producers of idle work sev after queueing, so a wfe after an
+        // empty poll cannot miss it.
+        if (!idle_work || !idle_work()) {
+           asm volatile("wfe");
+        }
+     }
+     seen = seq;
+     crt_soft_render(crt_job_.crt, crt_job_.src, crt_job_.src_pitch,
+                     crt_job_.dst, crt_job_.dst_pitch,
+                     crt_job_.y0, crt_job_.y1);
+     __atomic_store_n(&crt_job_done_, seq, __ATOMIC_RELEASE);
+     asm volatile("dsb\n\tsev" ::: "memory");
+  }
+}
+
 
 // Static
 void FrameBufferLayer::SwapResources(bool sync,
@@ -1103,6 +1392,17 @@ void FrameBufferLayer::UpdatePalette() {
   if (!allocated_) return;
   assert (mode_ == VC_IMAGE_8BPP);
 
+  if (uses_soft_crt_) {
+     // Palette is baked into the CRT tables. Redraw so the
+     // change is visible right away like it is for dispmanx.
+     assert(!transparency_);
+     crt_soft_set_palette(&crt_, pal_565_);
+     if (showing_) {
+        FrameReady(0);
+     }
+     return;
+  }
+
   int ret;
   if (transparency_) {
      ret = vc_dispmanx_resource_set_palette(dispman_resource_[0],
@@ -1142,6 +1442,10 @@ bool FrameBufferLayer::UsesShader() {
 	return uses_shader_;
 }
 
+bool FrameBufferLayer::UsesSoftCrt() {
+	return uses_soft_crt_;
+}
+
 bool FrameBufferLayer::Showing() {
 	return showing_;
 }
@@ -1151,7 +1455,15 @@ void FrameBufferLayer::SetTransparency(bool transparency) {
   transparency_ = transparency;
 }
 
+void FrameBufferLayer::SetLineDoubling(bool enable, bool dark_lines) {
+  assert(!allocated_);
+  line_double_ = enable ? 2 : 1;
+  dark_lines_ = dark_lines;
+}
+
 void FrameBufferLayer::SetSrcRect(int x, int y, int w, int h) {
+  y /= line_double_;
+  h /= line_double_;
   bool has_changed = x != src_x_ || y != src_y_ || w != src_w_ || h != src_h_;
   src_x_ = x;
   src_y_ = y;
@@ -1162,6 +1474,30 @@ void FrameBufferLayer::SetSrcRect(int x, int y, int w, int h) {
       // When using cpu crop, we have to resize our texture.
       ReCreateTexture();
   }
+
+  if (has_changed && uses_soft_crt_ && showing_) {
+      SoftCrtConfigure();
+  }
+
+  if (has_changed && showing_ && line_double_ == 2 && dark_lines_) {
+      // The mask has two lines per source line, so it has to be
+      // rebuilt for the new height. Swap it in one update and free the
+      // old one after.
+      DISPMANX_RESOURCE_HANDLE_T old_lines = lines_resource_;
+      DISPMANX_UPDATE_HANDLE_T dispman_update = vc_dispmanx_update_start(0);
+      assert(dispman_update);
+      if (lines_element_) {
+         HideRasterLines(dispman_update);
+      }
+      lines_resource_ = 0;
+      ShowRasterLines(dispman_update);
+      int ret = vc_dispmanx_update_submit(dispman_update, NULL, NULL);
+      assert(ret == 0);
+      if (old_lines) {
+         ret = vc_dispmanx_resource_delete(old_lines);
+         assert(ret == 0);
+      }
+  }
 }
 
 // Set horizontal/vertical multipliers
@@ -1206,13 +1542,29 @@ void FrameBufferLayer::GetDimensions(int *display_w, int *display_h,
   *display_w = display_width_;
   *display_h = display_height_;
   *fb_w = fb_width_;
-  *fb_h = fb_height_;
+  *fb_h = fb_height_ * line_double_;
   *src_w = src_w_;
-  *src_h = src_h_;
+  *src_h = src_h_ * line_double_;
   *dst_w = dst_w_;
   *dst_h = dst_h_;
 }
 
+bool FrameBufferLayer::GetIndexedSource(const uint8_t **pixels, int *pitch,
+                                        int *x, int *y, int *w, int *h,
+                                        const uint16_t **palette) {
+  if (!allocated_ || mode_ != VC_IMAGE_8BPP || transparency_) {
+    return false;
+  }
+  *pixels = pixels_;
+  *pitch = fb_pitch_;
+  *x = src_x_;
+  *y = src_y_;
+  *w = src_w_;
+  *h = src_h_;
+  *palette = pal_565_;
+  return true;
+}
+
 void FrameBufferLayer::SetInterpolation(int enable) {
   if (enable) {
      bcm_set_sclker(config_scaling_kernel);
@@ -22,6 +22,30 @@
 #include "EGL/egl.h"
 #include "EGL/eglext.h"
 
+#include "crt_soft.h"
+
+// Values for ReAllocate's shader_mode
+#define FB_SHADER_NONE 0
+#define FB_SHADER_GL   1
+#define FB_SHADER_SOFT 2
+
+// Number of compiled shader programs kept around
+#define SHADER_CACHE_SIZE 8
+
+// Where the most recently used shader keys are remembered
+#define SHADER_RECENT_FILE "/shaders.txt"
+
+// Bits making up a shader cache key
+#define SHADER_KEY_RGB         0x01
+#define SHADER_KEY_CURVATURE   0x02
+#define SHADER_KEY_GAMMA       0x04
+#define SHADER_KEY_FAKE_GAMMA  0x08
+#define SHADER_KEY_SCANLINES   0x10
+#define SHADER_KEY_MULTISAMPLE 0x20
+#define SHADER_KEY_SHARPER     0x40
+#define SHADER_KEY_BILINEAR    0x80
+#define SHADER_KEY_MASK_SHIFT  8
+
 // A wrapper that manages a single dispmanx layer and
 // indexed frame buffer.
 class FrameBufferLayer {
@@ -39,6 +63,13 @@ public:
   // is used.
   void SetTransparency(bool transparency);
 
+  // When enabled, the height given to Allocate and the source rect
+  // are in doubled lines but the pixel buffer holds single lines. The
+  // lines are doubled when the layer is scaled onto the display. If
+  // dark_lines is set, every second display line is masked out to
+  // simulate raster lines. Must be called before Allocate.
+  void SetLineDoubling(bool enable, bool dark_lines);
+
   // pixel mode: 0=8-bit-indexed, 1=RGB565
   // pitch represents bytes per line
   int Allocate(int pixelmode, uint8_t **pixels,
@@ -46,8 +77,9 @@ public:
 
   // Allocate again with the same parameters. pixels and
   // pitch will remain the same.  Used for turning the shader
-  // on/off.
-  int ReAllocate(bool shader_enable);
+  // on/off. shader_mode is one of FB_SHADER_*. The software
+  // CRT is only available for indexed frame buffers.
+  int ReAllocate(int shader_mode);
 
   void Free();
   void Clear();
@@ -110,6 +142,13 @@ public:
                      int *src_w, int *src_h,
                      int *dst_w, int *dst_h);
 
+  // The indexed pixels inside the source rect, in single lines, and
+  // the RGB565 palette. Used by the frame stream. Returns false unless
+  // this is an allocated 8 bit layer.
+  bool GetIndexedSource(const uint8_t **pixels, int *pitch,
+                        int *x, int *y, int *w, int *h,
+                        const uint16_t **palette);
+
   // initializes the bcm_host interface
   static void Initialize();
   static void OGLInit();
@@ -120,6 +159,14 @@ public:
 
   void SetUsesShader(bool enable);
 
+  bool UsesSoftCrt();
+
+  // Never returns. Run on an otherwise idle core to have it render
+  // half of each software CRT frame. If given, idle_work is polled
+  // between CRT jobs and should return the number of things it did;
+  // the core only sleeps once it returns 0.
+  static void SoftCrtHelper(int (*idle_work)(void));
+
   // NOTE: This will implicitly Hide the layer since the shader must be
   // destroyed and recompiled.
   void SetShaderParams(
@@ -146,6 +193,10 @@ public:
 
   static void SetInterpolation(int enable);
 
+  // Shader programs compiled, including prewarming, and lookups that
+  // found one already compiled.
+  static void ShaderCacheGetStats(int *compiles, int *hits);
+
 private:
   void FreeInternal(bool keepPixels);
   void Swap(DISPMANX_UPDATE_HANDLE_T& dispman_update);
@@ -161,7 +212,18 @@ private:
   void EnableShader();
   void DisableShader();
 
-  void ConcatShaderDefines(char *dst);
+  uint32_t ShaderKey();
+  void ShaderSetParams();
+  static void ConcatShaderDefines(char *dst, uint32_t key);
+  static int ShaderCacheGet(uint32_t key, bool prewarm);
+  static void ShaderCacheRecordUse(uint32_t key);
+  static void ShaderPrewarm();
+
+  void SoftCrtConfigure();
+  void SoftCrtRender();
+
+  void ShowRasterLines(DISPMANX_UPDATE_HANDLE_T& dispman_update);
+  void HideRasterLines(DISPMANX_UPDATE_HANDLE_T& dispman_update);
 
   // Raw pixel data. Not VC memory.
   uint8_t* pixels_;
@@ -186,6 +248,7 @@ private:
   static bool initialized_;
 
   int fb_width_;
+  // Lines held in pixels_. Half the allocated height when doubling.
   int fb_height_;
   int fb_pitch_;
   int layer_;
@@ -293,6 +356,22 @@ private:
   float output_gamma_;
   bool sharper_;
   bool bilinear_interpolation_;
+
+  // Software CRT. When enabled, the dispmanx resources are RGB565 at
+  // display size and hold the processed image rather than the raw
+  // indexed pixels.
+  bool uses_soft_crt_;
+  struct crt_soft crt_;
+  uint16_t* crt_pixels_;
+  int crt_pitch_;
+
+  // 2 when lines are doubled at presentation, otherwise 1. Source
+  // coordinates are kept in pixel buffer lines.
+  int line_double_;
+  bool dark_lines_;
+  // Raster line mask element laid over this layer
+  DISPMANX_RESOURCE_HANDLE_T lines_resource_;
+  DISPMANX_ELEMENT_HANDLE_T lines_element_;
 };
 
 #endif
@@ -0,0 +1,155 @@
+// framecoder.cpp
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     https://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "framecoder.h"
+
+#include <string.h>
+
+namespace {
+
+enum FrameFlags {
+  kKeyFrame = 0x01,
+};
+
+// Control byte c < 128 is followed by c + 1 literal bytes. c >= 128 is
+// followed by one byte that repeats c - 125 times, 3 to 130.
+unsigned EncodeSpan(const u8 *span, unsigned count, u8 *out) {
+  u8 *start = out;
+  unsigned i = 0;
+  while (i < count) {
+    unsigned run = 1;
+    while (i + run < count && run < 130 && span[i + run] == span[i]) {
+      ++run;
+    }
+    if (run >= 3) {
+      *out++ = (u8)(run + 125);
+      *out++ = span[i];
+      i += run;
+      continue;
+    }
+    unsigned first = i;
+    while (i < count && i - first < 128 &&
+           !(i + 2 < count && span[i] == span[i + 1] &&
+             span[i] == span[i + 2])) {
+      ++i;
+    }
+    *out++ = (u8)(i - first - 1);
+    memcpy(out, span + first, i - first);
+    out += i - first;
+  }
+  return out - start;
+}
+
+}  // namespace
+
+FrameCoder::FrameCoder()
+    : previous_(new u8[kMaxWidth * kMaxHeight]), width_(0), height_(0),
+      pixels_(0), frame_(0), key_(false), start_(0), frameAt_(0), out_(0),
+      line_(0), spans_(0) {
+  memset(palette_, 0, sizeof palette_);
+}
+
+FrameCoder::~FrameCoder() { delete[] previous_; }
+
+void FrameCoder::Put16(u8 *bytes, unsigned value) {
+  bytes[0] = (u8)value;
+  bytes[1] = (u8)(value >> 8);
+}
+
+void FrameCoder::Put32(u8 *bytes, u32 value) {
+  Put16(bytes, value & 0xffff);
+  Put16(bytes + 2, value >> 16);
+}
+
+void FrameCoder::PutHeader(u8 *bytes, unsigned type, unsigned length) {
+  bytes[0] = (u8)type;
+  bytes[1] = 0;
+  Put16(bytes + 2, 0);
+  Put32(bytes + 4, length);
+}
+
+void FrameCoder::Begin(const u8 *pixels, unsigned width, unsigned height,
+                       const u16 *palette565, u32 frame, bool key, u8 *out) {
+  key_ = key || width != width_ || height != height_;
+  pixels_ = pixels;
+  frame_ = frame;
+  start_ = out;
+  out_ = out;
+
+  if (key_ || memcmp(palette_, palette565, sizeof palette_) != 0) {
+    memcpy(palette_, palette565, sizeof palette_);
+    PutHeader(out_, kFrameCoderPalette, 4 + kPaletteSize * 3);
+    u8 *body = out_ + kHeaderSize;
+    Put16(body, kPaletteSize);
+    Put16(body + 2, 0);
+    for (unsigned index = 0; index < kPaletteSize; ++index) {
+      unsigned rgb = palette_[index];
+      u8 *entry = body + 4 + index * 3;
+      entry[0] = (u8)((rgb >> 11) * 255 / 31);
+      entry[1] = (u8)(((rgb >> 5) & 0x3f) * 255 / 63);
+      entry[2] = (u8)((rgb & 0x1f) * 255 / 31);
+    }
+    out_ += kHeaderSize + 4 + kPaletteSize * 3;
+  }
+
+  frameAt_ = out_;
+  out_ += kHeaderSize + 12;
+  line_ = 0;
+  spans_ = 0;
+  width_ = width;
+  height_ = height;
+}
+
+bool FrameCoder::Continue(unsigned rows) {
+  unsigned last = line_ + rows < height_ ? line_ + rows : height_;
+  for (; line_ < last; ++line_) {
+    const u8 *row = pixels_ + line_ * width_;
+    u8 *previous = previous_ + line_ * width_;
+    unsigned first = 0;
+    unsigned end = width_;
+    if (!key_) {
+      if (memcmp(row, previous, width_) == 0) {
+        continue;
+      }
+      // Only the span between the first and last changed pixel.
+      while (row[first] == previous[first]) {
+        ++first;
+      }
+      while (row[end - 1] == previous[end - 1]) {
+        --end;
+      }
+    }
+    memcpy(previous + first, row + first, end - first);
+    unsigned length = EncodeSpan(row + first, end - first, out_ + 8);
+    Put16(out_, line_);
+    Put16(out_ + 2, first);
+    Put16(out_ + 4, end - first);
+    Put16(out_ + 6, length);
+    out_ += 8 + length;
+    ++spans_;
+  }
+  if (line_ < height_) {
+    return false;
+  }
+
+  u8 *body = frameAt_ + kHeaderSize;
+  Put32(body, frame_);
+  Put16(body + 4, width_);
+  Put16(body + 6, height_);
+  Put16(body + 8, spans_);
+  body[10] = key_ ? kKeyFrame : 0;
+  body[11] = 0;
+  PutHeader(frameAt_, kFrameCoderFrame, out_ - body);
+  return true;
+}
@@ -0,0 +1,70 @@
+#ifndef FRAMECODER_H
+#define FRAMECODER_H
+
+#include <circle/types.h>
+
+// Codes indexed frames as the palette and frame messages of the frame
+// stream (tools/FRAME_STREAM.md): rows that did not change since the
+// last frame are left out and the changed span of the others is run
+// length coded. Also the message header both the stream and the A/V
+// capture use. Not thread safe; one coder belongs to one encoder.
+
+enum FrameCoderMessage {
+  kFrameCoderPalette = 0x01,
+  kFrameCoderFrame = 0x02,
+};
+
+class FrameCoder {
+public:
+  // Big enough for the VDC with its borders.
+  static const unsigned kMaxWidth = 1024;
+  static const unsigned kMaxHeight = 320;
+  static const unsigned kPaletteSize = 256;
+  static const unsigned kHeaderSize = 8;
+  // A palette message, and a frame whose rows all grew by the worst
+  // case of the run length code.
+  static const unsigned kMaxBytes =
+      kHeaderSize + 4 + kPaletteSize * 3 + kHeaderSize + 12 +
+      kMaxHeight * (8 + kMaxWidth + kMaxWidth / 128 + 1);
+
+  FrameCoder();
+  ~FrameCoder();
+
+  // Starts coding frame into out, which has room for kMaxBytes, with a
+  // palette message first if the palette changed. key sends every row;
+  // so does the first frame and a change of size. pixels and palette
+  // must stay put until Continue returns true.
+  void Begin(const u8 *pixels, unsigned width, unsigned height,
+             const u16 *palette565, u32 frame, bool key, u8 *out);
+
+  // Codes up to rows more rows. True when the frame is done.
+  bool Continue(unsigned rows);
+
+  // The bytes written to out, once Continue returned true.
+  unsigned Length() const { return out_ - start_; }
+  bool KeyFrame() const { return key_; }
+
+  // The next frame is a key frame.
+  void Reset() { width_ = 0; }
+
+  static void Put16(u8 *bytes, unsigned value);
+  static void Put32(u8 *bytes, u32 value);
+  static void PutHeader(u8 *bytes, unsigned type, unsigned length);
+
+private:
+  u8 *previous_;
+  unsigned width_;
+  unsigned height_;
+  u16 palette_[kPaletteSize];
+
+  const u8 *pixels_;
+  u32 frame_;
+  bool key_;
+  u8 *start_;
+  u8 *frameAt_;
+  u8 *out_;
+  unsigned line_;
+  unsigned spans_;
+};
+
+#endif
@@ -14,6 +14,8 @@
 // limitations under the License.
 
 #include "kernel.h"
+#include "bmccapture.h"
+#include "bmcstream.h"
 
 #include <errno.h>
 #include <math.h>
@@ -218,6 +220,10 @@ void circle_set_src_rect_fbl(int layer, int x, int y, int w, int h) {
   static_kernel->circle_set_src_rect_fbl(layer, x,y,w,h);
 }
 
+void circle_set_line_doubling_fbl(int layer, int enable, int dark_lines) {
+  static_kernel->circle_set_line_doubling_fbl(layer, enable, dark_lines);
+}
+
 void circle_set_valign_fbl(int layer, int align, int padding) {
   static_kernel->circle_set_valign_fbl(layer, align, padding);
 }
@@ -1301,6 +1307,7 @@ int CKernel::circle_sound_init(const char *param, int *speed, int *fragsize,
   *fragsize = FRAG_SIZE;
   *fragnr = NUM_FRAGS;
   mNumSoundChannels = *channels;
+  CaptureSetSoundFormat(SAMPLE_RATE, mNumSoundChannels);
 
   // NOTE: We init sound after boot is complete to avoid an initial
   // sound sync issue if a cartridge is attached. But if it's already
@@ -1314,6 +1321,7 @@ int CKernel::circle_sound_init(const char *param, int *speed, int *fragsize,
 
 // Called from VICE: Core 1
 int CKernel::circle_sound_write(int16_t *pbuf, size_t nr) {
+  CaptureAudio(pbuf, nr);
   if (mViceSound) {
     return mViceSound->AddChunk(pbuf, nr);
   }
@@ -1739,6 +1747,26 @@ void CKernel::circle_hide_fbl(int layer) {
 }
 
 void CKernel::circle_frames_ready_fbl(int layer1, int layer2, int sync) {
+  // Emulated frames only, from whichever of the VIC and VDC is showing.
+  // Both ask every frame since both count frames.
+  bool stream = layer1 == FB_LAYER_VIC && FrameStreamWanted();
+  bool capture = layer1 == FB_LAYER_VIC && CaptureWanted();
+  if (stream || capture) {
+    int source = fbl[layer1].Showing() || layer2 < 0 ? layer1 : layer2;
+    const uint8_t *pixels;
+    const uint16_t *palette;
+    int pitch, x, y, w, h;
+    if (fbl[source].GetIndexedSource(&pixels, &pitch, &x, &y, &w, &h,
+                                     &palette)) {
+      if (stream) {
+        FrameStreamCapture(pixels, pitch, x, y, w, h, palette);
+      }
+      if (capture) {
+        CaptureFrame(pixels, pitch, x, y, w, h, palette);
+      }
+    }
+  }
+
   // If we're going to sync to vblank, indicate this frame data should go
   // to the offscreen resource.
   fbl[layer1].FrameReady(sync);
@@ -1774,6 +1802,11 @@ void CKernel::circle_set_src_rect_fbl(int layer, int x, int y, int w, int h) {
   fbl[layer].SetSrcRect(x,y,w,h);
 }
 
+void CKernel::circle_set_line_doubling_fbl(int layer, int enable,
+                                           int dark_lines) {
+  fbl[layer].SetLineDoubling(enable, dark_lines);
+}
+
 void CKernel::circle_set_valign_fbl(int layer, int align, int padding) {
   fbl[layer].SetVerticalAlignment(align, padding);
 }
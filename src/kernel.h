@@ -86,6 +86,7 @@ public:
   void circle_set_stretch_fbl(int layer, double hstretch, double vstretch, int hintstr, int vintstr, int use_hintstr, int use_vintstr);
   void circle_set_center_offset(int layer, int cx, int cy);
   void circle_set_src_rect_fbl(int layer, int x, int y, int w, int h);
+  void circle_set_line_doubling_fbl(int layer, int enable, int dark_lines);
   void circle_set_valign_fbl(int layer, int align, int padding);
   void circle_set_halign_fbl(int layer, int align, int padding);
   void circle_set_padding_fbl(int layer, double lpad, double rpad, double tpad, double bpad);
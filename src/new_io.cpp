@@ -19,9 +19,18 @@ extern int errno;
 #include <stdio.h>
 #include <sys/unistd.h>
 #include <circle/serial.h>
+#include <circle/multicore.h>
+#include <circle/sched/scheduler.h>
+#include "bmclog.h"
+#include "bmcnetdisk.h"
+#include "bmcsave.h"
+
+extern "C" {
+#include "../third_party/common/circle.h"
+}
 
 struct _CIRCLE_DIR {
-  _CIRCLE_DIR() : mFirstRead(0), mOpen(0) {
+  _CIRCLE_DIR() : mFirstRead(0), mOpen(0), mNetDir(-1) {
     mEntry.d_ino = 0;
     mEntry.d_name[0] = 0;
   }
@@ -30,6 +39,7 @@ struct _CIRCLE_DIR {
   struct dirent mEntry;
   unsigned int mFirstRead : 1;
   unsigned int mOpen : 1;
+  int mNetDir; // NetDiskOpenDir handle for NET: directories, else -1
 };
 
 // This is a replacement io.cpp specifically for BMC64.
@@ -59,6 +69,14 @@ struct _CIRCLE_DIR {
 // current file size is not.  Call to fstat on a file in WRTE_ONLY
 // mode will not work as expected.
 //
+// A file marked with circle_save_begin is not written at close. Its
+// buffer and fatfs file go to bmcsave.cpp, which writes them in the
+// background; opening or removing that path waits until it has.
+//
+// Paths on the NET: volume are not in fatfs at all. Those files are
+// read and written through bmcnetdisk.cpp, which keeps its own block
+// cache, so they are never loaded into ram here.
+//
 // When a file is opened for READ_WRITE, fat fs is used to
 // immediately load the contents of the existing file into RAM,
 // while retaining the read/write FatFs handle. Reads and seeks use
@@ -192,6 +210,8 @@ struct CircleFile {
   int mode; // remembers mode this file was opened under
   int written_to; // at least one write was performed on this file
   int fopen_called; // f_open was called and thus f_close needs to be called
+  int on_net; // file is on the NET: volume and net_file is its handle
+  int net_file;
 };
 
 struct CircleDir {
@@ -213,6 +233,7 @@ PARTITION VolToPart[FF_VOLUMES];
 
 void CGlueStdioInit(CSerialDevice *serial) {
   g_serial = serial;
+  LogInit(serial);
 
   if (g_serial) {
     setvbuf(stdout, nullptr, _IOLBF, 0);
@@ -235,6 +256,32 @@ void CGlueStdioInit(CSerialDevice *serial) {
   strcpy (currentDir, "/");
 }
 
+static int g_fatFsBusy = 0;
+
+void CGlueFatFsLock(void) {
+  while (__atomic_exchange_n(&g_fatFsBusy, 1, __ATOMIC_ACQUIRE)) {
+#ifdef ARM_ALLOW_MULTI_CORE
+    // Only core 0 has tasks; the holder may be one of them.
+    if (CMultiCoreSupport::ThisCore() == 0) {
+      CScheduler::Get()->Yield();
+    }
+#else
+    CScheduler::Get()->Yield();
+#endif
+  }
+}
+
+void CGlueFatFsUnlock(void) {
+  __atomic_store_n(&g_fatFsBusy, 0, __ATOMIC_RELEASE);
+}
+
+// Holds the FatFs lock for a scope.
+class FatFsGuard {
+public:
+  FatFsGuard() { CGlueFatFsLock(); }
+  ~FatFsGuard() { CGlueFatFsUnlock(); }
+};
+
 static int g_bootStatNum = 0;
 static int *g_bootStatWhat;
 static const char **g_bootStatFile;
@@ -374,6 +421,34 @@ extern "C" int _open(char *file, int flags, int mode) {
     CirclePath circlePath(file);
     CircleFile &newFile = fileTab[slot];
 
+    if (NetDiskIsPath(circlePath.path)) {
+      // Images are opened to be read or updated, never created.
+      if (masked_flags == O_WRONLY) {
+        errno = EACCES;
+        return -1;
+      }
+      int net_file = NetDiskOpen(circlePath.path, masked_flags == O_RDWR);
+      if (net_file < 0) {
+        errno = -net_file;
+        return -1;
+      }
+      newFile.on_net = 1;
+      newFile.net_file = net_file;
+      newFile.fopen_called = 0;
+      newFile.contents = nullptr;
+      newFile.position = 0;
+      newFile.size = NetDiskSize(net_file);
+      newFile.allocated = 0;
+      newFile.mode = masked_flags;
+      newFile.written_to = 0;
+      strcpy(newFile.fname, circlePath.path);
+      newFile.in_use = 1;
+      return slot;
+    }
+
+    SaveWaitFor(circlePath.path);
+
+    FatFsGuard guard;
     int result;
     if (masked_flags == O_RDONLY) {
       result = f_open(&newFile.file, circlePath.path, FA_READ);
@@ -427,6 +502,14 @@ extern "C" int _close(int fildes) {
     return -1;
   }
 
+  if (file.contents && file.mode == O_WRONLY && file.fopen_called &&
+      SaveTakeFile(file.fname, &file.file, file.contents, file.size)) {
+    // The save writer owns the buffer and the open file now.
+    file.contents = nullptr;
+    file.fopen_called = 0;
+  }
+
+  FatFsGuard guard;
     if (file.contents) {
       if (file.mode == O_WRONLY) {
         // Dump contents of memory buffer to actual file.
@@ -439,6 +522,7 @@ extern "C" int _close(int fildes) {
   }
 
   int need_close = file.fopen_called;
+  int net_result = file.on_net ? NetDiskClose(file.net_file) : 0;
 
   file.allocated = 0;
   file.size = 0;
@@ -446,6 +530,7 @@ extern "C" int _close(int fildes) {
   file.in_use = 0;
   file.written_to = 0;
   file.fopen_called = 0;
+  file.on_net = 0;
   file.fname[0] = '\0';
 
   if (file.contents) {
@@ -458,6 +543,11 @@ extern "C" int _close(int fildes) {
     return -1;
   }
 
+  if (net_result < 0) {
+    errno = -net_result;
+    return -1;
+  }
+
   return 0;
 }
 
@@ -468,11 +558,21 @@ extern "C" int fsync(int fildes) {
   }
 
   CircleFile &file = fileTab[fildes];
+  if (file.in_use && file.on_net) {
+    int result = NetDiskSync(file.net_file);
+    if (result < 0) {
+      errno = -result;
+      return -1;
+    }
+    return 0;
+  }
+
   if (!file.in_use || !file.fopen_called) {
     errno = EBADF;
     return -1;
   }
 
+  FatFsGuard guard;
   if (f_sync(&file.file) != FR_OK) {
     errno = EIO;
     return -1;
@@ -493,12 +593,23 @@ extern "C" int _read(int fildes, char *ptr, int len) {
     return -1;
   }
 
+  if (file.on_net) {
+    int num_read = NetDiskRead(file.net_file, file.position, ptr, len);
+    if (num_read < 0) {
+      errno = -num_read;
+      return -1;
+    }
+    file.position += num_read;
+    return num_read;
+  }
+
   unsigned int num_read;
   if (file.contents == nullptr) {
      // Assert file.FIL has been opened
      // else EBADF -1
 
      // Read data from the file
+     FatFsGuard guard;
      if (f_read(&file.file, ptr, len, &num_read) != FR_OK) {
        errno = EIO;
        return -1;
@@ -530,10 +641,10 @@ extern "C" int _write(int fildes, char *ptr, int len) {
   }
 
   if (fildes == 1 || fildes == 2) {
-    if (g_serial) {
-       return g_serial->Write(ptr, len);
-    } 
-    return len;
+    // Queued for the log task; never waits for the UART.
+    return LogWrite(CIRCLE_LOG_BMC64,
+                    fildes == 2 ? CIRCLE_LOG_ERRORS : CIRCLE_LOG_ALL, ptr,
+                    len);
   }
 
   CircleFile &file = fileTab[fildes];
@@ -542,6 +653,17 @@ extern "C" int _write(int fildes, char *ptr, int len) {
     return -1;
   }
 
+  if (file.on_net) {
+    int num_written = NetDiskWrite(file.net_file, file.position, ptr, len);
+    if (num_written < 0) {
+      errno = -num_written;
+      return -1;
+    }
+    file.written_to = 1;
+    file.position += num_written;
+    return num_written;
+  }
+
   // Keep the RAM cache coherent with the on-disk image.
   file.written_to = 1;
 
@@ -569,6 +691,7 @@ extern "C" int _write(int fildes, char *ptr, int len) {
 
   if (file.mode == O_RDWR) {
      unsigned int num_written = 0;
+     FatFsGuard guard;
      if (f_lseek(&file.file, write_position) != FR_OK ||
          f_write(&file.file, ptr, len, &num_written) != FR_OK ||
          num_written != static_cast<unsigned int>(len)) {
@@ -647,6 +770,21 @@ extern "C" DIR *opendir(const char *name) {
   }
 
   CircleDir &slot = dirTab[slotNum];
+  if (NetDiskIsPath(circlePath.path)) {
+    int net_dir = NetDiskOpenDir(circlePath.path);
+    if (net_dir < 0) {
+      errno = -net_dir;
+      return 0;
+    }
+    slot.dir.mNetDir = net_dir;
+    slot.dir.mOpen = 1;
+    slot.dir.mFirstRead = 1;
+    slot.in_use = 1;
+    return &slot.dir;
+  }
+
+  slot.dir.mNetDir = -1;
+  FatFsGuard guard;
   if (f_opendir(&slot.dir.mCurrentEntry, circlePath.path) != FR_OK) {
     errno = ENFILE;
     return 0;
@@ -670,9 +808,25 @@ static bool read_next_entry(FATFS_DIR *currentEntry, FILINFO *filinfo) {
 static struct dirent *do_readdir(DIR *dir, struct dirent *de) {
   assert(dir->mOpen);
 
+  if (dir->mNetDir >= 0) {
+    if (dir->mFirstRead) {
+      NetDiskRewindDir(dir->mNetDir);
+      dir->mFirstRead = 0;
+    }
+    const char *name = NetDiskReadDir(dir->mNetDir);
+    if (name == nullptr) {
+      return nullptr;
+    }
+    strncpy(de->d_name, name, sizeof(de->d_name) - 1);
+    de->d_name[sizeof(de->d_name) - 1] = '\0';
+    de->d_ino = 0;
+    return de;
+  }
+
   FILINFO fno;
   bool haveEntry;
   struct dirent *result = nullptr;
+  FatFsGuard guard;
 
   if (dir->mFirstRead) {
     if (f_readdir(&dir->mCurrentEntry, nullptr) == FR_OK) {
@@ -748,6 +902,13 @@ extern "C" int closedir(DIR *dir) {
   c_dir->in_use = 0;
   dir->mOpen = 0;
 
+  if (dir->mNetDir >= 0) {
+    NetDiskCloseDir(dir->mNetDir);
+    dir->mNetDir = -1;
+    return 0;
+  }
+
+  FatFsGuard guard;
   if (f_closedir(&dir->mCurrentEntry) != FR_OK) {
     errno = EIO;
     return -1;
@@ -777,7 +938,25 @@ extern "C" int _stat(const char *file, struct stat *st) {
      }
   }
 
+  if (NetDiskIsPath(circlePath.path)) {
+    bool directory;
+    unsigned size;
+    bool writable;
+    int result = NetDiskStat(circlePath.path, &directory, &size, &writable);
+    if (result < 0) {
+      errno = -result;
+      return -1;
+    }
+    st->st_mode = (directory ? S_IFDIR : S_IFREG) | S_IRUSR;
+    if (writable) {
+      st->st_mode |= S_IWUSR;
+    }
+    st->st_size = size;
+    return 0;
+  }
+
   FILINFO fno;
+  FatFsGuard guard;
   if (f_stat(circlePath.path, &fno) == FR_OK) {
     if (fno.fattrib & AM_DIR) {
       st->st_mode |= S_IFDIR;
@@ -806,6 +985,17 @@ extern "C" int _fstat(int fildes, struct stat *st) {
     return -1;
   }
 
+  if (file.on_net) {
+    // The size came with the open; no need to ask the server again.
+    memset(st, 0, sizeof(struct stat));
+    st->st_mode = S_IFREG | S_IRUSR;
+    if (file.mode == O_RDWR) {
+      st->st_mode |= S_IWUSR;
+    }
+    st->st_size = file.size;
+    return 0;
+  }
+
   return _stat(file.fname, st);
 }
 
@@ -822,8 +1012,9 @@ extern "C" int _lseek(int fildes, int ptr, int dir) {
     return -1;
   }
 
-  if (file.mode == O_RDONLY) {
+  if (file.mode == O_RDONLY && !file.on_net) {
     // Assert FIL has been opened
+    FatFsGuard guard;
     if (slurp_file(file)) {
        errno = EACCES;
        return -1;
@@ -928,6 +1119,9 @@ extern "C" int access(const char *fn, int flags)
 }
 
 extern "C" int _link(char *existing, char *newname) {
+  SaveWaitFor(existing);
+  SaveWaitFor(newname);
+  FatFsGuard guard;
   int result = f_rename(existing, newname);
   if (result != FR_OK) {
      if (result == FR_EXIST) errno = EEXIST;
@@ -938,6 +1132,8 @@ extern "C" int _link(char *existing, char *newname) {
 }
 
 extern "C" int _unlink(char *name) {
+  SaveWaitFor(name);
+  FatFsGuard guard;
   f_unlink(name);
   return 0;
 }
@@ -72,12 +72,20 @@ void Plus4EmulatorCore::Run(unsigned nCore) {
     RunMainPlus4(true);
     break;
   case 2:
-    // Core 2 will initialize 6581 filter data. Then sleep.
+    // Core 2 will initialize 6581 filter data. Then decode video
+    // lines for the emulator core.
     ComputeResidFilter(0);
+#ifdef ARM_ALLOW_MULTI_CORE
+    emu_video_helper_loop();
+#endif
     break;
   case 3:
-    // Core 3 will initialize 8580 filter data. Then sleep.
+    // Core 3 will initialize 8580 filter data. Then take over sound
+    // synthesis for the emulator core.
     ComputeResidFilter(1);
+#ifdef ARM_ALLOW_MULTI_CORE
+    emu_sound_helper_loop();
+#endif
     break;
   }
 
@@ -0,0 +1,174 @@
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <string.h>
+
+// Lock free rings between one producer and one consumer, for handing
+// work between the emulation core and a task or another core. The
+// producer only stores write_ and the consumer only stores read_. The
+// indices run freely and are masked on use, so Size must be a power of
+// two.
+
+// A ring of items, copied in and out, that can also be written and read
+// a run at a time.
+template <typename T, unsigned Size> class SpscRing {
+public:
+  SpscRing() : read_(0), write_(0) {}
+
+  // Producer side.
+  bool Push(const T &item) {
+    unsigned write = __atomic_load_n(&write_, __ATOMIC_RELAXED);
+    if (write - __atomic_load_n(&read_, __ATOMIC_ACQUIRE) == Size) {
+      return false;
+    }
+    items_[write & (Size - 1)] = item;
+    __atomic_store_n(&write_, write + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // Copies as many items as fit, in at most two pieces around the end
+  // of the ring, and returns how many that was.
+  unsigned Write(const T *items, unsigned count) {
+    unsigned write = __atomic_load_n(&write_, __ATOMIC_RELAXED);
+    unsigned free = Size - (write - __atomic_load_n(&read_, __ATOMIC_ACQUIRE));
+    if (count > free) {
+      count = free;
+    }
+    unsigned index = write & (Size - 1);
+    unsigned first = Size - index < count ? Size - index : count;
+    memcpy(items_ + index, items, first * sizeof(T));
+    memcpy(items_, items + first, (count - first) * sizeof(T));
+    __atomic_store_n(&write_, write + count, __ATOMIC_RELEASE);
+    return count;
+  }
+
+  unsigned Free() const { return Size - Used(); }
+
+  unsigned WritePosition() const {
+    return __atomic_load_n(&write_, __ATOMIC_RELAXED);
+  }
+
+  // Consumer side.
+  bool Peek(T *item) const {
+    unsigned read = __atomic_load_n(&read_, __ATOMIC_RELAXED);
+    if (read == __atomic_load_n(&write_, __ATOMIC_ACQUIRE)) {
+      return false;
+    }
+    *item = items_[read & (Size - 1)];
+    return true;
+  }
+
+  bool Pop(T *item) {
+    if (!Peek(item)) {
+      return false;
+    }
+    __atomic_store_n(&read_, read_ + 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  // The items that can be read without wrapping, to be passed on in
+  // place and then released with Consume.
+  unsigned Contiguous(const T **items) const {
+    unsigned read = __atomic_load_n(&read_, __ATOMIC_RELAXED);
+    unsigned used = __atomic_load_n(&write_, __ATOMIC_ACQUIRE) - read;
+    unsigned index = read & (Size - 1);
+    *items = items_ + index;
+    return Size - index < used ? Size - index : used;
+  }
+
+  void Consume(unsigned count) {
+    __atomic_store_n(&read_, read_ + count, __ATOMIC_RELEASE);
+  }
+
+  unsigned ReadPosition() const {
+    return __atomic_load_n(&read_, __ATOMIC_RELAXED);
+  }
+
+  // Drops everything the producer wrote before position.
+  void DiscardTo(unsigned position) {
+    __atomic_store_n(&read_, position, __ATOMIC_RELEASE);
+  }
+
+  // Either side.
+  unsigned Used() const {
+    return __atomic_load_n(&write_, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&read_, __ATOMIC_ACQUIRE);
+  }
+
+private:
+  T items_[Size];
+  unsigned read_;
+  unsigned write_;
+};
+
+
+// A ring of fixed slots. The producer fills the slot Reserve hands out
+// and Commit publishes it; the consumer reads Front in place and Release
+// frees it. The producer may also walk the slots still published, from
+// First to Last, and the consumer may read ahead of Front with Peek.
+template <typename Slot, unsigned Size> class SlotRing {
+public:
+  SlotRing() : read_(0), write_(0) {}
+
+  Slot *At(unsigned index) { return &slots_[index & (Size - 1)]; }
+
+  // Producer side.
+  Slot *Reserve() {
+    unsigned write = __atomic_load_n(&write_, __ATOMIC_RELAXED);
+    if (write - __atomic_load_n(&read_, __ATOMIC_ACQUIRE) == Size) {
+      return 0;
+    }
+    return &slots_[write & (Size - 1)];
+  }
+
+  void Commit() {
+    __atomic_store_n(&write_, write_ + 1, __ATOMIC_RELEASE);
+  }
+
+  unsigned First() const { return __atomic_load_n(&read_, __ATOMIC_ACQUIRE); }
+  unsigned Last() const { return write_; }
+
+  // Consumer side.
+  Slot *Front() {
+    unsigned read = __atomic_load_n(&read_, __ATOMIC_RELAXED);
+    if (read == __atomic_load_n(&write_, __ATOMIC_ACQUIRE)) {
+      return 0;
+    }
+    return &slots_[read & (Size - 1)];
+  }
+
+  void Release() {
+    __atomic_store_n(&read_, read_ + 1, __ATOMIC_RELEASE);
+  }
+
+  // The slots published and not yet released. Peek returns the one
+  // ahead places past Front, for ahead below Count.
+  unsigned Count() const {
+    return __atomic_load_n(&write_, __ATOMIC_ACQUIRE) -
+           __atomic_load_n(&read_, __ATOMIC_RELAXED);
+  }
+
+  Slot *Peek(unsigned ahead) {
+    return &slots_[(__atomic_load_n(&read_, __ATOMIC_RELAXED) + ahead) &
+                   (Size - 1)];
+  }
+
+  // Drops every slot published so far.
+  void Clear() {
+    __atomic_store_n(&read_, __atomic_load_n(&write_, __ATOMIC_ACQUIRE),
+                     __ATOMIC_RELEASE);
+  }
+
+  // Either side.
+  bool Empty() const {
+    return __atomic_load_n(&read_, __ATOMIC_ACQUIRE) ==
+           __atomic_load_n(&write_, __ATOMIC_ACQUIRE);
+  }
+
+private:
+  Slot slots_[Size];
+  unsigned read_;
+  unsigned write_;
+};
+
+#endif
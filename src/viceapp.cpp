@@ -16,6 +16,12 @@
 #include "viceapp.h"
 #include "vice_network.h"
 #include "network_time_sync.h"
+#include "bmccapture.h"
+#include "bmclog.h"
+#include "bmcsave.h"
+#include "bmcmonitor.h"
+#include "bmcnetdisk.h"
+#include "bmcstream.h"
 #include "../third_party/common/circle.h"
 #include "fbl.h"
 
@@ -51,6 +57,7 @@ bool ViceApp::Initialize(void) {
   // a pointer to our serial device so we can use printf
   // to serial as soon as possible.
   CGlueStdioInit(mViceOptions.SerialEnabled() ? &mSerial : nullptr);
+  LogSetLevels(mViceOptions.GetLogLevels());
 
   if (!mInterrupt.Initialize()) {
     return false;
@@ -520,6 +527,10 @@ void ViceStdioApp::InitializeNetwork() {
     } else {
       ViceNetworkSetSubsystem(mNet);
       StartNetworkTimeSync(mNet);
+      StartRemoteMonitor(mNet, mViceOptions.GetRemoteMonitorPort());
+      StartNetDisk(mNet, mViceOptions.GetNetDiskServer());
+      StartFrameStream(mNet, mViceOptions.GetFrameStreamPort(),
+                       mViceOptions.GetFrameStreamDivider());
       SetNetworkStatus(CIRCLE_NETWORK_ETHERNET_WAITING_FOR_DHCP);
       mLogger.Write(GetKernelName(), LogNotice, "Networking: Ethernet initialized");
     }
@@ -586,6 +597,10 @@ void ViceStdioApp::InitializeNetwork() {
   }
   ViceNetworkSetSubsystem(mNet);
   StartNetworkTimeSync(mNet);
+  StartRemoteMonitor(mNet, mViceOptions.GetRemoteMonitorPort());
+  StartNetDisk(mNet, mViceOptions.GetNetDiskServer());
+  StartFrameStream(mNet, mViceOptions.GetFrameStreamPort(),
+                   mViceOptions.GetFrameStreamDivider());
   SetNetworkStatus(CIRCLE_NETWORK_WIFI_WPA_INITIALIZING);
   mLogger.Write(GetKernelName(), LogNotice, "Networking: Wi-Fi initialized");
 
@@ -771,6 +786,10 @@ bool ViceStdioApp::Initialize(void) {
     mLogger.Write(GetKernelName(), LogWarning, "Cannot configure timezone");
   }
   InitializeNetwork();
+  StartCapture();
+  StartSaveWriter();
+  // Serial output is written straight out until here.
+  StartLogWriter();
 
   // Now that emmc is initialized, launch
   // the emulator main loop on CORE 1 before USBHCII.
@@ -828,6 +847,8 @@ void ViceStdioApp::circle_find_usb(int (*usb)[3]) {
 
 int ViceStdioApp::circle_mount_usb(int usb) {
   int status;
+  // The capture writer may be using FatFs on core 0.
+  CGlueFatFsLock();
   switch (usb) {
      case 0:
        status = f_mount(&mFileSystemUSB1, "USB:", 1);
@@ -838,8 +859,11 @@ int ViceStdioApp::circle_mount_usb(int usb) {
      case 2:
        status = f_mount(&mFileSystemUSB1, "USB3:", 1);
        break;
-     default: return 0;
+     default:
+       CGlueFatFsUnlock();
+       return 0;
   }
+  CGlueFatFsUnlock();
 
   if (status != FR_OK) {
     mLogger.Write(GetKernelName(), LogError, "Cannot mount usb %d", usb);
@@ -851,6 +875,8 @@ int ViceStdioApp::circle_mount_usb(int usb) {
 
 int ViceStdioApp::circle_unmount_usb(int usb) {
   int status;
+  // The capture writer may be using FatFs on core 0.
+  CGlueFatFsLock();
   switch (usb) {
      case 0:
        status = f_mount(0, "USB:", 1);
@@ -861,8 +887,11 @@ int ViceStdioApp::circle_unmount_usb(int usb) {
      case 2:
        status = f_mount(0, "USB3:", 1);
        break;
-     default: return 0;
+     default:
+       CGlueFatFsUnlock();
+       return 0;
   }
+  CGlueFatFsUnlock();
 
   if (status != FR_OK) {
     mLogger.Write(GetKernelName(), LogError, "Cannot unmount usb %d", usb);
@@ -19,19 +19,35 @@
 #include <stdio.h>
 #include <string.h>
 
+#include "bmccapture.h"
+#include "bmcstream.h"
 #include "defs.h"
+#include "fbl.h"
 
 extern "C" {
 #include "../third_party/vice-3.3/src/main.h"
 #include "../third_party/common/semaphore.h"
 
 extern void circle_kernel_core_init_complete(int core);
+#ifdef RASPI_C128
+extern int vdc_draw_helper_poll(void);
+#endif
 }
 
 #include "../third_party/vice-3.3/src/sid/sid.h"
 #include "../third_party/vice-3.3/src/resid/sid.h"
 #include "../third_party/vice-3.3/src/resid/filter.h"
 
+// Idle work for core 3.
+static int helper_poll(void) {
+  int done = FrameStreamHelperPoll();
+  done += CaptureHelperPoll();
+#ifdef RASPI_C128
+  done += vdc_draw_helper_poll();
+#endif
+  return done;
+}
+
 ViceEmulatorCore::ViceEmulatorCore(CMemorySystem *pMemorySystem,
                                    int cyclesPerSecond) :
 #ifdef ARM_ALLOW_MULTI_CORE
@@ -93,32 +109,25 @@ void ViceEmulatorCore::RunMainVice(bool wait) {
   printf("Starting emulator main loop\n");
 
 #if defined(RASPI_C64)
-  int argc = 9;
+  int argc = 8;
   char *argv[] = {
       (char *)"vice", timing_option_, (char *)"-sounddev", (char *)"raspi",
       (char *)"-soundsync", (char *)"0",
       (char *)"-refresh", (char *)"1",
-      // Unless we disable the video cache, vsync is messed up
-      (char *)"+VICIIvcache",
   };
 #elif defined(RASPI_C128)
-  int argc = 12;
+  int argc = 10;
   char *argv[] = {
       (char *)"vice", timing_option_, (char *)"-sounddev", (char *)"raspi",
       (char *)"-soundoutput", (char *)"1", (char *)"-soundsync", (char *)"0",
       (char *)"-refresh", (char *)"1",
-      // Unless we disable the video cache, vsync is messed up
-      (char *)"+VICIIvcache",
-      (char *)"+VDCvcache",
   };
 #elif defined(RASPI_VIC20)
-  int argc = 11;
+  int argc = 10;
   char *argv[] = {
       (char *)"vice", timing_option_, (char *)"-sounddev", (char *)"raspi",
       (char *)"-soundoutput", (char *)"1", (char *)"-soundsync", (char *)"0",
       (char *)"-refresh", (char *)"1",
-      // Unless we disable the video cache, vsync is messed up
-      (char *)"+VICvcache",
   };
 #elif defined(RASPI_PLUS4)
   int argc = 11;
@@ -126,16 +135,15 @@ void ViceEmulatorCore::RunMainVice(bool wait) {
       (char *)"vice", timing_option_, (char *)"-sounddev", (char *)"raspi",
       (char *)"-soundoutput", (char *)"1", (char *)"-soundsync", (char *)"0",
       (char *)"-refresh", (char *)"1",
-      // Unless we disable the video cache, vsync is messed up
+      // VICE's TED cache does not work (off by default in VICE too)
       (char *)"+TEDvcache",
   };
 #elif defined(RASPI_PET)
-  int argc = 11;
+  int argc = 10;
   char *argv[] = {
       (char *)"vice", timing_option_, (char *)"-sounddev", (char *)"raspi",
       (char *)"-soundoutput", (char *)"1", (char *)"-soundsync", (char *)"0",
       (char *)"-refresh", (char *)"1",
-      (char *)"+CRTCvcache",
   };
 #else
 #error "RASPI_[model] NOT DEFINED"
@@ -205,6 +213,14 @@ void ViceEmulatorCore::Run(unsigned nCore) {
      }
   }
 
+#ifdef ARM_ALLOW_MULTI_CORE
+  if (nCore == 3) {
+     // Core 3 has nothing else to do. Share software CRT rendering,
+     // encode streamed frames and, on the C128, draw VDC lines.
+     FrameBufferLayer::SoftCrtHelper(helper_poll);
+  }
+#endif
+
 #ifdef ARM_ALLOW_MULTI_CORE
   printf("Core %d idle\n", nCore);
   asm("dsb\n\t"
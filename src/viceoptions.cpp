@@ -38,7 +38,9 @@ ViceOptions::ViceOptions(void)
       m_audioOut(VCHIQSoundDestinationAuto), m_bDPIEnabled(false),
       m_scaling_param_fbw{0,0}, m_scaling_param_fbh{0,0},
       m_scaling_param_sx{0,0}, m_scaling_param_sy{0,0},
-      m_raster_skip(false), m_raster_skip2(false) {
+      m_raster_skip(false), m_raster_skip2(false),
+      m_nRemoteMonitorPort(0), m_nFrameStreamPort(0),
+      m_nFrameStreamDivider(2) {
   s_pThis = this;
 
   CBcmPropertyTags Tags;
@@ -57,6 +59,8 @@ ViceOptions::ViceOptions(void)
   // Set the default volume we mount for fatfs
   m_disk_partition = 0; // this tells fatfs 'auto'
   strcpy(m_disk_volume, "SD");
+  m_netdisk_server[0] = '\0';
+  m_log_levels[0] = '\0';
 
   char *pOption;
   while ((pOption = GetToken()) != 0) {
@@ -153,6 +157,27 @@ ViceOptions::ViceOptions(void)
       } else {
         m_raster_skip2 = false;
       }
+    } else if (strcmp(pOption, "remote_monitor") == 0) {
+      unsigned nPort = GetDecimal(pValue);
+      if (nPort != INVALID_VALUE && nPort <= 65535) {
+        m_nRemoteMonitorPort = nPort;
+      }
+    } else if (strcmp(pOption, "netdisk") == 0) {
+      strncpy(m_netdisk_server, pValue, sizeof m_netdisk_server - 1);
+      m_netdisk_server[sizeof m_netdisk_server - 1] = '\0';
+    } else if (strcmp(pOption, "frame_stream") == 0) {
+      unsigned nPort = GetDecimal(pValue);
+      if (nPort != INVALID_VALUE && nPort <= 65535) {
+        m_nFrameStreamPort = nPort;
+      }
+    } else if (strcmp(pOption, "frame_stream_divider") == 0) {
+      unsigned nDivider = GetDecimal(pValue);
+      if (nDivider != INVALID_VALUE && nDivider >= 1 && nDivider <= 50) {
+        m_nFrameStreamDivider = nDivider;
+      }
+    } else if (strcmp(pOption, "log_levels") == 0) {
+      strncpy(m_log_levels, pValue, sizeof m_log_levels - 1);
+      m_log_levels[sizeof m_log_levels - 1] = '\0';
     }
   }
 
@@ -211,6 +236,24 @@ void ViceOptions::GetScalingParams(int display, int *fbw, int *fbh, int *sx, int
 bool ViceOptions::GetRasterSkip(void) const { return m_raster_skip; }
 bool ViceOptions::GetRasterSkip2(void) const { return m_raster_skip2; }
 
+unsigned ViceOptions::GetRemoteMonitorPort(void) const {
+  return m_nRemoteMonitorPort;
+}
+
+const char *ViceOptions::GetNetDiskServer(void) const {
+  return m_netdisk_server;
+}
+
+unsigned ViceOptions::GetFrameStreamPort(void) const {
+  return m_nFrameStreamPort;
+}
+
+unsigned ViceOptions::GetFrameStreamDivider(void) const {
+  return m_nFrameStreamDivider;
+}
+
+const char *ViceOptions::GetLogLevels(void) const { return m_log_levels; }
+
 const char *ViceOptions::GetDiskVolume(void) const { return m_disk_volume; }
 
 unsigned long ViceOptions::GetCyclesPerSecond(void) const {
@@ -39,6 +39,11 @@ public:
   void GetScalingParams(int display, int *fbw, int *fbh, int *sx, int *sy) const;
   bool GetRasterSkip(void) const;
   bool GetRasterSkip2(void) const;
+  unsigned GetRemoteMonitorPort(void) const; // 0 when off
+  const char *GetNetDiskServer(void) const; // host:port, empty when off
+  unsigned GetFrameStreamPort(void) const; // 0 when off
+  unsigned GetFrameStreamDivider(void) const; // send every n'th frame
+  const char *GetLogLevels(void) const; // "drives:errors,video:off"
 
   static ViceOptions *Get(void);
 
@@ -71,6 +76,11 @@ private:
   int m_scaling_param_sy[2];
   bool m_raster_skip;
   bool m_raster_skip2; // for VDC
+  unsigned m_nRemoteMonitorPort;
+  char m_netdisk_server[64];
+  unsigned m_nFrameStreamPort;
+  unsigned m_nFrameStreamDivider;
+  char m_log_levels[128];
 
   static ViceOptions *s_pThis;
 };
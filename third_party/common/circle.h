@@ -66,6 +66,11 @@
 #define FB_LAYER_STATUS 2
 #define FB_LAYER_UI     3
 
+// Values for circle_realloc_fbl's shader arg. Must match fbl.h
+#define FB_SHADER_NONE 0
+#define FB_SHADER_GL   1
+#define FB_SHADER_SOFT 2
+
 #define USB_PREF_ANALOG 0
 #define USB_PREF_HAT 1
 #define USB_PREF_HAT_AND_PADDLES 2
@@ -258,6 +263,8 @@ extern void circle_set_palette32_fbl(int layer, uint8_t index, uint32_t argb);
 extern void circle_update_palette_fbl(int layer);
 extern void circle_set_stretch_fbl(int layer, double hstretch, double vstretch, int hintstr, int vintstr, int use_hintstr, int use_vintstr);
 extern void circle_set_src_rect_fbl(int layer, int x, int y, int w, int h);
+extern void circle_set_line_doubling_fbl(int layer, int enable,
+                                        int dark_lines);
 extern void circle_set_center_offset(int layer, int cx, int cy);
 extern void circle_set_valign_fbl(int layer, int align, int padding);
 extern void circle_set_halign_fbl(int layer, int align, int padding);
@@ -271,6 +278,43 @@ extern void circle_boot_complete();
 extern void circle_find_usb(int (*usb)[3]);
 extern int circle_mount_usb(int usb);
 extern int circle_unmount_usb(int usb);
+extern int circle_netdisk_available(void);
+// Records picture and sound to the next free captureNNN.bmv in dir.
+// Returns NNN, or -1 if a capture is still being written or the file
+// cannot be created.
+extern int circle_capture_start(const char *dir, double fps);
+extern void circle_capture_stop(void);
+extern int circle_capture_active(void);
+// The next close of path, as the emulator opened it to write, leaves
+// the file to be written to the card in the background. Until
+// circle_save_end.
+extern void circle_save_begin(const char *path);
+extern void circle_save_end(void);
+// Percent of the background saves written so far, or -1 when none is
+// waiting.
+extern int circle_save_progress(void);
+
+// Serial log. Each subsystem shows messages up to its level.
+#define CIRCLE_LOG_BMC64 0      // stdout and stderr outside VICE's log
+#define CIRCLE_LOG_EMULATOR 1   // VICE's log, unless one below
+#define CIRCLE_LOG_DRIVES 2
+#define CIRCLE_LOG_VIDEO 3
+#define CIRCLE_LOG_SOUND 4
+#define CIRCLE_LOG_NETWORK 5
+#define CIRCLE_LOG_SUBSYSTEMS 6
+
+#define CIRCLE_LOG_OFF 0
+#define CIRCLE_LOG_ERRORS 1
+#define CIRCLE_LOG_WARNINGS 2
+#define CIRCLE_LOG_ALL 3
+
+extern const char *circle_log_subsystem_name(int subsystem);
+extern int circle_log_get_level(int subsystem);
+extern void circle_log_set_level(int subsystem, int level);
+// For VICE's log: whether a message of the named log is shown, level
+// 0 message, 1 warning, 2 error as VICE counts them, and the line.
+extern int circle_log_wanted(const char *name, unsigned int level);
+extern void circle_log_line(const char *prefix, const char *text);
 extern void circle_set_volume(int value);
 extern int circle_get_model();
 extern unsigned circle_get_arm_clock();
@@ -29,6 +29,7 @@
 #include <assert.h>
 
 #include "circle.h"
+#include "input_record.h"
 #include "overlay.h"
 #include "menu.h"
 #include "menu_timing.h"
@@ -58,42 +59,92 @@ int vdc_showing;
 int vic_enabled = 1;
 int vdc_enabled;
 
-// Ring buffer for key latch events
-struct pending_emu_key_s pending_emu_key;
-
-// Ring buffer for joy latch events
-struct pending_emu_joy_s pending_emu_joy;
+// Ring buffer for key and joy latch events
+struct input_queue pending_emu_input;
 
 struct CanvasState canvas_state[2];
 
+// Dropped events reported so far. Main loop only.
+static uint32_t input_overflow_reported;
+
+static void queue_input_event(struct input_event *event) {
+  event->timestamp = circle_get_ticks();
+  input_queue_push(&pending_emu_input, event);
+}
+
 // queue a key for press/release for the main loop
 void emux_key_interrupt(long key, int pressed) {
-  circle_lock_acquire();
-  int i = pending_emu_key.tail & 0xf;
-  pending_emu_key.key[i] = key;
-  pending_emu_key.pressed[i] = pressed;
-  pending_emu_key.tail++;
-  circle_lock_release();
+  struct input_event event = {0};
+  event.type = INPUT_EVENT_KEY;
+  event.source = INPUT_SOURCE_KEYBOARD;
+  event.key = key;
+  event.value = pressed;
+  queue_input_event(&event);
 }
 
-// Same as above except can call while already holding the lock
+// Same as above except can call while already holding the lock.
+// The queue takes no lock so this only differs by its source.
 void emux_key_interrupt_locked(long key, int pressed) {
-  int i = pending_emu_key.tail & 0xf;
-  pending_emu_key.key[i] = key;
-  pending_emu_key.pressed[i] = pressed;
-  pending_emu_key.tail++;
+  struct input_event event = {0};
+  event.type = INPUT_EVENT_KEY;
+  event.source = INPUT_SOURCE_VKBD;
+  event.key = key;
+  event.value = pressed;
+  queue_input_event(&event);
 }
 
 // Queue a joy latch change for the main loop
 void emux_joy_interrupt(int type, int port, int device, int value) {
-  circle_lock_acquire();
-  int i = pending_emu_joy.tail & 0x7f;
-  pending_emu_joy.type[i] = type;
-  pending_emu_joy.port[i] = port;
-  pending_emu_joy.device[i] = device;
-  pending_emu_joy.value[i] = value;
-  pending_emu_joy.tail++;
-  circle_lock_release();
+  struct input_event event = {0};
+  event.type = INPUT_EVENT_JOY;
+  event.source = INPUT_SOURCE_JOYSTICK;
+  event.joy_type = type;
+  event.port = port;
+  event.device = device;
+  event.value = value;
+  queue_input_event(&event);
+}
+
+// Queue mouse motion for the main loop
+void emux_mouse_move_interrupt(int dx, int dy) {
+  struct input_event event = {0};
+  event.type = INPUT_EVENT_MOUSE_MOVE;
+  event.source = INPUT_SOURCE_MOUSE;
+  event.dx = dx;
+  event.dy = dy;
+  queue_input_event(&event);
+}
+
+// Queue a mouse button change for the main loop
+void emux_mouse_button_interrupt(int button, int pressed) {
+  struct input_event event = {0};
+  event.type = INPUT_EVENT_MOUSE_BUTTON;
+  event.source = INPUT_SOURCE_MOUSE;
+  event.key = button;
+  event.value = pressed;
+  queue_input_event(&event);
+}
+
+int emux_next_input_event(struct input_event *event) {
+  if (input_queue_pop(&pending_emu_input, event)) {
+    if (input_record_active()) {
+      input_record_event(event);
+    }
+    return 1;
+  }
+  // Drained, so this frame's input is complete.
+  if (input_record_active()) {
+    input_record_end_frame();
+  }
+  // Drained. Producers may be in an ISR so we report drops from here.
+  uint32_t dropped = input_queue_overflow(&pending_emu_input);
+  if (dropped != input_overflow_reported) {
+    printf("Input queue full, %u events dropped (high water %u)\n",
+           (unsigned)dropped,
+           (unsigned)input_queue_high_water(&pending_emu_input));
+    input_overflow_reported = dropped;
+  }
+  return 0;
 }
 
 // This makes sure we are showing what the enable flags say we should
@@ -299,3 +350,9 @@ int is_composite() {
 int allow_shader() {
   return circle_get_model() <= 3 && !is_composite();
 }
+
+// When the GL shader is not allowed, CRT effects are rendered on
+// the CPU instead.
+int crt_shader_mode() {
+  return allow_shader() ? FB_SHADER_GL : FB_SHADER_SOFT;
+}
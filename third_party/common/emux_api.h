@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <stdint.h>
 
+#include "input_queue.h"
 #include "ui.h"
 
 extern const uint8_t ascii_to_petscii[256];
@@ -46,6 +47,11 @@ typedef enum {
   BMC64_MACHINE_CLASS_PET,
 } BMC64MachineClass;
 
+typedef enum {
+  EMUX_TYPEIN_TOKENIZE,
+  EMUX_TYPEIN_KEYBOARD,
+} EmuxTypeInMode;
+
 typedef enum {
   EMUX_TAPE_STOP,
   EMUX_TAPE_PLAY,
@@ -103,24 +109,9 @@ typedef enum {
 #define PENDING_EMU_JOY_TYPE_AND 1
 #define PENDING_EMU_JOY_TYPE_OR 2
 
-struct pending_emu_key_s {
-  int head;
-  int tail;
-  long key[16];
-  int pressed[16];
-};
-
-struct pending_emu_joy_s {
-  int head;
-  int tail;
-  int value[128];
-  int port[128];
-  int type[128];
-  int device[128];
-};
-
-extern struct pending_emu_key_s pending_emu_key;
-extern struct pending_emu_joy_s pending_emu_joy;
+// All key, joy latch and mouse events for the emulator main loop. Drained
+// once per frame with emux_next_input_event.
+extern struct input_queue pending_emu_input;
 
 typedef char*(*fullpath_func)(DirType dir_type, char *name);
 
@@ -295,6 +286,19 @@ void emux_display_tape_motor_status(int motor);
 // Autostart a file
 int emux_autostart_file(char* filename);
 
+// Enter a BASIC listing from a text file. EMUX_TYPEIN_TOKENIZE puts
+// the program straight into memory, EMUX_TYPEIN_KEYBOARD types it
+// through the keyboard buffer in warp. Return negative on error.
+int emux_type_text_file(char* filename, int mode);
+
+// Write the attached images and the settings a replay needs to the
+// input recording being started, ahead of its reset.
+void emux_record_machine_state(void);
+
+// Restore a setting from an input recording. Return negative if this
+// emulator does not know it.
+int emux_apply_recorded_setting(const char* name, int value);
+
 // Show change model menu
 void emux_drive_change_model(int unit);
 
@@ -364,6 +368,16 @@ void emux_joy_interrupt(int type, int port, int device, int value);
 void emux_key_interrupt(long key, int pressed);
 void emux_key_interrupt_locked(long key, int pressed);
 
+// Queue mouse motion or a button (INPUT_MOUSE_*) change
+// Safe to call from ISR
+void emux_mouse_move_interrupt(int dx, int dy);
+void emux_mouse_button_interrupt(int button, int pressed);
+
+// Pop the next queued key, joy or mouse event. Emulator main loop only.
+// Returns 0 when there is nothing left to drain, which happens once per
+// frame.
+int emux_next_input_event(struct input_event *event);
+
 vkbd_key_array emux_get_vkbd(void);
 int emux_get_vkbd_width(void);
 int emux_get_vkbd_height(void);
@@ -416,6 +430,7 @@ void emux_get_default_color_setting(int *brightness, int *contrast, int *gamma,
 int is_ntsc();
 int is_composite();
 int allow_shader();
+int crt_shader_mode();
 
 void emux_add_userport_joys(struct menu_item* parent);
 
@@ -0,0 +1,103 @@
+/*
+ * input_queue.c - lock free queue for input events
+ *
+ * Written by
+ *  Randy Rossi <randy.rossi@gmail.com>
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "input_queue.h"
+
+#define INPUT_QUEUE_MASK (INPUT_QUEUE_SIZE - 1)
+
+// Each slot carries a sequence number. For position pos, let lap be
+// pos with the index bits cleared. A producer may only claim the slot
+// when seq == lap. Once the event is written, seq becomes lap + 1 which
+// tells the consumer it is ready. After the consumer copies the event
+// out, seq becomes lap + INPUT_QUEUE_SIZE so the slot can be claimed
+// again on the next lap around the ring. A zero filled queue is a valid
+// empty queue. A producer interrupted between claiming and publishing
+// only holds up the consumer until it finishes; it never blocks other
+// producers.
+
+int input_queue_push(struct input_queue *q, const struct input_event *event) {
+  struct input_queue_slot *slot;
+  uint32_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+
+  for (;;) {
+    slot = &q->slots[pos & INPUT_QUEUE_MASK];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+    int32_t diff = (int32_t)(seq - (pos & ~INPUT_QUEUE_MASK));
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        break;
+      }
+      // pos was reloaded by the failed exchange
+    } else if (diff < 0) {
+      // Consumer has not freed this slot yet. Full.
+      __atomic_fetch_add(&q->overflow, 1, __ATOMIC_RELAXED);
+      return -1;
+    } else {
+      pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    }
+  }
+
+  slot->event = *event;
+  __atomic_store_n(&slot->seq, (pos & ~INPUT_QUEUE_MASK) + 1,
+                   __ATOMIC_RELEASE);
+
+  uint32_t pending = pos + 1 - __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+  uint32_t high = __atomic_load_n(&q->high_water, __ATOMIC_RELAXED);
+  while (pending > high) {
+    if (__atomic_compare_exchange_n(&q->high_water, &high, pending, 1,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+      break;
+    }
+  }
+  return 0;
+}
+
+int input_queue_pop(struct input_queue *q, struct input_event *event) {
+  uint32_t pos = q->head;
+  struct input_queue_slot *slot = &q->slots[pos & INPUT_QUEUE_MASK];
+
+  uint32_t lap = pos & ~INPUT_QUEUE_MASK;
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != lap + 1) {
+    return 0;
+  }
+
+  *event = slot->event;
+  // head moves first so a producer that sees the slot free also sees
+  // the new head and never counts more than the ring holds as pending.
+  __atomic_store_n(&q->head, pos + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&slot->seq, lap + INPUT_QUEUE_SIZE, __ATOMIC_RELEASE);
+  return 1;
+}
+
+uint32_t input_queue_overflow(struct input_queue *q) {
+  return __atomic_load_n(&q->overflow, __ATOMIC_RELAXED);
+}
+
+uint32_t input_queue_high_water(struct input_queue *q) {
+  return __atomic_load_n(&q->high_water, __ATOMIC_RELAXED);
+}
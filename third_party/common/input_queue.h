@@ -0,0 +1,108 @@
+/*
+ * input_queue.h - lock free queue for input events
+ *
+ * Written by
+ *  Randy Rossi <randy.rossi@gmail.com>
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef RASPI_INPUT_QUEUE_H
+#define RASPI_INPUT_QUEUE_H
+
+#include <stdint.h>
+
+// Bounded multi producer, single consumer ring of input events. USB
+// handlers, GPIO scanning and the UI push from any core or from IRQ
+// context. Only the emulator main loop pops. Nothing here takes a lock
+// so producers never wait on the emulator draining the queue. When the
+// ring is full, the event is dropped and counted. A zero initialized
+// struct input_queue is empty and ready to use.
+
+// Must be a power of 2
+#define INPUT_QUEUE_SIZE 512
+
+// Event types
+#define INPUT_EVENT_KEY 0
+#define INPUT_EVENT_JOY 1
+#define INPUT_EVENT_MOUSE_MOVE 2
+#define INPUT_EVENT_MOUSE_BUTTON 3
+
+// Where an event came from
+#define INPUT_SOURCE_KEYBOARD 0
+#define INPUT_SOURCE_VKBD 1
+#define INPUT_SOURCE_JOYSTICK 2
+#define INPUT_SOURCE_MOUSE 3
+
+// Mouse buttons
+#define INPUT_MOUSE_LEFT 0
+#define INPUT_MOUSE_RIGHT 1
+#define INPUT_MOUSE_MIDDLE 2
+#define INPUT_MOUSE_WHEEL_UP 3
+#define INPUT_MOUSE_WHEEL_DOWN 4
+
+struct input_event {
+  // circle_get_ticks() at the time the event was queued
+  uint32_t timestamp;
+  uint8_t type;
+  uint8_t source;
+  // PENDING_EMU_JOY_TYPE_* for joy events
+  uint8_t joy_type;
+  // Joy port for joy events (indexed from 1)
+  uint8_t port;
+  // JOYDEV_* for joy events
+  int device;
+  // Keycode for key events, INPUT_MOUSE_* for mouse button events
+  long key;
+  // Pressed state for key and mouse button events, latch value for joy
+  // events
+  int value;
+  // Motion for mouse move events
+  int16_t dx;
+  int16_t dy;
+};
+
+struct input_queue_slot {
+  uint32_t seq;
+  struct input_event event;
+};
+
+struct input_queue {
+  uint32_t tail;
+  uint32_t head;
+  // Number of events dropped because the ring was full
+  uint32_t overflow;
+  // Most events ever seen waiting in the ring
+  uint32_t high_water;
+  struct input_queue_slot slots[INPUT_QUEUE_SIZE];
+};
+
+// Safe to call from any core or ISR. Returns 0 on success, -1 if
+// the ring was full and the event was dropped.
+int input_queue_push(struct input_queue *q, const struct input_event *event);
+
+// Consumer side only. Returns 1 if an event was copied to event,
+// 0 if the queue is empty.
+int input_queue_pop(struct input_queue *q, struct input_event *event);
+
+uint32_t input_queue_overflow(struct input_queue *q);
+uint32_t input_queue_high_water(struct input_queue *q);
+
+#endif
@@ -0,0 +1,287 @@
+/*
+ * input_record.c - record and replay of emulator input
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "input_record.h"
+
+#include <string.h>
+
+static const char magic[4] = {'B', 'M', 'C', 'I'};
+
+static FILE *record_fp;
+static uint32_t record_frame;
+static uint32_t record_last_frame;
+
+static void record_failed(void) {
+  printf("Input recording write failed, stopping\n");
+  fclose(record_fp);
+  record_fp = NULL;
+}
+
+static void put_byte(int b) {
+  if (record_fp && fputc(b, record_fp) == EOF) {
+    record_failed();
+  }
+}
+
+static void put_varint(uint32_t v) {
+  while (v >= 0x80) {
+    put_byte((v & 0x7f) | 0x80);
+    v >>= 7;
+  }
+  put_byte(v);
+}
+
+static uint32_t zigzag(int v) {
+  return v < 0 ? ((uint32_t)(-(v + 1)) << 1) | 1 : (uint32_t)v << 1;
+}
+
+static int unzigzag(uint32_t v) {
+  return v & 1 ? -(int)(v >> 1) - 1 : (int)(v >> 1);
+}
+
+static void put_header(int type) {
+  put_byte(type);
+  put_varint(record_frame - record_last_frame);
+  record_last_frame = record_frame;
+}
+
+int input_record_start(const char *path, int machine_class) {
+  input_record_stop();
+
+  record_fp = fopen(path, "wb");
+  if (!record_fp) {
+    return -1;
+  }
+  record_frame = 0;
+  record_last_frame = 0;
+
+  if (fwrite(magic, 1, sizeof(magic), record_fp) != sizeof(magic)) {
+    record_failed();
+    return -1;
+  }
+  put_byte(INPUT_RECORD_VERSION);
+  put_byte(machine_class);
+  put_byte(0);
+  put_byte(0);
+  return record_fp ? 0 : -1;
+}
+
+void input_record_stop(void) {
+  if (!record_fp) {
+    return;
+  }
+  put_header(INPUT_RECORD_END);
+  if (record_fp) {
+    fclose(record_fp);
+    record_fp = NULL;
+  }
+}
+
+int input_record_active(void) {
+  return record_fp != NULL;
+}
+
+void input_record_event(const struct input_event *event) {
+  put_header(event->type);
+  switch (event->type) {
+  case INPUT_EVENT_KEY:
+    put_varint(event->key);
+    put_byte(event->value);
+    put_byte(event->source);
+    break;
+  case INPUT_EVENT_JOY:
+    put_byte(event->joy_type);
+    put_byte(event->port);
+    put_byte(event->device);
+    put_varint(event->value);
+    break;
+  case INPUT_EVENT_MOUSE_MOVE:
+    put_varint(zigzag(event->dx));
+    put_varint(zigzag(event->dy));
+    break;
+  case INPUT_EVENT_MOUSE_BUTTON:
+    put_byte(event->key);
+    put_byte(event->value);
+    break;
+  }
+}
+
+static void put_string(const char *str) {
+  size_t len = strlen(str);
+  if (len >= INPUT_RECORD_MAX_PATH) {
+    len = INPUT_RECORD_MAX_PATH - 1;
+  }
+  put_varint(len);
+  if (record_fp && fwrite(str, 1, len, record_fp) != len) {
+    record_failed();
+  }
+}
+
+void input_record_attach(int kind, int unit, const char *path) {
+  if (!record_fp) {
+    return;
+  }
+  put_header(INPUT_RECORD_ATTACH);
+  put_byte(kind);
+  put_byte(unit);
+  put_string(path);
+}
+
+void input_record_setting(const char *name, int value) {
+  if (!record_fp) {
+    return;
+  }
+  put_header(INPUT_RECORD_SETTING);
+  put_varint(zigzag(value));
+  put_string(name);
+}
+
+void input_record_reset(void) {
+  if (!record_fp) {
+    return;
+  }
+  put_header(INPUT_RECORD_RESET);
+}
+
+void input_record_end_frame(void) {
+  record_frame++;
+}
+
+static int get_varint(FILE *fp, uint32_t *v) {
+  int shift = 0, b;
+  *v = 0;
+  do {
+    if ((b = fgetc(fp)) == EOF || shift > 28) {
+      return -1;
+    }
+    *v |= (uint32_t)(b & 0x7f) << shift;
+    shift += 7;
+  } while (b & 0x80);
+  return 0;
+}
+
+static int get_string(FILE *fp, char *str) {
+  uint32_t len;
+  if (get_varint(fp, &len) || len >= INPUT_RECORD_MAX_PATH ||
+      fread(str, 1, len, fp) != len) {
+    return -1;
+  }
+  str[len] = '\0';
+  return 0;
+}
+
+int input_replay_open(struct input_replay *replay, const char *path) {
+  char header[8];
+
+  memset(replay, 0, sizeof(*replay));
+  replay->fp = fopen(path, "rb");
+  if (!replay->fp) {
+    return -1;
+  }
+  if (fread(header, 1, sizeof(header), replay->fp) != sizeof(header) ||
+      memcmp(header, magic, sizeof(magic)) || header[4] < 1 ||
+      header[4] > INPUT_RECORD_VERSION) {
+    input_replay_close(replay);
+    return -1;
+  }
+  replay->version = header[4];
+  replay->machine_class = header[5];
+  return 0;
+}
+
+int input_replay_next(struct input_replay *replay,
+                      struct input_record_entry *entry) {
+  FILE *fp = replay->fp;
+  uint32_t delta, a, b;
+  int type;
+
+  if (!fp || (type = fgetc(fp)) == EOF || get_varint(fp, &delta)) {
+    return 0;
+  }
+  memset(entry, 0, sizeof(*entry));
+  replay->frame += delta;
+  entry->frame = replay->frame;
+  entry->type = type;
+  entry->event.type = type;
+
+  switch (type) {
+  case INPUT_EVENT_KEY:
+    if (get_varint(fp, &a)) {
+      return 0;
+    }
+    entry->event.key = a;
+    entry->event.value = fgetc(fp);
+    entry->event.source = fgetc(fp);
+    break;
+  case INPUT_EVENT_JOY:
+    entry->event.source = INPUT_SOURCE_JOYSTICK;
+    entry->event.joy_type = fgetc(fp);
+    entry->event.port = fgetc(fp);
+    entry->event.device = fgetc(fp);
+    if (get_varint(fp, &a)) {
+      return 0;
+    }
+    entry->event.value = a;
+    break;
+  case INPUT_EVENT_MOUSE_MOVE:
+    if (get_varint(fp, &a) || get_varint(fp, &b)) {
+      return 0;
+    }
+    entry->event.source = INPUT_SOURCE_MOUSE;
+    entry->event.dx = unzigzag(a);
+    entry->event.dy = unzigzag(b);
+    break;
+  case INPUT_EVENT_MOUSE_BUTTON:
+    entry->event.source = INPUT_SOURCE_MOUSE;
+    entry->event.key = fgetc(fp);
+    entry->event.value = fgetc(fp);
+    break;
+  case INPUT_RECORD_ATTACH:
+    entry->kind = fgetc(fp);
+    entry->unit = fgetc(fp);
+    if (get_string(fp, entry->path)) {
+      return 0;
+    }
+    break;
+  case INPUT_RECORD_SETTING:
+    if (get_varint(fp, &a) || get_string(fp, entry->path)) {
+      return 0;
+    }
+    entry->value = unzigzag(a);
+    break;
+  case INPUT_RECORD_END:
+  case INPUT_RECORD_RESET:
+    break;
+  default:
+    // Unknown record, the rest of the file can't be parsed.
+    return 0;
+  }
+  return !feof(fp);
+}
+
+void input_replay_close(struct input_replay *replay) {
+  if (replay->fp) {
+    fclose(replay->fp);
+    replay->fp = NULL;
+  }
+}
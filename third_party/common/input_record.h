@@ -0,0 +1,120 @@
+/*
+ * input_record.h - record and replay of emulator input
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef RASPI_INPUT_RECORD_H
+#define RASPI_INPUT_RECORD_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "input_queue.h"
+
+// Records every input event the emulator main loop drains, stamped
+// with the frame it was applied on, plus image attaches made from the
+// menu. Frames are counted from the start of the recording, which
+// begins with a hard reset, so a replay that starts from the same
+// reset feeds the machine the same input at the same points.
+//
+// The recording opens with the machine as it was before that reset:
+// the settings a replay needs and the images attached, then a reset
+// record. A replay restores them and resets before its first frame.
+//
+// File layout (all multi byte values are LEB128 varints):
+//   "BMCI" version(1) machine_class(1) reserved(2)
+//   then records of: type(1) frames_since_last_record payload
+//
+//   INPUT_EVENT_KEY           key pressed(1) source(1)
+//   INPUT_EVENT_JOY           joy_type(1) port(1) device(1) value
+//   INPUT_EVENT_MOUSE_MOVE    dx dy (zigzag)
+//   INPUT_EVENT_MOUSE_BUTTON  button(1) pressed(1)
+//   INPUT_RECORD_ATTACH       kind(1) unit(1) length path
+//   INPUT_RECORD_END          (none) marks the frame recording stopped
+//   INPUT_RECORD_SETTING      value (zigzag) length name
+//   INPUT_RECORD_RESET        (none) the hard reset that starts frame 0
+//
+// Version 1 files have no settings and no reset record.
+
+#define INPUT_RECORD_VERSION 2
+
+// Record types beyond the INPUT_EVENT_* ones
+#define INPUT_RECORD_ATTACH 0x10
+#define INPUT_RECORD_END 0x11
+#define INPUT_RECORD_SETTING 0x12
+#define INPUT_RECORD_RESET 0x13
+
+// Attach kinds
+#define INPUT_RECORD_ATTACH_DISK 0
+#define INPUT_RECORD_ATTACH_TAPE 1
+#define INPUT_RECORD_ATTACH_CART 2
+#define INPUT_RECORD_AUTOSTART 3
+
+#define INPUT_RECORD_MAX_PATH 256
+
+struct input_record_entry {
+  // Frames since the recording started
+  uint32_t frame;
+  // INPUT_EVENT_* or INPUT_RECORD_*
+  int type;
+  // Key, joy and mouse records
+  struct input_event event;
+  // Attach records. unit is the drive unit or cart bank.
+  int kind;
+  int unit;
+  // The image, or for setting records the setting's name
+  char path[INPUT_RECORD_MAX_PATH];
+  // Setting records
+  int value;
+};
+
+struct input_replay {
+  FILE *fp;
+  int version;
+  int machine_class;
+  uint32_t frame;
+};
+
+// Start writing to path. Returns 0 on success.
+int input_record_start(const char *path, int machine_class);
+void input_record_stop(void);
+int input_record_active(void);
+
+// Main loop only
+void input_record_event(const struct input_event *event);
+void input_record_attach(int kind, int unit, const char *path);
+void input_record_end_frame(void);
+
+// The machine's state, between input_record_start and the reset.
+// Images go in with input_record_attach.
+void input_record_setting(const char *name, int value);
+void input_record_reset(void);
+
+// Returns 0 on success, -1 if the file is missing or not a recording.
+int input_replay_open(struct input_replay *replay, const char *path);
+
+// Returns 1 and fills entry with the next record, 0 at the end.
+int input_replay_next(struct input_replay *replay,
+                      struct input_record_entry *entry);
+
+void input_replay_close(struct input_replay *replay);
+
+#endif
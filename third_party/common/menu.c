@@ -37,6 +37,7 @@
 
 // RASPI Includes
 #include "emux_api.h"
+#include "input_record.h"
 #include "demo.h"
 #include "joy.h"
 #include "kbd.h"
@@ -306,6 +307,8 @@ struct menu_item *c40_80_column_item;
 struct menu_item *dir_convention_item;
 
 struct menu_item *scaling_interp_item;
+// NULL when the machine has no usable raster cache
+struct menu_item *video_cache_item;
 
 struct menu_item* s_enable_shader_item;
 struct menu_item* s_curvature_item;
@@ -838,6 +841,12 @@ static void filesystem_change_volume(struct menu_item *item) {
     item2->sub_id = MENU_SUB_CHANGE_VOLUME;
     item2->value = MENU_VOLUME_USB3;
   }
+  // Image server set with netdisk= in cmdline.txt
+  if (circle_netdisk_available()) {
+    item2 = ui_menu_add_button(item->id, vol_root, "NET");
+    item2->sub_id = MENU_SUB_CHANGE_VOLUME;
+    item2->value = MENU_VOLUME_NET;
+  }
 }
 
 static void drive_change_rom() {
@@ -1239,6 +1248,9 @@ static int save_settings() {
   fprintf(fp, "tapereset=%d\n", tape_reset_with_machine_item->value);
   fprintf(fp, "reset_confirm=%d\n", reset_confirm_item->value);
   fprintf(fp, "scaling_interp=%d\n", scaling_interp_item->value);
+  if (video_cache_item) {
+    fprintf(fp, "video_cache=%d\n", video_cache_item->value);
+  }
   fprintf(fp, "gpio_config=%d\n", gpio_config_item->choice_ints[gpio_config_item->value]);
   if (network_device_item != NULL) {
     fprintf(fp, "network_device=%d\n", network_device_item->value);
@@ -1508,6 +1520,10 @@ static void load_settings() {
       reset_confirm_item->value = value;
     } else if (strcmp(name, "scaling_interp") == 0) {
       scaling_interp_item->value = value;
+    } else if (strcmp(name, "video_cache") == 0) {
+      if (video_cache_item) {
+        video_cache_item->value = value;
+      }
     } else if (strcmp(name, "gpio_config") == 0) {
       // We save/restore the choice int and map back to
       // the value as index into the choices for this
@@ -1759,7 +1775,9 @@ void menu_swap_joysticks() {
 }
 
 static void attach_cart(int menu_id, struct menu_item *item) {
-  emux_attach_cart(menu_id, fullpath(DIR_CARTS, item->str_value));
+  char *path = fullpath(DIR_CARTS, item->str_value);
+  input_record_attach(INPUT_RECORD_ATTACH_CART, menu_id, path);
+  emux_attach_cart(menu_id, path);
 }
 
 // Reset current_dir_names according to preference.
@@ -1816,6 +1834,8 @@ static void select_file(struct menu_item *item) {
          ui_error("Failed to attach disk image");
 	 attached_disk_name[unit-8][0] = '\0';
        } else {
+         input_record_attach(INPUT_RECORD_ATTACH_DISK, unit,
+                             fullpath(DIR_DISKS, item->str_value));
          ui_pop_all_and_toggle();
 	 strcpy (attached_disk_name[unit-8], item->str_value);
        }
@@ -1837,6 +1857,8 @@ static void select_file(struct menu_item *item) {
          ui_pop_menu();
          ui_error("Failed to attach tape image");
        } else {
+         input_record_attach(INPUT_RECORD_ATTACH_TAPE, 1,
+                             fullpath(DIR_TAPES, item->str_value));
          ui_pop_all_and_toggle();
        }
        return;
@@ -1859,6 +1881,8 @@ static void select_file(struct menu_item *item) {
          ui_pop_menu();
          ui_error("Failed to autostart file");
        } else {
+         input_record_attach(INPUT_RECORD_AUTOSTART, 0,
+                             fullpath(DIR_ROOT, item->str_value));
          ui_pop_all_and_toggle();
        }
        return;
@@ -1867,6 +1891,21 @@ static void select_file(struct menu_item *item) {
        if (emux_autostart_file(fullpath(DIR_ROOT, item->str_value)) < 0) {
          ui_pop_menu();
          ui_error("Failed to load file");
+       } else {
+         input_record_attach(INPUT_RECORD_AUTOSTART, 0,
+                             fullpath(DIR_ROOT, item->str_value));
+         ui_pop_all_and_toggle();
+       }
+       return;
+     case MENU_TYPEIN_TOKENIZE_FILE:
+     case MENU_TYPEIN_KEYBOARD_FILE:
+       ui_info("Typing...");
+       if (emux_type_text_file(fullpath(DIR_ROOT, item->str_value),
+                               item->id == MENU_TYPEIN_TOKENIZE_FILE ?
+                                   EMUX_TYPEIN_TOKENIZE :
+                                   EMUX_TYPEIN_KEYBOARD) < 0) {
+         ui_pop_menu();
+         ui_error("Failed to type in file");
        } else {
          ui_pop_all_and_toggle();
        }
@@ -2037,6 +2076,8 @@ static int menu_file_item_to_dir_index(struct menu_item *item) {
     return DIR_ROMS;
   case MENU_AUTOSTART_FILE:
   case MENU_LOADPRG_FILE:
+  case MENU_TYPEIN_TOKENIZE_FILE:
+  case MENU_TYPEIN_KEYBOARD_FILE:
     return DIR_ROOT;
   case MENU_IEC_DIR:
     return DIR_IEC;
@@ -2134,6 +2175,10 @@ static void relist_files_after_dir_change(struct menu_item *item) {
   case MENU_LOADPRG_FILE:
     show_files(DIR_ROOT, FILTER_PRGS, item->id, 1);
     break;
+  case MENU_TYPEIN_TOKENIZE_FILE:
+  case MENU_TYPEIN_KEYBOARD_FILE:
+    show_files(DIR_ROOT, FILTER_NONE, item->id, 1);
+    break;
   case MENU_IEC_DIR:
     show_files(DIR_IEC, FILTER_DIRS, item->id, 1);
     break;
@@ -2513,6 +2558,11 @@ static void menu_value_changed(struct menu_item *item) {
     return;
   }
 
+  if (item->id >= MENU_LOG_LEVEL_0 && item->id <= MENU_LOG_LEVEL_5) {
+    circle_log_set_level(item->id - MENU_LOG_LEVEL_0, item->value);
+    return;
+  }
+
   switch (item->id) {
   case MENU_SAVE_SETTINGS:
     if (save_settings()) {
@@ -2538,6 +2588,12 @@ static void menu_value_changed(struct menu_item *item) {
   case MENU_LOADPRG:
     show_files(DIR_ROOT, FILTER_PRGS, MENU_LOADPRG_FILE, 0);
     return;
+  case MENU_TYPEIN_TOKENIZE:
+    show_files(DIR_ROOT, FILTER_NONE, MENU_TYPEIN_TOKENIZE_FILE, 0);
+    return;
+  case MENU_TYPEIN_KEYBOARD:
+    show_files(DIR_ROOT, FILTER_NONE, MENU_TYPEIN_KEYBOARD_FILE, 0);
+    return;
   case MENU_SAVE_SNAP:
     show_files(DIR_SNAPS, FILTER_SNAP, MENU_SAVE_SNAP_FILE, 0);
     return;
@@ -2905,6 +2961,38 @@ static void menu_value_changed(struct menu_item *item) {
     raspi_demo_mode = item->value;
     demo_reset();
     return;
+  case MENU_RECORD_INPUT:
+    if (!item->value) {
+      input_record_stop();
+      return;
+    }
+    if (input_record_start(fullpath(DIR_ROOT, "input.bmr"),
+                           emux_machine_class) < 0) {
+      item->value = 0;
+      ui_error("Could not create input.bmr");
+      return;
+    }
+    emux_record_machine_state();
+    input_record_reset();
+    menu_machine_reset(0 /* hard */, 1 /* pop */);
+    return;
+  case MENU_RECORD_AV:
+    if (!item->value) {
+      circle_capture_stop();
+      return;
+    }
+    if (circle_capture_active()) {
+      item->value = 0;
+      ui_error("Still writing the last recording");
+      return;
+    }
+    if (circle_capture_start(fullpath(DIR_ROOT, ""),
+                             emux_calculate_fps()) < 0) {
+      item->value = 0;
+      ui_error("Could not create capture file");
+      return;
+    }
+    return;
   case MENU_DRIVE_SOUND_EMULATION:
     emux_set_int(Setting_DriveSoundEmulation, item->value);
     return;
@@ -3236,9 +3324,9 @@ static void menu_value_changed(struct menu_item *item) {
   case MENU_SHADER_ENABLE:
     sanity_check_shader_params(item->id);
     ui_canvas_reveal_temp(FB_LAYER_VIC);
-    // Despite what the menu says, don't allow this to enable the shader
-    // when conditions apply.
-    circle_realloc_fbl(FB_LAYER_VIC, allow_shader() ? item->value : 0);
+    // Falls back to the software CRT when the GL shader is not allowed.
+    circle_realloc_fbl(FB_LAYER_VIC,
+                       item->value ? crt_shader_mode() : FB_SHADER_NONE);
     emux_set_int(Setting_VideoFilter, item->value ? MENU_VIDEO_FILTER_CRT : MENU_VIDEO_FILTER_NONE);
     handle_shader_param_change();
     vic_showing = 0;
@@ -3287,6 +3375,9 @@ static void menu_value_changed(struct menu_item *item) {
        }
     }
     break;
+  case MENU_VIDEO_CACHE:
+    emux_set_video_cache(item->value);
+    break;
   case MENU_SCALING_INTERPOLATION:
     ui_canvas_reveal_temp(FB_LAYER_VIC);
     circle_set_interpolation(item->value); // dispmanx interpolation
@@ -3327,6 +3418,9 @@ static void menu_value_changed(struct menu_item *item) {
            strcpy (current_volume_name, "USB3:");
            if (!usb3_mounted) { circle_mount_usb(2); usb3_mounted = 1; }
            break;
+       case MENU_VOLUME_NET:
+           strcpy (current_volume_name, "NET:");
+           break;
        default:
            break;
     }
@@ -3736,6 +3830,11 @@ void build_menu(struct menu_item *root) {
      break;
   }
 
+  if (emux_machine_class != BMC64_MACHINE_CLASS_PLUS4EMU) {
+     ui_menu_add_button(MENU_TYPEIN_TOKENIZE, root, "Type In Listing (Fast)...");
+     ui_menu_add_button(MENU_TYPEIN_KEYBOARD, root, "Type In Listing (Keyboard)...");
+  }
+
   machine_parent = ui_menu_add_folder(root, "Machine");
     emux_add_machine_options(machine_parent);
     menu_build_machine_switch(machine_parent);
@@ -3862,6 +3961,14 @@ void build_menu(struct menu_item *root) {
      MENU_SCALING_INTERPOLATION, parent,
         "Scaling Interpolation", 1, "Off", "On");
 
+  // Plus/4 TED cache is broken in VICE and Plus4Emu has none.
+  if (emux_machine_class != BMC64_MACHINE_CLASS_PLUS4 &&
+      emux_machine_class != BMC64_MACHINE_CLASS_PLUS4EMU) {
+     video_cache_item = ui_menu_add_toggle_labels(
+        MENU_VIDEO_CACHE, parent,
+           "Raster Line Cache", 1, "Off", "On");
+  }
+
   if (emux_machine_class == BMC64_MACHINE_CLASS_C128) {
      // For C128, we split video options under video into VICII
      // and VDC submenus since there are two displays.  Otherwise,
@@ -3907,10 +4014,8 @@ void build_menu(struct menu_item *root) {
            "Enable CRT Shader?", crt_filter != MENU_VIDEO_FILTER_NONE, "No", "Yes");
 
      if (!allow_shader()) {
-        s_enable_shader_item->value = 0;
-        s_enable_shader_item->disabled = 1;
-        strcpy (s_enable_shader_item->custom_toggle_label[0], "Disabled");
-        strcpy (s_enable_shader_item->custom_toggle_label[1], "Disabled");
+        // Software CRT. No curvature, sharper or bilinear.
+        strcpy (s_enable_shader_item->custom_toggle_label[1], "Yes (CPU)");
      }
 
      s_curvature_item =
@@ -4278,6 +4383,19 @@ void build_menu(struct menu_item *root) {
   reset_confirm_item = ui_menu_add_toggle(MENU_RESET_CONFIRM, parent,
                                           "Confirm Reset from Emulator", 1);
 
+  // Starts from log_levels= in cmdline.txt; not saved with the settings.
+  child = ui_menu_add_folder(parent, "Serial Log Levels");
+  for (i = 0; i < CIRCLE_LOG_SUBSYSTEMS; i++) {
+    struct menu_item *log_item = ui_menu_add_multiple_choice(
+        MENU_LOG_LEVEL_0 + i, child, (char *)circle_log_subsystem_name(i));
+    log_item->num_choices = 4;
+    log_item->value = circle_log_get_level(i);
+    strcpy(log_item->choices[CIRCLE_LOG_OFF], "Off");
+    strcpy(log_item->choices[CIRCLE_LOG_ERRORS], "Errors");
+    strcpy(log_item->choices[CIRCLE_LOG_WARNINGS], "Warnings");
+    strcpy(log_item->choices[CIRCLE_LOG_ALL], "All");
+  }
+
   char emu_folder[16];
   char folder_emu[16];
 
@@ -4302,6 +4420,10 @@ void build_menu(struct menu_item *root) {
   parent = ui_menu_add_folder(root, "Reset");
   ui_menu_add_button(MENU_SOFT_RESET, parent, "Soft Reset");
   ui_menu_add_button(MENU_HARD_RESET, parent, "Hard Reset");
+  ui_menu_add_toggle(MENU_RECORD_INPUT, parent,
+                     "Hard Reset and Record Input", 0);
+
+  ui_menu_add_toggle(MENU_RECORD_AV, root, "Record Video and Sound", 0);
 
   ui_menu_add_button(MENU_SAVE_SETTINGS, root, "Save settings");
 
@@ -4323,7 +4445,9 @@ void build_menu(struct menu_item *root) {
 
   // Apply shader params
   sanity_check_shader_params(s_enable_shader_item->id);
-  circle_realloc_fbl(FB_LAYER_VIC, allow_shader() ? s_enable_shader_item->value : 0);
+  circle_realloc_fbl(FB_LAYER_VIC,
+                     s_enable_shader_item->value ? crt_shader_mode() :
+                                                   FB_SHADER_NONE);
   handle_shader_param_change();
 
   set_current_dir_names();
@@ -4355,8 +4479,9 @@ void build_menu(struct menu_item *root) {
   if (emux_machine_class == BMC64_MACHINE_CLASS_C128) {
      do_video_settings(FB_LAYER_VDC);
   }
+  // Only the C128 has a 40/80 column key.
   overlay_init(statusbar_padding_item->value,
-               c40_80_column_item->value,
+               c40_80_column_item ? c40_80_column_item->value : 0,
                vkbd_transparency_item->value);
 
   emux_set_joy_pot_x(0, pot_x_high_value);
@@ -4364,7 +4489,7 @@ void build_menu(struct menu_item *root) {
   emux_set_joy_pot_y(0, pot_y_high_value);
   emux_set_joy_pot_y(1, pot_y_high_value);
 
-  emux_set_video_cache(0);
+  emux_set_video_cache(video_cache_item ? video_cache_item->value : 0);
   emux_set_hw_scale(0);
 
   // This can somehow get turned off. Make sure its always 1.
@@ -4629,6 +4754,11 @@ void emux_geometry_changed(int layer) {
 
 void emux_frame_buffer_changed(int layer) {
   int canvas_index = layer == FB_LAYER_VIC ? VIC_INDEX : VDC_INDEX;
+  // The first frame buffer is allocated by machine init, before the
+  // menu exists. build_menu applies the video settings once it does.
+  if (!use_scaling_params_item[canvas_index]) {
+     return;
+  }
   if (use_scaling_params_item[canvas_index]->value) {
      if (!do_use_int_scaling(layer, 1 /* silent */)) {
         use_scaling_params_item[canvas_index]->value = 0;
@@ -166,6 +166,10 @@ typedef enum {
 
    MENU_LOADPRG,
    MENU_LOADPRG_FILE,
+   MENU_TYPEIN_TOKENIZE,
+   MENU_TYPEIN_TOKENIZE_FILE,
+   MENU_TYPEIN_KEYBOARD,
+   MENU_TYPEIN_KEYBOARD_FILE,
 
    MENU_IECDEVICE_8,
    MENU_IECDEVICE_9,
@@ -484,6 +488,7 @@ typedef enum {
    MENU_USE_SCALING_PARAMS_1,
 
    MENU_SCALING_INTERPOLATION,
+   MENU_VIDEO_CACHE,
 
    MENU_SHADER_ENABLE,
    MENU_SHADER_CURVATURE,
@@ -528,7 +533,18 @@ typedef enum {
    MENU_IDE64_SECTORS_1,
    MENU_IDE64_SECTORS_2,
    MENU_IDE64_SECTORS_3,
-   MENU_IDE64_SECTORS_4
+   MENU_IDE64_SECTORS_4,
+
+   MENU_RECORD_INPUT,
+   MENU_RECORD_AV,
+
+   // One per CIRCLE_LOG_* subsystem, in order.
+   MENU_LOG_LEVEL_0,
+   MENU_LOG_LEVEL_1,
+   MENU_LOG_LEVEL_2,
+   MENU_LOG_LEVEL_3,
+   MENU_LOG_LEVEL_4,
+   MENU_LOG_LEVEL_5
 } MenuID;
 
 typedef enum {
@@ -644,7 +660,8 @@ typedef enum {
    MENU_VOLUME_SD = 0,
    MENU_VOLUME_USB1,
    MENU_VOLUME_USB2,
-   MENU_VOLUME_USB3
+   MENU_VOLUME_USB3,
+   MENU_VOLUME_NET
 } MenuVolume;
 
 typedef enum {
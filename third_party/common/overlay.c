@@ -76,6 +76,7 @@ static int tape_control = EMUX_TAPE_STOP;
 static int tape_motor = 0;
 static int warp_state = 0;
 static int swap_state = 0;
+static int save_progress = -1;
 
 static unsigned long statusbar_delay = 0;
 static unsigned long statusbar_start = 0;
@@ -144,6 +145,7 @@ static void draw_tape_control_status(int control);
 static void draw_tape_motor_status(int motor);
 static void draw_warp(int warp);
 static void draw_joyswap(int swap);
+static void draw_save_progress(int progress);
 
 static void draw_statusbar() {
   // Now draw the bg for the status bar
@@ -167,6 +169,7 @@ static void draw_statusbar() {
   draw_tape_motor_status(tape_motor);
   draw_warp(warp_state);
   draw_joyswap(swap_state);
+  draw_save_progress(save_progress);
 
   if (emux_machine_class == BMC64_MACHINE_CLASS_C128) {
      ui_draw_rect_buf(columns_x + inset_x, inset_y,
@@ -488,8 +491,46 @@ void overlay_joyswap_changed(int swap) {
   draw_joyswap(swap);
 }
 
+// A bar along the top of the status bar while a save is being written
+// to the card in the background.
+static void draw_save_progress(int progress) {
+  int y = OVERLAY_HEIGHT - STATUS_BAR_HEIGHT;
+  if (progress < 0) {
+    ui_draw_rect_buf(0, y, OVERLAY_WIDTH, SCALE_XY, BG_COLOR, 1,
+                     overlay_buf, overlay_buf_pitch);
+  } else {
+    int done = OVERLAY_WIDTH * progress / 100;
+    ui_draw_rect_buf(0, y, OVERLAY_WIDTH, SCALE_XY, GREEN_COLOR, 1,
+                     overlay_buf, overlay_buf_pitch);
+    if (done > 0) {
+      ui_draw_rect_buf(0, y, done, SCALE_XY, LIGHT_GREEN_COLOR, 1,
+                       overlay_buf, overlay_buf_pitch);
+    }
+  }
+  overlay_dirty = 1;
+}
+
+void overlay_save_progress_changed(int progress) {
+  save_progress = progress;
+
+  if (!overlay_buf)
+    return;
+
+  statusbar_triggered_by_activity();
+
+  if (!statusbar_enabled) return;
+  draw_save_progress(progress);
+}
+
 // Checks whether a showing overlay due to activity should no longer be showing
 void overlay_check(void) {
+  // Keeps the status bar up until the save is written.
+  if (save_progress >= 0) {
+    int progress = circle_save_progress();
+    if (progress != save_progress) {
+      overlay_save_progress_changed(progress);
+    }
+  }
   // Rollover safe way of checking duration
   if (statusbar_enabled && circle_get_ticks() - statusbar_start >= statusbar_delay) {
       overlay_statusbar_dismiss();
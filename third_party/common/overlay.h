@@ -55,6 +55,8 @@ void overlay_check(void);
 void overlay_activate(void);
 void overlay_warp_changed(int warp);
 void overlay_joyswap_changed(int swap);
+// Percent of the background save written, or -1 once it is.
+void overlay_save_progress_changed(int progress);
 void overlay_statusbar_dismiss(void);
 void overlay_statusbar_enable(void);
 void overlay_statusbar_disable(void);
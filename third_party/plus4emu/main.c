@@ -8,6 +8,7 @@
 #include "plus4lib/plus4emu.h"
 #include "../common/circle.h"
 #include "../common/emux_api.h"
+#include "../common/input_record.h"
 #include "../common/keycodes.h"
 #include "../common/overlay.h"
 #include "../common/demo.h"
@@ -392,11 +393,319 @@ static void vmError(void)
   exit(-1);
 }
 
+// Once emu_sound_helper_loop is running, SID synthesis, mixing and
+// resampling happen on that core and audioOutputCallback is called from
+// there. Audio must still be fed to the sound device from the emulation
+// core, so samples come back through this ring and are written out after
+// every run slice. If the ring is full, samples are dropped rather than
+// stalling the helper.
+#define SOUND_RING_SIZE 4096
+#define SOUND_RING_MASK (SOUND_RING_SIZE - 1)
+
+static int16_t sound_ring[SOUND_RING_SIZE];
+static uint32_t sound_ring_head; // emulation core only writes
+static uint32_t sound_ring_tail; // helper core only writes
+static uint32_t sound_ring_dropped;
+static uint32_t sound_ring_dropped_reported;
+static int sound_helper_running;
+static int vm_ready;
+
 static void audioOutputCallback(void *userData,
                                 const int16_t *buf, size_t nFrames)
 {
-  if (!ui_warp)
-     circle_sound_write((int16_t*)buf, nFrames);
+  if (!__atomic_load_n(&sound_helper_running, __ATOMIC_ACQUIRE)) {
+    if (!ui_warp)
+       circle_sound_write((int16_t*)buf, nFrames);
+    return;
+  }
+
+  uint32_t tail = sound_ring_tail;
+  uint32_t space = SOUND_RING_SIZE -
+      (tail - __atomic_load_n(&sound_ring_head, __ATOMIC_ACQUIRE));
+  if (nFrames > space) {
+    __atomic_fetch_add(&sound_ring_dropped, nFrames - space,
+                       __ATOMIC_RELAXED);
+    nFrames = space;
+  }
+  for (size_t i = 0; i < nFrames; i++) {
+    sound_ring[(tail + i) & SOUND_RING_MASK] = buf[i];
+  }
+  __atomic_store_n(&sound_ring_tail, tail + nFrames, __ATOMIC_RELEASE);
+}
+
+// Write out whatever the sound helper has produced so far.
+static void drain_sound_ring(void) {
+  uint32_t head = sound_ring_head;
+  uint32_t tail = __atomic_load_n(&sound_ring_tail, __ATOMIC_ACQUIRE);
+  while (head != tail) {
+    uint32_t idx = head & SOUND_RING_MASK;
+    uint32_t n = tail - head;
+    if (idx + n > SOUND_RING_SIZE) {
+      n = SOUND_RING_SIZE - idx;
+    }
+    if (!ui_warp)
+       circle_sound_write(&sound_ring[idx], n);
+    head += n;
+  }
+  __atomic_store_n(&sound_ring_head, head, __ATOMIC_RELEASE);
+
+  uint32_t dropped = __atomic_load_n(&sound_ring_dropped, __ATOMIC_RELAXED);
+  if (dropped != sound_ring_dropped_reported) {
+    printf ("Sound helper: %lu samples dropped\n",
+            (unsigned long)(dropped - sound_ring_dropped_reported));
+    sound_ring_dropped_reported = dropped;
+  }
+}
+
+// Frame scheduler. Run slices are sized from the time left before the
+// next vsync and the measured speed of emulation, less whatever the last
+// frame ran past its vsync, and the per frame housekeeping (OSD, status
+// bar, GPIO, input, tape/drive status) is done before the vsync wait
+// when the frame finished early enough to leave room for it. Otherwise
+// it is done after the flip as before. In warp, only one frame in
+// WARP_FRAME_SKIP is decoded and presented.
+#define SCHED_MARGIN_US 1500
+#define SCHED_MIN_SLICE_US 500
+#define SCHED_STAT_FRAMES 500
+#define WARP_FRAME_SKIP 16
+
+static struct {
+  uint32_t period_us;
+  // When the previous frame started emulating
+  unsigned long frame_start;
+  // When the previous flip returned
+  unsigned long last_vsync;
+  // Running averages (1/8 weight)
+  uint32_t emu_avg_us;
+  uint32_t housekeeping_avg_us;
+  // Frames since the last stats line
+  int frames;
+  int early;
+  // Frames that took longer than a vsync period to emulate
+  uint32_t overruns;
+  uint32_t total_overruns;
+  // How far the last frame ran past its vsync, taken off the time the
+  // next one has
+  uint32_t overrun_us;
+  // Slices run since the last stats line
+  uint32_t slices;
+  uint64_t slice_total_us;
+  // Frames skipped in warp
+  uint32_t warp_frame_cnt;
+} sched;
+
+static int warp_skip_frame;
+
+static void sched_init(void) {
+  sched.period_us = time_advance * 10;
+  sched.frame_start = circle_get_ticks();
+  sched.last_vsync = sched.frame_start;
+}
+
+// Wall time left before the next vsync, after paying back the last
+// frame's overrun. Negative when the frame is already late.
+static long sched_time_left(unsigned long now) {
+  return (long)sched.period_us - (long)(now - sched.last_vsync) -
+      (long)sched.overrun_us;
+}
+
+static int sched_next_slice(void) {
+  long left, slice;
+
+  if (ui_warp) {
+    // Nothing to pace against. Fewer trips through the main loop.
+    slice = sched.period_us;
+  } else {
+    left = sched_time_left(circle_get_ticks());
+    if (left <= 0) {
+      // Late. Spend less time entering and leaving the VM.
+      slice = sched.period_us / 4;
+    } else {
+      // As much emulated time as the measured speed gets done in what
+      // is left, so the frame ends about when the flip is due. The
+      // sound ring is still drained at least twice a frame.
+      slice = sched.emu_avg_us ?
+          (long)((uint64_t)left * sched.period_us / sched.emu_avg_us) : left;
+      if (slice > sched.period_us / 2) {
+        slice = sched.period_us / 2;
+      }
+      if (slice < SCHED_MIN_SLICE_US) {
+        slice = SCHED_MIN_SLICE_US;
+      }
+    }
+  }
+  sched.slices++;
+  sched.slice_total_us += slice;
+  return slice;
+}
+
+// Returns 1 if there is enough time left before vsync to do the
+// housekeeping without missing it.
+static int sched_housekeeping_early(unsigned long now) {
+  if (ui_warp || wait_vsync) {
+    return 0;
+  }
+  return sched_time_left(now) >
+      (long)(sched.housekeeping_avg_us + SCHED_MARGIN_US);
+}
+
+static void sched_frame_presented(unsigned long before_present) {
+  unsigned long now = circle_get_ticks();
+  uint32_t took = before_present - sched.last_vsync;
+  sched.overrun_us = 0;
+  if (!ui_warp && took > sched.period_us) {
+    sched.overruns++;
+    sched.total_overruns++;
+    // A frame or more late is a missed vsync; the flip waited for the
+    // next one and that is all there is to pay back.
+    sched.overrun_us = took - sched.period_us;
+    if (sched.overrun_us > sched.period_us) {
+      sched.overrun_us = sched.period_us;
+    }
+  }
+  sched.last_vsync = now;
+}
+
+static void sched_frame_done(unsigned long callback_entry, int early) {
+  uint32_t emu_us = callback_entry - sched.frame_start;
+  sched.emu_avg_us = (sched.emu_avg_us * 7 + emu_us) / 8;
+  sched.early += early;
+  sched.frame_start = circle_get_ticks();
+
+  if (ui_warp && !wait_vsync) {
+    warp_skip_frame = (++sched.warp_frame_cnt % WARP_FRAME_SKIP) != 0;
+  } else {
+    warp_skip_frame = 0;
+    sched.warp_frame_cnt = 0;
+  }
+
+  if (++sched.frames < SCHED_STAT_FRAMES) {
+    return;
+  }
+  printf ("Frame sched: emu %lu us/frame, housekeeping %lu us, "
+          "%d early, %lu overruns (%lu total), slice %lu us\n",
+          (unsigned long)sched.emu_avg_us,
+          (unsigned long)sched.housekeeping_avg_us,
+          sched.early,
+          (unsigned long)sched.overruns,
+          (unsigned long)sched.total_overruns,
+          (unsigned long)(sched.slices ?
+              sched.slice_total_us / sched.slices : 0));
+  sched.frames = 0;
+  sched.early = 0;
+  sched.overruns = 0;
+  sched.slices = 0;
+  sched.slice_total_us = 0;
+}
+
+static void run_slice(int microseconds) {
+  Plus4VM_Run(vm, microseconds);
+  drain_sound_ring();
+}
+
+void emu_sound_helper_loop(void) {
+  while (!__atomic_load_n(&vm_ready, __ATOMIC_ACQUIRE)) {
+    asm volatile ("wfe");
+  }
+
+  printf ("Sound synthesis moved to helper core\n");
+  __atomic_store_n(&sound_helper_running, 1, __ATOMIC_RELEASE);
+  Plus4VM_RunSoundHelper(vm);
+}
+
+// When another core is free, TED lines are not decoded on the emulation
+// core. The raw line data is copied into this ring and emu_video_helper_loop
+// (running on core 2) decodes it into fb_buf. Before a frame is handed to
+// the display, the emulation core waits for the ring to drain. Until the
+// helper announces itself, or if there is no helper (single core builds),
+// lines are decoded in place as before.
+#define VIDEO_RING_SIZE 64
+#define VIDEO_RING_MASK (VIDEO_RING_SIZE - 1)
+
+struct video_ring_slot {
+  uint8_t *dst;
+  Plus4VideoLineData *line;
+};
+
+static struct video_ring_slot video_ring[VIDEO_RING_SIZE];
+static uint32_t video_ring_head; // helper core only writes
+static uint32_t video_ring_tail; // emulation core only writes
+static int video_ring_ready;
+static int video_helper_active;
+
+// Stats. Helper side counters are only written by the helper core.
+static uint32_t video_helper_decode_ticks;
+static uint32_t video_emu_ticks;
+static uint32_t video_ring_stalls;
+static int video_stat_frames;
+
+#define VIDEO_STAT_FRAMES 500
+
+static void video_ring_init(void) {
+  for (int i = 0; i < VIDEO_RING_SIZE; i++) {
+    video_ring[i].line = Plus4VideoLineData_Create();
+    if (!video_ring[i].line) {
+      printf ("Failed to create video line ring. Decoding on main core.\n");
+      return;
+    }
+  }
+  __atomic_store_n(&video_ring_ready, 1, __ATOMIC_RELEASE);
+  asm volatile ("dsb\n\tsev");
+}
+
+// Wait for the helper to finish every line queued so far. Must be called
+// before fb_buf is shown, reallocated or the decoder's colormap changes.
+static void video_ring_fence(void) {
+  if (!__atomic_load_n(&video_helper_active, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  while (__atomic_load_n(&video_ring_head, __ATOMIC_ACQUIRE) !=
+         video_ring_tail) {
+  }
+}
+
+static void video_ring_stats(void) {
+  if (++video_stat_frames < VIDEO_STAT_FRAMES) {
+    return;
+  }
+  uint32_t decode =
+      __atomic_exchange_n(&video_helper_decode_ticks, 0, __ATOMIC_RELAXED);
+  int32_t saved = (int32_t)(decode - video_emu_ticks);
+  printf ("Video helper: decode %lu us/frame, emu core %lu us/frame, "
+          "saved %ld us/frame, %lu ring stalls\n",
+          (unsigned long)(decode / VIDEO_STAT_FRAMES),
+          (unsigned long)(video_emu_ticks / VIDEO_STAT_FRAMES),
+          (long)(saved / VIDEO_STAT_FRAMES),
+          (unsigned long)video_ring_stalls);
+  video_emu_ticks = 0;
+  video_ring_stalls = 0;
+  video_stat_frames = 0;
+}
+
+void emu_video_helper_loop(void) {
+  while (!__atomic_load_n(&video_ring_ready, __ATOMIC_ACQUIRE)) {
+    asm volatile ("wfe");
+  }
+
+  printf ("Video line decoding moved to helper core\n");
+  __atomic_store_n(&video_helper_active, 1, __ATOMIC_RELEASE);
+
+  uint32_t head = video_ring_head;
+  for (;;) {
+    if (head == __atomic_load_n(&video_ring_tail, __ATOMIC_ACQUIRE)) {
+      // The producer signals after every line so this can't miss one.
+      asm volatile ("wfe");
+      continue;
+    }
+    unsigned long start = circle_get_ticks();
+    struct video_ring_slot *slot = &video_ring[head & VIDEO_RING_MASK];
+    Plus4VideoDecoder_DecodeLine(videoDecoder, slot->dst, 384, slot->line);
+    head++;
+    __atomic_store_n(&video_ring_head, head, __ATOMIC_RELEASE);
+    __atomic_fetch_add(&video_helper_decode_ticks,
+                       (uint32_t)(circle_get_ticks() - start),
+                       __ATOMIC_RELAXED);
+  }
 }
 
 static void videoLineCallback(void *userData,
@@ -407,23 +716,36 @@ static void videoLineCallback(void *userData,
    } else {
       lineNum = lineNum - raster_low;
    }
-   if (lineNum >= 0 && lineNum < vertical_res) {
-     Plus4VideoDecoder_DecodeLine(videoDecoder, fb_buf + lineNum * fb_pitch, 384, lineData);
+   if (lineNum < 0 || lineNum >= vertical_res || warp_skip_frame) {
+     return;
    }
-}
 
-static void videoFrameCallback(void *userData)
-{
-  circle_frames_ready_fbl(FB_LAYER_VIC,
-                          -1 /* no 2nd layer */,
-                          !ui_warp /* sync */);
+   uint8_t *dst = fb_buf + lineNum * fb_pitch;
+   if (!__atomic_load_n(&video_helper_active, __ATOMIC_ACQUIRE)) {
+     Plus4VideoDecoder_DecodeLine(videoDecoder, dst, 384, lineData);
+     return;
+   }
 
-  // Something is waiting for vsync, ack and return.
-  if (wait_vsync) {
-    wait_vsync = 0;
-    return;
-  }
+   unsigned long start = circle_get_ticks();
+   uint32_t tail = video_ring_tail;
+   if (tail - __atomic_load_n(&video_ring_head, __ATOMIC_ACQUIRE) >=
+          VIDEO_RING_SIZE) {
+     video_ring_stalls++;
+     while (tail - __atomic_load_n(&video_ring_head, __ATOMIC_ACQUIRE) >=
+               VIDEO_RING_SIZE) {
+     }
+   }
+   struct video_ring_slot *slot = &video_ring[tail & VIDEO_RING_MASK];
+   Plus4VideoLineData_Copy(slot->line, lineData);
+   slot->dst = dst;
+   __atomic_store_n(&video_ring_tail, tail + 1, __ATOMIC_RELEASE);
+   asm volatile ("dsb\n\tsev");
+   video_emu_ticks += circle_get_ticks() - start;
+}
 
+// Everything done once per frame besides presenting it.
+static void frame_housekeeping(void)
+{
   emux_ensure_video();
 
   // This render will handle any OSDs we have. ODSs don't pause emulation.
@@ -450,31 +772,28 @@ static void videoFrameCallback(void *userData)
 
   int reset_demo = 0;
 
-  circle_lock_acquire();
-  while (pending_emu_key.head != pending_emu_key.tail) {
-    int i = pending_emu_key.head & 0xf;
+  // Key and joystick event dequeue
+  struct input_event ev;
+  while (emux_next_input_event(&ev)) {
     reset_demo = 1;
-    if (vkbd_enabled) {
-      // Kind of nice to have virtual keyboard's state
-      // stay in sync with changes happening from USB
-      // key events.
-      vkbd_sync_event(pending_emu_key.key[i], pending_emu_key.pressed[i]);
-    }
-    int p4code = keysymToP4Code[pending_emu_key.key[i]];
-    if (p4code >= 0) {
-       Plus4VM_KeyboardEvent(vm, p4code, pending_emu_key.pressed[i]);
+    if (ev.type == INPUT_EVENT_KEY) {
+      if (vkbd_enabled) {
+        // Kind of nice to have virtual keyboard's state
+        // stay in sync with changes happening from USB
+        // key events.
+        vkbd_sync_event(ev.key, ev.value);
+      }
+      int p4code = keysymToP4Code[ev.key];
+      if (p4code >= 0) {
+         Plus4VM_KeyboardEvent(vm, p4code, ev.value);
+      }
+      continue;
     }
-    pending_emu_key.head++;
-  }
 
-  // Joystick event dequeue
-  while (pending_emu_joy.head != pending_emu_joy.tail) {
-    int i = pending_emu_joy.head & 0x7f;
-    reset_demo = 1;
     if (vkbd_enabled) {
-      int value = pending_emu_joy.value[i];
-      int devd = pending_emu_joy.device[i];
-      switch (pending_emu_joy.type[i]) {
+      int value = ev.value;
+      int devd = ev.device;
+      switch (ev.joy_type) {
       case PENDING_EMU_JOY_TYPE_ABSOLUTE:
         if (!vkbd_press[devd]) {
            if (value & 0x1 && !vkbd_up[devd]) {
@@ -507,21 +826,21 @@ static void videoFrameCallback(void *userData)
         break;
       }
     } else {
-      int port = pending_emu_joy.port[i]-1;
+      int port = ev.port-1;
       int oldv = joy_latch_value[port];
-      switch (pending_emu_joy.type[i]) {
+      switch (ev.joy_type) {
       case PENDING_EMU_JOY_TYPE_ABSOLUTE:
         // If new bit is 0 and old bit is 1, it is an up event
         // If new bit is 1 and old bit is 0, it is a down event
-        joy_latch_value[port] = pending_emu_joy.value[i];
+        joy_latch_value[port] = ev.value;
         break;
       case PENDING_EMU_JOY_TYPE_AND:
         // If new bit is 0 and old bit is 1, it is an up event
-        joy_latch_value[port] &= pending_emu_joy.value[i];
+        joy_latch_value[port] &= ev.value;
         break;
       case PENDING_EMU_JOY_TYPE_OR:
         // If new bit is 1 and old bit is 0, it is a down event
-        joy_latch_value[port] |= pending_emu_joy.value[i];
+        joy_latch_value[port] |= ev.value;
         break;
       default:
         break;
@@ -559,9 +878,9 @@ static void videoFrameCallback(void *userData)
         Plus4VM_KeyboardEvent(vm, 79 + 7*port, 1);
       }
     }
-    pending_emu_joy.head++;
   }
 
+  circle_lock_acquire();
   if (ui_trap) {
       ui_trap = 0;
       circle_lock_release();
@@ -627,6 +946,55 @@ static void videoFrameCallback(void *userData)
   }
 }
 
+static void run_housekeeping(void)
+{
+  unsigned long start = circle_get_ticks();
+  frame_housekeeping();
+  uint32_t took = circle_get_ticks() - start;
+  // A trip into the menu says nothing about the next frame.
+  if (took > sched.period_us) {
+    took = sched.period_us;
+  }
+  sched.housekeeping_avg_us = (sched.housekeeping_avg_us * 7 + took) / 8;
+}
+
+static void videoFrameCallback(void *userData)
+{
+  unsigned long entry = circle_get_ticks();
+
+  if (__atomic_load_n(&video_helper_active, __ATOMIC_ACQUIRE)) {
+    video_ring_fence();
+    video_emu_ticks += circle_get_ticks() - entry;
+    video_ring_stats();
+  }
+
+  // A pending menu trap must see the latest frame on screen first.
+  int early = !ui_trap && sched_housekeeping_early(entry);
+  if (early) {
+    run_housekeeping();
+  }
+
+  if (!warp_skip_frame) {
+    unsigned long before_present = circle_get_ticks();
+    circle_frames_ready_fbl(FB_LAYER_VIC,
+                            -1 /* no 2nd layer */,
+                            !ui_warp /* sync */);
+    sched_frame_presented(before_present);
+  }
+
+  // Something is waiting for vsync, ack and return.
+  if (wait_vsync) {
+    wait_vsync = 0;
+    sched_frame_done(entry, early);
+    return;
+  }
+
+  if (!early) {
+    run_housekeeping();
+  }
+  sched_frame_done(entry, early);
+}
+
 static void load_keymap(void) {
   FILE *fp = NULL;
   if (keyboard_mapping_item->value == KEYBOARD_MAPPING_POS) {
@@ -741,6 +1109,10 @@ int main_program(int argc, char **argv)
     errorMessage("could not create video decoder object");
   Plus4VM_SetVideoOutputCallback(vm, &Plus4VideoDecoder_VideoCallback,
                                  (void *) videoDecoder);
+  video_ring_init();
+
+  __atomic_store_n(&vm_ready, 1, __ATOMIC_RELEASE);
+  asm volatile ("dsb\n\tsev");
 
   vic_enabled = 1; // really TED
 
@@ -774,8 +1146,9 @@ int main_program(int argc, char **argv)
   circle_boot_complete();
 
   assert(time_advance > 0);
+  sched_init();
   for(;;) {
-    Plus4VM_Run(vm, time_advance);
+    run_slice(sched_next_slice());
   }
 
   Plus4VM_Destroy(vm);
@@ -967,7 +1340,13 @@ void emux_reset(int isSoft) {
 }
 
 int emux_save_state(char *filename) {
-  if (Plus4VM_SaveState(vm, filename) != PLUS4EMU_SUCCESS) {
+  circle_save_begin(filename);
+  Plus4Emu_Error result = Plus4VM_SaveState(vm, filename);
+  circle_save_end();
+  if (circle_save_progress() >= 0) {
+    overlay_save_progress_changed(circle_save_progress());
+  }
+  if (result != PLUS4EMU_SUCCESS) {
     return 1;
   }
   return 0;
@@ -1052,6 +1431,31 @@ int emux_autostart_file(char* filename) {
   return 0;
 }
 
+int emux_type_text_file(char* filename, int mode) {
+  return -1;
+}
+
+void emux_record_machine_state(void) {
+  // Drive models and the rest live in plus4emu's config, which a replay
+  // has no way to set; only the cartridge slots are recorded.
+  struct menu_item* items[] = {c0_lo_item, c0_hi_item, c1_lo_item,
+                               c1_hi_item, c2_lo_item, c2_hi_item};
+  int ids[] = {MENU_PLUS4_CART_C0_LO_FILE, MENU_PLUS4_CART_C0_HI_FILE,
+               MENU_PLUS4_CART_C1_LO_FILE, MENU_PLUS4_CART_C1_HI_FILE,
+               MENU_PLUS4_CART_C2_LO_FILE, MENU_PLUS4_CART_C2_HI_FILE};
+  int i;
+  for (i = 0; i < 6; i++) {
+    if (strlen(items[i]->str_value) > 0) {
+      input_record_attach(INPUT_RECORD_ATTACH_CART, ids[i],
+                          items[i]->str_value);
+    }
+  }
+}
+
+int emux_apply_recorded_setting(const char* name, int value) {
+  return -1;
+}
+
 void emux_drive_change_model(int unit) {
 }
 
@@ -1127,12 +1531,13 @@ void emux_add_sound_options(struct menu_item* parent) {
 }
 
 void emux_video_color_setting_changed(int display_num) {
+  video_ring_fence();
   Plus4VideoDecoder_UpdatePalette(videoDecoder);
   // Plus4Emu doesn't use an indexed palette so we have to allow
   // the decoder to draw a frame after we change a color param.
   wait_vsync = 1;
   do {
-    Plus4VM_Run(vm, 2000);
+    run_slice(2000);
   } while (wait_vsync);
 }
 
@@ -3,4 +3,12 @@
 
 int main_program(int argc, char* argv[]);
 
+// Never returns. Run by a spare core to decode TED lines off the
+// emulation core.
+void emu_video_helper_loop(void);
+
+// Never returns. Run by a spare core to synthesize SID sound and resample
+// audio off the emulation core.
+void emu_sound_helper_loop(void);
+
 #endif
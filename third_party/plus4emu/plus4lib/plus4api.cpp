@@ -366,6 +366,12 @@ extern "C" PLUS4EMU_EXPORT Plus4Emu_Error Plus4VM_Run(Plus4VM *vm,
   return PLUS4EMU_SUCCESS;
 }
 
+// Added for BMC64
+extern "C" PLUS4EMU_EXPORT void Plus4VM_RunSoundHelper(Plus4VM *vm)
+{
+  vm->getVM().runSoundHelper();
+}
+
 extern "C" PLUS4EMU_EXPORT void Plus4VM_Reset(Plus4VM *vm, int isColdReset)
 {
   try {
@@ -1228,6 +1234,8 @@ extern "C" PLUS4EMU_EXPORT Plus4Emu_Error Plus4VM_LoadState(
 {
   try {
     Plus4Emu::File  f(fileName);
+    // BMC64: the SID chunk is loaded directly into the SID
+    vm->getVM().syncSoundHelper();
     vm->getVM().registerChunkTypes(f);
     f.processAllChunks();
   }
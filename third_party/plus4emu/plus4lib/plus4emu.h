@@ -115,6 +115,12 @@ PLUS4EMU_EXPORT void Plus4VM_SetVideoOutputCallback(
  * Run emulation for the specified number of microseconds.
  */
 PLUS4EMU_EXPORT Plus4Emu_Error Plus4VM_Run(Plus4VM *vm, size_t microseconds);
+/*!
+ * Added for BMC64. Run SID synthesis, sound mixing and resampling on the
+ * calling core from now on. Never returns. The audio output callback will
+ * be called from the calling core.
+ */
+PLUS4EMU_EXPORT void Plus4VM_RunSoundHelper(Plus4VM *vm);
 /*!
  * Reset emulated machine; if 'forceReset' is non-zero, TED registers and
  * memory banking are also reset, and SID emulation and unused floppy drives
@@ -99,14 +99,15 @@ namespace Plus4 {
   void Plus4VM::TED7360_::playSample(int16_t sampleValue)
   {
     int32_t tmp = vm.soundOutputAccumulator;
-    if (tmp != 0) {
-      vm.soundOutputAccumulator = 0;
-      tmp = (tmp >= -1048576 ? (tmp < 1048576 ? tmp : 1048576) : -1048576);
-      tmp = int32_t((uint32_t(tmp * vm.sidOutputVolume)
-                     + uint32_t(0x80004000UL)) >> 15) - int32_t(65536);
+    vm.soundOutputAccumulator = 0;
+    if (vm.soundHelperActive) {
+      // BMC64: SID output is added on the helper core
+      vm.queueSoundEvent(2, 0, 0, sampleValue, tmp);
+      return;
     }
-    vm.soundOutputSignal = tmp + int32_t(sampleValue);
-    vm.sendMonoAudioOutput(vm.soundOutputSignal);
+    tmp += vm.sidOutputAccumulator;
+    vm.sidOutputAccumulator = 0;
+    vm.mixSoundOutput(tmp, sampleValue);
   }
 
   void Plus4VM::TED7360_::videoOutputCallback(const uint8_t *buf, size_t nBytes)
@@ -144,6 +145,8 @@ namespace Plus4 {
   {
     TED7360_& ted = *(reinterpret_cast<TED7360_ *>(userData));
     if (ted.vm.sidEnabled) {
+      // BMC64: reads need the SID caught up to the current cycle
+      ted.vm.syncSoundHelper();
       uint8_t regNum = uint8_t(addr & 0x001F);
       if (ted.vm.digiBlasterEnabled && regNum >= 0x1E) {
         if (regNum == 0x1E) {
@@ -173,16 +176,19 @@ namespace Plus4 {
     if (PLUS4EMU_UNLIKELY(!ted.vm.sidEnabled)) {
       ted.vm.sidEnabled = true;
       if (!(ted.vm.sidFlags & 4))
-        ted.setCallback(&SID::clockCallback, ted.vm.sid_, 1);
+        ted.setCallback(&sidClockCallback, &(ted.vm), 1);
       else
         ted.setCallback(&(ted.vm.sidCallbackC64), &(ted.vm), 1);
     }
     uint8_t regNum = uint8_t(addr & 0x001F);
-    if (regNum == 0x1E) {
+    if (regNum == 0x1E)
       ted.vm.digiBlasterOutput = value;
-      if (ted.vm.digiBlasterEnabled)
-        ted.vm.sid_->input((int(value) << 8) - 32768);
+    if (ted.vm.soundHelperActive) {
+      ted.vm.queueSoundEvent(1, regNum, value, 0, 0);
+      return;
     }
+    if (regNum == 0x1E && ted.vm.digiBlasterEnabled)
+      ted.vm.sid_->input((int(value) << 8) - 32768);
     ted.vm.sid_->write(regNum, value);
   }
 
@@ -411,6 +417,7 @@ namespace Plus4 {
     freqMult = (freqMult > 1 ? (freqMult < 100 ? freqMult : 100) : 1);
     ted->setCPUClockMultiplier(freqMult);
     if ((singleClockFreq >> 2) != soundClockFrequency) {
+      syncSoundHelper();
       soundClockFrequency = singleClockFreq >> 2;
       setAudioConverterSampleRate(float(long(soundClockFrequency)));
       if (videoCapture)
@@ -500,6 +507,96 @@ namespace Plus4 {
     vm.soundOutputAccumulator += vm.tapeFeedbackSignal;
   }
 
+  PLUS4EMU_REGPARM1 void Plus4VM::sidClockCallback(void *userData)
+  {
+    Plus4VM&  vm = *(reinterpret_cast<Plus4VM *>(userData));
+    if (vm.soundHelperActive) {
+      if (PLUS4EMU_UNLIKELY(++(vm.sidPendingClocks) == 255U))
+        vm.queueSoundEvent(0, 0, 0, 0, 0);
+      return;
+    }
+    SID::clockCallback(vm.sid_);
+  }
+
+  void Plus4VM::mixSoundOutput(int32_t accumulator, int16_t sampleValue)
+  {
+    int32_t tmp = accumulator;
+    if (tmp != 0) {
+      tmp = (tmp >= -1048576 ? (tmp < 1048576 ? tmp : 1048576) : -1048576);
+      tmp = int32_t((uint32_t(tmp * sidOutputVolume)
+                     + uint32_t(0x80004000UL)) >> 15) - int32_t(65536);
+    }
+    soundOutputSignal = tmp + int32_t(sampleValue);
+    sendMonoAudioOutput(soundOutputSignal);
+  }
+
+  void Plus4VM::queueSoundEvent(uint8_t type, uint8_t regNum, uint8_t value,
+                                int16_t tedSample, int32_t accumulator)
+  {
+    uint32_t  tail = soundQueueTail;
+    while ((tail - __atomic_load_n(&soundQueueHead, __ATOMIC_ACQUIRE))
+           >= soundQueueSize) {
+      // helper core is behind, wait for a free slot
+    }
+    SoundEvent& e = soundQueue[tail & (soundQueueSize - 1U)];
+    e.type = type;
+    e.clocks = uint8_t(sidPendingClocks);
+    e.regNum = regNum;
+    e.value = value;
+    e.tedSample = tedSample;
+    e.accumulator = accumulator;
+    sidPendingClocks = 0;
+    __atomic_store_n(&soundQueueTail, tail + 1U, __ATOMIC_RELEASE);
+    __asm__ volatile ("dsb\n\tsev");
+  }
+
+  void Plus4VM::processSoundEvent(const SoundEvent& e)
+  {
+    for (uint8_t i = e.clocks; i > 0; i--)
+      SID::clockCallback(sid_);
+    switch (e.type) {
+    case 1:
+      if (e.regNum == 0x1E && digiBlasterEnabled)
+        sid_->input((int(e.value) << 8) - 32768);
+      sid_->write(e.regNum, e.value);
+      break;
+    case 2:
+      {
+        int32_t tmp = e.accumulator + sidOutputAccumulator;
+        sidOutputAccumulator = 0;
+        mixSoundOutput(tmp, e.tedSample);
+      }
+      break;
+    }
+  }
+
+  void Plus4VM::runSoundHelper()
+  {
+    __atomic_store_n(&soundHelperRequested, true, __ATOMIC_RELEASE);
+    uint32_t  head = soundQueueHead;
+    for ( ; ; ) {
+      if (head == __atomic_load_n(&soundQueueTail, __ATOMIC_ACQUIRE)) {
+        // the emulation core signals after every event
+        __asm__ volatile ("wfe");
+        continue;
+      }
+      processSoundEvent(soundQueue[head & (soundQueueSize - 1U)]);
+      head++;
+      __atomic_store_n(&soundQueueHead, head, __ATOMIC_RELEASE);
+    }
+  }
+
+  void Plus4VM::syncSoundHelper()
+  {
+    if (!soundHelperActive)
+      return;
+    if (sidPendingClocks)
+      queueSoundEvent(0, 0, 0, 0, 0);
+    while (__atomic_load_n(&soundQueueHead, __ATOMIC_ACQUIRE)
+           != soundQueueTail) {
+    }
+  }
+
   PLUS4EMU_REGPARM1 void Plus4VM::sidCallbackC64(void *userData)
   {
     Plus4VM&  vm = *(reinterpret_cast<Plus4VM *>(userData));
@@ -508,10 +605,10 @@ namespace Plus4 {
       // on every 9th TED single clock cycle (7th if NTSC),
       // run the SID emulation twice and average the outputs
       vm.sidCycleCnt = (uint8_t(vm.tedInputClockFrequency >> 24) << 1) + 7;
-      vm.soundOutputAccumulator = (vm.soundOutputAccumulator << 1) + 0x40000001;
+      vm.sidOutputAccumulator = (vm.sidOutputAccumulator << 1) + 0x40000001;
       SID::clockCallback(vm.sid_);
       SID::clockCallback(vm.sid_);
-      vm.soundOutputAccumulator = (vm.soundOutputAccumulator >> 1) - 0x20000000;
+      vm.sidOutputAccumulator = (vm.sidOutputAccumulator >> 1) - 0x20000000;
       return;
     }
     SID::clockCallback(vm.sid_);
@@ -831,6 +928,13 @@ namespace Plus4 {
       digiBlasterOutput(0x80),
       sidCycleCnt(4),
       sidFlags(0),
+      sidOutputAccumulator(0),
+      soundQueue((SoundEvent *) 0),
+      soundQueueHead(0U),
+      soundQueueTail(0U),
+      sidPendingClocks(0U),
+      soundHelperRequested(false),
+      soundHelperActive(false),
       is1541HighAccuracy(true),
       serialBusDelayOffset(0),
       floppyROM_1541((uint8_t *) 0),
@@ -868,8 +972,9 @@ namespace Plus4 {
   {
     for (int i = 0; i < 12; i++)
       serialDevices[i] = (SerialDevice *) 0;
-    sid_ = new SID(soundOutputAccumulator);
+    sid_ = new SID(sidOutputAccumulator);
     try {
+      soundQueue = new SoundEvent[soundQueueSize];
       sid_->set_chip_model(MOS8580);
       sid_->enable_external_filter(false);
       sid_->reset();
@@ -892,6 +997,8 @@ namespace Plus4 {
         delete iecDrive8;
       if (iecDrive9)
         delete iecDrive9;
+      if (soundQueue)
+        delete[] soundQueue;
       delete sid_;
       throw;
     }
@@ -932,12 +1039,19 @@ namespace Plus4 {
     delete iecDrive8;
     delete iecDrive9;
     delete sid_;
+    delete[] soundQueue;
     if (videoBreakPoints)
       delete[] videoBreakPoints;
   }
 
   void Plus4VM::run(size_t microseconds)
   {
+    // BMC64: hand sound over to the helper core once it is waiting. SID
+    // emulation at C64 clock frequency always stays on this core.
+    if (!soundHelperActive && !(sidFlags & 4) &&
+        __atomic_load_n(&soundHelperRequested, __ATOMIC_ACQUIRE)) {
+      soundHelperActive = true;
+    }
     Plus4Emu::VirtualMachine::run(microseconds);
     if (snapshotLoadFlag) {
       snapshotLoadFlag = false;
@@ -974,6 +1088,7 @@ namespace Plus4 {
     stopDemoPlayback();         // TODO: should be recorded as an event ?
     stopDemoRecording(false);
     removePasteTextCallback();
+    syncSoundHelper();
     ted->reset(isColdReset);
     setTapeMotorState(false);
     sid_->reset();
@@ -981,7 +1096,7 @@ namespace Plus4 {
     sid_->input(0);
     if (isColdReset) {
       sidEnabled = false;
-      ted->setCallback(&SID::clockCallback, sid_, 0);
+      ted->setCallback(&sidClockCallback, this, 0);
       ted->setCallback(&sidCallbackC64, this, 0);
       disableUnusedFloppyDrives();
     }
@@ -1161,6 +1276,11 @@ namespace Plus4 {
                                     int outputVolume)
   {
     sidFlags_ = sidFlags_ & 7;
+    syncSoundHelper();
+    if (sidFlags_ & 4) {
+      // BMC64: C64 clock frequency SID emulation is not queued
+      soundHelperActive = false;
+    }
     if (sidFlags_ != sidFlags) {
       uint8_t changeMask = sidFlags_ ^ sidFlags;
       sidFlags = sidFlags_;
@@ -1174,7 +1294,7 @@ namespace Plus4 {
         if (changeMask & 2)
           ted->setEnableC64CompatibleSID(bool(sidFlags_ & 2));
         if (sidEnabled && (changeMask & 4) != 0) {
-          ted->setCallback(&SID::clockCallback, sid_, int(!(sidFlags_ & 4)));
+          ted->setCallback(&sidClockCallback, this, int(!(sidFlags_ & 4)));
           ted->setCallback(&sidCallbackC64, this, int(bool(sidFlags_ & 4)));
         }
       }
@@ -1200,11 +1320,12 @@ namespace Plus4 {
     if (sidEnabled) {
       stopDemoPlayback();
       stopDemoRecording(false);
+      syncSoundHelper();
       sid_->reset();
       digiBlasterOutput = 0x80;
       sid_->input(0);
       sidEnabled = false;
-      ted->setCallback(&SID::clockCallback, sid_, 0);
+      ted->setCallback(&sidClockCallback, this, 0);
       ted->setCallback(&sidCallbackC64, this, 0);
     }
   }
@@ -2349,6 +2470,7 @@ namespace Plus4 {
 
   void Plus4VM::saveState(Plus4Emu::File& f)
   {
+    syncSoundHelper();
     ted->saveState(f);
     sid_->saveState(f);
     {
@@ -2448,6 +2570,7 @@ namespace Plus4 {
 
   void Plus4VM::loadState(Plus4Emu::File::Buffer& buf)
   {
+    syncSoundHelper();
     buf.setPosition(0);
     // check version number
     unsigned int  version = buf.readUInt32();
@@ -2496,7 +2619,9 @@ namespace Plus4 {
         sid_->input((int(digiBlasterOutput) << 8) - 32768);
       else
         sid_->input(0);
-      ted->setCallback(&SID::clockCallback, sid_,
+      if (sidFlags & 4)
+        soundHelperActive = false;
+      ted->setCallback(&sidClockCallback, this,
                        int(sidEnabled) & int(!(sidFlags & 4)));
       ted->setCallback(&sidCallbackC64, this,
                        int(sidEnabled) & int(bool(sidFlags & 4)));
@@ -119,6 +119,29 @@ namespace Plus4 {
     // bit 1 = enable write access at $D400-$D41F
     // bit 2 = run SID emulation at C64 clock frequency
     uint8_t   sidFlags;
+    // BMC64: SID output is accumulated separately from tape feedback so
+    // that SID synthesis can run on another core.
+    int32_t   sidOutputAccumulator;
+    // BMC64: When a helper core has called runSoundHelper(), SID clocking,
+    // SID register writes, mixing and resampling are queued here and done
+    // on that core. The emulation core only counts SID clocks and queues
+    // register writes and TED samples. Anything else that touches sid_ or
+    // the audio converter must call syncSoundHelper() first.
+    struct SoundEvent {
+      uint8_t   type;           // 0: SID clocks only, 1: SID write, 2: sample
+      uint8_t   clocks;         // SID clocks to run before this event
+      uint8_t   regNum;
+      uint8_t   value;
+      int16_t   tedSample;
+      int32_t   accumulator;    // tape feedback
+    };
+    static const uint32_t soundQueueSize = 4096;   // must be a power of 2
+    SoundEvent  *soundQueue;
+    uint32_t  soundQueueHead;           // written by the helper core only
+    uint32_t  soundQueueTail;           // written by the emulation core only
+    uint32_t  sidPendingClocks;
+    bool      soundHelperRequested;
+    bool      soundHelperActive;
     bool      is1541HighAccuracy;
     int16_t   serialBusDelayOffset;
     SerialDevice  *serialDevices[12];
@@ -165,6 +188,12 @@ namespace Plus4 {
     M7501 * getDebugCPU();
     const M7501 * getDebugCPU() const;
     static PLUS4EMU_REGPARM1 void tapeCallback(void *userData);
+    // BMC64: clocks the SID, or counts the clock if a helper core owns it
+    static PLUS4EMU_REGPARM1 void sidClockCallback(void *userData);
+    void queueSoundEvent(uint8_t type, uint8_t regNum, uint8_t value,
+                         int16_t tedSample, int32_t accumulator);
+    void processSoundEvent(const SoundEvent& e);
+    void mixSoundOutput(int32_t accumulator, int16_t sampleValue);
     // run SID emulation at 10/9 * TED single clock frequency
     static PLUS4EMU_REGPARM1 void sidCallbackC64(void *userData);
     static PLUS4EMU_REGPARM1 void demoPlayCallback(void *userData);
@@ -252,6 +281,17 @@ namespace Plus4 {
      * any of the SID registers) to reduce CPU usage.
      */
     virtual void disableSIDEmulation();
+    /*!
+     * BMC64: Take over SID synthesis, mixing and resampling on the calling
+     * core. Never returns. The emulation core hands the work over at the
+     * start of its next run() call.
+     */
+    void runSoundHelper();
+    /*!
+     * BMC64: Wait until the helper core has processed every queued sound
+     * event. Does nothing if there is no helper.
+     */
+    void syncSoundHelper();
     /*!
      * Set state of key 'keyCode' (0 to 127).
      */
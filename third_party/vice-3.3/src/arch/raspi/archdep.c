@@ -38,6 +38,9 @@
 #include <unistd.h>
 
 #include "archdep.h"
+#ifdef RASPI_HEADLESS
+#include "headless.h"
+#endif
 #include "circle.h"
 #include "lib.h"
 #include "log.h"
@@ -61,7 +64,11 @@ const char *archdep_program_name(void) {
   return program_name;
 }
 
+#ifdef RASPI_HEADLESS
+const char *archdep_boot_path(void) { return headless_boot_path(); }
+#else
 const char *archdep_boot_path(void) { return ""; }
+#endif
 
 char *archdep_default_sysfile_pathlist(const char *emu_id) {
 
@@ -116,13 +123,15 @@ FILE *archdep_open_default_log_file(void) {
 }
 
 int archdep_default_logger(const char *level_string, const char *txt) {
-  if (fputs(level_string, stdout) == EOF || fprintf(stdout, txt) < 0 ||
-      fputc('\n', stdout) == EOF) {
-    return -1;
-  }
+  // One record in the serial log ring, not three writes to stdout.
+  circle_log_line(level_string, txt);
   return 0;
 }
 
+int archdep_log_wanted(const char *name, unsigned int level) {
+  return circle_log_wanted(name, level);
+}
+
 int archdep_path_is_relative(const char *path) {
   if (path == NULL) {
     return 0;
@@ -0,0 +1,44 @@
+/*
+ * headless.h - hooks for the headless benchmark build
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef RASPI_HEADLESS_H
+#define RASPI_HEADLESS_H
+
+// Only used when configured with --enable-raspiheadless. The Pi port
+// then runs on the build machine against the stand in kernel in
+// tools/headless, which implements these.
+
+// Subsystems timed separately. Whatever is left over is reported as
+// CPU time.
+#define HEADLESS_PROF_VIDEO 0
+#define HEADLESS_PROF_SOUND 1
+#define HEADLESS_PROF_DRIVE 2
+#define HEADLESS_PROF_NUM   3
+
+void headless_prof_begin(int slot);
+void headless_prof_end(int slot);
+
+// Directory standing in for the root of the SD card.
+const char *headless_boot_path(void);
+
+#endif
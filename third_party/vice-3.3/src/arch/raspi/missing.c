@@ -44,7 +44,6 @@
 // ------------------------------------------------------------------------
 
 char *ui_get_file(const char *format, ...) { return 0; }
-char *uimon_get_in(char **p1, const char *p2) { return 0; }
 char video_canvas_can_resize(struct video_canvas_s *canvas) { return 0; }
 int archdep_rtc_get_centisecond(void) { return 0; }
 int c128ui_init_early(void) { return 0; }
@@ -108,12 +107,6 @@ int video_canvas_refresh_dx9(video_canvas_t *canvas, unsigned int xs,
 }
 int video_init(void) { return 0; }
 int vsid_ui_init(void) { return 0; }
-struct console_s *uimon_window_open(void) {
-  return 0;
-}
-struct console_s *uimon_window_resume(void) {
-  return 0;
-}
 ui_jam_action_t ui_jam_dialog(const char *format, ...) { return UI_JAM_NONE; }
 video_canvas_t *video_canvas_create_ddraw(video_canvas_t *canvas) { return 0; }
 video_canvas_t *video_canvas_create_dx9(video_canvas_t *canvas,
@@ -0,0 +1,304 @@
+/*
+ * monitorarch.c - the machine side of the remote binary monitor
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "vice.h"
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "console.h"
+#include "interrupt.h"
+#include "lib.h"
+#include "machine.h"
+#include "maincpu.h"
+#include "mem.h"
+#include "mon_breakpoint.h"
+#include "mon_register.h"
+#include "monitor.h"
+#include "montypes.h"
+#include "uimon.h"
+
+#include "circle.h"
+#include "emux_api.h"
+#include "monitorbmc.h"
+#include "videoarch.h"
+
+// The kernel serves the protocol (src/bmcmonitor.cpp) and calls back in
+// here for anything that touches the machine. That only happens at an
+// instruction boundary: from a trap raised at the end of a frame while
+// the machine runs, or from the monitor's input loop while it is
+// stopped. VICE's own monitor does the stopping and stepping; this file
+// stands in for its console.
+
+#define REMOTE_SNAPSHOT_FILE "/snapshots/remote.vsf"
+
+static console_t remote_console = { 80, 25, 0, 0, NULL };
+static int stop_reported;
+
+static int vice_memspace(int memspace) {
+  int mem = memspace + e_comp_space;
+  if (memspace < BMCMONITOR_MEMSPACE_COMPUTER ||
+      memspace > BMCMONITOR_MEMSPACE_DRIVES ||
+      mon_interfaces[mem] == NULL) {
+    return -1;
+  }
+  if (monitor_diskspace_dnr(mem) >= 0 &&
+      !check_drive_emu_level_ok(monitor_diskspace_dnr(mem) + 8)) {
+    return -1;
+  }
+  return mem;
+}
+
+static int vice_bank(int mem, int bank) {
+  const char **names;
+
+  if (bank < 0) {
+    return mon_interfaces[mem]->current_bank;
+  }
+  names = mon_interfaces[mem]->mem_bank_list();
+  for (; *names != NULL; ++names) {
+    if (mon_interfaces[mem]->mem_bank_from_name(*names) == bank) {
+      return bank;
+    }
+  }
+  return -1;
+}
+
+void monitor_arch_info(int memspace, struct bmcmonitor_info *info) {
+  int mem = vice_memspace(memspace);
+
+  info->machine = machine_class;
+  info->frame = video_frame_count;
+  info->clock = maincpu_clk;
+  info->pc = mem < 0 ? 0 : (uint16_t)monitor_cpu_for_memspace[mem]
+                               ->mon_register_get_val(mem, e_PC);
+}
+
+// mem_ram is laid out the way the "ram" banks read it, so those can be
+// handed out as they are.
+const uint8_t *monitor_arch_ram(int memspace, int bank) {
+  int mem = vice_memspace(memspace);
+
+  if (mem != e_comp_space || (bank = vice_bank(mem, bank)) < 0) {
+    return NULL;
+  }
+  if (bank == mon_interfaces[mem]->mem_bank_from_name("ram")) {
+    return mem_ram;
+  }
+  if (machine_class == VICE_MACHINE_C128 &&
+      bank == mon_interfaces[mem]->mem_bank_from_name("ram1")) {
+    return mem_ram + 0x10000;
+  }
+  return NULL;
+}
+
+int monitor_arch_read(int memspace, int bank, uint16_t start, uint8_t *data,
+                      unsigned int length) {
+  int mem = vice_memspace(memspace);
+  unsigned int i;
+
+  if (mem < 0 || (bank = vice_bank(mem, bank)) < 0) {
+    return 0;
+  }
+  for (i = 0; i < length; ++i) {
+    data[i] = mon_get_mem_val_ex(mem, bank, (uint16_t)(start + i));
+  }
+  return 1;
+}
+
+int monitor_arch_write(int memspace, int bank, uint16_t start,
+                       const uint8_t *data, unsigned int length) {
+  int mem = vice_memspace(memspace);
+  unsigned int i;
+
+  if (mem < 0 || (bank = vice_bank(mem, bank)) < 0) {
+    return 0;
+  }
+  for (i = 0; i < length; ++i) {
+    mon_interfaces[mem]->mem_bank_write(bank, (uint16_t)(start + i), data[i],
+                                        mon_interfaces[mem]->context);
+  }
+  return 1;
+}
+
+const char **monitor_arch_bank_list(int memspace) {
+  int mem = vice_memspace(memspace);
+  return mem < 0 ? NULL : mon_interfaces[mem]->mem_bank_list();
+}
+
+int monitor_arch_bank_number(int memspace, const char *name) {
+  int mem = vice_memspace(memspace);
+  return mem < 0 ? -1 : mon_interfaces[mem]->mem_bank_from_name(name);
+}
+
+int monitor_arch_registers(int memspace, struct bmcmonitor_register *regs,
+                           int max) {
+  int mem = vice_memspace(memspace);
+  mon_reg_list_t *list, *reg;
+  int count = 0;
+
+  if (mem < 0) {
+    return -1;
+  }
+  list = mon_register_list_get(mem);
+  for (reg = list; reg->name != NULL && count < max; ++reg, ++count) {
+    regs[count].name = reg->name;
+    regs[count].id = reg->id;
+    regs[count].bits = reg->size;
+    regs[count].flags =
+        ((reg->flags & MON_REGISTER_IS_FLAGS) ? BMCMONITOR_REGISTER_FLAGS : 0) |
+        ((reg->flags & MON_REGISTER_IS_MEMORY) ? BMCMONITOR_REGISTER_MEMORY
+                                               : 0);
+    regs[count].value = reg->val;
+  }
+  lib_free(list);
+  return count;
+}
+
+int monitor_arch_set_register(int memspace, unsigned int id, uint32_t value) {
+  int mem = vice_memspace(memspace);
+
+  if (mem < 0 || !mon_register_valid(mem, (int)id)) {
+    return 0;
+  }
+  monitor_cpu_for_memspace[mem]->mon_register_set_val(mem, (int)id,
+                                                      (uint16_t)value);
+  return 1;
+}
+
+int monitor_arch_checkpoint_add(int memspace, uint16_t start, uint16_t end,
+                                int ops, int stop) {
+  int mem = vice_memspace(memspace);
+  int op = ((ops & BMCMONITOR_OP_LOAD) ? e_load : 0) |
+           ((ops & BMCMONITOR_OP_STORE) ? e_store : 0) |
+           ((ops & BMCMONITOR_OP_EXEC) ? e_exec : 0);
+
+  if (mem < 0 || op == 0) {
+    return 0;
+  }
+  return mon_breakpoint_add_checkpoint(new_addr(mem, start),
+                                       new_addr(mem, end), stop ? TRUE : FALSE,
+                                       (MEMORY_OP)op, FALSE);
+}
+
+int monitor_arch_checkpoint_delete(int number) {
+  mon_checkpoint_info_t info;
+
+  if (number <= 0 || !mon_breakpoint_next_checkpoint(number - 1, &info) ||
+      info.checknum != number) {
+    return 0;
+  }
+  mon_breakpoint_delete_checkpoint(number);
+  return 1;
+}
+
+int monitor_arch_checkpoint_next(int after, struct bmcmonitor_checkpoint *cp) {
+  mon_checkpoint_info_t info;
+
+  if (!mon_breakpoint_next_checkpoint(after, &info)) {
+    return 0;
+  }
+  cp->number = info.checknum;
+  cp->memspace = addr_memspace(info.start_addr) - e_comp_space;
+  cp->start = (uint16_t)addr_location(info.start_addr);
+  cp->end = (uint16_t)addr_location(info.end_addr);
+  cp->ops = ((info.op & e_load) ? BMCMONITOR_OP_LOAD : 0) |
+            ((info.op & e_store) ? BMCMONITOR_OP_STORE : 0) |
+            ((info.op & e_exec) ? BMCMONITOR_OP_EXEC : 0);
+  cp->stop = info.stop ? 1 : 0;
+  cp->enabled = info.enabled ? 1 : 0;
+  cp->hits = (uint32_t)info.hit_count;
+  return 1;
+}
+
+void monitor_arch_stop(void) { monitor_startup_trap(); }
+
+const char *monitor_arch_snapshot(void) {
+  static char path[] = REMOTE_SNAPSHOT_FILE;
+  return emux_save_state(path) < 0 ? NULL : path;
+}
+
+static void service_trap(uint16_t addr, void *data) {
+  int count;
+  bmcmonitor_service(0, &count);
+}
+
+// Registers only hold the CPU's state at an instruction boundary, so
+// requests wait for the trap. It is left alone when another trap is
+// already pending; there is only one slot and the next frame will do.
+void monitor_arch_vsync(void) {
+  if (bmcmonitor_pending() &&
+      !(maincpu_int_status->global_pending_int & IK_TRAP)) {
+    interrupt_maincpu_trigger_trap(service_trap, NULL);
+  }
+}
+
+// BMC64 has no monitor console. While a client is connected it stands
+// in for one, and the monitor stops for checkpoints instead of going
+// straight back to the emulation.
+struct console_s *uimon_window_open(void) {
+  if (!bmcmonitor_connected()) {
+    return NULL;
+  }
+  stop_reported = 0;
+  return &remote_console;
+}
+
+struct console_s *uimon_window_resume(void) { return uimon_window_open(); }
+
+// The monitor asks for its next command line. Serve the client until it
+// says to go on and answer with the command that does that.
+char *uimon_get_in(char **ppchCommandLine, const char *prompt) {
+  char command[16];
+  int action = BMCMONITOR_NONE;
+  int count = 0;
+
+  if (!stop_reported) {
+    bmcmonitor_notify_stopped(default_memspace - e_comp_space);
+    stop_reported = 1;
+  }
+  while (action == BMCMONITOR_NONE && bmcmonitor_connected()) {
+    action = bmcmonitor_service(1, &count);
+    if (action == BMCMONITOR_NONE) {
+      circle_yield();
+      circle_sleep(1000);
+    }
+  }
+  // Replies may still point into emulated memory.
+  while (!bmcmonitor_idle()) {
+    circle_yield();
+  }
+
+  switch (action) {
+  case BMCMONITOR_STEP:
+    snprintf(command, sizeof command, "z %d", count);
+    break;
+  case BMCMONITOR_NEXT:
+    snprintf(command, sizeof command, "n %d", count);
+    break;
+  default:
+    snprintf(command, sizeof command, "x");
+    break;
+  }
+  return lib_stralloc(command);
+}
@@ -0,0 +1,98 @@
+#ifndef VICE_MONITORBMC_H
+#define VICE_MONITORBMC_H
+
+#include <stdint.h>
+
+/* Memory spaces as the remote monitor numbers them: the computer, then
+   drives 8 to 11. */
+#define BMCMONITOR_MEMSPACE_COMPUTER 0
+#define BMCMONITOR_MEMSPACE_DRIVES   4
+
+/* Checkpoint operations. */
+#define BMCMONITOR_OP_LOAD  0x01
+#define BMCMONITOR_OP_STORE 0x02
+#define BMCMONITOR_OP_EXEC  0x04
+
+/* Register flags. */
+#define BMCMONITOR_REGISTER_FLAGS  0x01 /* shown as bits */
+#define BMCMONITOR_REGISTER_MEMORY 0x02 /* memory mapped, read only here */
+
+/* What a stopped machine should do once bmcmonitor_service returns. */
+#define BMCMONITOR_NONE     0
+#define BMCMONITOR_CONTINUE 1
+#define BMCMONITOR_STEP     2
+#define BMCMONITOR_NEXT     3 /* step over subroutine calls */
+
+struct bmcmonitor_info {
+    uint32_t machine; /* VICE_MACHINE_* */
+    uint32_t frame;
+    uint64_t clock;
+    uint16_t pc;
+};
+
+struct bmcmonitor_register {
+    const char *name;
+    unsigned int id;
+    unsigned int bits;
+    unsigned int flags;
+    uint32_t value;
+};
+
+struct bmcmonitor_checkpoint {
+    int number;
+    int memspace;
+    uint16_t start;
+    uint16_t end;
+    int ops;
+    int stop;
+    int enabled;
+    uint32_t hits;
+};
+
+/* The kernel side lives in src/bmcmonitor.cpp. It owns the socket; the
+   emulation core only looks at its rings. */
+int bmcmonitor_connected(void);
+int bmcmonitor_pending(void);
+/* Runs the waiting requests against the machine, which must be at an
+   instruction boundary. Stops early and returns BMCMONITOR_CONTINUE,
+   _STEP or _NEXT when a stopped machine is told to go on, with the
+   instruction count for steps in *count. */
+int bmcmonitor_service(int stopped, int *count);
+void bmcmonitor_notify_stopped(int memspace);
+/* Whether every reply has gone out, so that memory handed to the
+   network task in place may change again. */
+int bmcmonitor_idle(void);
+
+/* The machine side lives in arch/raspi/monitorarch.c (and in the loopback
+   bench on the host). The kernel only calls these from
+   bmcmonitor_service and bmcmonitor_notify_stopped. */
+void monitor_arch_info(int memspace, struct bmcmonitor_info *info);
+/* The 64K of emulated RAM behind bank, to be read in place, or NULL
+   when the bank is not plain RAM. */
+const uint8_t *monitor_arch_ram(int memspace, int bank);
+/* bank -1 is the bank the monitor has selected. These return 0 for a
+   memory space or bank that does not exist. */
+int monitor_arch_read(int memspace, int bank, uint16_t start, uint8_t *data,
+                      unsigned int length);
+int monitor_arch_write(int memspace, int bank, uint16_t start,
+                       const uint8_t *data, unsigned int length);
+const char **monitor_arch_bank_list(int memspace);
+int monitor_arch_bank_number(int memspace, const char *name);
+/* Returns the number of registers, or -1 for a bad memory space. */
+int monitor_arch_registers(int memspace, struct bmcmonitor_register *regs,
+                           int max);
+int monitor_arch_set_register(int memspace, unsigned int id, uint32_t value);
+/* Returns the new checkpoint's number, or 0. */
+int monitor_arch_checkpoint_add(int memspace, uint16_t start, uint16_t end,
+                                int ops, int stop);
+int monitor_arch_checkpoint_delete(int number);
+/* Fills in the lowest numbered checkpoint above after; 0 when done. */
+int monitor_arch_checkpoint_next(int after, struct bmcmonitor_checkpoint *cp);
+void monitor_arch_stop(void);
+/* Writes a snapshot and returns the file's path, or NULL. */
+const char *monitor_arch_snapshot(void);
+
+/* Called once a frame from vsyncarch_presync. */
+void monitor_arch_vsync(void);
+
+#endif
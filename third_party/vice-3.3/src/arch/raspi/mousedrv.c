@@ -29,6 +29,7 @@
 #include <stdio.h>
 
 // RASPI includes
+#include "emux_api.h"
 #include "videoarch.h"
 
 static int mouse_x, mouse_y;
@@ -57,28 +58,55 @@ int mousedrv_get_y(void) { return mouse_y; }
 
 unsigned long mousedrv_get_timestamp(void) { return mouse_timestamp; }
 
+// USB mouse reports arrive on another core. They are queued with the
+// other input so the emulator applies them between frames.
 void emu_mouse_move(int x, int y) {
-  mouse_x += x;
-  mouse_y -= y;
-  mouse_timestamp = vsyncarch_gettime();
+  emux_mouse_move_interrupt(x, y);
 }
 
 void emu_mouse_button_left(int pressed) {
-  mouse_funcs.mbl(pressed);
+  emux_mouse_button_interrupt(INPUT_MOUSE_LEFT, pressed);
 }
 
 void emu_mouse_button_right(int pressed) {
-  mouse_funcs.mbr(pressed);
+  emux_mouse_button_interrupt(INPUT_MOUSE_RIGHT, pressed);
 }
 
 void emu_mouse_button_middle(int pressed) {
-  mouse_funcs.mbm(pressed);
+  emux_mouse_button_interrupt(INPUT_MOUSE_MIDDLE, pressed);
 }
 
 void emu_mouse_wheel_up(int pressed) {
-  mouse_funcs.mbu(pressed);
+  emux_mouse_button_interrupt(INPUT_MOUSE_WHEEL_UP, pressed);
 }
 
 void emu_mouse_wheel_down(int pressed) {
-  mouse_funcs.mbd(pressed);
+  emux_mouse_button_interrupt(INPUT_MOUSE_WHEEL_DOWN, pressed);
+}
+
+void mousedrv_input_event(struct input_event *ev) {
+  if (ev->type == INPUT_EVENT_MOUSE_MOVE) {
+    mouse_x += ev->dx;
+    mouse_y -= ev->dy;
+    mouse_timestamp = vsyncarch_gettime();
+    return;
+  }
+
+  switch (ev->key) {
+  case INPUT_MOUSE_LEFT:
+    mouse_funcs.mbl(ev->value);
+    break;
+  case INPUT_MOUSE_RIGHT:
+    mouse_funcs.mbr(ev->value);
+    break;
+  case INPUT_MOUSE_MIDDLE:
+    mouse_funcs.mbm(ev->value);
+    break;
+  case INPUT_MOUSE_WHEEL_UP:
+    mouse_funcs.mbu(ev->value);
+    break;
+  case INPUT_MOUSE_WHEEL_DOWN:
+    mouse_funcs.mbd(ev->value);
+    break;
+  }
 }
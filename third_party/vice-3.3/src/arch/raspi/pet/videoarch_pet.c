@@ -28,11 +28,14 @@
 
 #include <stdlib.h>
 
+#include "archdep.h"
 #include "emux_api.h"
+#include "lib.h"
 #include "pet/pet.h"
 #include "pet/petmem.h"
 #include "pet/petmodel.h"
 #include "resources.h"
+#include "util.h"
 
 static unsigned int white_color_palette[] = {
     0x00, 0x00, 0x00, 0xFF, 0xFF, 0xFF,
@@ -55,8 +58,14 @@ void set_refresh_rate(struct video_canvas_s *canvas) {
 }
 
 void set_video_font(void) {
+  char* path = util_concat(archdep_boot_path(), "/PET/chargen", NULL);
+  FILE* fp = fopen(path, "r");
+  lib_free(path);
+  if (!fp) {
+    return;
+  }
+
   uint8_t* chargen = malloc(4096); // never freed
-  FILE* fp = fopen("PET/CHARGEN", "r");
   fread(chargen,1,2048,fp);
   fseek(fp, 0, SEEK_SET);
   fread(chargen+2048,1,2048,fp);
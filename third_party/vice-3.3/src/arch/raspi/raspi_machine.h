@@ -38,6 +38,8 @@ extern unsigned int *raspi_get_palette(int display, int index);
 extern int is_vic(struct video_canvas_s *canvas);
 extern int is_vdc(struct video_canvas_s *canvas);
 void cartridge_freeze(void);
+void cartridge_forget_attached(void);
+void cartridge_record_attached(void);
 void set_canvas_size(int index, int* w, int *h, int *gw, int *gh);
 void set_canvas_borders(int index, int *w, int *h);
 void emux_machine_load_settings_done(void);
@@ -0,0 +1,164 @@
+/*
+ * rawnetarch.c - CS8900 frames over the Raspberry Pi's network device
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "vice.h"
+
+#ifdef HAVE_RAWNET
+
+#include <stdint.h>
+
+#include "lib.h"
+#include "log.h"
+#include "rawnetarch.h"
+#include "rawnetbmc.h"
+
+// The kernel bridges the frames (src/bmcether.cpp). It also filters
+// them by the cartridge's receive settings, so a busy network costs the
+// emulation core nothing for frames the C64 would throw away.
+
+// There is only the one adapter, whichever device Network uses.
+#define BMCETHER_INTERFACE "bmc64"
+
+static log_t rawnet_arch_log = LOG_ERR;
+
+static int receive_flags;
+static int receiver_enabled;
+static int transmitter_enabled;
+static int enum_done;
+
+int rawnet_arch_enumadapter_open(void) {
+  enum_done = 0;
+  return 1;
+}
+
+int rawnet_arch_enumadapter(char **ppname, char **ppdescription) {
+  if (enum_done) {
+    return 0;
+  }
+  enum_done = 1;
+  *ppname = lib_stralloc(BMCETHER_INTERFACE);
+  *ppdescription = lib_stralloc("Raspberry Pi network device");
+  return 1;
+}
+
+int rawnet_arch_enumadapter_close(void) { return 1; }
+
+char *rawnet_arch_get_standard_interface(void) {
+  return lib_stralloc(BMCETHER_INTERFACE);
+}
+
+int rawnet_arch_init(void) {
+  rawnet_arch_log = log_open("TFEARCH");
+  return 1;
+}
+
+void rawnet_arch_pre_reset(void) {}
+
+void rawnet_arch_post_reset(void) {}
+
+int rawnet_arch_activate(const char *interface_name) {
+  if (!bmcether_activate()) {
+    log_message(rawnet_arch_log, "No network device for %s; "
+                "select Ethernet or WiFi in the Network menu",
+                interface_name);
+    return 0;
+  }
+  return 1;
+}
+
+void rawnet_arch_deactivate(void) {
+  struct bmcether_stats stats;
+
+  bmcether_deactivate();
+  bmcether_get_stats(&stats);
+  log_message(rawnet_arch_log,
+              "rx %u frames, %u filtered, %u dropped, %u delivered (%u bytes); "
+              "tx %u frames (%u bytes), %u dropped",
+              (unsigned)stats.rx_frames, (unsigned)stats.rx_filtered,
+              (unsigned)stats.rx_dropped, (unsigned)stats.rx_delivered,
+              (unsigned)stats.rx_bytes, (unsigned)stats.tx_frames,
+              (unsigned)stats.tx_bytes, (unsigned)stats.tx_dropped);
+}
+
+void rawnet_arch_set_mac(const uint8_t mac[6]) { bmcether_set_mac(mac); }
+
+void rawnet_arch_set_hashfilter(const uint32_t hash_mask[2]) {
+  bmcether_set_hashfilter(hash_mask);
+}
+
+static void update_receive(void) {
+  bmcether_set_receive(receive_flags |
+                       (receiver_enabled ? BMCETHER_RX_ENABLE : 0));
+}
+
+// bCorrect only decides whether frames with bad CRCs are wanted. The
+// network device never passes those on.
+void rawnet_arch_recv_ctl(int bBroadcast, int bIA, int bMulticast,
+                          int bCorrect, int bPromiscuous, int bIAHash) {
+  (void)bCorrect;
+  receive_flags = (bBroadcast ? BMCETHER_RX_BROADCAST : 0) |
+                  (bIA ? BMCETHER_RX_IA : 0) |
+                  (bMulticast ? BMCETHER_RX_MULTICAST : 0) |
+                  (bPromiscuous ? BMCETHER_RX_PROMISCUOUS : 0) |
+                  (bIAHash ? BMCETHER_RX_IAHASH : 0);
+  update_receive();
+}
+
+void rawnet_arch_line_ctl(int bEnableTransmitter, int bEnableReceiver) {
+  transmitter_enabled = bEnableTransmitter;
+  receiver_enabled = bEnableReceiver;
+  update_receive();
+}
+
+// The device adds the CRC and any padding itself.
+void rawnet_arch_transmit(int force, int onecoll, int inhibit_crc,
+                          int tx_pad_dis, int txlength, uint8_t *txframe) {
+  (void)force;
+  (void)onecoll;
+  (void)inhibit_crc;
+  (void)tx_pad_dis;
+  if (transmitter_enabled) {
+    bmcether_transmit(txframe, txlength);
+  }
+}
+
+int rawnet_arch_receive(uint8_t *pbuffer, int *plen, int *phashed,
+                        int *phash_index, int *prx_ok, int *pcorrect_mac,
+                        int *pbroadcast, int *pcrc_error) {
+  int flags;
+
+  if (!bmcether_receive(pbuffer, plen, &flags, phash_index)) {
+    return 0;
+  }
+  if (*plen & 1) {
+    ++*plen;
+  }
+  *phashed = (flags & BMCETHER_FRAME_HASHED) ? 1 : 0;
+  *pcorrect_mac = (flags & BMCETHER_FRAME_CORRECT_MAC) ? 1 : 0;
+  *pbroadcast = (flags & BMCETHER_FRAME_BROADCAST) ? 1 : 0;
+  *pcrc_error = 0;
+  *prx_ok = 1;
+  return 1;
+}
+
+#endif
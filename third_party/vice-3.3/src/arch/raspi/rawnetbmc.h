@@ -0,0 +1,45 @@
+#ifndef VICE_RAWNETBMC_H
+#define VICE_RAWNETBMC_H
+
+#include <stdint.h>
+
+/* Receive filter flags, from the CS8900 RxCTL and LineCTL registers. */
+#define BMCETHER_RX_ENABLE      0x01
+#define BMCETHER_RX_BROADCAST   0x02
+#define BMCETHER_RX_IA          0x04
+#define BMCETHER_RX_MULTICAST   0x08
+#define BMCETHER_RX_PROMISCUOUS 0x10
+#define BMCETHER_RX_IAHASH      0x20
+
+/* Why bmcether_receive's frame passed the filter. A frame with none of
+   these set (multicast, promiscuous) is left to the CS8900 to classify. */
+#define BMCETHER_FRAME_CORRECT_MAC 0x01
+#define BMCETHER_FRAME_BROADCAST   0x02
+#define BMCETHER_FRAME_HASHED      0x04
+
+struct bmcether_stats {
+    uint32_t rx_frames;     /* seen on the network */
+    uint32_t rx_filtered;   /* not for the cartridge */
+    uint32_t rx_dropped;    /* for the cartridge, but its ring was full */
+    uint32_t rx_delivered;  /* read by the CS8900 */
+    uint32_t rx_bytes;
+    uint32_t tx_frames;     /* handed to the network device */
+    uint32_t tx_dropped;
+    uint32_t tx_bytes;
+};
+
+/* The kernel side lives in src/bmcether.cpp. Everything here is called
+   from the emulation core and only touches the frame rings. */
+int bmcether_activate(void);
+void bmcether_deactivate(void);
+void bmcether_set_mac(const uint8_t mac[6]);
+void bmcether_set_hashfilter(const uint32_t hash_mask[2]);
+void bmcether_set_receive(int flags);
+int bmcether_transmit(const uint8_t *frame, int length);
+/* Copies the oldest waiting frame, at most *length bytes, straight out
+   of the ring. Returns 0 when there is none. */
+int bmcether_receive(uint8_t *buffer, int *length, int *frame_flags,
+                     int *hash_index);
+void bmcether_get_stats(struct bmcether_stats *stats);
+
+#endif
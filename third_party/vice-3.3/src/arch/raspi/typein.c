@@ -0,0 +1,584 @@
+/*
+ * typein.c - fast entry of BASIC listings from text files
+ *
+ * Written by
+ *  Randy Rossi <randy.rossi@gmail.com>
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#include "typein.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// VICE includes
+#include "alarm.h"
+#include "charset.h"
+#include "kbdbuf.h"
+#include "lib.h"
+#include "machine.h"
+#include "maincpu.h"
+#include "mem.h"
+#include "resources.h"
+
+// RASPI includes
+#include "circle.h"
+#include "overlay.h"
+
+// Largest listing we will read.
+#define TYPEIN_MAX_FILE (64 * 1024)
+
+// Longest tokenized line we will store.
+#define TYPEIN_MAX_LINE 255
+
+// How often we try to flush the keyboard queue into the KERNAL's
+// buffer while typing. Once a frame (what kbdbuf does on its own) is
+// far slower than the KERNAL can accept characters.
+#define TYPEIN_POLL_CYCLES 2000
+
+// How much text we hand to kbdbuf at a time.
+#define TYPEIN_CHUNK 256
+
+#define TOKEN_DATA 0x83
+#define TOKEN_REM 0x8f
+#define TOKEN_PRINT 0x99
+
+// BASIC V2 keywords, tokens 0x80 - 0xcb. Stored as they appear after
+// ASCII to PETSCII conversion of a lower case listing.
+static const char *basic_v2_keywords[] = {
+  "END",   "FOR",    "NEXT", "DATA", "INPUT#",  "INPUT",  "DIM",    "READ",
+  "LET",   "GOTO",   "RUN",  "IF",   "RESTORE", "GOSUB",  "RETURN", "REM",
+  "STOP",  "ON",     "WAIT", "LOAD", "SAVE",    "VERIFY", "DEF",    "POKE",
+  "PRINT#", "PRINT", "CONT", "LIST", "CLR",     "CMD",    "SYS",    "OPEN",
+  "CLOSE", "GET",    "NEW",  "TAB(", "TO",      "FN",     "SPC(",   "THEN",
+  "NOT",   "STEP",   "+",    "-",    "*",       "/",      "^",      "AND",
+  "OR",    ">",      "=",    "<",    "SGN",     "INT",    "ABS",    "USR",
+  "FRE",   "POS",    "SQR",  "RND",  "LOG",     "EXP",    "COS",    "SIN",
+  "TAN",   "ATN",    "PEEK", "LEN",  "STR$",    "VAL",    "ASC",    "CHR$",
+  "LEFT$", "RIGHT$", "MID$", "GO",
+};
+
+// BASIC 3.5 and 7.0 keywords, tokens 0xcc - 0xfd. On the C128, 0xce
+// is a prefix byte rather than RLUM.
+static const char *basic_35_keywords[] = {
+  "RGR",      "RCLR",   "RLUM",    "JOY",     "RDOT",   "DEC",    "HEX$",
+  "ERR$",     "INSTR",  "ELSE",    "RESUME",  "TRAP",   "TRON",   "TROFF",
+  "SOUND",    "VOL",    "AUTO",    "PUDEF",   "GRAPHIC", "PAINT", "CHAR",
+  "BOX",      "CIRCLE", "GSHAPE",  "SSHAPE",  "DRAW",   "LOCATE", "COLOR",
+  "SCNCLR",   "SCALE",  "HELP",    "DO",      "LOOP",   "EXIT",
+  "DIRECTORY", "DSAVE", "DLOAD",   "HEADER",  "SCRATCH", "COLLECT", "COPY",
+  "RENAME",   "BACKUP", "DELETE",  "RENUMBER", "KEY",   "MONITOR", "USING",
+  "UNTIL",    "WHILE",
+};
+
+// BASIC 7.0 keywords following the 0xce prefix, starting at 0x02.
+static const char *basic_7_ce_keywords[] = {
+  "POT", "BUMP", "PEN", "RSPPOS", "RSPRITE", "RSPCOLOR", "XOR", "RWINDOW",
+  "POINTER",
+};
+
+// BASIC 7.0 keywords following the 0xfe prefix, starting at 0x02.
+static const char *basic_7_fe_keywords[] = {
+  "BANK",     "FILTER", "PLAY",     "TEMPO",  "MOVSPR",  "SPRITE", "SPRCOLOR",
+  "RREG",     "ENVELOPE", "SLEEP",  "CATALOG", "DOPEN",  "APPEND", "DCLOSE",
+  "BSAVE",    "BLOAD",  "RECORD",   "CONCAT", "DVERIFY", "DCLEAR", "SPRSAV",
+  "COLLISION", "BEGIN", "BEND",     "WINDOW", "BOOT",    "WIDTH",  "SPRDEF",
+  "QUIT",     "STASH",  "",         "FETCH",  "",        "SWAP",   "OFF",
+  "FAST",     "SLOW",
+};
+
+#define NUM_KEYWORDS(a) ((int)(sizeof(a) / sizeof(a[0])))
+
+struct typein_line {
+  int number;
+  // Position in the file, so later duplicates replace earlier ones.
+  int order;
+  int len;
+  uint8_t *data;
+};
+
+// Keyboard mode state. Only touched from the emulator thread.
+static uint8_t *typein_text;
+static int typein_size;
+static int typein_pos;
+static int typein_active;
+static int typein_warp_before;
+static unsigned long typein_start_ticks;
+static int typein_frames;
+static alarm_t *typein_alarm;
+
+// Reads the whole file. Caller frees with lib_free.
+static uint8_t *read_text_file(const char *filename, int *size) {
+  FILE *fp = fopen(filename, "r");
+  if (fp == NULL) {
+    return NULL;
+  }
+
+  uint8_t *buf = lib_malloc(TYPEIN_MAX_FILE + 1);
+  *size = fread(buf, 1, TYPEIN_MAX_FILE + 1, fp);
+  fclose(fp);
+
+  if (*size > TYPEIN_MAX_FILE) {
+    printf("Type in file %s too large\n", filename);
+    lib_free(buf);
+    return NULL;
+  }
+  return buf;
+}
+
+// Upper case ASCII letters come out of charset_p_topetcii as shifted
+// PETSCII (0xc1 - 0xda), which the ROM would never take for a keyword.
+// This gives them the unshifted code lower case letters convert to.
+static uint8_t fold_case(uint8_t c) {
+  return (c >= 0xc1 && c <= 0xda) ? c - 0x80 : c;
+}
+
+// Returns -1 for characters that should be dropped.
+static int to_petscii(uint8_t c) {
+  if (c == '\n') {
+    return 0x0d;
+  } else if (c == '\t') {
+    return ' ';
+  } else if (c < 0x20) {
+    return -1;
+  }
+  return charset_p_topetcii(c);
+}
+
+// Converts a listing to PETSCII, dropping control characters, and
+// returns its new length. out may be text. A listing with no lower
+// case letters at all was written the way the machine shows it, so all
+// of it, strings too, is folded to unshifted PETSCII. In a mixed case
+// listing only keywords and names are folded, by tokenize_line.
+static int listing_to_petscii(const uint8_t *text, int size, uint8_t *out) {
+  int upper = 1;
+  int i, n = 0;
+
+  for (i = 0; i < size; i++) {
+    if (text[i] >= 'a' && text[i] <= 'z') {
+      upper = 0;
+      break;
+    }
+  }
+  for (i = 0; i < size; i++) {
+    int c = to_petscii(text[i]);
+    if (c >= 0) {
+      out[n++] = upper ? fold_case(c) : c;
+    }
+  }
+  return n;
+}
+
+// Compare keyword against PETSCII text, ignoring case. Returns keyword
+// length on match, 0 otherwise.
+static int match_keyword(const char *kw, const uint8_t *p, int remain) {
+  int len = strlen(kw);
+  int i;
+  if (len == 0 || len > remain) {
+    return 0;
+  }
+  for (i = 0; i < len; i++) {
+    if ((uint8_t)kw[i] != fold_case(p[i])) {
+      return 0;
+    }
+  }
+  return len;
+}
+
+// Tokenize one keyword at p. The V2 table is searched in token order
+// and the first hit wins, same as the ROM's crunch routine. Extension
+// tables are only tried when V2 has no match, and there the longest
+// keyword wins so DOPEN is not taken for DO. Returns the number of
+// source bytes consumed and fills in up to two token bytes.
+static int tokenize_keyword(const uint8_t *p, int remain, uint8_t *tok,
+                            int *tok_len) {
+  int i, len;
+  int best_len = 0;
+
+  for (i = 0; i < NUM_KEYWORDS(basic_v2_keywords); i++) {
+    len = match_keyword(basic_v2_keywords[i], p, remain);
+    if (len) {
+      tok[0] = 0x80 + i;
+      *tok_len = 1;
+      return len;
+    }
+  }
+
+  if (machine_class != VICE_MACHINE_PLUS4 &&
+      machine_class != VICE_MACHINE_C128) {
+    return 0;
+  }
+
+  for (i = 0; i < NUM_KEYWORDS(basic_35_keywords); i++) {
+    if (machine_class == VICE_MACHINE_C128 && 0xcc + i == 0xce) {
+      continue;
+    }
+    len = match_keyword(basic_35_keywords[i], p, remain);
+    if (len > best_len) {
+      best_len = len;
+      tok[0] = 0xcc + i;
+      *tok_len = 1;
+    }
+  }
+
+  if (machine_class != VICE_MACHINE_C128) {
+    return best_len;
+  }
+
+  for (i = 0; i < NUM_KEYWORDS(basic_7_ce_keywords); i++) {
+    len = match_keyword(basic_7_ce_keywords[i], p, remain);
+    if (len > best_len) {
+      best_len = len;
+      tok[0] = 0xce;
+      tok[1] = 0x02 + i;
+      *tok_len = 2;
+    }
+  }
+
+  for (i = 0; i < NUM_KEYWORDS(basic_7_fe_keywords); i++) {
+    len = match_keyword(basic_7_fe_keywords[i], p, remain);
+    if (len > best_len) {
+      best_len = len;
+      tok[0] = 0xfe;
+      tok[1] = 0x02 + i;
+      *tok_len = 2;
+    }
+  }
+
+  return best_len;
+}
+
+// Tokenize a single PETSCII line (no line terminator) into out. Lines
+// that don't start with a line number are skipped and get number -1.
+// Returns the number of bytes written, 0 for a line number alone (which
+// deletes that line, as in the ROM) or -1 on error.
+static int tokenize_line(const uint8_t *src, int len, int *number,
+                         uint8_t *out) {
+  int i = 0;
+  int n = 0;
+  int num = 0;
+  int have_num = 0;
+  int quote = 0;
+  int data = 0;
+  int rem = 0;
+
+  *number = -1;
+  while (i < len && src[i] == ' ') i++;
+  while (i < len && src[i] >= '0' && src[i] <= '9') {
+    num = num * 10 + (src[i] - '0');
+    if (num > 63999) {
+      return -1;
+    }
+    have_num = 1;
+    i++;
+  }
+  if (!have_num) {
+    return 0;
+  }
+  while (i < len && src[i] == ' ') i++;
+
+  while (i < len) {
+    uint8_t c = src[i];
+    uint8_t tok[2];
+    int tok_len;
+    int consumed;
+
+    if (n + 2 > TYPEIN_MAX_LINE) {
+      return -1;
+    }
+
+    // Keywords and names in either case. Strings and REMs keep theirs.
+    if (!rem && !quote) {
+      c = fold_case(c);
+    }
+    if (rem || c >= 0x80) {
+      out[n++] = c;
+      i++;
+      continue;
+    }
+    if (c == '"') {
+      quote = !quote;
+      out[n++] = c;
+      i++;
+      continue;
+    }
+    if (quote) {
+      out[n++] = c;
+      i++;
+      continue;
+    }
+    if (data) {
+      if (c == ':') {
+        data = 0;
+      }
+      out[n++] = c;
+      i++;
+      continue;
+    }
+    if (c == '?') {
+      out[n++] = TOKEN_PRINT;
+      i++;
+      continue;
+    }
+
+    consumed = tokenize_keyword(src + i, len - i, tok, &tok_len);
+    if (consumed) {
+      memcpy(out + n, tok, tok_len);
+      n += tok_len;
+      i += consumed;
+      if (tok_len == 1 && tok[0] == TOKEN_REM) {
+        rem = 1;
+      } else if (tok_len == 1 && tok[0] == TOKEN_DATA) {
+        data = 1;
+      }
+    } else {
+      out[n++] = c;
+      i++;
+    }
+  }
+
+  *number = num;
+  return n;
+}
+
+static int compare_lines(const void *a, const void *b) {
+  const struct typein_line *la = (const struct typein_line *)a;
+  const struct typein_line *lb = (const struct typein_line *)b;
+  if (la->number != lb->number) {
+    return la->number - lb->number;
+  }
+  return la->order - lb->order;
+}
+
+// Highest address BASIC text may occupy.
+static int basic_text_top(void) {
+  switch (machine_class) {
+    case VICE_MACHINE_C128:
+      return mem_read(0x1212) | (mem_read(0x1213) << 8);
+    case VICE_MACHINE_PET:
+      return mem_read(0x34) | (mem_read(0x35) << 8);
+    default:
+      return mem_read(0x37) | (mem_read(0x38) << 8);
+  }
+}
+
+int typein_tokenize_file(const char *filename) {
+  int size;
+  int i;
+  int num_lines = 0;
+  int max_lines = 1;
+  int pool_used = 0;
+  int line_start = 0;
+  int rc = -1;
+  uint16_t start;
+  unsigned long ticks = circle_get_ticks();
+
+  uint8_t *raw = read_text_file(filename, &size);
+  if (raw == NULL) {
+    return -1;
+  }
+
+  for (i = 0; i < size; i++) {
+    if (raw[i] == '\n') max_lines++;
+  }
+
+  // Converted text is never longer than the raw text and tokenized
+  // lines are never longer than their source, so one pool of the file
+  // size holds everything.
+  uint8_t *petscii = lib_malloc(size + 1);
+  uint8_t *pool = lib_malloc(size + 1);
+  struct typein_line *lines = lib_malloc(max_lines * sizeof(struct typein_line));
+  uint8_t line_buf[TYPEIN_MAX_LINE];
+
+  int plen = listing_to_petscii(raw, size, petscii);
+  petscii[plen++] = 0x0d;
+
+  for (i = 0; i < plen; i++) {
+    if (petscii[i] != 0x0d) {
+      continue;
+    }
+    int number;
+    int n = tokenize_line(petscii + line_start, i - line_start, &number,
+                          line_buf);
+    if (n < 0) {
+      printf("Type in: bad line at offset %d\n", line_start);
+      goto done;
+    }
+    if (number >= 0) {
+      lines[num_lines].number = number;
+      lines[num_lines].order = num_lines;
+      lines[num_lines].len = n;
+      lines[num_lines].data = pool + pool_used;
+      memcpy(pool + pool_used, line_buf, n);
+      pool_used += n;
+      num_lines++;
+    }
+    line_start = i + 1;
+  }
+
+  if (num_lines == 0) {
+    goto done;
+  }
+
+  qsort(lines, num_lines, sizeof(struct typein_line), compare_lines);
+
+  mem_get_basic_text(&start, NULL);
+  int top = basic_text_top();
+  int addr = start;
+  int written = 0;
+
+  for (i = 0; i < num_lines; i++) {
+    // Same line number entered again replaces the earlier one.
+    if (i + 1 < num_lines && lines[i + 1].number == lines[i].number) {
+      continue;
+    }
+    // A line number alone deletes the line.
+    if (lines[i].len == 0) {
+      continue;
+    }
+    int next = addr + 4 + lines[i].len + 1;
+    if (next + 2 > top) {
+      printf("Type in: listing does not fit in BASIC memory\n");
+      goto done;
+    }
+    mem_inject(addr, next & 0xff);
+    mem_inject(addr + 1, next >> 8);
+    mem_inject(addr + 2, lines[i].number & 0xff);
+    mem_inject(addr + 3, lines[i].number >> 8);
+    for (int j = 0; j < lines[i].len; j++) {
+      mem_inject(addr + 4 + j, lines[i].data[j]);
+    }
+    mem_inject(addr + 4 + lines[i].len, 0);
+    addr = next;
+    written++;
+  }
+  mem_inject(addr, 0);
+  mem_inject(addr + 1, 0);
+  mem_set_basic_text(start, addr + 2);
+
+  printf("Type in: tokenized %d lines ($%04x-$%04x) in %lu us\n",
+         written, start, addr + 2, circle_get_ticks() - ticks);
+  rc = 0;
+
+done:
+  lib_free(lines);
+  lib_free(pool);
+  lib_free(petscii);
+  lib_free(raw);
+  return rc;
+}
+
+static void typein_alarm_triggered(CLOCK offset, void *data) {
+  alarm_unset(typein_alarm);
+  if (!typein_active) {
+    return;
+  }
+  kbdbuf_flush();
+  alarm_set(typein_alarm, maincpu_clk + TYPEIN_POLL_CYCLES);
+}
+
+static void typein_finish(void) {
+  unsigned long elapsed = circle_get_ticks() - typein_start_ticks;
+
+  typein_active = 0;
+  alarm_unset(typein_alarm);
+  lib_free(typein_text);
+  typein_text = NULL;
+
+  if (!typein_warp_before) {
+    resources_set_int("WarpMode", 0);
+    overlay_warp_changed(0);
+  }
+
+  printf("Type in: %d bytes in %lu ms (%d frames)\n", typein_size,
+         elapsed / 1000, typein_frames);
+}
+
+int typein_keyboard_file(const char *filename) {
+  int size;
+
+  if (typein_active) {
+    return -1;
+  }
+
+  uint8_t *raw = read_text_file(filename, &size);
+  if (raw == NULL) {
+    return -1;
+  }
+
+  // Converted in place, never grows.
+  typein_size = listing_to_petscii(raw, size, raw);
+  typein_text = raw;
+  typein_pos = 0;
+  typein_frames = 0;
+  typein_start_ticks = circle_get_ticks();
+
+  if (typein_alarm == NULL) {
+    typein_alarm = alarm_new(maincpu_alarm_context, "TypeIn",
+                             typein_alarm_triggered, NULL);
+  }
+
+  resources_get_int("WarpMode", &typein_warp_before);
+  if (!typein_warp_before) {
+    resources_set_int("WarpMode", 1);
+    overlay_warp_changed(1);
+  }
+
+  typein_active = 1;
+  alarm_set(typein_alarm, maincpu_clk + TYPEIN_POLL_CYCLES);
+  return 0;
+}
+
+void typein_frame(void) {
+  char chunk[TYPEIN_CHUNK + 1];
+
+  if (!typein_active) {
+    return;
+  }
+
+  typein_frames++;
+
+  // Keep kbdbuf's queue topped up. It refuses a chunk that doesn't fit
+  // so we just try again next frame.
+  while (typein_pos < typein_size) {
+    int n = typein_size - typein_pos;
+    if (n > TYPEIN_CHUNK) {
+      n = TYPEIN_CHUNK;
+    }
+    memcpy(chunk, typein_text + typein_pos, n);
+    chunk[n] = '\0';
+    if (kbdbuf_feed(chunk) < 0) {
+      if (kbdbuf_num_pending() == 0) {
+        // Nothing queued and still refused. Keyboard buffer is
+        // disabled for this machine.
+        printf("Type in: keyboard buffer unavailable\n");
+        typein_finish();
+      }
+      return;
+    }
+    typein_pos += n;
+  }
+
+  if (kbdbuf_num_pending() == 0 && kbdbuf_is_empty()) {
+    typein_finish();
+  }
+}
@@ -0,0 +1,44 @@
+/*
+ * typein.h - fast entry of BASIC listings from text files
+ *
+ * Written by
+ *  Randy Rossi <randy.rossi@gmail.com>
+ *
+ * This file is part of VICE, the Versatile Commodore Emulator.
+ * See README for copyright notice.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA
+ *  02111-1307  USA.
+ *
+ */
+
+#ifndef RASPI_TYPEIN_H
+#define RASPI_TYPEIN_H
+
+#include "vice.h"
+
+// Tokenize an ASCII listing and place it directly into BASIC program
+// memory. Machine should be sitting at the READY prompt. Returns
+// negative on error.
+int typein_tokenize_file(const char *filename);
+
+// Feed an ASCII listing through the KERNAL keyboard buffer as fast as
+// the KERNAL will take it, in warp. Returns negative on error.
+int typein_keyboard_file(const char *filename);
+
+// Called once per frame from vsyncarch_presync.
+void typein_frame(void);
+
+#endif
@@ -34,6 +34,7 @@
 
 // VICE includes
 #include "raspi_machine.h"
+#include "typein.h"
 #include "autostart.h"
 #include "diskimage.h"
 #include "attach.h"
@@ -62,7 +63,9 @@
 
 // RASPI includes
 #include "circle.h"
+#include "input_record.h"
 #include "keycodes.h"
+#include "overlay.h"
 
 struct menu_item *sid_dual_item;
 struct menu_item *sid_base_address_item;
@@ -212,6 +215,7 @@ void emux_detach_disk(int unit) {
 void emux_detach_cart(int bank) {
   // Ignore bank for vice
   cartridge_detach_image(CARTRIDGE_NONE);
+  cartridge_forget_attached();
 }
 
 void emux_set_cart_default(void) {
@@ -224,7 +228,13 @@ void emux_reset(int soft) {
 }
 
 int emux_save_state(char *filename) {
+  // The snapshot is built in RAM; the card gets it in the background.
+  circle_save_begin(filename);
   int status = machine_write_snapshot(filename, 1, 1, 0);
+  circle_save_end();
+  if (circle_save_progress() >= 0) {
+    overlay_save_progress_changed(circle_save_progress());
+  }
   if (status < 0) {
     const char *module = snapshot_get_current_module();
     log_error(LOG_DEFAULT,
@@ -321,6 +331,76 @@ int emux_autostart_file(char* filename) {
    return autostart_autodetect(filename, NULL, 0, AUTOSTART_MODE_RUN);
 }
 
+int emux_type_text_file(char* filename, int mode) {
+   if (mode == EMUX_TYPEIN_TOKENIZE) {
+      return typein_tokenize_file(filename);
+   }
+   return typein_keyboard_file(filename);
+}
+
+// What a replay has to match for the same input to do the same thing.
+// Ones this machine doesn't have are skipped.
+static const char *recorded_settings[] = {
+  "KeymapIndex", "JoyPort1Device", "JoyPort2Device", "JoyPort3Device",
+  "JoyPort4Device", "UserportJoy", "UserportJoyType", "Mouse",
+  "C128ColumnKey", "RAMBlock0", "RAMBlock1", "RAMBlock2", "RAMBlock3",
+  "RAMBlock5", "VirtualDevices", "Datasette", "DatasetteResetWithCPU",
+  "DriveSoundEmulation", "SidEngine", "SidModel", "SidFilters",
+  "SidResidSampling", "SidResidPassband", "SidResid8580Passband",
+  "SidStereo", "SidStereoAddressStart", "Sid2Model",
+};
+
+static const char *recorded_unit_settings[] = {
+  "Drive%dType", "Drive%dParallelCable", "IECDevice%d",
+  "FileSystemDevice%d",
+};
+
+static void record_setting(const char *name) {
+  int value;
+  if (resources_query_type(name) == RES_INTEGER &&
+      resources_get_int(name, &value) == 0) {
+    input_record_setting(name, value);
+  }
+}
+
+void emux_record_machine_state(void) {
+  char name[32];
+  const char *path;
+  int i, unit;
+
+  // Settings first; drive types decide what an image attaches to.
+  for (i = 0; i < sizeof(recorded_settings) / sizeof(*recorded_settings);
+       i++) {
+    record_setting(recorded_settings[i]);
+  }
+  for (unit = 8; unit <= 11; unit++) {
+    for (i = 0; i < sizeof(recorded_unit_settings) /
+                    sizeof(*recorded_unit_settings); i++) {
+      snprintf(name, sizeof(name), recorded_unit_settings[i], unit);
+      record_setting(name);
+    }
+  }
+
+  for (unit = 8; unit <= 11; unit++) {
+    path = file_system_get_disk_name(unit);
+    if (path && *path) {
+      input_record_attach(INPUT_RECORD_ATTACH_DISK, unit, path);
+    }
+  }
+  path = tape_get_file_name();
+  if (path && *path) {
+    input_record_attach(INPUT_RECORD_ATTACH_TAPE, 1, path);
+  }
+  cartridge_record_attached();
+}
+
+int emux_apply_recorded_setting(const char *name, int value) {
+  if (resources_query_type(name) != RES_INTEGER) {
+    return -1;
+  }
+  return resources_set_int(name, value);
+}
+
 void emux_drive_change_model(int unit) {
   struct menu_item *model_root = ui_push_menu(12, 8);
   struct menu_item *item;
@@ -893,8 +973,10 @@ void emux_add_sound_options(struct menu_item* parent) {
 
   resources_get_int("SidModel", &tmp_value);
   sid_model_item[0]->value = viceSidModelToBmcChoice(tmp_value);
-  resources_get_int("Sid2Model", &tmp_value);
-  sid_model_item[1]->value = viceSidModelToBmcChoice(tmp_value);
+  if (supports_dual_sid) {
+    resources_get_int("Sid2Model", &tmp_value);
+    sid_model_item[1]->value = viceSidModelToBmcChoice(tmp_value);
+  }
 
   resources_get_int("SidFilters", &tmp_value);
   sid_filter_item->value = tmp_value;
@@ -36,10 +36,56 @@
 
 // RASPI includes
 #include "emux_api.h"
+#include "input_record.h"
 #include "menu.h"
 #include "raspi_machine.h"
 #include "ui.h"
 
+// Carts attached since the last detach, oldest first, so an input
+// recording can start with them. On most machines a new cart replaces
+// the last one; attaching them again in order does the same.
+#define MAX_ATTACHED_CARTS 8
+
+static struct {
+  int menu_id;
+  char path[INPUT_RECORD_MAX_PATH];
+} attached_carts[MAX_ATTACHED_CARTS];
+static int num_attached_carts;
+
+static void remember_cart(int menu_id, const char *filename) {
+  int i;
+  for (i = 0; i < num_attached_carts; i++) {
+    if (attached_carts[i].menu_id == menu_id) {
+      break;
+    }
+  }
+  if (i == MAX_ATTACHED_CARTS) {
+    i = 0;
+  }
+  // Move it to the end.
+  for (; i < num_attached_carts - 1; i++) {
+    attached_carts[i] = attached_carts[i + 1];
+  }
+  if (i == num_attached_carts) {
+    num_attached_carts++;
+  }
+  attached_carts[i].menu_id = menu_id;
+  strncpy(attached_carts[i].path, filename, INPUT_RECORD_MAX_PATH - 1);
+  attached_carts[i].path[INPUT_RECORD_MAX_PATH - 1] = '\0';
+}
+
+void cartridge_forget_attached(void) {
+  num_attached_carts = 0;
+}
+
+void cartridge_record_attached(void) {
+  int i;
+  for (i = 0; i < num_attached_carts; i++) {
+    input_record_attach(INPUT_RECORD_ATTACH_CART, attached_carts[i].menu_id,
+                        attached_carts[i].path);
+  }
+}
+
 static void menu_item_changed(struct menu_item *item) {
   switch (item->id) {
   case MENU_SAVE_EASYFLASH:
@@ -170,5 +216,6 @@ int emux_attach_cart(int menu_id, char* filename) {
   } else {
      ui_pop_all_and_toggle();
   }
+  remember_cart(menu_id, filename);
   return 0;
 }
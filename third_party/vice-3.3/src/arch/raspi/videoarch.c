@@ -53,8 +53,10 @@
 #include "menu.h"
 #include "menu_usb.h"
 #include "menu_tape_osd.h"
+#include "monitorbmc.h"
 #include "overlay.h"
 #include "raspi_machine.h"
+#include "typein.h"
 #include "ui.h"
 
 struct video_canvas_s *vdc_canvas;
@@ -68,6 +70,10 @@ struct video_draw_buffer_callback_s draw_buffer_callback[2];
 static int vic_first_refresh;
 static int vdc_first_refresh;
 
+// Waits for lines still being drawn on another core. See
+// video_arch_set_draw_fence.
+static void (*draw_fence)(void);
+
 // We tell vice our clock resolution is the actual vertical
 // refresh rate of the machine * some factor. We report our
 // tick count when asked for the current time which is incremented
@@ -204,9 +210,14 @@ static int draw_buffer_alloc(struct video_canvas_s *canvas,
                              unsigned int fb_width, unsigned int fb_height,
                              unsigned int *fb_pitch) {
    int status;
+   // VICE draws single height lines. The fb layer is told the doubled
+   // height and scales the lines up when it is shown, laying dark
+   // raster lines over the gaps if asked to.
    if (is_vdc(canvas)) {
       check_dimensions(canvas, VDC_INDEX, fb_width,
                           fb_height * canvas->raster_skip, raster2_lines);
+      circle_set_line_doubling_fbl(FB_LAYER_VDC, canvas->raster_skip == 2,
+                                   canvas->raster_lines);
       status = circle_alloc_fbl(FB_LAYER_VDC, 0 /* indexed */, draw_buffer,
                               fb_width, fb_height * canvas->raster_skip,
                               fb_pitch);
@@ -214,6 +225,8 @@ static int draw_buffer_alloc(struct video_canvas_s *canvas,
    } else {
       check_dimensions(canvas, VIC_INDEX, fb_width,
                           fb_height * canvas->raster_skip, raster_lines);
+      circle_set_line_doubling_fbl(FB_LAYER_VIC, canvas->raster_skip == 2,
+                                   canvas->raster_lines);
       status = circle_alloc_fbl(FB_LAYER_VIC, 0 /* indexed */, draw_buffer,
                               fb_width, fb_height * canvas->raster_skip,
                               fb_pitch);
@@ -224,6 +237,9 @@ static int draw_buffer_alloc(struct video_canvas_s *canvas,
 }
 
 static void draw_buffer_free(struct video_canvas_s *canvas, uint8_t *draw_buffer) {
+   if (draw_fence) {
+      draw_fence();
+   }
    if (is_vdc(canvas)) {
       circle_free_fbl(FB_LAYER_VDC);
       vdc_showing = 0;
@@ -236,6 +252,9 @@ static void draw_buffer_free(struct video_canvas_s *canvas, uint8_t *draw_buffer
 static void draw_buffer_clear(struct video_canvas_s *canvas, uint8_t *draw_buffer,
                               uint8_t value, unsigned int fb_width,
                               unsigned int fb_height, unsigned int fb_pitch) {
+   if (draw_fence) {
+      draw_fence();
+   }
    if (is_vdc(canvas)) {
       circle_clear_fbl(FB_LAYER_VDC);
    } else {
@@ -347,7 +366,11 @@ unsigned long vsyncarch_gettime(void) { return video_ticks; }
 void vsyncarch_init(void) {
 }
 
-void vsyncarch_presync(void) { kbdbuf_flush(); }
+void vsyncarch_presync(void) {
+  kbdbuf_flush();
+  typein_frame();
+  monitor_arch_vsync();
+}
 
 void vsyncarch_postsync(void) {
   emux_ensure_video();
@@ -386,6 +409,9 @@ void vsyncarch_postsync(void) {
   // Hold for vsync unless warping or in boot warp.
   int raspi_warp;
   resources_get_int("WarpMode", &raspi_warp);
+  if (draw_fence) {
+    draw_fence();
+  }
   circle_frames_ready_fbl(FB_LAYER_VIC,
                          machine_class == VICE_MACHINE_C128 ? FB_LAYER_VDC : -1,
                          !raspi_boot_warp && !raspi_warp);
@@ -395,31 +421,34 @@ void vsyncarch_postsync(void) {
   int reset_demo = 0;
 
   // Do key press/releases and joy latches on the main loop.
-  circle_lock_acquire();
-  while (pending_emu_key.head != pending_emu_key.tail) {
-    int i = pending_emu_key.head & 0xf;
+  struct input_event ev;
+  while (emux_next_input_event(&ev)) {
     reset_demo = 1;
-    if (vkbd_enabled) {
-      // Kind of nice to have virtual keyboard's state
-      // stay in sync with changes happening from USB
-      // key events.
-      vkbd_sync_event(pending_emu_key.key[i], pending_emu_key.pressed[i]);
+    if (ev.type == INPUT_EVENT_KEY) {
+      if (vkbd_enabled) {
+        // Kind of nice to have virtual keyboard's state
+        // stay in sync with changes happening from USB
+        // key events.
+        vkbd_sync_event(ev.key, ev.value);
+      }
+      if (ev.value) {
+        keyboard_key_pressed(ev.key);
+      } else {
+        keyboard_key_released(ev.key);
+      }
+      continue;
     }
-    if (pending_emu_key.pressed[i]) {
-      keyboard_key_pressed(pending_emu_key.key[i]);
-    } else {
-      keyboard_key_released(pending_emu_key.key[i]);
+
+    if (ev.type == INPUT_EVENT_MOUSE_MOVE ||
+        ev.type == INPUT_EVENT_MOUSE_BUTTON) {
+      mousedrv_input_event(&ev);
+      continue;
     }
-    pending_emu_key.head++;
-  }
 
-  while (pending_emu_joy.head != pending_emu_joy.tail) {
-    int i = pending_emu_joy.head & 0x7f;
-    reset_demo = 1;
     if (vkbd_enabled) {
-      int value = pending_emu_joy.value[i];
-      int devd = pending_emu_joy.device[i];
-      switch (pending_emu_joy.type[i]) {
+      int value = ev.value;
+      int devd = ev.device;
+      switch (ev.joy_type) {
       case PENDING_EMU_JOY_TYPE_ABSOLUTE:
         if (!vkbd_press[devd]) {
            if (value & 0x1 && !vkbd_up[devd]) {
@@ -452,40 +481,29 @@ void vsyncarch_postsync(void) {
         break;
       }
     } else {
-      switch (pending_emu_joy.type[i]) {
+      switch (ev.joy_type) {
       // NOTE: VICE's joystick_set_value functions have ports indexed starting
       // at 1 but our pot functions are indexed at 0. Hence -1.
       case PENDING_EMU_JOY_TYPE_ABSOLUTE:
-        joystick_set_value_absolute(pending_emu_joy.port[i],
-                                  pending_emu_joy.value[i] & 0x1f);
-        joystick_set_potx(pending_emu_joy.port[i]-1,
-			  (pending_emu_joy.value[i] & POTX_BIT_MASK) >> 5);
-        joystick_set_poty(pending_emu_joy.port[i]-1,
-			  (pending_emu_joy.value[i] & POTY_BIT_MASK) >> 13);
+        joystick_set_value_absolute(ev.port, ev.value & 0x1f);
+        joystick_set_potx(ev.port-1, (ev.value & POTX_BIT_MASK) >> 5);
+        joystick_set_poty(ev.port-1, (ev.value & POTY_BIT_MASK) >> 13);
         break;
       case PENDING_EMU_JOY_TYPE_AND:
-        joystick_set_value_and(pending_emu_joy.port[i],
-                             pending_emu_joy.value[i] & 0x1f);
-        joystick_set_potx_and(pending_emu_joy.port[i]-1,
-			  (pending_emu_joy.value[i] & POTX_BIT_MASK) >> 5);
-        joystick_set_poty_and(pending_emu_joy.port[i]-1,
-			  (pending_emu_joy.value[i] & POTY_BIT_MASK) >> 13);
+        joystick_set_value_and(ev.port, ev.value & 0x1f);
+        joystick_set_potx_and(ev.port-1, (ev.value & POTX_BIT_MASK) >> 5);
+        joystick_set_poty_and(ev.port-1, (ev.value & POTY_BIT_MASK) >> 13);
         break;
       case PENDING_EMU_JOY_TYPE_OR:
-        joystick_set_value_or(pending_emu_joy.port[i],
-                            pending_emu_joy.value[i] & 0x1f);
-        joystick_set_potx_or(pending_emu_joy.port[i]-1,
-			  (pending_emu_joy.value[i] & POTX_BIT_MASK) >> 5);
-        joystick_set_poty_or(pending_emu_joy.port[i]-1,
-			  (pending_emu_joy.value[i] & POTY_BIT_MASK) >> 13);
+        joystick_set_value_or(ev.port, ev.value & 0x1f);
+        joystick_set_potx_or(ev.port-1, (ev.value & POTX_BIT_MASK) >> 5);
+        joystick_set_poty_or(ev.port-1, (ev.value & POTY_BIT_MASK) >> 13);
         break;
       default:
         break;
       }
     }
-    pending_emu_joy.head++;
   }
-  circle_lock_release();
 
   ui_handle_toggle_or_quick_func();
 
@@ -528,3 +546,7 @@ void set_raster_lines(int v, int v2) {
   raster_lines = v;
   raster2_lines = v2;
 }
+
+void video_arch_set_draw_fence(void (*fence)(void)) {
+  draw_fence = fence;
+}
@@ -51,12 +51,13 @@ struct video_canvas_s {
   float refreshrate;
   struct video_draw_buffer_callback_s *video_draw_buffer_callback;
 
-  // Set to 2 to double the height of the frame buffer. Allows for
-  // 'cheap' raster line simulation that can be turned on/off by
-  // setting raster_lines;
+  // Set to 2 to double the height of the displayed frame. Lines are
+  // still drawn single height; the fb layer doubles them when shown.
+  // Allows for 'cheap' raster line simulation that can be turned on/off
+  // by setting raster_lines;
   int raster_skip;
 
-  // When non zero, simulates scanlines. Only applicable is raster_lines = 2
+  // When non zero, simulates scanlines. Only applicable is raster_skip = 2
   int raster_lines;
 };
 
@@ -77,6 +78,7 @@ int video_canvas_set_palette(struct video_canvas_s *canvas, palette_t *p);
 void video_arch_canvas_init(struct video_canvas_s *canvas);
 
 // For timing
+extern unsigned long video_frame_count;
 unsigned long vsyncarch_frequency(void);
 unsigned long vsyncarch_gettime(void);
 void vsyncarch_init(void);
@@ -98,4 +100,12 @@ void main_exit(void);
 void key_interrupt_locked(long key, int pressed);
 
 void set_raster_lines(int v, int v2);
+
+// Register a function that returns once every line handed to another
+// core has been drawn. Called before frames are shown or freed.
+void video_arch_set_draw_fence(void (*fence)(void));
+
+// Apply a queued mouse move or button event. Main loop only.
+struct input_event;
+void mousedrv_input_event(struct input_event *ev);
 #endif
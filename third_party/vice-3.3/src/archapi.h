@@ -115,6 +115,12 @@ char *      archdep_tmpnam(void);
 
 extern int archdep_default_logger(const char *level_string, const char *txt);
 
+#ifdef RASPI_COMPILE
+/* Whether a message from the named log at level (0 message, 1 warning,
+   2 error) goes out at all; checked before it is formatted.  */
+extern int archdep_log_wanted(const char *name, unsigned int level);
+#endif
+
 /* Launch program `name' (searched via the PATH environment variable)
    passing `argv' as the parameters, wait for it to exit and return its
    exit status. If `pstdout_redir' or `stderr_redir' are != NULL,
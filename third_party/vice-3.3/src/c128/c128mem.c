@@ -886,10 +886,11 @@ void mem_set_tape_motor_in(int val)
 
 /* ------------------------------------------------------------------------- */
 
+/* BASIC 7.0 keeps the start of text at $2d/$2e, not at $2b/$2c as V2 does.  */
 void mem_get_basic_text(uint16_t *start, uint16_t *end)
 {
     if (start != NULL) {
-        *start = mem_ram[0x2b] | (mem_ram[0x2c] << 8);
+        *start = mem_ram[0x2d] | (mem_ram[0x2e] << 8);
     }
     if (end != NULL) {
         *end = mem_ram[0x1210] | (mem_ram[0x1211] << 8);
@@ -898,8 +899,8 @@ void mem_get_basic_text(uint16_t *start, uint16_t *end)
 
 void mem_set_basic_text(uint16_t start, uint16_t end)
 {
-    mem_ram[0x2b] = mem_ram[0xac] = start & 0xff;
-    mem_ram[0x2c] = mem_ram[0xad] = start >> 8;
+    mem_ram[0x2d] = mem_ram[0xac] = start & 0xff;
+    mem_ram[0x2e] = mem_ram[0xad] = start >> 8;
     mem_ram[0x1210] = end & 0xff;
     mem_ram[0x1211] = end >> 8;
 }
@@ -141,6 +141,9 @@ extern unsigned int disk_image_raw_track_size(unsigned int format,
 extern unsigned int disk_image_gap_size(unsigned int format, unsigned int track);
 extern int disk_image_read_image(const disk_image_t *image);
 extern int disk_image_write_p64_image(const disk_image_t *image);
+#ifdef RASPI_COMPILE
+extern int disk_image_load_half_track(const disk_image_t *image, unsigned int half_track);
+#endif
 extern int disk_image_write_half_track(disk_image_t *image, unsigned int half_track,
                                        const struct disk_track_s *raw);
 
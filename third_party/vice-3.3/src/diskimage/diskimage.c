@@ -692,6 +692,24 @@ int disk_image_write_p64_image(const disk_image_t *image)
     return fsimage_write_p64_image(image);
 }
 
+#ifdef RASPI_COMPILE
+/* Sector images are converted to GCR one track at a time, the first
+   time the drive head reaches a track. Returns 1 if half_track was
+   converted by this call.  */
+int disk_image_load_half_track(const disk_image_t *image, unsigned int half_track)
+{
+    switch (image->type) {
+        case DISK_IMAGE_TYPE_D64:
+        case DISK_IMAGE_TYPE_D67:
+        case DISK_IMAGE_TYPE_D71:
+        case DISK_IMAGE_TYPE_X64:
+            return fsimage_dxx_load_half_track(image, half_track);
+        default:
+            return 0;
+    }
+}
+#endif
+
 /*-----------------------------------------------------------------------*/
 /* Initialization.  */
 
@@ -32,6 +32,9 @@
 #include "diskconstants.h"
 #include "diskimage.h"
 #include "cbmdos.h"
+#ifdef RASPI_HEADLESS
+#include "crc32.h"
+#endif
 #include "fsimage-dxx.h"
 #include "fsimage.h"
 #include "gcr.h"
@@ -142,14 +145,14 @@ int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
     return 0;
 }
 
-int fsimage_read_dxx_image(const disk_image_t *image)
+/* Convert one track of the sector image into its GCR track.  */
+static void fsimage_dxx_convert_track(const disk_image_t *image, unsigned int track,
+                                      gcr_header_t *header)
 {
-    uint8_t buffer[256], *bam_id;
+    uint8_t buffer[256];
     int gap;
-    unsigned int track, sector, track_size;
-    gcr_header_t header;
+    unsigned int sector, track_size;
     fdc_err_t rf;
-    int double_sided = 0;
     fsimage_t *fsimage = image->media.fsimage;
     unsigned int max_sector;
     uint8_t *ptr;
@@ -157,6 +160,61 @@ int fsimage_read_dxx_image(const disk_image_t *image)
     int sectors;
     long offset;
 
+    half_track = track * 2 - 2;
+
+    track_size = disk_image_raw_track_size(image->type, track);
+    if (image->gcr->tracks[half_track].data == NULL) {
+        image->gcr->tracks[half_track].data = lib_malloc(track_size);
+    } else if (image->gcr->tracks[half_track].size != (int)track_size) {
+        image->gcr->tracks[half_track].data = lib_realloc(image->gcr->tracks[half_track].data, track_size);
+    }
+    ptr = image->gcr->tracks[half_track].data;
+    image->gcr->tracks[half_track].size = track_size;
+
+    if (track <= image->tracks) {
+        gap = disk_image_gap_size(image->type, track);
+
+        max_sector = disk_image_sector_per_track(image->type, track);
+
+        /* Clear track to avoid read errors.  */
+        memset(ptr, 0x55, track_size);
+
+        for (sector = 0; sector < max_sector; sector++) {
+            sectors = disk_image_check_sector(image, track, sector);
+            offset = sectors * 256;
+
+            if (image->type == DISK_IMAGE_TYPE_X64) {
+                offset += X64_HEADER_LENGTH;
+            }
+
+            if (sectors >= 0) {
+                rf = CBMDOS_FDC_ERR_DRIVE;
+                if (util_fpread(fsimage->fd, buffer, 256, offset) >= 0) {
+                    if (fsimage->error_info.map != NULL) {
+                        rf = fsimage->error_info.map[sectors];
+                    }
+                }
+                header->sector = sector;
+                gcr_convert_sector_to_GCR(buffer, ptr, header, 9, 5, rf);
+            }
+
+            ptr += SECTOR_GCR_SIZE_WITH_HEADER + 9 + gap + 5;
+        }
+    } else {
+        memset(ptr, 0x55, track_size);
+    }
+}
+
+int fsimage_read_dxx_image(const disk_image_t *image)
+{
+    uint8_t buffer[256], *bam_id;
+    unsigned int track;
+    gcr_header_t header;
+    int double_sided = 0;
+    fsimage_t *fsimage = image->media.fsimage;
+    int half_track;
+    int sectors;
+
     if (image->type == DISK_IMAGE_TYPE_D80
         || image->type == DISK_IMAGE_TYPE_D82) {
         sectors = disk_image_check_sector(image, BAM_TRACK_8050, BAM_SECTOR_8050);
@@ -179,59 +237,31 @@ int fsimage_read_dxx_image(const disk_image_t *image)
     for (header.track = track = 1; track <= image->max_half_tracks / 2; track++, header.track++) {
         half_track = track * 2 - 2;
 
-        track_size = disk_image_raw_track_size(image->type, track);
-        if (image->gcr->tracks[half_track].data == NULL) {
-            image->gcr->tracks[half_track].data = lib_malloc(track_size);
-        } else if (image->gcr->tracks[half_track].size != (int)track_size) {
-            image->gcr->tracks[half_track].data = lib_realloc(image->gcr->tracks[half_track].data, track_size);
-        }
-        ptr = image->gcr->tracks[half_track].data;
-        image->gcr->tracks[half_track].size = track_size;
-
-        if (track <= image->tracks) {
-            if (double_sided && track == 36) {
-                sectors = disk_image_check_sector(image, BAM_TRACK_1571 + 35, BAM_SECTOR_1571);
+        if (double_sided && track == 36 && track <= image->tracks) {
+            sectors = disk_image_check_sector(image, BAM_TRACK_1571 + 35, BAM_SECTOR_1571);
 
-                buffer[BAM_ID_1571] = buffer[BAM_ID_1571 + 1] = 0xa0;
-                if (sectors >= 0) {
-                    util_fpread(fsimage->fd, buffer, 256, sectors << 8);
-                }
-                header.id1 = buffer[BAM_ID_1571]; /* second side, update id and track */
-                header.id2 = buffer[BAM_ID_1571 + 1];
-                header.track = 1;
+            buffer[BAM_ID_1571] = buffer[BAM_ID_1571 + 1] = 0xa0;
+            if (sectors >= 0) {
+                util_fpread(fsimage->fd, buffer, 256, sectors << 8);
             }
+            header.id1 = buffer[BAM_ID_1571]; /* second side, update id and track */
+            header.id2 = buffer[BAM_ID_1571 + 1];
+            header.track = 1;
+        }
 
-            gap = disk_image_gap_size(image->type, track);
-
-            max_sector = disk_image_sector_per_track(image->type, track);
-
-            /* Clear track to avoid read errors.  */
-            memset(ptr, 0x55, track_size);
-
-            for (sector = 0; sector < max_sector; sector++) {
-                sectors = disk_image_check_sector(image, track, sector);
-                offset = sectors * 256;
-
-                if (image->type == DISK_IMAGE_TYPE_X64) {
-                    offset += X64_HEADER_LENGTH;
-                }
-
-                if (sectors >= 0) {
-                    rf = CBMDOS_FDC_ERR_DRIVE;
-                    if (util_fpread(fsimage->fd, buffer, 256, offset) >= 0) {
-                        if (fsimage->error_info.map != NULL) {
-                            rf = fsimage->error_info.map[sectors];
-                        }
-                    }
-                    header.sector = sector;
-                    gcr_convert_sector_to_GCR(buffer, ptr, &header, 9, 5, rf);
-                }
-
-                ptr += SECTOR_GCR_SIZE_WITH_HEADER + 9 + gap + 5;
-            }
-        } else {
-            memset(ptr, 0x55, track_size);
+#ifdef RASPI_COMPILE
+        /* Defer the conversion until the head reaches the track, see
+           fsimage_dxx_load_half_track().  */
+        fsimage->lazy_gcr.pending[track] = 1;
+        fsimage->lazy_gcr.header[track] = header;
+        if (image->gcr->tracks[half_track].data) {
+            lib_free(image->gcr->tracks[half_track].data);
+            image->gcr->tracks[half_track].data = NULL;
+            image->gcr->tracks[half_track].size = 0;
         }
+#else
+        fsimage_dxx_convert_track(image, track, &header);
+#endif
 
         /* Clear odd track */
         half_track++;
@@ -241,9 +271,48 @@ int fsimage_read_dxx_image(const disk_image_t *image)
             image->gcr->tracks[half_track].size = 0;
         }
     }
+#ifdef RASPI_COMPILE
+    for (; track <= MAX_GCR_TRACKS / 2; track++) {
+        fsimage->lazy_gcr.pending[track] = 0;
+    }
+#endif
     return 0;
 }
 
+#ifdef RASPI_COMPILE
+int fsimage_dxx_load_half_track(const disk_image_t *image, unsigned int half_track)
+{
+    fsimage_t *fsimage = image->media.fsimage;
+    unsigned int track = half_track / 2;
+
+    if (image->gcr == NULL || (half_track & 1) || track < 1
+        || track > MAX_GCR_TRACKS / 2 || !fsimage->lazy_gcr.pending[track]) {
+        return 0;
+    }
+    fsimage->lazy_gcr.pending[track] = 0;
+    fsimage_dxx_convert_track(image, track, &fsimage->lazy_gcr.header[track]);
+    return 1;
+}
+
+/* Whether sector reads and writes go through image->gcr. A pending
+   track is converted first: decoding the GCR reports sector errors
+   differently from the image's error info, and writes must land in the
+   GCR as they did when every track was converted on attach.  */
+static int fsimage_dxx_gcr_valid(const disk_image_t *image, unsigned int track)
+{
+    if (image->gcr == NULL) {
+        return 0;
+    }
+    fsimage_dxx_load_half_track(image, track * 2);
+    return 1;
+}
+#else
+static int fsimage_dxx_gcr_valid(const disk_image_t *image, unsigned int track)
+{
+    return image->gcr != NULL;
+}
+#endif
+
 int fsimage_dxx_read_sector(const disk_image_t *image, uint8_t *buf, const disk_addr_t *dadr)
 {
     int sectors;
@@ -265,7 +334,7 @@ int fsimage_dxx_read_sector(const disk_image_t *image, uint8_t *buf, const disk_
         offset += X64_HEADER_LENGTH;
     }
 
-    if (image->gcr == NULL) {
+    if (!fsimage_dxx_gcr_valid(image, dadr->track)) {
         if (util_fpread(fsimage->fd, buf, 256, offset) < 0) {
             log_error(fsimage_dxx_log,
                       "Error reading T:%i S:%i from disk image.",
@@ -334,7 +403,7 @@ int fsimage_dxx_write_sector(disk_image_t *image, const uint8_t *buf, const disk
                   dadr->track, dadr->sector);
         return -1;
     }
-    if (image->gcr != NULL) {
+    if (fsimage_dxx_gcr_valid(image, dadr->track)) {
         gcr_write_sector(&image->gcr->tracks[(dadr->track * 2) - 2], buf, (uint8_t)dadr->sector);
     }
 
@@ -362,3 +431,149 @@ void fsimage_dxx_init(void)
 {
     fsimage_dxx_log = log_open("Filesystem Image DXX");
 }
+
+#ifdef RASPI_HEADLESS
+/* Check the lazy conversion against converting every track on attach,
+   as VICE does, for the headless build (--gcr-check). */
+
+static disk_image_t *check_attach(const char *name)
+{
+    disk_image_t *image = disk_image_create();
+
+    image->gcr = NULL;
+    image->read_only = 0;
+    image->device = DISK_IMAGE_DEVICE_FS;
+    disk_image_media_create(image);
+    disk_image_fsimage_name_set(image, name);
+    if (disk_image_open(image) < 0) {
+        disk_image_media_destroy(image);
+        disk_image_destroy(image);
+        return NULL;
+    }
+    image->gcr = gcr_create_image();
+    if (disk_image_read_image(image) < 0) {
+        log_error(fsimage_dxx_log, "Cannot convert %s.", name);
+    }
+    return image;
+}
+
+static void check_detach(disk_image_t *image)
+{
+    unsigned int i;
+
+    for (i = 0; i < MAX_GCR_TRACKS; i++) {
+        lib_free(image->gcr->tracks[i].data);
+    }
+    gcr_destroy_image(image->gcr);
+    image->gcr = NULL;
+    disk_image_close(image);
+    disk_image_media_destroy(image);
+    disk_image_destroy(image);
+}
+
+/* Reads every sector of both images, which must give the same data and
+   status, then writes a new pattern to the ones without an error. */
+static int check_sectors(disk_image_t *lazy, disk_image_t *eager, int pass)
+{
+    uint8_t lazy_buf[256], eager_buf[256];
+    disk_addr_t dadr;
+    int lazy_rc, eager_rc, sectors, i;
+    int bad = 0;
+
+    for (dadr.track = 1; dadr.track <= lazy->tracks; dadr.track++) {
+        for (dadr.sector = 0;
+             dadr.sector < disk_image_sector_per_track(lazy->type, dadr.track);
+             dadr.sector++) {
+            lazy_rc = disk_image_read_sector(lazy, lazy_buf, &dadr);
+            eager_rc = disk_image_read_sector(eager, eager_buf, &dadr);
+            if (lazy_rc != eager_rc
+                || (lazy_rc == CBMDOS_IPE_OK
+                    && memcmp(lazy_buf, eager_buf, sizeof(lazy_buf)))) {
+                if (bad++ < 5) {
+                    log_error(fsimage_dxx_log,
+                              "T:%u S:%u reads %d lazily, %d converted on attach.",
+                              dadr.track, dadr.sector, lazy_rc, eager_rc);
+                }
+            }
+            sectors = disk_image_check_sector(lazy, dadr.track, dadr.sector);
+            if (lazy->media.fsimage->error_info.map != NULL
+                && lazy->media.fsimage->error_info.map[sectors] != CBMDOS_FDC_ERR_OK) {
+                /* A drive can't find some of these to write them. */
+                continue;
+            }
+            for (i = 0; i < 256; i++) {
+                lazy_buf[i] = (uint8_t)(i * pass + dadr.track * 7 + dadr.sector);
+            }
+            disk_image_write_sector(lazy, lazy_buf, &dadr);
+            disk_image_write_sector(eager, lazy_buf, &dadr);
+        }
+    }
+    return bad;
+}
+
+/* Attaches lazy_name and eager_name, two copies of the same sector
+   image. The first is converted as the drive reaches each track, the
+   second all at once. With some tracks of the first converted and the
+   rest pending, both get the same sector reads and writes; then the
+   rest is converted and every half track must be the same. crc is set
+   to a CRC of the resulting GCR. Returns the number of sectors and half
+   tracks that differ, or -1 if an image can't be attached. */
+int fsimage_dxx_check_lazy_gcr(const char *lazy_name, const char *eager_name,
+                               uint32_t *crc)
+{
+    disk_image_t *lazy, *eager;
+    disk_track_t *a, *b;
+    uint32_t crcs[MAX_GCR_TRACKS];
+    unsigned int half_track, converted = 0;
+    int bad = 0;
+
+    lazy = check_attach(lazy_name);
+    eager = check_attach(eager_name);
+    if (lazy == NULL || eager == NULL) {
+        if (lazy) {
+            check_detach(lazy);
+        }
+        if (eager) {
+            check_detach(eager);
+        }
+        return -1;
+    }
+
+    for (half_track = 2; half_track <= eager->max_half_tracks; half_track++) {
+        disk_image_load_half_track(eager, half_track);
+    }
+    /* Every third track now, as if the head had been there */
+    for (half_track = 2; half_track <= lazy->max_half_tracks; half_track += 6) {
+        converted += disk_image_load_half_track(lazy, half_track);
+    }
+
+    bad += check_sectors(lazy, eager, 1);
+    for (half_track = 2; half_track <= lazy->max_half_tracks; half_track++) {
+        converted += disk_image_load_half_track(lazy, half_track);
+    }
+    bad += check_sectors(lazy, eager, 3);
+
+    for (half_track = 0; half_track < MAX_GCR_TRACKS; half_track++) {
+        a = &lazy->gcr->tracks[half_track];
+        b = &eager->gcr->tracks[half_track];
+        if ((a->data == NULL) != (b->data == NULL) || a->size != b->size
+            || (a->data && memcmp(a->data, b->data, a->size))) {
+            if (bad++ < 10) {
+                log_error(fsimage_dxx_log,
+                          "Half track %u differs: %d bytes lazily, %d on attach.",
+                          half_track + 2, a->data ? a->size : -1,
+                          b->data ? b->size : -1);
+            }
+        }
+        crcs[half_track] = b->data ? crc32_buf((const char *)b->data, b->size) : 0;
+    }
+    *crc = crc32_buf((const char *)crcs, sizeof(crcs));
+
+    log_message(fsimage_dxx_log,
+                "Lazy GCR check: %u tracks converted as the head reached them, "
+                "the rest on sector access.", converted);
+    check_detach(lazy);
+    check_detach(eager);
+    return bad;
+}
+#endif
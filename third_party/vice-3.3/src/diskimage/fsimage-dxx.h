@@ -36,6 +36,13 @@ struct disk_addr_s;
 extern void fsimage_dxx_init(void);
 
 extern int fsimage_read_dxx_image(const disk_image_t *image);
+#ifdef RASPI_COMPILE
+extern int fsimage_dxx_load_half_track(const disk_image_t *image, unsigned int half_track);
+#endif
+#ifdef RASPI_HEADLESS
+extern int fsimage_dxx_check_lazy_gcr(const char *lazy_name, const char *eager_name,
+                                      uint32_t *crc);
+#endif
 
 extern int fsimage_dxx_write_half_track(disk_image_t *image, unsigned int half_track,
                                         const struct disk_track_s *raw);
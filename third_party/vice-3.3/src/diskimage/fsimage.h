@@ -30,6 +30,9 @@
 #include <stdio.h>
 
 #include "types.h"
+#ifdef RASPI_COMPILE
+#include "gcr.h"
+#endif
 
 struct disk_image_s;
 struct disk_addr_s;
@@ -42,6 +45,14 @@ typedef struct fsimage_s {
         int dirty;
         int len;
     } error_info;
+#ifdef RASPI_COMPILE
+    /* Tracks of a sector image not yet converted to GCR, and the
+       header IDs they will get. Indexed by track.  */
+    struct {
+        uint8_t pending[MAX_GCR_TRACKS / 2 + 1];
+        gcr_header_t header[MAX_GCR_TRACKS / 2 + 1];
+    } lazy_gcr;
+#endif
 } fsimage_t;
 
 
@@ -291,6 +291,9 @@ static int set_drive_idling_method(int val, void *param)
         case DRIVE_IDLE_SKIP_CYCLES:
         case DRIVE_IDLE_TRAP_IDLE:
         case DRIVE_IDLE_NO_IDLE:
+#ifdef RASPI_COMPILE
+        case DRIVE_IDLE_ADAPTIVE:
+#endif
             break;
         default:
             return -1;
@@ -354,8 +357,13 @@ static const resource_int_t resources_int[] = {
 static resource_int_t res_drive[] = {
     { NULL, DRIVE_EXTEND_NEVER, RES_EVENT_SAME, NULL,
       NULL, set_drive_extend_image_policy, NULL },
+#ifdef RASPI_COMPILE
+    { NULL, DRIVE_IDLE_ADAPTIVE, RES_EVENT_SAME, NULL,
+      NULL, set_drive_idling_method, NULL },
+#else
     { NULL, DRIVE_IDLE_NO_IDLE, RES_EVENT_SAME, NULL,
       NULL, set_drive_idling_method, NULL },
+#endif
     { NULL, 30000, RES_EVENT_SAME, NULL,
       NULL, set_drive_rpm, NULL },
     { NULL, 50, RES_EVENT_SAME, NULL,
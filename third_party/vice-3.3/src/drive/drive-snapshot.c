@@ -1059,6 +1059,12 @@ static int drive_snapshot_write_gcrimage_module(snapshot_t *s, unsigned int dnr)
 
     /* Write half track data */
     for (i = 0; i < num_half_tracks; i++) {
+#ifdef RASPI_COMPILE
+        /* Include tracks the head has not reached yet */
+        if (drive->image != NULL) {
+            disk_image_load_half_track(drive->image, i + 2);
+        }
+#endif
         data = drive->gcr->tracks[i].data;
         track_size = data ? drive->gcr->tracks[i].size : 0;
         if (0
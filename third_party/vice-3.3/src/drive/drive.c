@@ -74,6 +74,9 @@
 #include "drive-sound.h"
 #include "p64.h"
 #include "monitor.h"
+#ifdef RASPI_HEADLESS
+#include "headless.h"
+#endif
 
 #ifdef DEBUG_DRIVE
 #define DBG(x) printf x
@@ -597,6 +600,12 @@ void drive_set_half_track(int num, int side, drive_t *dptr)
     /* FIXME: why would the offset be different for D71 and G71? */
     tmp = (dptr->image && dptr->image->type == DISK_IMAGE_TYPE_G71) ? DRIVE_HALFTRACKS_1571 : 70;
 
+#ifdef RASPI_COMPILE
+    if (dptr->image != NULL && dptr->GCR_image_loaded) {
+        disk_image_load_half_track(dptr->image, dptr->current_half_track + (dptr->side * tmp));
+    }
+#endif
+
     dptr->GCR_track_start_ptr = dptr->gcr->tracks[dptr->current_half_track - 2 + (dptr->side * tmp)].data;
 
     if (dptr->GCR_current_track_size != 0) {
@@ -820,11 +829,17 @@ void drive_cpu_execute_one(drive_context_t *drv, CLOCK clk_value)
 {
     drive_t *drive = drv->drive;
 
+#ifdef RASPI_HEADLESS
+    headless_prof_begin(HEADLESS_PROF_DRIVE);
+#endif
     if (drive->type == DRIVE_TYPE_2000 || drive->type == DRIVE_TYPE_4000) {
         drivecpu65c02_execute(drv, clk_value);
     } else {
         drivecpu_execute(drv, clk_value);
     }
+#ifdef RASPI_HEADLESS
+    headless_prof_end(HEADLESS_PROF_DRIVE);
+#endif
 }
 
 void drive_cpu_execute_all(CLOCK clk_value)
@@ -864,13 +879,22 @@ void drive_vsync_hook(void)
             if (drive->idling_method != DRIVE_IDLE_SKIP_CYCLES) {
                 drive_cpu_execute_one(drive_context[dnr], maincpu_clk);
             }
-            if (drive->idling_method == DRIVE_IDLE_NO_IDLE) {
+            if (drive->idling_method == DRIVE_IDLE_NO_IDLE
+#ifdef RASPI_COMPILE
+                || drive->idling_method == DRIVE_IDLE_ADAPTIVE
+#endif
+                ) {
                 /* if drive is never idle, also rotate the disk. this prevents
                  * huge peaks in cpu usage when the drive must catch up with
                  * a longer period of time.
                  */
                 rotation_rotate_disk(drive);
             }
+#ifdef RASPI_COMPILE
+            if (drive->idling_method == DRIVE_IDLE_ADAPTIVE) {
+                drivecpu_idle_report(drive_context[dnr]);
+            }
+#endif
             /* printf("drive_vsync_hook drv %d @clk:%d\n", dnr, maincpu_clk); */
         }
     }
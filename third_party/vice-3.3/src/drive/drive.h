@@ -48,6 +48,10 @@
 #define DRIVE_IDLE_NO_IDLE     0
 #define DRIVE_IDLE_SKIP_CYCLES 1
 #define DRIVE_IDLE_TRAP_IDLE   2
+#ifdef RASPI_COMPILE
+/* Trap idle plus skipping over stable polling loops.  */
+#define DRIVE_IDLE_ADAPTIVE    3
+#endif
 
 /* Drive type ID's and names. When adding things here, please also update
  * the `drive_type_info_list` array in src/drive/drive.c to keep UI's current
@@ -42,6 +42,7 @@
 #include "drive-check.h"
 #include "drivemem.h"
 #include "drivetypes.h"
+#include "iecbus.h"
 #include "interrupt.h"
 #include "lib.h"
 #include "log.h"
@@ -278,10 +279,308 @@ CLOCK drivecpu_prevent_clk_overflow(drive_context_t *drv, CLOCK sub)
     return clk_guard_prevent_overflow(drv->cpu->clk_guard);
 }
 
+#ifdef RASPI_COMPILE
+/* -------------------------------------------------------------------------- */
+/* Adaptive idling.
+
+   Besides the idle trap, look for loops that only read memory and
+   the VIA1 port and interrupt registers, as the DOS serial routines and
+   custom loaders do while they wait for the computer.  Once such a loop
+   gets back to its head twice in a row with the same registers and the
+   same number of cycles per turn, it will keep going round unchanged
+   until either an alarm fires (VIA timers, drive rotation events) or
+   the IEC lines change, and the main CPU always runs the drives up to
+   its clock before it touches the bus.  So the clock can be moved on by
+   whole turns up to the next alarm or the end of this slice, which
+   leaves the drive exactly where it would have been.  */
+
+/* Longest backward jump taken as a loop and longest turn of it.  */
+#define IDLE_LOOP_MAX   32
+#define IDLE_PERIOD_MAX 256
+
+#define IDLE_REPORT_FRAMES 500
+
+/* How an opcode allowed in a polling loop addresses memory.  */
+enum {
+    IDLE_OP_BAD,
+    IDLE_OP_NONE,
+    IDLE_OP_ABS,
+    IDLE_OP_ABS_X,
+    IDLE_OP_ABS_Y
+};
+
+static int idle_opcode_kind(uint8_t op)
+{
+    switch (op) {
+        case 0x0a: case 0x2a: case 0x4a: case 0x6a:   /* shifts on A */
+        case 0x18: case 0x38: case 0xd8: case 0xea:   /* CLC SEC CLD NOP */
+        case 0xaa: case 0xa8: case 0x8a: case 0x98:   /* transfers */
+        case 0xba:
+        case 0xe8: case 0xca: case 0xc8: case 0x88:   /* INX DEX INY DEY */
+        case 0x09: case 0x29: case 0x49: case 0x69:   /* immediate */
+        case 0xe9: case 0xc9: case 0xe0: case 0xc0:
+        case 0xa9: case 0xa2: case 0xa0:
+        case 0x05: case 0x25: case 0x45: case 0x65:   /* zero page */
+        case 0xe5: case 0xc5: case 0xe4: case 0xc4:
+        case 0xa5: case 0xa6: case 0xa4: case 0x24:
+        case 0x15: case 0x35: case 0x55: case 0x75:
+        case 0xf5: case 0xd5: case 0xb5: case 0xb6:
+        case 0xb4:
+        case 0x10: case 0x30: case 0x50: case 0x70:   /* branches */
+        case 0x90: case 0xb0: case 0xd0: case 0xf0:
+        case 0x4c: case 0x20: case 0x60:              /* JMP JSR RTS */
+            return IDLE_OP_NONE;
+        case 0x0d: case 0x2d: case 0x4d: case 0x6d:
+        case 0xed: case 0xcd: case 0xec: case 0xcc:
+        case 0xad: case 0xae: case 0xac: case 0x2c:
+            return IDLE_OP_ABS;
+        case 0x1d: case 0x3d: case 0x5d: case 0x7d:
+        case 0xfd: case 0xdd: case 0xbd: case 0xbc:
+            return IDLE_OP_ABS_X;
+        case 0x19: case 0x39: case 0x59: case 0x79:
+        case 0xf9: case 0xd9: case 0xb9: case 0xbe:
+            return IDLE_OP_ABS_Y;
+    }
+    return IDLE_OP_BAD;
+}
+
+/* Nonzero for the opcodes that can change or test V.  Clearing V makes
+   the drive CPU catch up the disk rotation, so with the motor on these
+   make the loop depend on how often it runs.  */
+static int idle_opcode_uses_v(uint8_t op)
+{
+    switch (op) {
+        case 0x24: case 0x2c:                         /* BIT */
+        case 0x65: case 0x69: case 0x6d: case 0x75:   /* ADC */
+        case 0x79: case 0x7d:
+        case 0xe5: case 0xe9: case 0xed: case 0xf5:   /* SBC */
+        case 0xf9: case 0xfd:
+        case 0x50: case 0x70:                         /* BVC BVS */
+            return 1;
+    }
+    return 0;
+}
+
+/* Memory, or one of the VIA1 registers that nothing but the IEC lines
+   and alarms change: port B, PCR, IFR and IER.  */
+static int idle_address_ok(drive_context_t *drv, unsigned int addr)
+{
+    addr &= 0xffff;
+    if (drv->cpud->read_base_tab_ptr[addr >> 8] != NULL) {
+        return 1;
+    }
+    if (addr < 0x1800 || addr >= 0x1c00) {
+        return 0;
+    }
+    switch (addr & 0xf) {
+        case 0x0: case 0xc: case 0xd: case 0xe:
+            return 1;
+    }
+    return 0;
+}
+
+/* Check the instruction about to run at `pc'.  JSR and RTS are the only
+   writes allowed; the return address they push is the same every turn.  */
+static void drivecpu_idle_check_op(drive_context_t *drv, unsigned int pc)
+{
+    drivecpu_context_t *cpu = drv->cpu;
+    uint8_t *p = drv->cpud->read_base_tab_ptr[pc >> 8];
+    unsigned int addr;
+    uint8_t op;
+
+    if (p == NULL || pc + 2 > 0xffff) {
+        cpu->idle_clean = 0;
+        return;
+    }
+    op = p[pc];
+    if ((drv->drive->byte_ready_active & 4) && idle_opcode_uses_v(op)) {
+        cpu->idle_clean = 0;
+        return;
+    }
+    addr = p[pc + 1] | (p[pc + 2] << 8);
+    switch (idle_opcode_kind(op)) {
+        case IDLE_OP_NONE:
+            return;
+        case IDLE_OP_ABS:
+            break;
+        case IDLE_OP_ABS_X:
+            addr += cpu->cpu_regs.x;
+            break;
+        case IDLE_OP_ABS_Y:
+            addr += cpu->cpu_regs.y;
+            break;
+        default:
+            cpu->idle_clean = 0;
+            return;
+    }
+    if (!idle_address_ok(drv, addr)) {
+        cpu->idle_clean = 0;
+    }
+}
+
+/* The VIA1 addresses and the DOS idle loop handling here are those of
+   the 1541 and its descendants.  */
+static int idle_drive_ok(drive_context_t *drv)
+{
+    switch (drv->drive->type) {
+        case DRIVE_TYPE_1540:
+        case DRIVE_TYPE_1541:
+        case DRIVE_TYPE_1541II:
+        case DRIVE_TYPE_1570:
+        case DRIVE_TYPE_1571:
+        case DRIVE_TYPE_1571CR:
+            return 1;
+    }
+    return 0;
+}
+
+static int idle_regs_equal(const mos6510_regs_t *a, const mos6510_regs_t *b)
+{
+    return a->a == b->a && a->x == b->x && a->y == b->y && a->sp == b->sp
+           && a->p == b->p && a->n == b->n && a->z == b->z;
+}
+
+/* The drive CPU just jumped back from `tail' to `head'.  Only branches
+   and JMP close a loop; JSR and RTS are steps inside one.  */
+static void drivecpu_idle_loop(drive_context_t *drv,
+                               unsigned int head, unsigned int tail)
+{
+    drivecpu_context_t *cpu = drv->cpu;
+    uint8_t *p = drv->cpud->read_base_tab_ptr[tail >> 8];
+    CLOCK now = *(drv->clk_ptr);
+    CLOCK next_alarm, period, target, skip;
+
+    if (p == NULL || (p[tail] != 0x4c && (p[tail] & 0x1f) != 0x10)) {
+        return;
+    }
+
+    next_alarm = alarm_context_next_pending_clk(cpu->alarm_context);
+    if (head != cpu->idle_head || tail != cpu->idle_tail || !cpu->idle_clean
+        || next_alarm != cpu->idle_alarm
+        || !idle_regs_equal(&cpu->cpu_regs, &cpu->idle_regs)) {
+        cpu->idle_head = head;
+        cpu->idle_tail = tail;
+        cpu->idle_regs = cpu->cpu_regs;
+        cpu->idle_alarm = next_alarm;
+        cpu->idle_clk = now;
+        cpu->idle_period = 0;
+        cpu->idle_clean = 1;
+        return;
+    }
+
+    period = now - cpu->idle_clk;
+    cpu->idle_clk = now;
+    if (period != cpu->idle_period) {
+        cpu->idle_period = period;
+        return;
+    }
+
+    if (period == 0 || period > IDLE_PERIOD_MAX
+        || cpu->int_status->global_pending_int != IK_NONE
+        || monitor_mask[cpu->monspace]) {
+        return;
+    }
+    if (!idle_drive_ok(drv)) {
+        return;
+    }
+
+    target = next_alarm;
+    if ((int)(target - cpu->stop_clk) > 0) {
+        target = cpu->stop_clk;
+    }
+    if ((int)(target - now) < (int)period) {
+        return;
+    }
+    skip = (target - now) / period * period;
+
+    *(drv->clk_ptr) += skip;
+    cpu->idle_clk += skip;
+    cpu->idle_skipped += skip;
+}
+
+/* Called before every instruction.  */
+inline static void drivecpu_idle_step(drive_context_t *drv)
+{
+    drivecpu_context_t *cpu = drv->cpu;
+    unsigned int pc = cpu->cpu_regs.pc;
+    unsigned int last_pc = cpu->idle_last_pc;
+
+    cpu->idle_last_pc = pc;
+    if (pc < last_pc && last_pc - pc <= IDLE_LOOP_MAX) {
+        drivecpu_idle_loop(drv, pc, last_pc);
+    }
+    if (cpu->idle_clean) {
+        drivecpu_idle_check_op(drv, pc);
+    }
+}
+
+/* The DOS idle loop reached the trap.  As with DRIVE_IDLE_TRAP_IDLE,
+   move on to the next alarm or the end of the slice and go round the
+   loop again.  But if it already went round once with the motor off and
+   no alarm or interrupt since, it has nothing new to look at, so stay
+   on the trap rather than going round again every slice.  */
+static void drivecpu_idle_trap(drive_context_t *drv)
+{
+    drivecpu_context_t *cpu = drv->cpu;
+    CLOCK next_alarm = alarm_context_next_pending_clk(cpu->alarm_context);
+    CLOCK target = next_alarm;
+
+    if (next_alarm != cpu->idle_trap_alarm
+        || cpu->int_status->irq_clk != cpu->idle_trap_irq
+        || cpu->int_status->global_pending_int != IK_NONE
+        || (drv->drive->byte_ready_active & 4) || !idle_drive_ok(drv)) {
+        MOS6510_REGS_SET_PC(&(cpu->cpu_regs), drv->drive->trapcont);
+        cpu->idle_trap_alarm = next_alarm;
+        cpu->idle_trap_irq = cpu->int_status->irq_clk;
+    }
+
+    if ((int)(target - cpu->stop_clk) > 0) {
+        target = cpu->stop_clk;
+    }
+    if ((int)(target - *(drv->clk_ptr)) > 0) {
+        cpu->idle_skipped += target - *(drv->clk_ptr);
+        *(drv->clk_ptr) = target;
+    }
+}
+
+/* Called at every vsync.  Periodically log how much of the drive's time
+   went by without running it.  */
+void drivecpu_idle_report(drive_context_t *drv)
+{
+    drivecpu_context_t *cpu = drv->cpu;
+    uint64_t drive_hz;
+
+    if (++cpu->idle_frames < IDLE_REPORT_FRAMES) {
+        return;
+    }
+
+    if (cpu->idle_cycles != 0) {
+        drive_hz = (uint64_t)machine_get_cycles_per_second()
+                   * drv->cpud->sync_factor >> 16;
+        log_message(drv->drive->log,
+                    "%u%% of cycles skipped idle, %u cycles/s",
+                    (unsigned int)((uint64_t)cpu->idle_skipped * 100
+                                   / cpu->idle_cycles),
+                    (unsigned int)(cpu->idle_skipped * drive_hz
+                                   / cpu->idle_cycles));
+    }
+
+    cpu->idle_frames = 0;
+    cpu->idle_cycles = 0;
+    cpu->idle_skipped = 0;
+}
+#endif
+
 /* Handle a ROM trap. */
 inline static uint32_t drive_trap_handler(drive_context_t *drv)
 {
     if (MOS6510_REGS_GET_PC(&(drv->cpu->cpu_regs)) == (uint16_t)drv->drive->trap) {
+#ifdef RASPI_COMPILE
+        if (drv->drive->idling_method == DRIVE_IDLE_ADAPTIVE) {
+            drivecpu_idle_trap(drv);
+            return 0;
+        }
+#endif
         MOS6510_REGS_SET_PC(&(drv->cpu->cpu_regs), drv->drive->trapcont);
         if (drv->drive->idling_method == DRIVE_IDLE_TRAP_IDLE) {
             CLOCK next_clk;
@@ -386,6 +685,19 @@ void drivecpu_execute(drive_context_t *drv, CLOCK clk_value)
 
     drivecpu_wake_up(drv);
 
+#ifdef RASPI_COMPILE
+    /* A loop being watched only stays valid if the IEC lines have not
+       changed since the last slice.  */
+    {
+        iecbus_t *bus = iecbus_drive_port();
+
+        if (bus == NULL || bus->drv_port != cpu->idle_bus) {
+            cpu->idle_clean = 0;
+            cpu->idle_bus = bus != NULL ? bus->drv_port : 0;
+        }
+    }
+#endif
+
     /* Calculate number of main CPU clocks to emulate */
     if (clk_value > cpu->last_clk) {
         cycles = clk_value - cpu->last_clk;
@@ -399,6 +711,9 @@ void drivecpu_execute(drive_context_t *drv, CLOCK clk_value)
 
         cpu->cycle_accum += drv->cpud->sync_factor * tcycles;
         cpu->stop_clk += cpu->cycle_accum >> 16;
+#ifdef RASPI_COMPILE
+        cpu->idle_cycles += cpu->cycle_accum >> 16;
+#endif
         cpu->cycle_accum &= 0xffff;
     }
 
@@ -407,6 +722,14 @@ void drivecpu_execute(drive_context_t *drv, CLOCK clk_value)
      * paper over it by only considering subtractions of 2nd complement
      * integers. */
     while ((int) (*(drv->clk_ptr) - cpu->stop_clk) < 0) {
+#ifdef RASPI_COMPILE
+        if (drv->drive->idling_method == DRIVE_IDLE_ADAPTIVE) {
+            drivecpu_idle_step(drv);
+            if ((int) (*(drv->clk_ptr) - cpu->stop_clk) >= 0) {
+                break;
+            }
+        }
+#endif
 /* Include the 6502/6510 CPU emulation core.  */
 
 #define CLK (*(drv->clk_ptr))
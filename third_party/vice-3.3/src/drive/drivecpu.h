@@ -53,6 +53,9 @@ extern void drivecpu_shutdown(struct drive_context_s *drv);
 extern void drivecpu_reset_clk(struct drive_context_s *drv);
 extern void drivecpu_trigger_reset(unsigned int dnr);
 extern void drivecpu_set_overflow(struct drive_context_s *drv);
+#ifdef RASPI_COMPILE
+extern void drivecpu_idle_report(struct drive_context_s *drv);
+#endif
 
 extern void drivecpu_execute(struct drive_context_s *drv, CLOCK clk_value);
 extern int drivecpu_snapshot_write_module(struct drive_context_s *drv,
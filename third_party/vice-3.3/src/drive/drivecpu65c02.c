@@ -268,7 +268,11 @@ inline static uint32_t drive_trap_handler(drive_context_t *drv)
 {
     if (R65C02_REGS_GET_PC(&(drv->cpu->cpu_R65C02_regs)) == (uint16_t)drv->drive->trap) {
         R65C02_REGS_SET_PC(&(drv->cpu->cpu_R65C02_regs), drv->drive->trapcont);
-        if (drv->drive->idling_method == DRIVE_IDLE_TRAP_IDLE) {
+        if (drv->drive->idling_method == DRIVE_IDLE_TRAP_IDLE
+#ifdef RASPI_COMPILE
+            || drv->drive->idling_method == DRIVE_IDLE_ADAPTIVE
+#endif
+            ) {
             CLOCK next_clk;
 
             next_clk = alarm_context_next_pending_clk(drv->cpu->alarm_context);
@@ -132,7 +132,11 @@ void driverom_initialize_traps(drive_t *drive)
     drive->trap = -1;
     drive->trapcont = -1;
 
-    if (drive->idling_method != DRIVE_IDLE_TRAP_IDLE) {
+    if (drive->idling_method != DRIVE_IDLE_TRAP_IDLE
+#ifdef RASPI_COMPILE
+        && drive->idling_method != DRIVE_IDLE_ADAPTIVE
+#endif
+        ) {
         return;
     }
 
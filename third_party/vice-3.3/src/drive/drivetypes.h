@@ -103,6 +103,29 @@ typedef struct drivecpu_context_s {
     char *snap_module_name;
 
     char *identification_string;
+
+#ifdef RASPI_COMPILE
+    /* Adaptive idling: the address of the last opcode, the loop last
+       jumped back into, whether only allowed instructions ran since its
+       head was last reached, the IEC lines at the start of the slice,
+       the registers, clock, turn length and next alarm the last time
+       round, the next alarm and last IRQ at the DOS idle trap, and
+       counts for the skip statistics.  */
+    unsigned int idle_last_pc;
+    unsigned int idle_head;
+    unsigned int idle_tail;
+    int idle_clean;
+    uint8_t idle_bus;
+    mos6510_regs_t idle_regs;
+    CLOCK idle_clk;
+    CLOCK idle_period;
+    CLOCK idle_alarm;
+    CLOCK idle_trap_alarm;
+    CLOCK idle_trap_irq;
+    CLOCK idle_cycles;
+    CLOCK idle_skipped;
+    unsigned int idle_frames;
+#endif
 } drivecpu_context_t;
 
 
@@ -36,8 +36,15 @@
 #include "rotation.h"
 #include "types.h"
 #include "p64.h"
+#ifdef RASPI_HEADLESS
+#include "gcr.h"
+#include "log.h"
+#endif
 
 #include <stdlib.h>
+#ifdef RASPI_HEADLESS
+#include <string.h>
+#endif
 
 #define ACCUM_MAX 0x10000
 
@@ -938,6 +945,313 @@ static void rotation_1541_p64_cycle(drive_t *dptr)
     }
 }
 
+#ifdef RASPI_COMPILE
+inline static int track_bit(const drive_t *dptr, int pos)
+{
+    unsigned int p = (unsigned int)pos % (dptr->GCR_current_track_size << 3);
+
+    return (dptr->GCR_track_start_ptr[p >> 3] >> (~p & 7)) & 1;
+}
+
+/* Catching up on a long stretch of rotation nobody watched, the read
+   shifter state is fully known at the last bit of a sync mark at least
+   18 bits long: bit counter 0, ten 1 bits in the shifter and nothing
+   left in the write shifter. If a byte completes after that point,
+   which the 0 bit ending the sync guarantees 8 bits later, nothing
+   before it can be observed. Returns how many bits up to such a point
+   can be skipped, or 0 if all of them have to be stepped.  */
+static int rotation_1541_simple_skip(const drive_t *dptr, int bits_moved)
+{
+    int off = dptr->GCR_head_offset;
+    int track_bits = (int)(dptr->GCR_current_track_size << 3);
+    int limit = bits_moved - 8;
+    int k, end, start;
+
+    if (dptr->GCR_image_loaded == 0 || dptr->GCR_track_start_ptr == NULL
+        || track_bits == 0 || bits_moved < 64) {
+        return 0;
+    }
+
+    /* Bit k of the stretch is track bit off + k. Walk back a byte at
+       a time looking for a byte of 1 bits, any sync long enough has
+       one, but not further back than one revolution.  */
+    for (k = limit; k >= 18 && limit - k <= track_bits; k -= 8) {
+        if (dptr->GCR_track_start_ptr[((unsigned int)(off + k) % track_bits) >> 3] != 0xff) {
+            continue;
+        }
+        for (end = k; end <= limit && track_bit(dptr, off + end + 1); end++) {
+        }
+        for (start = k; start > 1 && track_bit(dptr, off + start - 1); start--) {
+        }
+        if (end <= limit && end - start >= 17) {
+            return end;
+        }
+        /* Sync runs past the limit or is too short, look before it */
+        k = start;
+    }
+    return 0;
+}
+#endif
+
+/* Steps the read shifter over bits_moved bits. With skip set, starts
+   at the last sync mark instead where it can.  */
+static void rotation_1541_simple_read(drive_t *dptr, rotation_t *rptr,
+                                      int bits_moved, int skip)
+{
+    int off = dptr->GCR_head_offset;
+    unsigned int byte, last_read_data = rptr->last_read_data << 7;
+    unsigned int bit_counter = rptr->bit_counter;
+
+#ifdef RASPI_COMPILE
+    if (skip) {
+        skip = rotation_1541_simple_skip(dptr, bits_moved);
+    }
+    if (skip) {
+        off = (off + skip) % (int)(dptr->GCR_current_track_size << 3);
+        last_read_data = 0x3ff << 7;
+        bit_counter = 0;
+        rptr->last_write_data = 0;
+        bits_moved -= skip;
+    }
+#endif
+
+    /* if no image is attached or track does not exists, read 0 */
+    if (dptr->GCR_image_loaded == 0 || dptr->GCR_track_start_ptr == NULL) {
+        byte = 0;
+    } else {
+        byte = dptr->GCR_track_start_ptr[off >> 3] << (off & 7);
+    }
+
+    while (bits_moved-- != 0) {
+        byte <<= 1; off++;
+        if (!(off & 7)) {
+            if ((off >> 3) >= (int)dptr->GCR_current_track_size) {
+                off = 0;
+            }
+            /* if no image is attached or track does not exists, read 0 */
+            if (dptr->GCR_image_loaded == 0 || dptr->GCR_track_start_ptr == NULL) {
+                byte = 0;
+            } else {
+                byte = dptr->GCR_track_start_ptr[off >> 3];
+            }
+        }
+
+        last_read_data <<= 1;
+        last_read_data |= byte & 0x80;
+        rptr->last_write_data <<= 1;
+
+        /* is sync? reset bit counter, don't move data, etc. */
+        if (~last_read_data & 0x1ff80) {
+            if (++bit_counter == 8) {
+                bit_counter = 0;
+                dptr->GCR_read = (uint8_t) (last_read_data >> 7);
+                /* tlr claims that the write register is loaded at every
+                 * byte boundary, and since the bus is shared, it's reasonable
+                 * to guess that it would be loaded with whatever was last read. */
+                rptr->last_write_data = dptr->GCR_read;
+                if ((dptr->byte_ready_active & 2) != 0) {
+                    dptr->byte_ready_edge = 1;
+                    dptr->byte_ready_level = 1;
+                }
+            }
+        } else {
+            bit_counter = 0;
+        }
+    }
+    rptr->last_read_data = (last_read_data >> 7) & 0x3ff;
+    rptr->bit_counter = bit_counter;
+    dptr->GCR_head_offset = off;
+    if (!dptr->GCR_read) {    /* can only happen if on a half or unformatted track */
+        dptr->GCR_read = 0x11; /* should be good enough, there's no data after all */
+    }
+}
+
+#ifdef RASPI_HEADLESS
+/* The headless build can step every bit beside each skip and compare
+   (--rotation-check), and run the skip against the bit loop on made up
+   tracks (--rotation-fuzz). tools/headless/rotation_test.py runs both.  */
+int rotation_skip_check = 0;
+static unsigned long skip_checked, skip_taken, skip_differ;
+
+typedef struct read_state_s {
+    unsigned int head_offset;
+    unsigned int last_read_data;
+    int bit_counter;
+    uint8_t last_write_data;
+    uint8_t gcr_read;
+    unsigned int byte_ready_edge;
+    unsigned int byte_ready_level;
+} read_state_t;
+
+static void read_state_get(const drive_t *dptr, const rotation_t *rptr,
+                           read_state_t *state)
+{
+    state->head_offset = dptr->GCR_head_offset;
+    state->last_read_data = rptr->last_read_data;
+    state->bit_counter = rptr->bit_counter;
+    state->last_write_data = rptr->last_write_data;
+    state->gcr_read = dptr->GCR_read;
+    state->byte_ready_edge = dptr->byte_ready_edge;
+    state->byte_ready_level = dptr->byte_ready_level;
+}
+
+static void read_state_set(drive_t *dptr, rotation_t *rptr,
+                           const read_state_t *state)
+{
+    dptr->GCR_head_offset = state->head_offset;
+    rptr->last_read_data = state->last_read_data;
+    rptr->bit_counter = state->bit_counter;
+    rptr->last_write_data = state->last_write_data;
+    dptr->GCR_read = state->gcr_read;
+    dptr->byte_ready_edge = state->byte_ready_edge;
+    dptr->byte_ready_level = state->byte_ready_level;
+}
+
+/* Steps the bits both ways from the same state and leaves the skipped
+   result. Returns 1 if the two differ.  */
+static int rotation_1541_simple_compare(drive_t *dptr, rotation_t *rptr,
+                                        int bits_moved)
+{
+    read_state_t before, stepped, skipped;
+
+    read_state_get(dptr, rptr, &before);
+    rotation_1541_simple_read(dptr, rptr, bits_moved, 0);
+    read_state_get(dptr, rptr, &stepped);
+    read_state_set(dptr, rptr, &before);
+    rotation_1541_simple_read(dptr, rptr, bits_moved, 1);
+    read_state_get(dptr, rptr, &skipped);
+
+    return stepped.head_offset != skipped.head_offset
+           || stepped.last_read_data != skipped.last_read_data
+           || stepped.bit_counter != skipped.bit_counter
+           || stepped.last_write_data != skipped.last_write_data
+           || stepped.gcr_read != skipped.gcr_read
+           || stepped.byte_ready_edge != skipped.byte_ready_edge
+           || stepped.byte_ready_level != skipped.byte_ready_level;
+}
+
+static void rotation_1541_simple_check(drive_t *dptr, rotation_t *rptr,
+                                       int bits_moved)
+{
+    unsigned int head_offset = dptr->GCR_head_offset;
+
+    skip_checked++;
+    if (rotation_1541_simple_skip(dptr, bits_moved)) {
+        skip_taken++;
+    }
+    if (rotation_1541_simple_compare(dptr, rptr, bits_moved)
+        && skip_differ++ < 10) {
+        log_error(LOG_DEFAULT,
+                  "Rotation skip differs from the bit loop: %d bits from %u, half track %d.",
+                  bits_moved, head_offset, dptr->current_half_track);
+    }
+}
+
+void rotation_skip_check_counts(unsigned long *checked, unsigned long *taken,
+                                unsigned long *differ)
+{
+    *checked = skip_checked;
+    *taken = skip_taken;
+    *differ = skip_differ;
+}
+
+static uint32_t fuzz_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+/* Sets count bits from bit at on, around the end of the track.  */
+static void fuzz_ones(uint8_t *track, unsigned int bits, unsigned int at,
+                      unsigned int count)
+{
+    while (count--) {
+        unsigned int p = at++ % bits;
+
+        track[p >> 3] |= 0x80 >> (p & 7);
+    }
+}
+
+/* Runs the skip and the bit loop from the same state over made up tracks:
+   random bytes, random bytes with sync marks of 1 to 48 bits, all ones,
+   all ones but one bit, and all zeros, at real track sizes and at a few
+   bytes so a catch-up spans several revolutions. Returns how many runs
+   differed.  */
+unsigned long rotation_skip_fuzz(unsigned long runs, uint32_t seed,
+                                 unsigned long *taken)
+{
+    static const unsigned int sizes[] = { 6250, 6666, 7142, 7692 };
+    static drive_t drive;
+    static uint8_t track[NUM_MAX_BYTES_TRACK];
+    rotation_t rot;
+    unsigned long run, differ = 0;
+    uint32_t state = seed ? seed : 1;
+
+    memset(&rot, 0, sizeof(rot));
+    *taken = 0;
+    for (run = 0; run < runs; run++) {
+        unsigned int kind = run % 5;
+        unsigned int size, bits, i, syncs;
+        int bits_moved;
+
+        if (fuzz_random(&state) & 1) {
+            size = sizes[fuzz_random(&state) % 4];
+        } else {
+            size = 8 + fuzz_random(&state) % 57;
+        }
+        bits = size << 3;
+
+        switch (kind) {
+            case 0:
+            case 1:
+                for (i = 0; i < size; i++) {
+                    track[i] = (uint8_t)fuzz_random(&state);
+                }
+                if (kind == 1) {
+                    syncs = 1 + fuzz_random(&state) % 30;
+                    for (i = 0; i < syncs; i++) {
+                        fuzz_ones(track, bits, fuzz_random(&state) % bits,
+                                  1 + fuzz_random(&state) % 48);
+                    }
+                }
+                break;
+            case 2:
+            case 3:
+                memset(track, 0xff, size);
+                if (kind == 3) {
+                    i = fuzz_random(&state) % bits;
+                    track[i >> 3] &= ~(0x80 >> (i & 7));
+                }
+                break;
+            default:
+                memset(track, 0, size);
+                break;
+        }
+
+        drive.GCR_image_loaded = 1;
+        drive.GCR_track_start_ptr = track;
+        drive.GCR_current_track_size = size;
+        drive.GCR_head_offset = fuzz_random(&state) % bits;
+        drive.GCR_read = (uint8_t)fuzz_random(&state);
+        drive.byte_ready_active = (fuzz_random(&state) & 1) ? 6 : 4;
+        drive.byte_ready_edge = 0;
+        drive.byte_ready_level = fuzz_random(&state) & 1;
+        rot.last_read_data = fuzz_random(&state) & 0x3ff;
+        rot.bit_counter = fuzz_random(&state) % 8;
+        rot.last_write_data = (uint8_t)fuzz_random(&state);
+        bits_moved = (int)(fuzz_random(&state) % (3 * bits + 100));
+
+        if (rotation_1541_simple_skip(&drive, bits_moved)) {
+            (*taken)++;
+        }
+        differ += rotation_1541_simple_compare(&drive, &rot, bits_moved);
+    }
+    return differ;
+}
+#endif
+
 /*******************************************************************************
  * very simple and fast emulation for perfect images like those comming from
  * dxx files
@@ -946,7 +1260,9 @@ static void rotation_1541_simple(drive_t *dptr)
 {
     rotation_t *rptr;
     CLOCK delta;
+#ifndef RASPI_COMPILE
     int tdelta;
+#endif
     int bits_moved = 0;
     uint64_t tmp = 1000000UL;
     unsigned long rpmscale;
@@ -966,6 +1282,15 @@ static void rotation_1541_simple(drive_t *dptr)
     tmp /= (dptr->rpm + wobble);
     rpmscale = (unsigned long)(tmp);
 
+#ifdef RASPI_COMPILE
+    /* Same result as the 1000 cycle steps below, in one division */
+    {
+        uint64_t total = rptr->accum
+                         + (uint64_t)rot_speed_bps[rptr->frequency][rptr->speed_zone] * delta;
+        bits_moved = (int)(total / rpmscale);
+        rptr->accum = (uint32_t)(total % rpmscale);
+    }
+#else
     while (delta > 0) {
         tdelta = delta > 1000 ? 1000 : delta;
         delta -= tdelta;
@@ -973,61 +1298,15 @@ static void rotation_1541_simple(drive_t *dptr)
         bits_moved += rptr->accum / rpmscale;
         rptr->accum %= rpmscale;
     }
+#endif
 
     if (dptr->read_write_mode) {
-        int off = dptr->GCR_head_offset;
-        unsigned int byte, last_read_data = rptr->last_read_data << 7;
-        unsigned int bit_counter = rptr->bit_counter;
-
-        /* if no image is attached or track does not exists, read 0 */
-        if (dptr->GCR_image_loaded == 0 || dptr->GCR_track_start_ptr == NULL) {
-            byte = 0;
-        } else {
-            byte = dptr->GCR_track_start_ptr[off >> 3] << (off & 7);
-        }
-
-        while (bits_moved-- != 0) {
-            byte <<= 1; off++;
-            if (!(off & 7)) {
-                if ((off >> 3) >= (int)dptr->GCR_current_track_size) {
-                    off = 0;
-                }
-                /* if no image is attached or track does not exists, read 0 */
-                if (dptr->GCR_image_loaded == 0 || dptr->GCR_track_start_ptr == NULL) {
-                    byte = 0;
-                } else {
-                    byte = dptr->GCR_track_start_ptr[off >> 3];
-                }
-            }
-
-            last_read_data <<= 1;
-            last_read_data |= byte & 0x80;
-            rptr->last_write_data <<= 1;
-
-            /* is sync? reset bit counter, don't move data, etc. */
-            if (~last_read_data & 0x1ff80) {
-                if (++bit_counter == 8) {
-                    bit_counter = 0;
-                    dptr->GCR_read = (uint8_t) (last_read_data >> 7);
-                    /* tlr claims that the write register is loaded at every
-                     * byte boundary, and since the bus is shared, it's reasonable
-                     * to guess that it would be loaded with whatever was last read. */
-                    rptr->last_write_data = dptr->GCR_read;
-                    if ((dptr->byte_ready_active & 2) != 0) {
-                        dptr->byte_ready_edge = 1;
-                        dptr->byte_ready_level = 1;
-                    }
-                }
-            } else {
-                bit_counter = 0;
-            }
-        }
-        rptr->last_read_data = (last_read_data >> 7) & 0x3ff;
-        rptr->bit_counter = bit_counter;
-        dptr->GCR_head_offset = off;
-        if (!dptr->GCR_read) {    /* can only happen if on a half or unformatted track */
-            dptr->GCR_read = 0x11; /* should be good enough, there's no data after all */
-        }
+#ifdef RASPI_HEADLESS
+        if (rotation_skip_check) {
+            rotation_1541_simple_check(dptr, rptr, bits_moved);
+        } else
+#endif
+        rotation_1541_simple_read(dptr, rptr, bits_moved, 1);
     } else {
         /* When writing, the first byte after transition is going to echo the
          * bits from the last read value.
@@ -46,4 +46,12 @@ extern void rotation_rotate_disk(struct drive_s *dptr);
 extern uint8_t rotation_sync_found(struct drive_s *dptr);
 extern void rotation_byte_read(struct drive_s *dptr);
 
+#ifdef RASPI_HEADLESS
+extern int rotation_skip_check;
+extern void rotation_skip_check_counts(unsigned long *checked, unsigned long *taken,
+                                       unsigned long *differ);
+extern unsigned long rotation_skip_fuzz(unsigned long runs, uint32_t seed,
+                                        unsigned long *taken);
+#endif
+
 #endif
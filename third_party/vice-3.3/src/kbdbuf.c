@@ -214,6 +214,15 @@ int kbdbuf_is_empty(void)
     return (int)(mem_read((uint16_t)(num_pending_location)) == 0);
 }
 
+#ifdef RASPI_COMPILE
+/* Return the number of characters still waiting to be fed into the
+   kernal's queue.  */
+int kbdbuf_num_pending(void)
+{
+    return num_pending;
+}
+#endif
+
 /* Feed `string' into the incoming queue.  */
 static int string_to_queue(const char *string)
 {
@@ -41,5 +41,8 @@ extern void kbdbuf_feed_cmdline(void);
 extern void kbdbuf_flush(void);
 extern int kbdbuf_cmdline_options_init(void);
 extern int kbdbuf_resources_init(void);
+#ifdef RASPI_COMPILE
+extern int kbdbuf_num_pending(void);
+#endif
 
 #endif
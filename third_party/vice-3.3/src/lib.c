@@ -1253,7 +1253,12 @@ void lib_FreeMem_pinpoint(void *ptr, unsigned long size, char *name, unsigned in
    delay are actually random, ie different on each startup, at all. */
 void lib_init_rand(void)
 {
+#ifdef RASPI_HEADLESS
+    /* Benchmark runs must draw the same frames every time. */
+    srand(1);
+#else
     srand((unsigned int)time(NULL));
+#endif
 }
 
 unsigned int lib_unsigned_rand(unsigned int min, unsigned int max)
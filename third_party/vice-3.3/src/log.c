@@ -331,6 +331,13 @@ static int log_helper(log_t log, unsigned int level, const char *format,
         }
     }
 
+#ifdef RASPI_COMPILE
+    if (!archdep_log_wanted(((logi != LOG_DEFAULT) && (logi != LOG_ERR))
+                            ? logs[logi] : "", level)) {
+        return 0;
+    }
+#endif
+
     if ((logi != LOG_DEFAULT) && (logi != LOG_ERR) && (*logs[logi] != '\0')) {
         logtxt = lib_msprintf("%s: %s", logs[logi], level_strings[level]);
     } else {
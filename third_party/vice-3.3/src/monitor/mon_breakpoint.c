@@ -311,6 +311,30 @@ void mon_breakpoint_delete_checkpoint(int cp_num)
     }
 }
 
+#ifdef RASPI_COMPILE
+int mon_breakpoint_next_checkpoint(int after, mon_checkpoint_info_t *info)
+{
+    int i;
+    checkpoint_t *cp;
+
+    for (i = after + 1; i < breakpoint_count; i++) {
+        if ((cp = find_checkpoint(i))) {
+            info->checknum = cp->checknum;
+            info->start_addr = cp->start_addr;
+            info->end_addr = cp->end_addr;
+            info->hit_count = cp->hit_count;
+            info->stop = cp->stop;
+            info->enabled = cp->enabled;
+            info->op = (cp->check_load ? e_load : 0)
+                       | (cp->check_store ? e_store : 0)
+                       | (cp->check_exec ? e_exec : 0);
+            return 1;
+        }
+    }
+    return 0;
+}
+#endif
+
 void mon_breakpoint_set_checkpoint_condition(int cp_num,
                                              cond_node_t *cnode)
 {
@@ -54,6 +54,24 @@ extern void mon_breakpoint_unset(MON_ADDR address);
 extern void mon_breakpoint_enable(MON_ADDR address);
 extern void mon_breakpoint_disable(MON_ADDR address);
 
+#ifdef RASPI_COMPILE
+/* What the remote monitor (arch/raspi/monitorarch.c) reports for one
+   checkpoint. op holds e_load, e_store and e_exec bits. */
+typedef struct mon_checkpoint_info_s {
+    int checknum;
+    MON_ADDR start_addr;
+    MON_ADDR end_addr;
+    int hit_count;
+    bool stop;
+    bool enabled;
+    int op;
+} mon_checkpoint_info_t;
+
+/* Fills in info for the lowest numbered checkpoint above after.
+   Returns 0 when there are no more. */
+extern int mon_breakpoint_next_checkpoint(int after, mon_checkpoint_info_t *info);
+#endif
+
 /* defined in mon_parse.y, and thus, in mon_parse.c */
 extern void parse_and_execute_line(char *input);
 
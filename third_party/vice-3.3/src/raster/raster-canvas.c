@@ -32,6 +32,7 @@
 #include "videoarch.h"
 
 #include "lib.h"
+#include "log.h"
 #include "machine.h"
 #include "raster-canvas.h"
 #include "raster.h"
@@ -105,8 +106,53 @@ inline static void refresh_canvas(raster_t *raster)
     update_area->is_null = 1;
 }
 
+#ifdef RASPI_COMPILE
+#define RASTER_CACHE_STAT_FRAMES 500
+
+/* Tally how many lines this frame the cache let us skip drawing and
+   periodically log the average and worst frame.  */
+static void update_cache_stats(raster_t *raster)
+{
+    unsigned int pct;
+
+    if (!raster->cache_enabled || raster->stat_frame_lines == 0) {
+        raster->stat_frame_lines = 0;
+        raster->stat_frame_reused = 0;
+        return;
+    }
+
+    pct = raster->stat_frame_reused * 100 / raster->stat_frame_lines;
+    if (pct < raster->stat_min_pct) {
+        raster->stat_min_pct = pct;
+    }
+    raster->stat_lines += raster->stat_frame_lines;
+    raster->stat_reused += raster->stat_frame_reused;
+    raster->stat_frame_lines = 0;
+    raster->stat_frame_reused = 0;
+
+    if (++raster->stat_frames < RASTER_CACHE_STAT_FRAMES) {
+        return;
+    }
+
+    log_message(LOG_DEFAULT,
+                "%s cache: %u%% of lines reused, worst frame %u%% (%u frames)",
+                raster->canvas->videoconfig->chip_name,
+                raster->stat_reused * 100 / raster->stat_lines,
+                raster->stat_min_pct, raster->stat_frames);
+
+    raster->stat_frames = 0;
+    raster->stat_lines = 0;
+    raster->stat_reused = 0;
+    raster->stat_min_pct = 100;
+}
+#endif
+
 void raster_canvas_handle_end_of_frame(raster_t *raster)
 {
+#ifdef RASPI_COMPILE
+    update_cache_stats(raster);
+#endif
+
     if (video_disabled_mode) {
         return;
     }
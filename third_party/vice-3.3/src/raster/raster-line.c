@@ -42,6 +42,9 @@
 #include "raster-sprite.h"
 #include "raster.h"
 #include "viewport.h"
+#ifdef RASPI_HEADLESS
+#include "headless.h"
+#endif
 
 
 unsigned int raster_line_get_real_mode(raster_t *raster)
@@ -125,6 +128,11 @@ inline static void handle_blank_line_cached(raster_t *raster)
                          map_current_line_to_area(raster),
                          0, raster->geometry->screen_size.width - 1);
     }
+#ifdef RASPI_COMPILE
+    else {
+        raster->line_reused = 1;
+    }
+#endif
 }
 
 static void handle_blank_line(raster_t *raster)
@@ -393,6 +401,11 @@ static void handle_visible_line_with_cache(raster_t *raster)
         add_line_to_area(raster->update_area, map_current_line_to_area(raster),
                          changed_start, changed_end);
     }
+#ifdef RASPI_COMPILE
+    else {
+        raster->line_reused = 1;
+    }
+#endif
 
     cache->is_dirty = 0;
 }
@@ -650,7 +663,13 @@ inline static void handle_visible_line(raster_t *raster)
 
 void raster_line_emulate(raster_t *raster)
 {
+#ifdef RASPI_HEADLESS
+    headless_prof_begin(HEADLESS_PROF_VIDEO);
+#endif
     raster_draw_buffer_ptr_update(raster);
+#ifdef RASPI_COMPILE
+    raster->line_reused = 0;
+#endif
 
     /* Emulate the vertical blank flip-flops.  (Well, sort of.)  */
     if (raster->current_line == raster->display_ystart && (!raster->blank || raster->blank_off)) {
@@ -679,6 +698,13 @@ void raster_line_emulate(raster_t *raster)
             }
         }
 
+#ifdef RASPI_COMPILE
+        if (raster->cache_enabled) {
+            raster->stat_frame_lines++;
+            raster->stat_frame_reused += raster->line_reused;
+        }
+#endif
+
         if (++raster->num_cached_lines == (1
                                            + raster->geometry->last_displayed_line
                                            - raster->geometry->first_displayed_line)) {
@@ -707,10 +733,6 @@ void raster_line_emulate(raster_t *raster)
         }
     }
 
-#ifdef RASPI_COMPILE
-    raster_draw_buffer_clone_line(raster);
-#endif
-
     raster->current_line++;
 
     if (raster->current_line == raster->geometry->screen_size.height) {
@@ -739,4 +761,7 @@ void raster_line_emulate(raster_t *raster)
     }
 
     raster->blank_this_line = 0;
+#ifdef RASPI_HEADLESS
+    headless_prof_end(HEADLESS_PROF_VIDEO);
+#endif
 }
@@ -122,23 +122,9 @@ void raster_draw_buffer_ptr_update(raster_t *raster)
             raster->geometry->screen_size.height : 0
             ) + raster->current_line
            ) * raster_calc_frame_buffer_width(raster)
-#ifdef RASPI_COMPILE
-             * raster->canvas->raster_skip
-#endif
         + raster->geometry->extra_offscreen_border_left;
 }
 
-#ifdef RASPI_COMPILE
-void raster_draw_buffer_clone_line(raster_t *raster)
-{
-  if (raster->canvas->raster_skip == 2 && !raster->canvas->raster_lines) {
-     int width = raster_calc_frame_buffer_width(raster);
-     memcpy(raster->draw_buffer_ptr + width,
-         raster->draw_buffer_ptr, width);
-  }
-}
-#endif
-
 static int raster_realize_frame_buffer(raster_t *raster)
 {
     unsigned int fb_width, fb_height, fb_pitch;
@@ -267,6 +253,15 @@ int raster_init(raster_t *raster,
     raster->dont_cache = 1;
     raster->dont_cache_all = 0;
     raster->num_cached_lines = 0;
+#ifdef RASPI_COMPILE
+    raster->line_reused = 0;
+    raster->stat_frames = 0;
+    raster->stat_lines = 0;
+    raster->stat_reused = 0;
+    raster->stat_frame_lines = 0;
+    raster->stat_frame_reused = 0;
+    raster->stat_min_pct = 100;
+#endif
 
     raster->fake_draw_buffer_line = NULL;
 
@@ -162,6 +162,19 @@ struct raster_s {
        is valid again.  */
     unsigned int num_cached_lines;
 
+#ifdef RASPI_COMPILE
+    /* Set when the current line was left as is because of a cache hit.  */
+    int line_reused;
+
+    /* Cache statistics, see raster-canvas.c.  */
+    unsigned int stat_frames;
+    unsigned int stat_lines;
+    unsigned int stat_reused;
+    unsigned int stat_frame_lines;
+    unsigned int stat_frame_reused;
+    unsigned int stat_min_pct;
+#endif
+
     /* Area to update.  */
     struct raster_canvas_area_s *update_area;
 
@@ -213,9 +226,6 @@ extern void raster_set_geometry(raster_t *raster,
                                 unsigned int extra_offscreen_border_right);
 extern void raster_new_cache(raster_t *raster, unsigned int screen_height);
 extern void raster_draw_buffer_ptr_update(raster_t *raster);
-#ifdef RASPI_COMPILE
-extern void raster_draw_buffer_clone_line(raster_t *raster);
-#endif
 extern void raster_force_repaint(raster_t *raster);
 extern void raster_set_title(raster_t *raster, const char *name);
 extern void raster_skip_frame(raster_t *raster, int skip);
@@ -563,7 +563,7 @@ int sid_sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr, i
         return tmp_nr;
     }
     if (soc == 2 && scc == 2) {
-#ifdef RASPI_COMPILE
+#if defined(RASPI_COMPILE) && !defined(RASPI_HEADLESS)
         // For BMC64, we're going to use an idle core to calculate the 2nd SID
         // stream. This will result in virtually no performance penalty and
         // prevents some stuttering on the Pi2 which is already very close to
@@ -58,6 +58,9 @@
 #include "vsync.h"
 #include "math.h"
 #include "ui.h"
+#ifdef RASPI_HEADLESS
+#include "headless.h"
+#endif
 
 
 static log_t sound_log = LOG_ERR;
@@ -253,6 +256,9 @@ static int sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr
     int i;
     int temp;
 
+#ifdef RASPI_HEADLESS
+    headless_prof_begin(HEADLESS_PROF_SOUND);
+#endif
     if (sound_calls[0]->cycle_based() || (!sound_calls[0]->cycle_based() && sound_calls[0]->chip_enabled)) {
         temp = sound_calls[0]->calculate_samples(psid, pbuf, nr, soc, scc, delta_t);
     } else {
@@ -265,6 +271,9 @@ static int sound_machine_calculate_samples(sound_t **psid, int16_t *pbuf, int nr
             sound_calls[i]->calculate_samples(psid, pbuf, temp, soc, scc, delta_t);
         }
     }
+#ifdef RASPI_HEADLESS
+    headless_prof_end(HEADLESS_PROF_SOUND);
+#endif
     return temp;
 }
 
@@ -30,12 +30,20 @@
 
 #include <stdio.h>
 #include <string.h>
+#ifdef RASPI_HEADLESS
+#include <sched.h>
+#endif
 
 #include "raster-cache-const.h"
 #include "raster-cache-fill.h"
 #include "raster-cache.h"
 #include "raster-modes.h"
 #include "types.h"
+#ifdef RASPI_COMPILE
+#include "log.h"
+#include "videoarch.h"
+#include "viewport.h"
+#endif
 #include "vdc-draw.h"
 #include "vdc-resources.h"
 #include "vdc.h"
@@ -522,10 +530,62 @@ static void draw_std_text_cached(raster_cache_t *cache, unsigned int xs,
     }
 }
 
-static void draw_std_text(void)
+/*-----------------------------------------------------------------------*/
+
+/* Everything the uncached draw functions read from the VDC for one raster
+   line.  Drawing from a copy lets the line be drawn later, on another core,
+   while the emulation carries on changing the real registers.  */
+typedef struct vdc_line_s {
+    uint8_t regs[64];
+    uint8_t *ram;
+    unsigned int screen_text_cols;
+    unsigned int screen_adr;
+    unsigned int attribute_adr;
+    unsigned int chargen_adr;
+    unsigned int mem_counter;
+    unsigned int bitmap_counter;
+    unsigned int bytes_per_char;
+    unsigned int mem_counter_inc;
+    unsigned int border_width;
+    unsigned int xsmooth;
+    unsigned int attribute_offset;
+    int frame_counter;
+    int attribute_blink;
+    int crsrpos;
+    struct {
+        uint8_t *draw_buffer_ptr;
+        unsigned int ycounter;
+        int xsmooth;
+    } raster;
+} vdc_line_t;
+
+static void vdc_line_capture(vdc_line_t *l, uint8_t *ram)
+{
+    memcpy(l->regs, vdc.regs, sizeof(l->regs));
+    l->ram = ram;
+    l->screen_text_cols = vdc.screen_text_cols;
+    l->screen_adr = vdc.screen_adr;
+    l->attribute_adr = vdc.attribute_adr;
+    l->chargen_adr = vdc.chargen_adr;
+    l->mem_counter = vdc.mem_counter;
+    l->bitmap_counter = vdc.bitmap_counter;
+    l->bytes_per_char = vdc.bytes_per_char;
+    l->mem_counter_inc = vdc.mem_counter_inc;
+    l->border_width = vdc.border_width;
+    l->xsmooth = vdc.xsmooth;
+    l->attribute_offset = vdc.attribute_offset;
+    l->frame_counter = vdc.frame_counter;
+    l->attribute_blink = vdc.attribute_blink;
+    l->crsrpos = vdc.crsrpos;
+    l->raster.draw_buffer_ptr = vdc.raster.draw_buffer_ptr;
+    l->raster.ycounter = vdc.raster.ycounter;
+    l->raster.xsmooth = vdc.raster.xsmooth;
+}
+
+static void render_std_text(const vdc_line_t *l)
 /* raster_modes_draw_line() in raster - draw text mode when cache is not used
    This draws one raster line of text directly into the raster buffer
-   (vdc.raster.draw_buffer_ptr), which is one byte per pixel, based on the VDC
+   (l->raster.draw_buffer_ptr), which is one byte per pixel, based on the VDC
    screen, attr(ibute) and char(set) ram (which are one byte per 8 pixels */
 {
     uint8_t *p, *q;
@@ -536,64 +596,64 @@ static void draw_std_text(void)
     unsigned int cpos = 0xffff;
     int icsi = -1;  /* Inter Character Spacing Index - used as a combo flag/index as to whether there is any intercharacter gap to render */
     
-    cpos = vdc.crsrpos - vdc.screen_adr - vdc.mem_counter;
+    cpos = l->crsrpos - l->screen_adr - l->mem_counter;
 
-    if(vdc.regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
-        charwidth = 2 * (vdc.regs[22] >> 4);
+    if(l->regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
+        charwidth = 2 * (l->regs[22] >> 4);
         if (charwidth > 16) {   /* Is there inter character spacing to render? */
             icsi = charwidth / 2 - 8;
         }
     } else { /* 80 column mode */
-        charwidth = 1 + (vdc.regs[22] >> 4);
+        charwidth = 1 + (l->regs[22] >> 4);
         if (charwidth > 8) {    /* Is there inter character spacing to render? */
             icsi = charwidth - 8;
         }
     }
     
-    p = vdc.raster.draw_buffer_ptr
-        + vdc.border_width
-        + ((vdc.regs[25] & 0x10) ? 2 : 0)
-        + vdc.xsmooth * ((vdc.regs[25] & 0x10) ? 2 : 1)
-        - (vdc.regs[22] >> 4) * ((vdc.regs[25] & 0x10) ? 2 : 1);
+    p = l->raster.draw_buffer_ptr
+        + l->border_width
+        + ((l->regs[25] & 0x10) ? 2 : 0)
+        + l->xsmooth * ((l->regs[25] & 0x10) ? 2 : 1)
+        - (l->regs[22] >> 4) * ((l->regs[25] & 0x10) ? 2 : 1);
 
-    attr_ptr = vdc.ram + vdc.attribute_adr + vdc.mem_counter;
-    screen_ptr = vdc.ram + vdc.screen_adr + vdc.mem_counter;
-    char_ptr = vdc.ram + vdc.chargen_adr + vdc.raster.ycounter;
+    attr_ptr = l->ram + l->attribute_adr + l->mem_counter;
+    screen_ptr = l->ram + l->screen_adr + l->mem_counter;
+    char_ptr = l->ram + l->chargen_adr + l->raster.ycounter;
 
-    if (vdc.regs[25] & 0x40) {
+    if (l->regs[25] & 0x40) {
         /* attribute mode */
         /* regs[26] & 0xf is the background colour */
-        table_ptr = hr_table + ((vdc.regs[26] & 0x0f) << 4);
-        pdl_ptr = pdl_table + ((vdc.regs[26] & 0x0f) << 4);
-        pdh_ptr = pdh_table + ((vdc.regs[26] & 0x0f) << 4);
-        for (i = 0; i < vdc.screen_text_cols; i++, p += charwidth) {
-            if (vdc.raster.ycounter > (signed)vdc.regs[23]) {
+        table_ptr = hr_table + ((l->regs[26] & 0x0f) << 4);
+        pdl_ptr = pdl_table + ((l->regs[26] & 0x0f) << 4);
+        pdh_ptr = pdh_table + ((l->regs[26] & 0x0f) << 4);
+        for (i = 0; i < l->screen_text_cols; i++, p += charwidth) {
+            if (l->raster.ycounter > (signed)l->regs[23]) {
                 /* Return nothing if > Vertical Character Size */
                 d = 0x00;
             } else {
                 d = *(char_ptr
-                  + ((*(attr_ptr + i) & VDC_ALTCHARSET_ATTR) ? 0x100 * vdc.bytes_per_char : 0) /* the offset to the alternate character set is either 0x1000 or 0x2000, depending on the character size (16 or 32) */
-                  + (*(screen_ptr + i) * vdc.bytes_per_char));
+                  + ((*(attr_ptr + i) & VDC_ALTCHARSET_ATTR) ? 0x100 * l->bytes_per_char : 0) /* the offset to the alternate character set is either 0x1000 or 0x2000, depending on the character size (16 or 32) */
+                  + (*(screen_ptr + i) * l->bytes_per_char));
             }
             /* mask against r[22] - pixels per char mask */
-            d &= mask[vdc.regs[22] & 0x0F];
+            d &= mask[l->regs[22] & 0x0F];
                   
             /* set underline if the underline attrib is set for this char */
-            if ((vdc.raster.ycounter == vdc.regs[29]) && (*(attr_ptr + i) & VDC_UNDERLINE_ATTR)) {
+            if ((l->raster.ycounter == l->regs[29]) && (*(attr_ptr + i) & VDC_UNDERLINE_ATTR)) {
                 /* TODO - figure out if the pixels per char applies to the underline */
                 d = 0xFF;
             }
 
             /* blink if the blink attribute is set for this char */
-            if (vdc.attribute_blink && (*(attr_ptr + i) & VDC_FLASH_ATTR)) {
+            if (l->attribute_blink && (*(attr_ptr + i) & VDC_FLASH_ATTR)) {
                 d = 0x00;
             }
 
-            if (vdc.regs[25] & 0x20) {
+            if (l->regs[25] & 0x20) {
                 /* Semi-graphics mode */
-                if (d & semigfxtest[vdc.regs[22] & 0x0F]) {
+                if (d & semigfxtest[l->regs[22] & 0x0F]) {
                 /* if the far right pixel is on.. */
-                    d |= semigfxmask[vdc.regs[22] & 0x0F];
+                    d |= semigfxmask[l->regs[22] & 0x0F];
                     /* .. mask the rest of the right hand side on */
                 }
             }
@@ -604,12 +664,12 @@ static void draw_std_text(void)
             }
 
             if (cpos == i) { /* handle cursor if this is the cursor */
-                if ((vdc.frame_counter | 1) & crsrblink[(vdc.regs[10] >> 5) & 3]) {
+                if ((l->frame_counter | 1) & crsrblink[(l->regs[10] >> 5) & 3]) {
                     /* invert current byte of the character if we are within the cursor area */
                     if (
-                    ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter < (vdc.regs[11] & 0x1F)))
-                    || ((vdc.raster.ycounter == (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter == (vdc.regs[11] & 0x1F)))
-                    || (((vdc.regs[10] & 0x1F) > (vdc.regs[11] & 0x1F)) && ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) || (vdc.raster.ycounter < (vdc.regs[11] & 0x1F))))
+                    ((l->raster.ycounter >= (l->regs[10] & 0x1F)) && (l->raster.ycounter < (l->regs[11] & 0x1F)))
+                    || ((l->raster.ycounter == (l->regs[10] & 0x1F)) && (l->raster.ycounter == (l->regs[11] & 0x1F)))
+                    || (((l->regs[10] & 0x1F) > (l->regs[11] & 0x1F)) && ((l->raster.ycounter >= (l->regs[10] & 0x1F)) || (l->raster.ycounter < (l->regs[11] & 0x1F))))
                     ) {
                         /* The VDC cursor reverses the char */
                         d ^= 0xFF;
@@ -617,12 +677,12 @@ static void draw_std_text(void)
                 }
             }
 
-            if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
+            if (l->regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
                 d ^= 0xff;
             }
 
             /* actually render the byte into 8 bytes of colour pixels using the lookup tables */
-            if (vdc.regs[25] & 0x10) { /* double pixel mode */
+            if (l->regs[25] & 0x10) { /* double pixel mode */
                 uint32_t *pdwl = pdl_ptr + ((*(attr_ptr + i) & 0x0f) << 8);
                 uint32_t *pdwh = pdh_ptr + ((*(attr_ptr + i) & 0x0f) << 8);
                 *((uint32_t *)p) = *(pdwh + (d >> 4));
@@ -631,7 +691,7 @@ static void draw_std_text(void)
                 *((uint32_t *)p + 3) = *(pdwl + (d & 0x0f));
                 if (icsi >= 0) {    /* if there's inter character spacing, then render it */
                     q = p + 16;
-                    if ((vdc.regs[25] & 0x20) && (d & semigfxtest[vdc.regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
+                    if ((l->regs[25] & 0x20) && (d & semigfxtest[l->regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
                         d = mask[icsi];   /* .. figure out how big it is based on the width of the gap */
                     } else { /* otherwise just draw the background */
                         d = 0;
@@ -639,7 +699,7 @@ static void draw_std_text(void)
                     if (*(attr_ptr + i) & VDC_REVERSE_ATTR) { /* reverse if the reverse attribute is set for this char */
                         d ^= 0xff;
                     }
-                    if (vdc.regs[24] & VDC_REVERSE_ATTR) {  /* whole screen reverse */
+                    if (l->regs[24] & VDC_REVERSE_ATTR) {  /* whole screen reverse */
                         d ^= 0xff;
                     }
                     *((uint32_t *)q) = *(pdwh + (d >> 4));
@@ -653,7 +713,7 @@ static void draw_std_text(void)
                 *((uint32_t *)p + 1) = *(ptr + (d & 0x0f));
                 if (icsi >= 0) {    /* if there's inter character spacing, then render it */
                     q = p + 8;
-                    if ((vdc.regs[25] & 0x20) && (d & semigfxtest[vdc.regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
+                    if ((l->regs[25] & 0x20) && (d & semigfxtest[l->regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
                         d = mask[icsi];   /* .. figure out how big it is based on the width of the gap */
                     } else { /* otherwise just draw the background */
                         d = 0;
@@ -661,7 +721,7 @@ static void draw_std_text(void)
                     if (*(attr_ptr + i) & VDC_REVERSE_ATTR) { /* reverse if the reverse attribute is set for this char */
                         d ^= 0xff;
                     }
-                    if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
+                    if (l->regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
                         d ^= 0xff;
                     }
                     *((uint32_t *)q) = *(ptr + (d >> 4));
@@ -671,31 +731,31 @@ static void draw_std_text(void)
         }
     } else {
         /* monochrome mode - attributes from register 26 */
-        uint32_t *ptr = hr_table + (vdc.regs[26] << 4);
-        uint32_t *pdwl = pdl_table + (vdc.regs[26] << 4);  /* Pointers into the lookup tables */
-        uint32_t *pdwh = pdh_table + (vdc.regs[26] << 4);
-        for (i = 0; i < vdc.screen_text_cols; i++, p += charwidth) {
-            d = *(char_ptr + (*(screen_ptr + i) * vdc.bytes_per_char));
+        uint32_t *ptr = hr_table + (l->regs[26] << 4);
+        uint32_t *pdwl = pdl_table + (l->regs[26] << 4);  /* Pointers into the lookup tables */
+        uint32_t *pdwh = pdh_table + (l->regs[26] << 4);
+        for (i = 0; i < l->screen_text_cols; i++, p += charwidth) {
+            d = *(char_ptr + (*(screen_ptr + i) * l->bytes_per_char));
             
             /* mask against r[22] - pixels per char mask */
-            d &= mask[vdc.regs[22] & 0x0F];
+            d &= mask[l->regs[22] & 0x0F];
 
-            if (vdc.regs[25] & 0x20) {
+            if (l->regs[25] & 0x20) {
                 /* Semi-graphics mode */
-                if (d & semigfxtest[vdc.regs[22] & 0x0F]) {
+                if (d & semigfxtest[l->regs[22] & 0x0F]) {
                 /* if the far right pixel is on.. */
-                    d |= semigfxmask[vdc.regs[22] & 0x0F];
+                    d |= semigfxmask[l->regs[22] & 0x0F];
                     /* .. mask the rest of the right hand side on */
                 }
             }
             
             if (cpos == i) { /* handle cursor if this is the cursor */
-                if ((vdc.frame_counter | 1) & crsrblink[(vdc.regs[10] >> 5) & 3]) {
+                if ((l->frame_counter | 1) & crsrblink[(l->regs[10] >> 5) & 3]) {
                     /* invert current byte of the character if we are within the cursor area */
                     if (
-                    ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter < (vdc.regs[11] & 0x1F)))
-                    || ((vdc.raster.ycounter == (vdc.regs[10] & 0x1F)) && (vdc.raster.ycounter == (vdc.regs[11] & 0x1F)))
-                    || (((vdc.regs[10] & 0x1F) > (vdc.regs[11] & 0x1F)) && ((vdc.raster.ycounter >= (vdc.regs[10] & 0x1F)) || (vdc.raster.ycounter < (vdc.regs[11] & 0x1F))))
+                    ((l->raster.ycounter >= (l->regs[10] & 0x1F)) && (l->raster.ycounter < (l->regs[11] & 0x1F)))
+                    || ((l->raster.ycounter == (l->regs[10] & 0x1F)) && (l->raster.ycounter == (l->regs[11] & 0x1F)))
+                    || (((l->regs[10] & 0x1F) > (l->regs[11] & 0x1F)) && ((l->raster.ycounter >= (l->regs[10] & 0x1F)) || (l->raster.ycounter < (l->regs[11] & 0x1F))))
                     ) {
                         /* The VDC cursor reverses the char */
                         d ^= 0xFF;
@@ -703,24 +763,24 @@ static void draw_std_text(void)
                 }
             }
 
-            if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
+            if (l->regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
                 d ^= 0xff;
             }
 
             /* actually render the byte into 8 bytes of colour pixels using the lookup tables */
-            if (vdc.regs[25] & 0x10) { /* double pixel mode */
+            if (l->regs[25] & 0x10) { /* double pixel mode */
                 *((uint32_t *)p) = *(pdwh + (d >> 4));
                 *((uint32_t *)p + 1) = *(pdwl + (d >> 4));
                 *((uint32_t *)p + 2) = *(pdwh + (d & 0x0f));
                 *((uint32_t *)p + 3) = *(pdwl + (d & 0x0f));
                 if (icsi >= 0) {    /* if there's inter character spacing, then render it */
                     q = p + 16;
-                    if ((vdc.regs[25] & 0x20) && (d & semigfxtest[vdc.regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
+                    if ((l->regs[25] & 0x20) && (d & semigfxtest[l->regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
                         d = mask[icsi];   /* .. figure out how big it is based on the width of the gap */
                     } else { /* otherwise just draw the background */
                         d = 0;
                     }    
-                    if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
+                    if (l->regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
                         d ^= 0xff;
                     }
                     *((uint32_t *)q) = *(pdwh + (d >> 4));
@@ -733,12 +793,12 @@ static void draw_std_text(void)
                 *((uint32_t *)p + 1) = *(ptr + (d & 0x0f));
                 if (icsi >= 0) {    /* if there's inter character spacing, then render it */
                     q = p + 8;
-                    if ((vdc.regs[25] & 0x20) && (d & semigfxtest[vdc.regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
+                    if ((l->regs[25] & 0x20) && (d & semigfxtest[l->regs[22] & 0x0F])) { /* If semi-graphics mode and the rightmost active bit is set */
                         d = mask[icsi];   /* .. figure out how big it is based on the width of the gap */
                     } else { /* otherwise just draw the background */
                         d = 0;
                     }
-                    if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
+                    if (l->regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
                         d ^= 0xff;
                     }
                     *((uint32_t *)q) = *(ptr + (d >> 4));
@@ -748,8 +808,8 @@ static void draw_std_text(void)
         }
     }
     /* fill the last few pixels of the display with bg colour if smooth scroll != 0 */
-    for (i = vdc.xsmooth; i < (unsigned)(vdc.regs[22] >> 4); i++, p++) {
-        *p = (vdc.regs[26] & 0x0f);
+    for (i = l->xsmooth; i < (unsigned)(l->regs[22] >> 4); i++, p++) {
+        *p = (l->regs[26] & 0x0f);
     }
 }
 
@@ -888,7 +948,7 @@ static void draw_std_bitmap_cached(raster_cache_t *cache, unsigned int xs,
 }
 
 
-static void draw_std_bitmap(void)
+static void render_std_bitmap(const vdc_line_t *l)
 /* raster_modes_draw_line() in raster - draw bitmap mode when cache is not used
    See draw_std_text(), this is for bitmap mode. */
 {
@@ -897,44 +957,44 @@ static void draw_std_bitmap(void)
 
     unsigned int i, d, j, fg, bg, charwidth;
     
-    if(vdc.regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
-        charwidth = 2 * (vdc.regs[22] >> 4);
+    if(l->regs[25] & 0x10) { /* double pixel a.k.a 40column mode */
+        charwidth = 2 * (l->regs[22] >> 4);
     } else { /* 80 column mode */
-        charwidth = 1 + (vdc.regs[22] >> 4);
+        charwidth = 1 + (l->regs[22] >> 4);
     }
     
-    p = vdc.raster.draw_buffer_ptr
-        + vdc.border_width
-        + ((vdc.regs[25] & 0x10) ? 2 : 0)
-        + vdc.xsmooth * ((vdc.regs[25] & 0x10) ? 2 : 1)
-        - (vdc.regs[22] >> 4) * ((vdc.regs[25] & 0x10) ? 2 : 1);
+    p = l->raster.draw_buffer_ptr
+        + l->border_width
+        + ((l->regs[25] & 0x10) ? 2 : 0)
+        + l->xsmooth * ((l->regs[25] & 0x10) ? 2 : 1)
+        - (l->regs[22] >> 4) * ((l->regs[25] & 0x10) ? 2 : 1);
 
-    attr_ptr = vdc.ram + vdc.attribute_adr + vdc.mem_counter + vdc.attribute_offset;
-    bitmap_ptr = vdc.ram + vdc.screen_adr + vdc.bitmap_counter;
+    attr_ptr = l->ram + l->attribute_adr + l->mem_counter + l->attribute_offset;
+    bitmap_ptr = l->ram + l->screen_adr + l->bitmap_counter;
 
-    for (i = 0; i < vdc.mem_counter_inc; i++, p += charwidth) {
+    for (i = 0; i < l->mem_counter_inc; i++, p += charwidth) {
         uint32_t *ptr, *pdwl, *pdwh;
 
-        if (vdc.regs[25] & 0x40) {
+        if (l->regs[25] & 0x40) {
             /* attribute mode */
             ptr = hr_table + (*(attr_ptr + i) & 0xf0) + ((*(attr_ptr + i) & 0x0f) << 8);
             pdwl = pdl_table + (*(attr_ptr + i) & 0xf0) + ((*(attr_ptr + i) & 0x0f) << 8);
             pdwh = pdh_table + (*(attr_ptr + i) & 0xf0) + ((*(attr_ptr + i) & 0x0f) << 8);
         } else {
             /* monochrome mode - attributes from register 26 */
-            ptr = hr_table + (vdc.regs[26] << 4);
-            pdwl = pdl_table + (vdc.regs[26] << 4);  /* Pointers into the lookup tables */
-            pdwh = pdh_table + (vdc.regs[26] << 4);
+            ptr = hr_table + (l->regs[26] << 4);
+            pdwl = pdl_table + (l->regs[26] << 4);  /* Pointers into the lookup tables */
+            pdwh = pdh_table + (l->regs[26] << 4);
         }
 
         d = *(bitmap_ptr + i); /* grab the data byte from the bitmap */
 
-        if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
+        if (l->regs[24] & VDC_REVERSE_ATTR) { /* whole screen reverse */
             d ^= 0xff;
         }
 
         /* actually render the byte into 8 bytes of colour pixels using the lookup tables */
-        if (vdc.regs[25] & 0x10) { /* double pixel mode */
+        if (l->regs[25] & 0x10) { /* double pixel mode */
             *((uint32_t *)p) = *(pdwh + (d >> 4));
             *((uint32_t *)p + 1) = *(pdwl + (d >> 4));
             *((uint32_t *)p + 2) = *(pdwh + (d & 0x0f));
@@ -947,19 +1007,19 @@ static void draw_std_bitmap(void)
 
     /* fill the last few pixels of the display with bg colour if xsmooth scroll != maximum  */
     d = *(bitmap_ptr + i);
-    if (vdc.regs[24] & VDC_REVERSE_ATTR) { /* reverse screen bit */
+    if (l->regs[24] & VDC_REVERSE_ATTR) { /* reverse screen bit */
         d ^= 0xff;
     }
-    if (vdc.regs[25] & 0x40) {
+    if (l->regs[25] & 0x40) {
         /* attribute mode */
         fg = *(attr_ptr + i) >> 4;
         bg = *(attr_ptr + i) & 0x0F;
     } else {
         /* monochrome mode - attributes from register 26 */
-        fg = vdc.regs[26] >> 4;
-        bg = vdc.regs[26] & 0x0F;
+        fg = l->regs[26] >> 4;
+        bg = l->regs[26] & 0x0F;
     }
-    for (i = vdc.xsmooth, j = 0x80; i < (unsigned)(vdc.regs[22] >> 4); i++, p++, j >>= 1) {
+    for (i = l->xsmooth, j = 0x80; i < (unsigned)(l->regs[22] >> 4); i++, p++, j >>= 1) {
         if (d & j) {
             /* foreground */
             *p = fg;
@@ -1004,7 +1064,7 @@ static void draw_idle_cached(raster_cache_t *cache, unsigned int xs,
     }
 }
 
-static void draw_idle(void)
+static void render_idle(const vdc_line_t *l)
 /* raster_modes_draw_line() in raster - draw idle mode (just border) when cache is not used */
 { /* TODO - can't we just memset()?? Or just let the border code in raster look after this?? */
     uint8_t *p;
@@ -1012,22 +1072,334 @@ static void draw_idle(void)
 
     unsigned int i;
 
-    p = vdc.raster.draw_buffer_ptr + vdc.border_width
-        + vdc.raster.xsmooth;
+    p = l->raster.draw_buffer_ptr + l->border_width
+        + l->raster.xsmooth;
 
     /* border colour is just the screen background colour from reg 26 bits 0-3 */
-    idleval = *(hr_table + ((vdc.regs[26] & 0x0f) << 4));
+    idleval = *(hr_table + ((l->regs[26] & 0x0f) << 4));
 
-    for (i = 0; i < vdc.mem_counter_inc; i++, p += ((vdc.regs[25] & 0x10) ? 16 : 8)) {
+    for (i = 0; i < l->mem_counter_inc; i++, p += ((l->regs[25] & 0x10) ? 16 : 8)) {
         *((uint32_t *)p) = idleval;
         *((uint32_t *)p + 1) = idleval;
-        if (vdc.regs[25] & 0x10) { /* double pixel mode */
+        if (l->regs[25] & 0x10) { /* double pixel mode */
             *((uint32_t *)p + 2) = idleval;
             *((uint32_t *)p + 3) = idleval;
         }
     }
 }
 
+/*-----------------------------------------------------------------------*/
+
+#ifdef RASPI_COMPILE
+/* On the Pi, uncached lines are handed to an otherwise idle core.  The
+   emulation core queues a snapshot of each line along with every write to
+   VDC RAM and the helper replays them in order against its own copy of VDC
+   RAM, so each line sees RAM exactly as it was when the raster reached it.
+   vdc_draw_sync() waits for the queue to drain.  It is called before the
+   frame buffer is shown or freed and at the top of each VDC frame.  */
+
+#define VDC_JOB_RING_SIZE 1024   /* must be a power of 2 */
+#define VDC_JOB_RING_MASK (VDC_JOB_RING_SIZE - 1)
+#define VDC_JOB_WRITE_MAX 128
+
+/* The build machine may run both sides on one CPU.  */
+#ifdef RASPI_HEADLESS
+#define JOB_WAIT() sched_yield()
+#else
+#define JOB_WAIT()
+#endif
+
+/* Job types.  Line jobs use the video mode as their type.  */
+#define VDC_JOB_WRITE VDC_NUM_VMODES
+#define VDC_JOB_FILL  (VDC_NUM_VMODES + 1)
+#define VDC_JOB_COPY  (VDC_NUM_VMODES + 2)
+
+typedef struct vdc_job_s {
+    int type;
+    union {
+        struct {
+            vdc_line_t line;
+            /* The raster draws the borders after the graphics, so they
+               are drawn again over the deferred line.  */
+            uint8_t border_color;
+            int left_end;
+            int right_start;
+            int right_end;
+        } draw;
+        struct {
+            unsigned int addr;
+            unsigned int len;
+            uint8_t data[VDC_JOB_WRITE_MAX];
+        } write;
+        struct {
+            int ptr;
+            int ptr2;
+            int len;
+            int mask;
+            uint8_t value;
+        } block;
+    } u;
+} vdc_job_t;
+
+static vdc_job_t job_ring[VDC_JOB_RING_SIZE];
+static uint32_t job_head;   /* advanced by the helper */
+static uint32_t job_tail;   /* advanced by the emulation core */
+
+/* The slot at job_tail holds a run of writes that is not published yet.
+   Consecutive writes share a job and are published ahead of the next job
+   or sync.  */
+static int job_write_open;
+
+static int helper_ready;
+static int deferred;
+static unsigned int job_ring_stalls;
+
+static uint8_t shadow_ram[0x10000];
+
+static vdc_job_t *job_reserve(void)
+{
+    if (job_tail - __atomic_load_n(&job_head, __ATOMIC_ACQUIRE)
+        >= VDC_JOB_RING_SIZE) {
+        job_ring_stalls++;
+        while (job_tail - __atomic_load_n(&job_head, __ATOMIC_ACQUIRE)
+               >= VDC_JOB_RING_SIZE) {
+            JOB_WAIT();
+        }
+    }
+    return &job_ring[job_tail & VDC_JOB_RING_MASK];
+}
+
+static void job_publish(void)
+{
+    __atomic_store_n(&job_tail, job_tail + 1, __ATOMIC_RELEASE);
+#ifndef RASPI_HEADLESS
+    asm volatile("dsb\n\tsev" ::: "memory");
+#endif
+}
+
+static void job_close_write(void)
+{
+    if (job_write_open) {
+        job_write_open = 0;
+        job_publish();
+    }
+}
+
+static void draw_line_deferred(int mode)
+{
+    raster_t *raster = &vdc.raster;
+    vdc_job_t *job;
+
+    job_close_write();
+    job = job_reserve();
+    job->type = mode;
+    vdc_line_capture(&job->u.draw.line, shadow_ram);
+
+    job->u.draw.border_color = raster->border_color;
+    job->u.draw.left_end = -1;
+    job->u.draw.right_start = 0;
+    job->u.draw.right_end = -1;
+    if (!raster->border_disable) {
+        if (!raster->open_left_border) {
+            job->u.draw.left_end = raster->display_xstart - 1;
+        }
+        if (!raster->open_right_border) {
+            job->u.draw.right_start = raster->display_xstop;
+            job->u.draw.right_end = raster->geometry->screen_size.width - 1;
+        }
+    }
+    job_publish();
+}
+
+static void run_job(const vdc_job_t *job)
+{
+    const vdc_line_t *l = &job->u.draw.line;
+    int i;
+
+    switch (job->type) {
+        case VDC_TEXT_MODE:
+            render_std_text(l);
+            break;
+        case VDC_BITMAP_MODE:
+            render_std_bitmap(l);
+            break;
+        case VDC_IDLE_MODE:
+            render_idle(l);
+            break;
+        case VDC_JOB_WRITE:
+            memcpy(shadow_ram + job->u.write.addr, job->u.write.data,
+                   job->u.write.len);
+            return;
+        case VDC_JOB_FILL:
+            for (i = 0; i < job->u.block.len; i++) {
+                shadow_ram[(job->u.block.ptr + i) & job->u.block.mask]
+                    = job->u.block.value;
+            }
+            return;
+        case VDC_JOB_COPY:
+            for (i = 0; i < job->u.block.len; i++) {
+                shadow_ram[(job->u.block.ptr + i) & job->u.block.mask]
+                    = shadow_ram[(job->u.block.ptr2 + i) & job->u.block.mask];
+            }
+            return;
+        default:
+            return;
+    }
+
+    if (job->u.draw.left_end >= 0) {
+        memset(l->raster.draw_buffer_ptr, job->u.draw.border_color,
+               job->u.draw.left_end + 1);
+    }
+    if (job->u.draw.right_end >= job->u.draw.right_start) {
+        memset(l->raster.draw_buffer_ptr + job->u.draw.right_start,
+               job->u.draw.border_color,
+               job->u.draw.right_end - job->u.draw.right_start + 1);
+    }
+}
+
+int vdc_draw_deferred(void)
+{
+    return deferred;
+}
+
+void vdc_draw_ram_write(unsigned int addr, uint8_t value)
+{
+    vdc_job_t *job;
+
+    if (!deferred) {
+        return;
+    }
+
+    if (job_write_open) {
+        job = &job_ring[job_tail & VDC_JOB_RING_MASK];
+        if (addr == job->u.write.addr + job->u.write.len
+            && job->u.write.len < VDC_JOB_WRITE_MAX) {
+            job->u.write.data[job->u.write.len++] = value;
+            return;
+        }
+        job_close_write();
+    }
+
+    job = job_reserve();
+    job->type = VDC_JOB_WRITE;
+    job->u.write.addr = addr;
+    job->u.write.len = 1;
+    job->u.write.data[0] = value;
+    job_write_open = 1;
+}
+
+void vdc_draw_ram_block(int ptr, int ptr2, int len, int copy)
+{
+    vdc_job_t *job;
+
+    if (!deferred) {
+        return;
+    }
+
+    job_close_write();
+    job = job_reserve();
+    job->type = copy ? VDC_JOB_COPY : VDC_JOB_FILL;
+    job->u.block.ptr = ptr;
+    job->u.block.ptr2 = ptr2;
+    job->u.block.len = len;
+    job->u.block.mask = vdc.vdc_address_mask;
+    job->u.block.value = vdc.regs[31];
+    job_publish();
+}
+
+void vdc_draw_sync(void)
+{
+    if (!deferred) {
+        /* Nothing is queued yet, so this is a safe point to start
+           deferring once the helper has shown up.  */
+        if (__atomic_load_n(&helper_ready, __ATOMIC_ACQUIRE)) {
+            memcpy(shadow_ram, vdc.ram, sizeof(shadow_ram));
+            deferred = 1;
+            log_message(vdc.log, "Drawing lines on helper core.");
+        }
+        return;
+    }
+
+    job_close_write();
+    while (__atomic_load_n(&job_head, __ATOMIC_ACQUIRE) != job_tail) {
+        JOB_WAIT();
+    }
+
+    if (job_ring_stalls) {
+        log_message(vdc.log, "Line queue was full %u times.",
+                    job_ring_stalls);
+        job_ring_stalls = 0;
+    }
+}
+
+void vdc_draw_ram_resync(void)
+{
+    if (deferred) {
+        vdc_draw_sync();
+        memcpy(shadow_ram, vdc.ram, sizeof(shadow_ram));
+    }
+}
+
+int vdc_draw_helper_poll(void)
+{
+    uint32_t head = job_head;
+    uint32_t tail = __atomic_load_n(&job_tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    if (!helper_ready) {
+        __atomic_store_n(&helper_ready, 1, __ATOMIC_RELEASE);
+    }
+
+    while (head != tail) {
+        run_job(&job_ring[head & VDC_JOB_RING_MASK]);
+        head++;
+        n++;
+        __atomic_store_n(&job_head, head, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+#endif
+
+static void draw_line(int mode)
+{
+    vdc_line_t l;
+
+#ifdef RASPI_COMPILE
+    if (deferred) {
+        draw_line_deferred(mode);
+        return;
+    }
+#endif
+
+    vdc_line_capture(&l, vdc.ram);
+    switch (mode) {
+        case VDC_TEXT_MODE:
+            render_std_text(&l);
+            break;
+        case VDC_BITMAP_MODE:
+            render_std_bitmap(&l);
+            break;
+        default:
+            render_idle(&l);
+            break;
+    }
+}
+
+static void draw_std_text(void)
+{
+    draw_line(VDC_TEXT_MODE);
+}
+
+static void draw_std_bitmap(void)
+{
+    draw_line(VDC_BITMAP_MODE);
+}
+
+static void draw_idle(void)
+{
+    draw_line(VDC_IDLE_MODE);
+}
+
 
 static void setup_modes(void)
 {
@@ -1058,4 +1430,8 @@ void vdc_draw_init(void)
     init_drawing_tables();
 
     setup_modes();
+
+#ifdef RASPI_COMPILE
+    video_arch_set_draw_fence(vdc_draw_sync);
+#endif
 }
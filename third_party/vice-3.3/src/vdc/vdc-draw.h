@@ -31,4 +31,23 @@
 
 extern void vdc_draw_init(void);
 
+#ifdef RASPI_COMPILE
+#include "types.h"
+
+/* Non zero once lines are being drawn by the helper core.  */
+extern int vdc_draw_deferred(void);
+
+/* Mirror writes to VDC RAM into the helper's copy.  */
+extern void vdc_draw_ram_write(unsigned int addr, uint8_t value);
+extern void vdc_draw_ram_block(int ptr, int ptr2, int len, int copy);
+extern void vdc_draw_ram_resync(void);
+
+/* Wait for queued lines to be drawn.  */
+extern void vdc_draw_sync(void);
+
+/* Called repeatedly from the helper core.  Draws whatever is queued and
+   returns the number of jobs done.  */
+extern int vdc_draw_helper_poll(void);
+#endif
+
 #endif
@@ -66,6 +66,9 @@ static void vdc_write_data(void)
 
     /* Write data byte to update address. */
     vdc.ram[ptr & vdc.vdc_address_mask] = vdc.regs[31];
+#ifdef RASPI_COMPILE
+    vdc_draw_ram_write(ptr & vdc.vdc_address_mask, vdc.regs[31]);
+#endif
 #ifdef REG_DEBUG
     log_message(vdc.log, "STORE %04x %02x", ptr & vdc.vdc_address_mask,
                 vdc.regs[31]);
@@ -91,6 +94,9 @@ static void vdc_perform_fillcopy(void)
     if (vdc.regs[24] & 0x80) { /* COPY flag */
         /* Block start address.  */
         ptr2 = (vdc.regs[32] << 8) + vdc.regs[33];
+#ifdef RASPI_COMPILE
+        vdc_draw_ram_block(ptr, ptr2, blklen, 1);
+#endif
         for (i = 0; i < blklen; i++) {
             vdc.ram[(ptr + i) & vdc.vdc_address_mask]
                 = vdc.ram[(ptr2 + i) & vdc.vdc_address_mask];
@@ -103,6 +109,9 @@ static void vdc_perform_fillcopy(void)
 #ifdef REG_DEBUG
         log_message(vdc.log, "Fill mem %04x, len %03x, data %02x",
                     ptr, blklen, vdc.regs[31]);
+#endif
+#ifdef RASPI_COMPILE
+        vdc_draw_ram_block(ptr, 0, blklen, 0);
 #endif
         for (i = 0; i < blklen; i++) {
             vdc.ram[(ptr + i) & vdc.vdc_address_mask] = vdc.regs[31];
@@ -320,6 +329,10 @@ void vdc_store(uint16_t addr, uint8_t value)
 
         case 22:                /* R22 Character Horizontal Size Control */
             /* TODO - changes to this register are real time, so need raster_changes() type call, but why bother... */
+            if (vdc.regs[22] != oldval) {
+                /* Character width, which the cache does not know either */
+                raster_force_repaint(&vdc.raster);
+            }
 #ifdef REG_DEBUG
             log_message(vdc.log, "REG 22 only partially supported!");
 #endif
@@ -371,6 +384,9 @@ void vdc_store(uint16_t addr, uint8_t value)
             if ((vdc.regs[25] & 0x10u) != (oldval & 0x10u)) {
                 /* Double-Pixel Mode */
                 vdc.update_geometry = 1;
+                /* The cache does not know the pixel width, so the lines
+                   left in this frame must not be taken from it.  */
+                raster_force_repaint(&vdc.raster);
             }
 #ifdef REG_DEBUG
             log_message(vdc.log, "Video mode: %s.",
@@ -574,6 +590,9 @@ uint8_t vdc_ram_read(uint16_t addr)
 void vdc_ram_store(uint16_t addr, uint8_t value)
 {
     vdc.ram[addr & vdc.vdc_address_mask] = value;
+#ifdef RASPI_COMPILE
+    vdc_draw_ram_write(addr & vdc.vdc_address_mask, value);
+#endif
 }
 
 
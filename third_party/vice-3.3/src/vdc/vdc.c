@@ -346,6 +346,9 @@ void vdc_powerup(void)
         vdc.ram[i] = v;
         v ^= 0xff;
     }
+#ifdef RASPI_COMPILE
+    vdc_draw_ram_resync();
+#endif
     memset(vdc.regs, 0, sizeof(vdc.regs));
     vdc.mem_counter = 0;
     vdc.mem_counter_inc = 0;
@@ -470,6 +473,10 @@ static void vdc_raster_draw_alarm_handler(CLOCK offset, void *data)
     }
 
     if (vdc.raster.current_line == 0) { /* We are on the first raster line, so go reset and/or handle everything for a new frame */
+#ifdef RASPI_COMPILE
+        /* Geometry may change below, let queued lines finish first.  */
+        vdc_draw_sync();
+#endif
         /* The top border position is based on the position of the vertical
            sync pulse [7] in relation to the total height of the screen [4]
            and the width of the sync pulse [3] */
@@ -613,6 +620,14 @@ static void vdc_raster_draw_alarm_handler(CLOCK offset, void *data)
         vdc.raster.video_mode = VDC_IDLE_MODE;
     }
 
+#ifdef RASPI_COMPILE
+    /* Comparing a line against the cache costs about as much as drawing
+       it, and the helper core draws for free.  */
+    if (vdc_draw_deferred()) {
+        vdc.raster.cache_enabled = 0;
+    }
+#endif
+
     /* actually draw the current raster line */
     raster_line_emulate(&vdc.raster);
 
@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+"""Turns a BMC64 A/V capture (captureNNN.bmv, see CAPTURE.md) into a
+video with ffmpeg, or into a WAV file and PPM frames."""
+
+import argparse
+import os
+import shutil
+import struct
+import subprocess
+import sys
+import tempfile
+import wave
+
+import stream_viewer
+
+START = 0x10
+AUDIO = 0x03
+END = 0x04
+
+START_BODY = struct.Struct("<4sHHII")
+AUDIO_HEADER = struct.Struct("<I")
+END_BODY = struct.Struct("<IIIII")
+
+
+class CaptureError(Exception):
+    pass
+
+
+def messages(data):
+    """Yields (type, body) from a capture's bytes. A capture cut short,
+    by a pulled card, ends at its last whole message."""
+    at = 0
+    while at + stream_viewer.HEADER.size <= len(data):
+        kind, _, _, length = stream_viewer.HEADER.unpack_from(data, at)
+        at += stream_viewer.HEADER.size
+        if at + length > len(data):
+            return
+        yield kind, data[at:at + length]
+        at += length
+
+
+class Capture:
+    """A whole capture: the format, the size and number of each frame,
+    the sound as (first sample, samples) and the counters the end
+    message carries, if it has one. The frames are decoded as video()
+    goes, so a long capture does not have to fit in memory twice."""
+
+    def __init__(self, data):
+        self.data = data
+        self.channels = 1
+        self.rate = 44100
+        self.fps = 50.0
+        self.end = None
+        self.frames = []
+        self.audio = []
+        started = False
+        for kind, body in messages(data):
+            if kind == START:
+                magic, version, self.channels, self.rate, fps = \
+                    START_BODY.unpack_from(body)
+                if magic != b"BMCA" or version != 1:
+                    raise CaptureError("not a version 1 capture")
+                self.fps = fps / 1000.0
+                started = True
+            elif not started:
+                raise CaptureError("no start message")
+            elif kind == AUDIO:
+                first = AUDIO_HEADER.unpack_from(body)[0]
+                self.audio.append((first, body[AUDIO_HEADER.size:]))
+            elif kind == END:
+                self.end = dict(zip(
+                    ("frames", "encoded", "capture_drops", "encode_drops",
+                     "audio_drops"), END_BODY.unpack_from(body)))
+            elif kind == stream_viewer.FRAME:
+                self.frames.append(
+                    stream_viewer.FRAME_HEADER.unpack_from(body)[:3])
+        if not started:
+            raise CaptureError("no start message")
+
+    def size(self):
+        """Big enough for every frame; the C128 switches between the
+        VIC-II and the VDC."""
+        return (max((f[1] for f in self.frames), default=0),
+                max((f[2] for f in self.frames), default=0))
+
+    def samples(self):
+        """All the sound as 16 bit little endian PCM, with silence where
+        samples were dropped."""
+        pcm = bytearray()
+        frame_bytes = 2 * self.channels
+        for first, samples in self.audio:
+            at = first * frame_bytes
+            if at > len(pcm):
+                pcm += bytes(at - len(pcm))
+            pcm[at:at + len(samples)] = samples
+        return bytes(pcm)
+
+    def decoded(self):
+        """Yields the stream_viewer.Decoder after each frame."""
+        decoder = stream_viewer.Decoder()
+        for kind, body in messages(self.data):
+            if decoder.message(kind, body):
+                yield decoder
+
+    def video(self):
+        """Yields one RGB picture of size() per frame the machine drew,
+        holding the last picture over dropped frames."""
+        width, height = self.size()
+        picture = bytes(width * height * 3)
+        last = -1
+        for decoder in self.decoded():
+            for _ in range(decoder.frame - last - 1):
+                yield picture
+            picture = rgb(decoder, width, height)
+            last = decoder.frame
+            yield picture
+        if self.end:
+            for _ in range(self.end["frames"] - last - 1):
+                yield picture
+
+
+def rgb(decoder, width, height):
+    """The decoder's picture as RGB, centred on a width x height
+    canvas."""
+    w, h = decoder.width, decoder.height
+    tables = [bytes(colour[c] for colour in decoder.palette)
+              for c in range(3)]
+    if (w, h) == (width, height):
+        out = bytearray(width * height * 3)
+        for c in range(3):
+            out[c::3] = decoder.pixels.translate(tables[c])
+        return bytes(out)
+    left = (width - w) // 2
+    top = (height - h) // 2
+    out = bytearray(width * height * 3)
+    for y in range(h):
+        row = decoder.pixels[y * w:(y + 1) * w]
+        at = ((top + y) * width + left) * 3
+        for c in range(3):
+            out[at + c:at + 3 * w:3] = row.translate(tables[c])
+    return bytes(out)
+
+
+def write_wav(capture, path):
+    with wave.open(path, "wb") as out:
+        out.setnchannels(capture.channels)
+        out.setsampwidth(2)
+        out.setframerate(capture.rate)
+        out.writeframes(capture.samples())
+
+
+def report(capture, name):
+    width, height = capture.size()
+    seconds = len(capture.samples()) / 2.0 / capture.channels / capture.rate
+    print("{}: {} frames at {:.3f} fps, {}x{}, {:.1f} s of {} channel "
+          "sound at {} Hz".format(name, len(capture.frames), capture.fps,
+                                 width, height, seconds, capture.channels,
+                                 capture.rate))
+    if capture.end is None:
+        print("no end message; the recording was cut short")
+    else:
+        print("machine drew {frames}, {capture_drops} dropped at capture, "
+              "{encode_drops} for the card, {audio_drops} samples "
+              "dropped".format(**capture.end))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("capture", help="captureNNN.bmv")
+    parser.add_argument("output", nargs="?",
+                        help="video to write with ffmpeg, e.g. out.mp4")
+    parser.add_argument("--scale", type=int, default=2,
+                        help="pixel size in the video (default: 2)")
+    parser.add_argument("--wav", metavar="FILE",
+                        help="also write the sound to FILE")
+    parser.add_argument("--ppm", metavar="DIR",
+                        help="also write every frame as a PPM to DIR")
+    parser.add_argument("--ffmpeg", default="ffmpeg")
+    arguments = parser.parse_args()
+
+    with open(arguments.capture, "rb") as source:
+        capture = Capture(source.read())
+    report(capture, arguments.capture)
+
+    if arguments.wav:
+        write_wav(capture, arguments.wav)
+    if arguments.ppm:
+        os.makedirs(arguments.ppm, exist_ok=True)
+        width, height = capture.size()
+        for index, picture in enumerate(capture.video()):
+            name = os.path.join(arguments.ppm,
+                                "frame{:06d}.ppm".format(index))
+            with open(name, "wb") as out:
+                out.write(b"P6\n%d %d\n255\n" % (width, height) + picture)
+    if not arguments.output:
+        return 0
+
+    if shutil.which(arguments.ffmpeg) is None:
+        raise SystemExit("no {}; --wav and --ppm work without it".format(
+            arguments.ffmpeg))
+    width, height = capture.size()
+    with tempfile.TemporaryDirectory() as scratch:
+        sound = os.path.join(scratch, "sound.wav")
+        write_wav(capture, sound)
+        command = [arguments.ffmpeg, "-loglevel", "error", "-y",
+                   "-f", "rawvideo", "-pix_fmt", "rgb24",
+                   "-s", "{}x{}".format(width, height),
+                   "-r", "{:.3f}".format(capture.fps), "-i", "-",
+                   "-i", sound,
+                   "-vf", "scale=iw*{0}:ih*{0}:flags=neighbor".format(
+                       arguments.scale),
+                   "-pix_fmt", "yuv420p", "-shortest", arguments.output]
+        encoder = subprocess.Popen(command, stdin=subprocess.PIPE)
+        for picture in capture.video():
+            encoder.stdin.write(picture)
+        encoder.stdin.close()
+        if encoder.wait() != 0:
+            raise SystemExit("ffmpeg failed")
+    print("wrote " + arguments.output)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,72 @@
+/*
+ * c64_scene.h - the synthetic C64 display the frame stream and capture
+ *               benches draw
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// What a C64 usually shows: a static screen of text, a scroller on two
+// rows, a sprite moving across and a raster bar rolling through the
+// border, 384x272 and one byte a pixel. stream_loopback.py draws the
+// same scene to check what comes out.
+
+#ifndef C64_SCENE_H
+#define C64_SCENE_H
+
+#include <stdint.h>
+
+const unsigned kSceneWidth = 384;
+const unsigned kSceneHeight = 272;
+
+// Pepto's C64 colours.
+const uint32_t kSceneColours[16] = {
+    0x000000, 0xffffff, 0x68372b, 0x70a4b2, 0x6f3d86, 0x588d43,
+    0x352879, 0xb8c76f, 0x6f4f25, 0x433900, 0x9a6759, 0x444444,
+    0x6c6c6c, 0x9ad284, 0x6c5eb5, 0x959595,
+};
+
+// As the frame buffer layer keeps it, RGB565.
+inline void scene_palette(uint16_t *palette) {
+  for (unsigned i = 0; i < 256; ++i) {
+    uint32_t rgb = kSceneColours[i & 15];
+    palette[i] = (uint16_t)(((rgb >> 19) & 0x1f) << 11 |
+                            ((rgb >> 10) & 0x3f) << 5 | ((rgb >> 3) & 0x1f));
+  }
+}
+
+// Frame n into pixels, row 0 at top. Keep in step with scene_row in
+// stream_loopback.py.
+inline void draw_scene(uint8_t *pixels, unsigned pitch, unsigned n) {
+  for (unsigned y = 0; y < kSceneHeight; ++y) {
+    uint8_t *row = pixels + y * pitch;
+    bool border_row = y < 36 || y >= 236;
+    uint8_t border = ((y + n) & 63) < 4 ? 1 : 14;
+    for (unsigned x = 0; x < kSceneWidth; ++x) {
+      if (border_row || x < 32 || x >= 352) {
+        row[x] = border;
+        continue;
+      }
+      unsigned cy = (y - 36) >> 3;
+      unsigned xs = x - 32 + (cy == 22 || cy == 23 ? 2 * n : 0);
+      unsigned cx = (xs >> 3) % 40;
+      unsigned h = cx * 7 + cy * 13;
+      unsigned bit = ((h * 0x9e37u) >> ((xs & 7) + ((y - 36) & 7) * 2)) & 1;
+      row[x] = bit ? 14 : 6;
+    }
+    unsigned sx = 24 + (n * 3) % 300;
+    unsigned sy = 50 + (n * 2) % 150;
+    if (y >= sy && y < sy + 21) {
+      for (unsigned x = sx; x < sx + 24; ++x) {
+        if ((((x - sx) ^ (y - sy)) & 4) == 0) {
+          row[x] = 2;
+        }
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,225 @@
+/*
+ * capture_bench.cc - record a synthetic C64 display and a tone through
+ *                    the A/V capture (src/bmccapture.cpp) to a file
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The main thread stands in for the emulation core. It draws the scene
+// in c64_scene.h 50 times a second into a padded buffer, the way VICE
+// draws into the VIC layer, and hands each frame and 882 samples of a
+// 450 Hz tone to the capture, in two writes as VICE's sound device
+// does. A second thread stands in for core 3 and polls the encoder
+// between frames; --no-helper leaves the encoding to the writer task.
+// --stall-ms makes the first write to the file take that long, like a
+// card that stops to erase, so the write buffer fills.
+//
+// capture_loopback.py reads the file back with capture_convert.py's
+// reader and checks it against the scene and the tone. The report gives
+// the time the emulation thread spent in the capture per frame, which is
+// what it costs on the Pi, and where frames and sound were dropped.
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "c64_scene.h"
+#include "modem_host.h"
+
+#include "../../src/bmccapture.h"
+
+extern "C" int circle_capture_start(const char *dir, double fps);
+extern "C" void circle_capture_stop(void);
+extern "C" int circle_capture_active(void);
+
+namespace {
+
+const unsigned kPitch = 512;
+const unsigned kLeft = 16;
+const unsigned kTop = 8;
+const unsigned kFrameUs = 20000;
+const unsigned kRate = 44100;
+const unsigned kSamplesPerFrame = kRate / 50;
+
+struct Options {
+  const char *dir = ".";
+  unsigned frames = 500;
+  unsigned stall_ms = 0;
+  bool helper = true;
+} options;
+
+uint8_t pixels[kPitch * (kSceneHeight + 2 * kTop)];
+uint16_t palette[256];
+int16_t tone[kSamplesPerFrame];
+volatile bool stopping;
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t thread_cpu_ns(pthread_t thread) {
+  clockid_t clock;
+  struct timespec used;
+  if (pthread_getcpuclockid(thread, &clock) != 0 ||
+      clock_gettime(clock, &used) != 0) {
+    return 0;
+  }
+  return (uint64_t)used.tv_sec * 1000000000 + used.tv_nsec;
+}
+
+// Sample i of the tone; keep in step with capture_loopback.py. A frame
+// holds a whole number of its periods, so every frame's samples are the
+// same.
+int16_t tone_sample(unsigned i) {
+  return (int16_t)lrint(8000 * sin(2 * M_PI * 450 * i / kRate));
+}
+
+void *helper_main(void *) {
+  while (!stopping) {
+    if (!CaptureHelperPoll()) {
+      usleep(100);
+    }
+  }
+  return 0;
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--dir DIR] [--frames N] [--stall-ms MS] [--no-helper]\n"
+          "          [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (!strcmp(argv[i], "--no-helper")) {
+      options.helper = false;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--dir")) {
+      options.dir = argv[++i];
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--stall-ms")) {
+      options.stall_ms = strtoul(argv[++i], 0, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.frames == 0) {
+    usage(argv[0]);
+  }
+
+  scene_palette(palette);
+  for (unsigned i = 0; i < kSamplesPerFrame; ++i) {
+    tone[i] = tone_sample(i);
+  }
+
+  modem_host_write_stall_ms = options.stall_ms;
+  StartCapture();
+  CaptureSetSoundFormat(kRate, 1);
+  modem_host_start_tasks();
+  pthread_t helper;
+  if (options.helper) {
+    pthread_create(&helper, 0, helper_main, 0);
+  }
+
+  char dir[1024];
+  snprintf(dir, sizeof dir, "%s/", options.dir);
+  int number = circle_capture_start(dir, 50.0);
+  if (number < 0) {
+    fprintf(stderr, "cannot create a capture file in %s\n", options.dir);
+    return 1;
+  }
+  printf("recording to %scapture%03d.bmv, %s\n", dir, number,
+         options.helper ? "helper encodes" : "writer task encodes");
+  fflush(stdout);
+
+  uint64_t start = now_ns();
+  uint64_t next = start;
+  uint64_t capture_ns = 0;
+  uint64_t max_capture_ns = 0;
+  uint64_t draw_ns = 0;
+  uint64_t helper_start = options.helper ? thread_cpu_ns(helper) : 0;
+  uint64_t tasks_start = modem_host_task_cpu_ns();
+  for (unsigned n = 0; n < options.frames; ++n) {
+    uint64_t begin = now_ns();
+    draw_scene(pixels + kTop * kPitch + kLeft, kPitch, n);
+    uint64_t drawn = now_ns();
+    if (CaptureWanted()) {
+      CaptureFrame(pixels, kPitch, kLeft, kTop, kSceneWidth, kSceneHeight,
+                   palette);
+    }
+    CaptureAudio(tone, kSamplesPerFrame / 2);
+    CaptureAudio(tone + kSamplesPerFrame / 2,
+                 kSamplesPerFrame - kSamplesPerFrame / 2);
+    uint64_t used = now_ns() - drawn;
+    draw_ns += drawn - begin;
+    capture_ns += used;
+    if (used > max_capture_ns) {
+      max_capture_ns = used;
+    }
+    next += kFrameUs * 1000ull;
+    uint64_t now = now_ns();
+    if (next > now) {
+      usleep((useconds_t)((next - now) / 1000));
+    } else {
+      next = now;
+    }
+  }
+  double seconds = (now_ns() - start) / 1e9;
+  double helper_cpu =
+      options.helper ? (thread_cpu_ns(helper) - helper_start) / 1e7 : 0.0;
+  double tasks_cpu = (modem_host_task_cpu_ns() - tasks_start) / 1e7;
+
+  uint64_t stopped = now_ns();
+  circle_capture_stop();
+  while (circle_capture_active()) {
+    usleep(1000);
+  }
+  double closing_ms = (now_ns() - stopped) / 1e6;
+  stopping = true;
+
+  CaptureStats stats;
+  CaptureGetStats(&stats);
+  printf("frames %u, captured %u, dropped at capture %u, too large %u\n",
+         stats.frames, stats.captured, stats.captureDrops, stats.tooLarge);
+  printf("encoded %u, key frames %u, dropped for the card %u\n",
+         stats.encoded, stats.keyFrames, stats.encodeDrops);
+  printf("audio %llu samples, dropped at capture %llu, for the card %llu\n",
+         stats.audioSamples, stats.audioDrops, stats.audioEncodeDrops);
+  printf("wrote %llu bytes, %.0f bytes/frame, %.1f KB/s, closed %.0f ms "
+         "after the stop\n",
+         stats.bytesWritten, (double)stats.bytesWritten / stats.frames,
+         stats.bytesWritten / 1024.0 / seconds, closing_ms);
+  printf("emulation thread in the capture: mean %.2f us, max %.2f us per "
+         "frame (drawing the scene %.1f us)\n",
+         capture_ns / 1e3 / options.frames, max_capture_ns / 1e3,
+         draw_ns / 1e3 / options.frames);
+  printf("encode: mean %.1f us, max %u us per frame\n",
+         stats.encoded ? (double)stats.encodeUs / stats.encoded : 0.0,
+         stats.maxEncodeUs);
+  printf("write: %u writes, mean %.2f ms, max %.2f ms\n", stats.writes,
+         stats.writes ? stats.writeUs / 1e3 / stats.writes : 0.0,
+         stats.maxWriteUs / 1e3);
+  printf("cpu: helper %.1f%%, writer task %.1f%%\n", helper_cpu / seconds,
+         tasks_cpu / seconds);
+  // The writer task is still polling.
+  fflush(stdout);
+  _exit(0);
+}
@@ -0,0 +1,153 @@
+#!/usr/bin/env python3
+"""Record bmc64-capture-bench's synthetic C64 display and tone, read the
+file back with capture_convert.py's reader, check the frames against the
+scene and the sound against the tone, and report what the capture cost
+with and without the helper, and with a card that stalls."""
+
+import argparse
+import math
+import os
+import subprocess
+import sys
+import tempfile
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, ".."))
+sys.path.insert(0, HERE)
+
+import capture_convert  # noqa: E402
+from stream_loopback import expect, field, scene  # noqa: E402
+
+RATE = 44100
+SAMPLES_PER_FRAME = RATE // 50
+
+
+def tone(i):
+    """Sample i of the tone, as tone_sample in capture_bench.cc makes it."""
+    return int(round(8000 * math.sin(2 * math.pi * 450 * i / RATE)))
+
+
+def check_sound(capture, name):
+    period = [tone(i) for i in range(SAMPLES_PER_FRAME)]
+    samples = 0
+    wrong = 0
+    for first, block in capture.audio:
+        values = memoryview(block).cast("h")
+        samples += len(values)
+        for offset in range(0, len(values), 97):
+            if values[offset] != period[(first + offset) % SAMPLES_PER_FRAME]:
+                wrong += 1
+    expect(wrong == 0, "{}: {} samples in {} blocks where they were "
+           "played".format(name, samples, len(capture.audio)))
+    return samples
+
+
+def run(bench, frames, helper, stall_ms, check_every):
+    with tempfile.TemporaryDirectory() as scratch:
+        command = [bench, "--dir", scratch, "--frames", str(frames)]
+        if not helper:
+            command.append("--no-helper")
+        if stall_ms:
+            command += ["--stall-ms", str(stall_ms)]
+        result = subprocess.run(command, stdout=subprocess.PIPE,
+                                universal_newlines=True, timeout=120)
+        if result.returncode != 0:
+            raise AssertionError("bench failed:\n" + result.stdout)
+        report = result.stdout
+        with open(os.path.join(scratch, "capture000.bmv"), "rb") as source:
+            data = source.read()
+
+    name = "{}{}".format("helper" if helper else "no helper",
+                         ", card stalls {} ms".format(stall_ms)
+                         if stall_ms else "")
+    capture = capture_convert.Capture(data)
+    expect(capture.end is not None and capture.end["frames"] == frames,
+           "{}: end message counts {} frames".format(name, frames))
+    numbers = [frame[0] for frame in capture.frames]
+    expect(all(b > a for a, b in zip(numbers, numbers[1:])),
+           "{}: frames in order".format(name))
+    dropped = capture.end["capture_drops"] + capture.end["encode_drops"]
+    expect(len(numbers) + dropped == frames,
+           "{}: {} frames written and {} dropped".format(
+               name, len(numbers), dropped))
+    checked = 0
+    wrong = []
+    for index, decoder in enumerate(capture.decoded()):
+        if index % check_every == 0 or index == len(numbers) - 1:
+            checked += 1
+            if bytes(decoder.pixels) != scene(decoder.frame):
+                wrong.append(decoder.frame)
+    expect(not wrong, "{}: {} of {} frames decoded as drawn".format(
+        name, checked, len(numbers)))
+    samples = check_sound(capture, name)
+    expect(samples + capture.end["audio_drops"] == frames *
+           SAMPLES_PER_FRAME, "{}: every sample written or counted "
+           "dropped".format(name))
+    video = sum(1 for _ in capture.video())
+    expect(video == frames, "{}: converts to {} pictures".format(
+        name, frames))
+    return name, report, len(data)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--bench", default=os.path.join(
+        HERE, "bmc64-capture-bench"))
+    parser.add_argument("--frames", type=int, default=500,
+                        help="frames per run, 50 a second (default: 500)")
+    parser.add_argument("--check-every", type=int, default=25,
+                        help="compare every n'th decoded frame with the "
+                        "scene (default: 25)")
+    arguments = parser.parse_args()
+    if not os.path.exists(arguments.bench):
+        raise SystemExit("build it first: make -C {} capture-bench".format(
+            HERE))
+
+    rows = []
+    # The write buffer holds about ten seconds of this scene, so a
+    # twelve second stall has to drop.
+    for helper, stall, frames in ((True, 0, arguments.frames),
+                                  (False, 0, arguments.frames),
+                                  (True, 12000, 800)):
+        name, report, size = run(arguments.bench, frames, helper, stall,
+                                  arguments.check_every)
+        encoded, encode_drops = field(
+            report, r"encoded (\d+), key frames \d+, dropped for the card "
+            r"(\d+)")
+        capture_drops = field(report, r"dropped at capture (\d+)")[0]
+        audio_drops = sum(int(n) for n in field(
+            report, r"dropped at capture (\d+), for the card (\d+)\n"))
+        rate = field(report, r"bytes/frame, ([\d.]+) KB/s")[0]
+        mean, worst = field(report, r"capture: mean ([\d.]+) us, "
+                            r"max ([\d.]+) us")
+        encode = field(report, r"encode: mean ([\d.]+) us")[0]
+        write_mean, write_max = field(report, r"write: \d+ writes, mean "
+                                      r"([\d.]+) ms, max ([\d.]+) ms")
+        helper_cpu, task_cpu = field(report, r"helper ([\d.]+)%, "
+                                     r"writer task ([\d.]+)%")
+        if stall:
+            expect(int(encode_drops) > 0,
+                   name + ": frames dropped, not waited for")
+        expect(float(worst) < 1000, name + ": emulation thread never waits")
+        rows.append((name, frames, int(encoded),
+                     int(capture_drops) + int(encode_drops), audio_drops,
+                     size // frames, rate, mean, worst, encode, write_mean,
+                     write_max, helper_cpu, task_cpu))
+
+    print()
+    print("384x272 C64 display and a tone at 50 Hz:")
+    print("{:28} | {:>6} | {:>7} | {:>6} | {:>7} | {:>6} | {:>6} | "
+          "{:>15} | {:>6} | {:>13} | {:>5} | {:>5}".format(
+              "run", "frames", "written", "drops", "samples", "B/fr",
+              "KB/s", "emu us mean/max", "enc us", "write ms mn/mx",
+              "help%", "wri%"))
+    for row in rows:
+        print("{:28} | {:6d} | {:7d} | {:6d} | {:7d} | {:6d} | {:>6} | "
+              "{:>7}/{:<7} | {:>6} | {:>6}/{:<6} | {:>5} | {:>5}".format(
+                  *row))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,373 @@
+/*
+ * circle_host.c - stand in for the Circle kernel on the build machine
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// Implements the emulator -> kernel half of circle.h so VICE's raspi
+// arch layer and the common layer link and run as an ordinary Linux
+// process. Frame buffers are plain heap memory, audio is discarded and
+// everything to do with USB, GPIO and networking reports 'not present'.
+
+#include "headless_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "circle.h"
+#include "monitorbmc.h"
+#include "rawnetbmc.h"
+
+// Same values as the kernel. See src/defs.h and src/vicesound.h
+#define SAMPLE_RATE 44100
+#define FRAG_SIZE 256
+#define NUM_FRAGS 16
+
+// Mirrors the parts of FrameBufferLayer that the emulator can observe.
+struct host_fbl {
+  uint8_t *pixels;
+  int allocated;
+  int width;
+  int height;
+  int pitch;
+  int line_double;
+  int src_w;
+  int src_h;
+  int zlayer;
+};
+
+static struct host_fbl fbl[FB_NUM_LAYERS];
+static int num_sound_channels = 1;
+static unsigned long sound_queued;
+
+int raspi_userport_enabled;
+
+static struct host_fbl *get_fbl(int layer) {
+  if (layer < 0 || layer >= FB_NUM_LAYERS) {
+    return NULL;
+  }
+  if (!fbl[layer].line_double) {
+    fbl[layer].line_double = 1;
+  }
+  return &fbl[layer];
+}
+
+const uint8_t *host_fbl_pixels(int layer, int *width, int *height,
+                               int *pitch) {
+  struct host_fbl *l = get_fbl(layer);
+  if (!l || !l->allocated) {
+    return NULL;
+  }
+  *width = l->width;
+  *height = l->height;
+  *pitch = l->pitch;
+  return l->pixels;
+}
+
+int circle_get_machine_timing() {
+  return host_options.ntsc ? MACHINE_TIMING_NTSC_HDMI
+                           : MACHINE_TIMING_PAL_HDMI;
+}
+
+// Same numbers ViceApp::circle_cycles_per_second uses for HDMI timing.
+int circle_cycles_per_sec() {
+  int ntsc = host_options.ntsc;
+#if defined(RASPI_C64) || defined(RASPI_C128)
+  return ntsc ? 1025700 : 982800;
+#elif defined(RASPI_VIC20)
+  return ntsc ? 1017900 : 1107600;
+#elif defined(RASPI_PLUS4)
+  return ntsc ? 1792080 : 1778400;
+#elif defined(RASPI_PET)
+  return ntsc ? 1013760 : 1001600;
+#else
+#error "RASPI_[model] NOT DEFINED"
+#endif
+}
+
+void circle_sleep(long delay) {
+  // Nothing emulated waits on wall clock time here.
+}
+
+unsigned long circle_get_ticks() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long)ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+void circle_yield() {}
+void circle_check_gpio() {}
+void circle_reset_gpio(int gpio_config) {}
+
+int circle_alloc_fbl(int layer, int pixelmode, uint8_t **pixels,
+                     int width, int height, int *pitch) {
+  struct host_fbl *l = get_fbl(layer);
+  int bytes_per_pixel = pixelmode == 1 ? 2 : 1;
+
+  if (!l || l->allocated) {
+    return -1;
+  }
+
+  l->allocated = 1;
+  l->width = width;
+  l->height = height / l->line_double;
+  l->pitch = (width * bytes_per_pixel + 31) & ~31;
+  l->src_w = width;
+  l->src_h = l->height;
+  if (pitch) {
+    *pitch = l->pitch;
+  }
+  if (pixels) {
+    l->pixels = (uint8_t *)calloc(l->pitch, l->height);
+    *pixels = l->pixels;
+  }
+  return 0;
+}
+
+int circle_realloc_fbl(int layer, int shader) { return 0; }
+
+void circle_free_fbl(int layer) {
+  struct host_fbl *l = get_fbl(layer);
+  if (!l || !l->allocated) {
+    return;
+  }
+  free(l->pixels);
+  l->pixels = NULL;
+  l->allocated = 0;
+}
+
+void circle_clear_fbl(int layer) {
+  struct host_fbl *l = get_fbl(layer);
+  if (l && l->pixels) {
+    memset(l->pixels, 0, l->pitch * l->height);
+  }
+}
+
+void circle_show_fbl(int layer) {}
+void circle_hide_fbl(int layer) {}
+
+// One frame's worth of samples has played.
+static void sound_drain(void) {
+  unsigned long played = SAMPLE_RATE / (host_options.ntsc ? 60 : 50);
+  sound_queued = sound_queued > played ? sound_queued - played : 0;
+}
+
+void circle_frames_ready_fbl(int layer1, int layer2, int sync) {
+  if (layer1 == FB_LAYER_VIC) {
+    sound_drain();
+  }
+  host_frame_ready(layer1, layer2);
+}
+
+// Frames are compared by palette index so colours are not kept.
+void circle_set_palette_fbl(int layer, uint8_t index, uint16_t rgb565) {}
+void circle_set_palette32_fbl(int layer, uint8_t index, uint32_t argb) {}
+
+void circle_update_palette_fbl(int layer) {}
+
+void circle_set_stretch_fbl(int layer, double hstretch, double vstretch,
+                            int hintstr, int vintstr, int use_hintstr,
+                            int use_vintstr) {}
+
+void circle_set_src_rect_fbl(int layer, int x, int y, int w, int h) {
+  struct host_fbl *l = get_fbl(layer);
+  if (l) {
+    l->src_w = w;
+    l->src_h = h / l->line_double;
+  }
+}
+
+void circle_set_line_doubling_fbl(int layer, int enable, int dark_lines) {
+  struct host_fbl *l = get_fbl(layer);
+  if (l) {
+    l->line_double = enable ? 2 : 1;
+  }
+}
+
+void circle_set_center_offset(int layer, int cx, int cy) {}
+void circle_set_valign_fbl(int layer, int align, int padding) {}
+void circle_set_halign_fbl(int layer, int align, int padding) {}
+void circle_set_padding_fbl(int layer, double lpad, double rpad,
+                            double tpad, double bpad) {}
+
+void circle_set_zlayer_fbl(int layer, int zlayer) {
+  struct host_fbl *l = get_fbl(layer);
+  if (l) {
+    l->zlayer = zlayer;
+  }
+}
+
+int circle_get_zlayer_fbl(int layer) {
+  struct host_fbl *l = get_fbl(layer);
+  return l ? l->zlayer : 0;
+}
+
+void circle_get_fbl_dimensions(int layer, int *display_w, int *display_h,
+                               int *fb_w, int *fb_h, int *src_w, int *src_h,
+                               int *dst_w, int *dst_h) {
+  struct host_fbl *l = get_fbl(layer);
+  int ld = l ? l->line_double : 1;
+  *display_w = 1920;
+  *display_h = 1080;
+  *fb_w = l ? l->width : 0;
+  *fb_h = l ? l->height * ld : 0;
+  *src_w = l ? l->src_w : 0;
+  *src_h = l ? l->src_h * ld : 0;
+  *dst_w = *src_w;
+  *dst_h = *src_h;
+}
+
+void circle_get_scaling_params(int display, int *fbw, int *fbh, int *sx,
+                               int *sy) {
+  *fbw = 0;
+  *fbh = 0;
+  *sx = 0;
+  *sy = 0;
+}
+
+void circle_set_interpolation(int enable) {}
+void circle_set_use_shader(int enable) {}
+void circle_set_shader_params(int curvature, float curvature_x,
+                              float curvature_y, int mask,
+                              float mask_brightness, int gamma,
+                              int fake_gamma, int scanlines, int multisample,
+                              float scanline_weight,
+                              float scanline_gap_brightness,
+                              float bloom_factor, float input_gamma,
+                              float output_gamma, int sharper,
+                              int bilinear_interpolation) {}
+
+void circle_lock_acquire() {}
+void circle_lock_release() {}
+void circle_boot_complete() {}
+
+void circle_find_usb(int (*usb)[3]) {
+  (*usb)[0] = 0;
+  (*usb)[1] = 0;
+  (*usb)[2] = 0;
+}
+
+int circle_mount_usb(int usb) { return -1; }
+int circle_unmount_usb(int usb) { return -1; }
+int circle_netdisk_available(void) { return 0; }
+int circle_capture_start(const char *dir, double fps) { return -1; }
+void circle_capture_stop(void) {}
+int circle_capture_active(void) { return 0; }
+void circle_save_begin(const char *path) {}
+void circle_save_end(void) {}
+int circle_save_progress(void) { return -1; }
+
+// No serial log ring on the host; VICE's log goes to stdout as it did.
+const char *circle_log_subsystem_name(int subsystem) { return ""; }
+int circle_log_get_level(int subsystem) { return CIRCLE_LOG_ALL; }
+void circle_log_set_level(int subsystem, int level) {}
+int circle_log_wanted(const char *name, unsigned int level) { return 1; }
+void circle_log_line(const char *prefix, const char *text) {
+  fputs(prefix, stdout);
+  fputs(text, stdout);
+  fputc('\n', stdout);
+}
+void circle_set_volume(int value) {}
+
+// Model is used to pick defaults for the UI. Claim a Pi 3.
+int circle_get_model() { return 3; }
+unsigned circle_get_arm_clock() { return 1200000000; }
+int circle_gpio_enabled() { return 0; }
+int circle_gpio_outputs_enabled() { return 0; }
+
+// The null audio sink throws samples away but drains at the emulated
+// rate, one frame's worth per frame, so VICE sees a device playing in
+// real time and neither pads nor drops samples.
+int circle_sound_init(const char *param, int *speed, int *fragsize,
+                      int *fragnr, int *channels) {
+  *speed = SAMPLE_RATE;
+  *fragsize = FRAG_SIZE;
+  *fragnr = NUM_FRAGS;
+  num_sound_channels = *channels;
+  return 0;
+}
+
+int circle_sound_write(int16_t *pbuf, size_t nr) {
+  host_stats.samples += nr / num_sound_channels;
+  sound_queued += nr / num_sound_channels;
+  host_sound_written(pbuf, nr);
+  return 0;
+}
+
+void circle_sound_close(void) {}
+int circle_sound_suspend(void) { return 0; }
+int circle_sound_resume(void) { return 0; }
+int circle_sound_bufferspace(void) {
+  if (sound_queued >= FRAG_SIZE * NUM_FRAGS) {
+    return 0;
+  }
+  return FRAG_SIZE * NUM_FRAGS - sound_queued;
+}
+
+void circle_kernel_core_init_complete(int core) {}
+
+int circle_get_network_ip_address(char *address, unsigned int address_size) {
+  return 0;
+}
+int circle_get_network_status(void) { return CIRCLE_NETWORK_DISABLED; }
+void circle_set_network_status_changed_handler(
+    circle_network_status_changed_handler_t *handler) {}
+int circle_get_acia_network_enabled(void) { return 0; }
+int circle_get_acia_network_address(void) {
+  return CIRCLE_ACIA_NETWORK_ADDRESS_DEFAULT;
+}
+int circle_set_acia_network_address(int address) { return 0; }
+int circle_set_acia_network_enabled(int enabled) { return 0; }
+int circle_has_onboard_ethernet(void) { return 0; }
+int circle_has_onboard_wifi(void) { return 0; }
+int circle_wifi_is_running(void) { return 0; }
+int circle_connect_wifi(void) { return 0; }
+int circle_scan_wifi_access_points(struct wifi_access_point *access_points,
+                                   unsigned int max_access_points) {
+  return 0;
+}
+
+// The modem lives in the kernel (src/bmcmodem.cpp). No carrier, ever.
+void bmcmodem_init(void) {}
+void bmcmodem_reset(void) {}
+int bmcmodem_open(int device) { return -1; }
+void bmcmodem_close(int device) {}
+int bmcmodem_putc(int device, uint8_t byte) { return -1; }
+int bmcmodem_getc(int device, uint8_t *byte) { return -1; }
+int bmcmodem_has_carrier(void) { return 0; }
+void bmcmodem_set_status(int status) {}
+void bmcmodem_set_bps(unsigned int bps) {}
+void bmcmodem_note_acia_tx(uint8_t byte) {}
+unsigned int bmcmodem_acia_trace_read(uint8_t *bytes, unsigned int maximum) {
+  return 0;
+}
+void bmcmodem_acia_trace_clear(void) {}
+
+// So does the Ethernet cartridge bridge (src/bmcether.cpp). There is no
+// network device to bridge to.
+int bmcether_activate(void) { return 0; }
+void bmcether_deactivate(void) {}
+void bmcether_set_mac(const uint8_t mac[6]) {}
+void bmcether_set_hashfilter(const uint32_t hash_mask[2]) {}
+void bmcether_set_receive(int flags) {}
+int bmcether_transmit(const uint8_t *frame, int length) { return 0; }
+int bmcether_receive(uint8_t *buffer, int *length, int *frame_flags,
+                     int *hash_index) {
+  return 0;
+}
+void bmcether_get_stats(struct bmcether_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+}
+
+// And the remote monitor (src/bmcmonitor.cpp), which never has a client.
+int bmcmonitor_connected(void) { return 0; }
+int bmcmonitor_pending(void) { return 0; }
+int bmcmonitor_service(int stopped, int *count) { return 0; }
+void bmcmonitor_notify_stopped(int memspace) {}
+int bmcmonitor_idle(void) { return 1; }
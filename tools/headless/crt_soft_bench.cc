@@ -0,0 +1,292 @@
+/*
+ * crt_soft_bench.cc - check the software CRT filter (src/crt_soft.c)
+ *                     against the shader math and golden images, and
+ *                     time it
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// Renders the scene in c64_scene.h, padded the way VICE's layer is,
+// through crt_soft_render for a few display sizes and shader settings.
+// For each one:
+//
+// - every output pixel must match crt_soft_reference_pixel, the shader's
+//   math evaluated straight in floats: exactly when the row weights fit
+//   the tables, within one step of each channel when they are quantized;
+// - the image's CRC must match the golden one recorded here, so any
+//   change to what the filter draws shows up. --dump DIR writes each
+//   image as a PPM to look at when one does;
+// - rendering the top and bottom halves on two threads, as the Pi does
+//   with the helper core, must give the same image.
+//
+// Then it times a frame on one thread and split across two.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "c64_scene.h"
+
+#include "../../src/crt_soft.h"
+
+namespace {
+
+const unsigned kPitch = 400;
+const unsigned kLeft = 8;
+const unsigned kTop = 4;
+
+struct Config {
+  const char *name;
+  // Source region within the scene and output size
+  int src_w;
+  int src_h;
+  int dst_w;
+  int dst_h;
+  int dst_x;
+  int scanlines;
+  int multisample;
+  int gamma;
+  int fake_gamma;
+  int mask;
+  uint32_t golden;
+};
+
+// The menu's defaults for the weights; see menu.c.
+const Config kConfigs[] = {
+    {"plain 1080p", 360, 270, 1440, 1080, 240, 0, 0, 0, 0, 0, 0xdef7dabd},
+    {"crt-pi 1080p", 360, 270, 1440, 1080, 240, 1, 1, 1, 0, 1, 0xfb5f9c93},
+    {"fake gamma 720p", 384, 272, 960, 680, 160, 1, 0, 1, 1, 2, 0xae593aaa},
+    {"trinitron 1000 rows", 384, 272, 1280, 1000, 0, 1, 1, 1, 0, 2,
+     0x80bde859},
+};
+
+struct Options {
+  const char *dump = 0;
+  int frames = 50;
+} options;
+
+uint8_t pixels[kPitch * (kSceneHeight + 2 * kTop)];
+uint16_t palette[256];
+uint32_t crc_table[256];
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void crc_init() {
+  for (uint32_t i = 0; i < 256; ++i) {
+    uint32_t c = i;
+    for (int j = 0; j < 8; ++j) {
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    crc_table[i] = c;
+  }
+}
+
+uint32_t image_crc(const uint16_t *image, int w, int h) {
+  uint32_t crc = 0xffffffff;
+  for (int i = 0; i < w * h; ++i) {
+    for (int b = 0; b < 2; ++b) {
+      uint8_t byte = (uint8_t)(image[i] >> (8 * b));
+      crc = crc_table[(crc ^ byte) & 0xff] ^ (crc >> 8);
+    }
+  }
+  return ~crc;
+}
+
+void dump_ppm(const char *name, const uint16_t *image, int w, int h) {
+  char path[512];
+  snprintf(path, sizeof path, "%s/%s.ppm", options.dump, name);
+  for (char *c = path + strlen(options.dump) + 1; *c; ++c) {
+    if (*c == ' ') {
+      *c = '_';
+    }
+  }
+  FILE *fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "could not write %s\n", path);
+    return;
+  }
+  fprintf(fp, "P6\n%d %d\n255\n", w, h);
+  for (int i = 0; i < w * h; ++i) {
+    uint16_t c = image[i];
+    uint8_t rgb[3] = {(uint8_t)((c >> 11) * 255 / 31),
+                      (uint8_t)(((c >> 5) & 0x3f) * 255 / 63),
+                      (uint8_t)((c & 0x1f) * 255 / 31)};
+    fwrite(rgb, 1, 3, fp);
+  }
+  fclose(fp);
+}
+
+struct Job {
+  struct crt_soft *crt;
+  const uint8_t *src;
+  uint16_t *dst;
+  int pitch;
+  int y0;
+  int y1;
+};
+
+void *render_job(void *arg) {
+  Job *job = (Job *)arg;
+  crt_soft_render(job->crt, job->src, kPitch, job->dst, job->pitch, job->y0,
+                  job->y1);
+  return 0;
+}
+
+// Bottom half on a second thread, as the helper core does it.
+void render_split(struct crt_soft *crt, uint16_t *dst, int pitch, int h) {
+  pthread_t helper;
+  Job job = {crt, pixels, dst, pitch, h / 2, h};
+  pthread_create(&helper, 0, render_job, &job);
+  crt_soft_render(crt, pixels, kPitch, dst, pitch, 0, h / 2);
+  pthread_join(helper, 0);
+}
+
+int channel_diff(uint16_t a, uint16_t b) {
+  int d[3] = {(a >> 11) - (b >> 11), ((a >> 5) & 0x3f) - ((b >> 5) & 0x3f),
+              (a & 0x1f) - (b & 0x1f)};
+  int worst = 0;
+  for (int i = 0; i < 3; ++i) {
+    int v = d[i] < 0 ? -d[i] : d[i];
+    if (v > worst) {
+      worst = v;
+    }
+  }
+  return worst;
+}
+
+bool run(const Config &config) {
+  struct crt_soft_params params;
+  params.scanlines = config.scanlines;
+  params.multisample = config.multisample;
+  params.gamma = config.gamma;
+  params.fake_gamma = config.fake_gamma;
+  params.mask = config.mask;
+  params.mask_brightness = 0.70f;
+  params.scanline_weight = 6.0f;
+  params.scanline_gap_brightness = 0.12f;
+  params.bloom_factor = 1.5f;
+  params.input_gamma = 2.4f;
+  params.output_gamma = 2.2f;
+
+  struct crt_soft crt;
+  crt_soft_init(&crt);
+  crt_soft_set_palette(&crt, palette);
+  int src_x = kLeft + (kSceneWidth - config.src_w) / 2;
+  int src_y = kTop + (kSceneHeight - config.src_h) / 2;
+  if (crt_soft_configure(&crt, &params, src_x, src_y, config.src_w,
+                         config.src_h, config.dst_x, config.dst_w,
+                         config.dst_h) != 0) {
+    printf("%s: could not allocate the tables\n", config.name);
+    return false;
+  }
+
+  int w = config.dst_w;
+  int h = config.dst_h;
+  int pitch = w * 2;
+  uint16_t *image = (uint16_t *)malloc(w * h * 2);
+  uint16_t *split = (uint16_t *)malloc(w * h * 2);
+  crt_soft_render(&crt, pixels, kPitch, image, pitch, 0, h);
+
+  bool quantized = crt.num_levels == CRT_SOFT_MAX_LEVELS;
+  int allowed = quantized ? 1 : 0;
+  int worst = 0;
+  long off = 0;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      uint16_t ref = crt_soft_reference_pixel(&crt, pixels, kPitch, x, y);
+      int d = channel_diff(image[y * w + x], ref);
+      if (d > worst) {
+        worst = d;
+      }
+      if (d > allowed && off++ < 3) {
+        printf("  %d,%d: %04x, the shader gives %04x\n", x, y,
+               image[y * w + x], ref);
+      }
+    }
+  }
+
+  uint32_t crc = image_crc(image, w, h);
+  memset(split, 0, w * h * 2);
+  render_split(&crt, split, pitch, h);
+  bool same = memcmp(image, split, w * h * 2) == 0;
+
+  uint64_t start = now_ns();
+  for (int i = 0; i < options.frames; ++i) {
+    crt_soft_render(&crt, pixels, kPitch, image, pitch, 0, h);
+  }
+  double one_ms = (now_ns() - start) / 1e6 / options.frames;
+  start = now_ns();
+  for (int i = 0; i < options.frames; ++i) {
+    render_split(&crt, split, pitch, h);
+  }
+  double two_ms = (now_ns() - start) / 1e6 / options.frames;
+
+  printf("%s: %dx%d from %dx%d, %d weight%s%s, %.2f ms a frame, %.2f ms "
+         "on two threads\n",
+         config.name, w, h, config.src_w, config.src_h, crt.num_levels,
+         crt.num_levels == 1 ? "" : "s", quantized ? " (quantized)" : "",
+         one_ms, two_ms);
+  printf("  shader math: %ld pixels off, at most %d step%s\n", off, worst,
+         worst == 1 ? "" : "s");
+  printf("  crc %08x, golden %08x%s\n", crc, config.golden,
+         crc == config.golden ? "" : " DIFFERENT");
+  if (!same) {
+    printf("  two threads drew a different image\n");
+  }
+  if (options.dump) {
+    dump_ppm(config.name, image, w, h);
+  }
+
+  free(image);
+  free(split);
+  crt_soft_free(&crt);
+  return off == 0 && crc == config.golden && same;
+}
+
+void usage(const char *program) {
+  fprintf(stderr, "usage: %s [--frames N] [--dump DIR]\n", program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--dump")) {
+      options.dump = argv[++i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.frames < 1) {
+    usage(argv[0]);
+  }
+
+  crc_init();
+  scene_palette(palette);
+  // Padding a colour the scene never uses shows up if it is sampled.
+  memset(pixels, 5, sizeof pixels);
+  draw_scene(pixels + kTop * kPitch + kLeft, kPitch, 100);
+
+  bool ok = true;
+  for (const Config &config : kConfigs) {
+    ok = run(config) && ok;
+  }
+  printf("%s\n", ok ? "software CRT checks passed"
+                    : "SOFTWARE CRT CHECKS FAILED");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,625 @@
+/*
+ * ether_bench.cc - drive src/bmcether.cpp with frames from a synthetic
+ *                  network, a capture file or a Linux TAP interface
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The bench plays both ends of the bridge. A feeder thread stands in for
+// Circle's network task and shows each frame to the bridge's tap. The
+// main thread is the emulation core: every --guest-rate'th of a second
+// it reads frames the way cs8900_receive does through
+// rawnet_arch_receive, classifying any the bridge left unclassified and
+// going on until one is accepted or the ring is empty.
+//
+// Synthetic traffic (the default) is a mix of what reaches a Pi on a
+// busy LAN: unicast for the C64, unicast for the Pi's own stack,
+// broadcast ARP, and multicast and unicast for other hosts that a switch
+// floods. --burst sends that many frames back to back. Every frame
+// carries its sequence number, so the report can say how many of the
+// frames the C64 wanted were lost and whether anything else got through.
+// --unfiltered makes the bridge pass everything and leaves the filtering
+// to the emulated CS8900, as the pcap backend on other platforms does.
+//
+// --pcap FILE replays a capture instead, and --write FILE saves what the
+// C64 sent. --tap NAME bridges a Linux TAP interface for --seconds and
+// answers ARP, ICMP echo and UDP echo (port 7) for --guest-ip, so the
+// host can ping and send datagrams to the C64 through the bridge.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+
+#include <vector>
+
+#include "modem_host.h"
+
+extern "C" {
+#include "../../third_party/vice-3.3/src/arch/raspi/rawnetbmc.h"
+}
+
+namespace {
+
+const unsigned kMaxFrame = 1514;
+// What cs8900_receive asks rawnet_arch_receive for.
+const int kMaxReceive = 1518;
+const unsigned kTagOffset = 42;
+const unsigned kMinFrame = 60;
+
+const u8 kHostMac[6] = {0x02, 0x42, 0x4d, 0x43, 0x36, 0x34};
+// IP65's default RR-Net address.
+const u8 kGuestMac[6] = {0x00, 0x80, 0x10, 0x0c, 0x64, 0x01};
+const u8 kOtherMac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x99};
+const u8 kMulticastMac[6] = {0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb};
+const u8 kBroadcastMac[6] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
+enum Category {
+  kForGuest,
+  kForPi,
+  kBroadcastArp,
+  kMulticast,
+  kForOther,
+  kCategories
+};
+
+const char *const kCategoryNames[kCategories] = {
+    "for_c64", "for_pi", "broadcast_arp", "multicast", "for_other"};
+
+uint64_t now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+void sleep_until(uint64_t deadline) {
+  struct timespec until;
+  until.tv_sec = deadline / 1000000000;
+  until.tv_nsec = deadline % 1000000000;
+  clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0);
+}
+
+void put16(u8 *bytes, unsigned value) {
+  bytes[0] = value >> 8;
+  bytes[1] = value;
+}
+
+void put32(u8 *bytes, uint32_t value) {
+  put16(bytes, value >> 16);
+  put16(bytes + 2, value);
+}
+
+unsigned checksum(const u8 *bytes, unsigned length) {
+  uint32_t sum = 0;
+  for (unsigned index = 0; index + 1 < length; index += 2) {
+    sum += bytes[index] << 8 | bytes[index + 1];
+  }
+  if (length & 1) {
+    sum += bytes[length - 1] << 8;
+  }
+  while (sum >> 16) {
+    sum = (sum & 0xffff) + (sum >> 16);
+  }
+  return ~sum & 0xffff;
+}
+
+struct Options {
+  unsigned frames = 20000;
+  unsigned rate = 2000;
+  unsigned burst = 1;
+  unsigned guest_rate = 1000;
+  double seconds = 10;
+  bool unfiltered = false;
+  const char *pcap = 0;
+  const char *write = 0;
+  const char *tap = 0;
+  uint32_t guest_ip = 0;  // network order
+  uint32_t pi_ip = 0;
+};
+
+Options options;
+
+// Captures in the classic libpcap format, Ethernet only.
+class PcapWriter {
+public:
+  PcapWriter() : file_(0) {}
+
+  bool Open(const char *path) {
+    file_ = fopen(path, "wb");
+    if (file_ == 0) {
+      return false;
+    }
+    uint32_t header[6] = {0xa1b2c3d4, 0x00040002, 0, 0, 65535, 1};
+    return fwrite(header, sizeof(header), 1, file_) == 1;
+  }
+
+  void Write(const void *frame, unsigned length) {
+    if (file_ == 0) {
+      return;
+    }
+    uint64_t now = now_ns();
+    uint32_t record[4] = {(uint32_t)(now / 1000000000),
+                          (uint32_t)(now % 1000000000 / 1000), length,
+                          length};
+    fwrite(record, sizeof(record), 1, file_);
+    fwrite(frame, length, 1, file_);
+  }
+
+  ~PcapWriter() {
+    if (file_ != 0) {
+      fclose(file_);
+    }
+  }
+
+private:
+  FILE *file_;
+};
+
+bool read_pcap(const char *path, std::vector<std::vector<u8> > *frames) {
+  FILE *file = fopen(path, "rb");
+  if (file == 0) {
+    return false;
+  }
+  uint32_t header[6];
+  bool ok = fread(header, sizeof(header), 1, file) == 1;
+  bool swapped = ok && header[0] == 0xd4c3b2a1;
+  ok = ok && (header[0] == 0xa1b2c3d4 || swapped);
+  uint32_t record[4];
+  while (ok && fread(record, sizeof(record), 1, file) == 1) {
+    uint32_t length = swapped ? __builtin_bswap32(record[2]) : record[2];
+    std::vector<u8> frame(length);
+    if (length > 65535 || fread(frame.data(), 1, length, file) != length) {
+      ok = false;
+      break;
+    }
+    if (length >= 14 && length <= kMaxFrame) {
+      frames->push_back(frame);
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+// The Pi's network device.
+class BenchDevice : public CNetDevice {
+public:
+  BenchDevice() : mac_(kHostMac), tap_(-1), sent_(0), untranslated_(0) {}
+
+  const CMACAddress *GetMACAddress() const override { return &mac_; }
+
+  boolean SendFrame(const void *buffer, unsigned length) override {
+    const u8 *frame = static_cast<const u8 *>(buffer);
+    if (memcmp(frame + 6, kGuestMac, 6) == 0 ||
+        (length >= 28 && frame[12] == 0x08 && frame[13] == 0x06 &&
+         memcmp(frame + 22, kGuestMac, 6) == 0)) {
+      __atomic_add_fetch(&untranslated_, 1, __ATOMIC_RELAXED);
+    }
+    writer_.Write(frame, length);
+    if (tap_ >= 0 && write(tap_, frame, length) != (ssize_t)length) {
+      return false;
+    }
+    __atomic_add_fetch(&sent_, 1, __ATOMIC_RELEASE);
+    return true;
+  }
+
+  unsigned Sent() const { return __atomic_load_n(&sent_, __ATOMIC_ACQUIRE); }
+  unsigned Untranslated() const {
+    return __atomic_load_n(&untranslated_, __ATOMIC_RELAXED);
+  }
+
+  PcapWriter writer_;
+  CMACAddress mac_;
+  int tap_;
+
+private:
+  unsigned sent_;
+  unsigned untranslated_;
+};
+
+BenchDevice device;
+
+// What the feeder offered, by category, and when it finished.
+unsigned offered[kCategories];
+bool feeder_done;
+
+unsigned synthetic_frame(unsigned sequence, u8 *frame, Category *category) {
+  unsigned pick = sequence * 7919 % 100;
+  unsigned length = kMinFrame + sequence * 2654435761u % (kMaxFrame - kMinFrame);
+  *category = pick < 40   ? kForGuest
+              : pick < 65 ? kForPi
+              : pick < 75 ? kBroadcastArp
+              : pick < 90 ? kMulticast
+                          : kForOther;
+
+  memset(frame, 0, kMaxFrame);
+  memcpy(frame + 6, kOtherMac, 6);
+  switch (*category) {
+  case kForGuest:
+  case kForPi:
+    memcpy(frame, kHostMac, 6);
+    break;
+  case kBroadcastArp:
+    memcpy(frame, kBroadcastMac, 6);
+    length = kMinFrame;
+    break;
+  case kMulticast:
+    memcpy(frame, kMulticastMac, 6);
+    break;
+  default:
+    memcpy(frame, kOtherMac, 6);
+    frame[5] = 0x98;
+    break;
+  }
+  if (*category == kBroadcastArp) {
+    put16(frame + 12, 0x0806);
+    put16(frame + 14, 1);
+    put16(frame + 16, 0x0800);
+    frame[18] = 6;
+    frame[19] = 4;
+    put16(frame + 20, 1);
+    memcpy(frame + 22, kOtherMac, 6);
+    memcpy(frame + 38, sequence & 1 ? &options.guest_ip : &options.pi_ip, 4);
+  } else {
+    put16(frame + 12, 0x0800);
+    frame[14] = 0x45;
+    put16(frame + 16, length - 14);
+    frame[22] = 64;
+    frame[23] = 17;
+    memcpy(frame + 30,
+           *category == kForPi ? &options.pi_ip : &options.guest_ip, 4);
+    put16(frame + 24, checksum(frame + 14, 20));
+    put16(frame + 38, length - 34);
+  }
+  put32(frame + kTagOffset, sequence);
+  frame[kTagOffset + 4] = *category;
+  return length;
+}
+
+void *feed_synthetic(void *) {
+  static u8 frame[kMaxFrame];
+  uint64_t next = now_ns();
+  uint64_t interval =
+      options.rate ? 1000000000ull * options.burst / options.rate : 0;
+  for (unsigned sequence = 0; sequence < options.frames; ++sequence) {
+    if (sequence % options.burst == 0 && interval) {
+      sleep_until(next);
+      next += interval;
+    }
+    Category category;
+    unsigned length = synthetic_frame(sequence, frame, &category);
+    ++offered[category];
+    modem_host_receive_frame(frame, length);
+  }
+  __atomic_store_n(&feeder_done, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+std::vector<std::vector<u8> > capture;
+
+void *feed_capture(void *) {
+  uint64_t next = now_ns();
+  uint64_t interval = options.rate ? 1000000000ull / options.rate : 0;
+  for (const std::vector<u8> &frame : capture) {
+    if (interval) {
+      sleep_until(next);
+      next += interval;
+    }
+    modem_host_receive_frame(frame.data(), frame.size());
+  }
+  __atomic_store_n(&feeder_done, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+void *feed_tap(void *) {
+  static u8 frame[FRAME_BUFFER_SIZE];
+  uint64_t end = now_ns() + (uint64_t)(options.seconds * 1e9);
+  while (now_ns() < end) {
+    struct pollfd ready = {device.tap_, POLLIN, 0};
+    if (poll(&ready, 1, 100) <= 0) {
+      continue;
+    }
+    ssize_t length = read(device.tap_, frame, sizeof(frame));
+    if (length > 0) {
+      modem_host_receive_frame(frame, length);
+    }
+  }
+  __atomic_store_n(&feeder_done, true, __ATOMIC_RELEASE);
+  return 0;
+}
+
+int open_tap(const char *name) {
+  int fd = open("/dev/net/tun", O_RDWR);
+  if (fd < 0) {
+    return -1;
+  }
+  struct ifreq request;
+  memset(&request, 0, sizeof(request));
+  request.ifr_flags = IFF_TAP | IFF_NO_PI;
+  strncpy(request.ifr_name, name, IFNAMSIZ - 1);
+  if (ioctl(fd, TUNSETIFF, &request) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// The emulated CS8900's receive settings.
+const int kReceiveFlags = BMCETHER_RX_ENABLE | BMCETHER_RX_BROADCAST |
+                          BMCETHER_RX_IA;
+
+// cs8900_should_accept for the settings above, for frames the bridge
+// did not classify.
+bool guest_accept(const u8 *frame) {
+  return memcmp(frame, kGuestMac, 6) == 0 ||
+         memcmp(frame, kBroadcastMac, 6) == 0;
+}
+
+struct GuestReport {
+  unsigned accepted[kCategories];
+  unsigned read;
+  unsigned untranslated;
+  uint64_t busy_ns;
+  unsigned answered;
+};
+
+GuestReport report;
+
+void guest_send(const u8 *frame, unsigned length) {
+  if (bmcether_transmit(frame, length)) {
+    ++report.answered;
+  }
+}
+
+// Answers ARP, ICMP echo and UDP echo for the guest address.
+void guest_answer(const u8 *frame, int length) {
+  u8 reply[kMaxFrame];
+  if (length < 42 || length > (int)kMaxFrame) {
+    return;
+  }
+  memcpy(reply, frame, length);
+  memcpy(reply, frame + 6, 6);
+  memcpy(reply + 6, kGuestMac, 6);
+  if (frame[12] == 0x08 && frame[13] == 0x06 && frame[21] == 1 &&
+      memcmp(frame + 38, &options.guest_ip, 4) == 0) {
+    put16(reply + 20, 2);
+    memcpy(reply + 22, kGuestMac, 6);
+    memcpy(reply + 28, &options.guest_ip, 4);
+    memcpy(reply + 32, frame + 22, 10);
+    guest_send(reply, 42);
+    return;
+  }
+  if (frame[12] != 0x08 || frame[13] != 0x00 ||
+      memcmp(frame + 30, &options.guest_ip, 4) != 0) {
+    return;
+  }
+  unsigned header = (frame[14] & 15) * 4;
+  unsigned total = frame[16] << 8 | frame[17];
+  if (14 + total > (unsigned)length || total < header + 8) {
+    return;
+  }
+  memcpy(reply + 26, frame + 30, 4);
+  memcpy(reply + 30, frame + 26, 4);
+  u8 *payload = reply + 14 + header;
+  if (frame[23] == 1 && payload[0] == 8) {
+    payload[0] = 0;
+    put16(payload + 2, 0);
+    put16(payload + 2, checksum(payload, total - header));
+    guest_send(reply, 14 + total);
+  } else if (frame[23] == 17 && payload[2] == 0 && payload[3] == 7) {
+    memcpy(payload, frame + 14 + header + 2, 2);
+    memcpy(payload + 2, frame + 14 + header, 2);
+    guest_send(reply, 14 + total);
+  }
+}
+
+// One poll of the CS8900: frames until one is accepted or none is left.
+bool guest_poll() {
+  u8 frame[kMaxReceive];
+  for (;;) {
+    int length = kMaxReceive, flags = 0, hash_index = 0;
+    uint64_t start = now_ns();
+    int got = bmcether_receive(frame, &length, &flags, &hash_index);
+    bool accepted = got && (flags != 0 || guest_accept(frame));
+    report.busy_ns += now_ns() - start;
+    if (!got) {
+      return false;
+    }
+    ++report.read;
+    if (!accepted) {
+      continue;
+    }
+    if (options.tap) {
+      guest_answer(frame, length);
+      return true;
+    }
+    if (capture.empty()) {
+      unsigned category = frame[kTagOffset + 4];
+      if (category < kCategories) {
+        ++report.accepted[category];
+      }
+      if (frame[0] != 0xff && memcmp(frame, kGuestMac, 6) != 0) {
+        ++report.untranslated;
+      }
+    }
+    return true;
+  }
+}
+
+void announce_guest() {
+  u8 frame[kMinFrame];
+  memset(frame, 0, sizeof(frame));
+  memcpy(frame, kBroadcastMac, 6);
+  memcpy(frame + 6, kGuestMac, 6);
+  put16(frame + 12, 0x0806);
+  put16(frame + 14, 1);
+  put16(frame + 16, 0x0800);
+  frame[18] = 6;
+  frame[19] = 4;
+  put16(frame + 20, 1);
+  memcpy(frame + 22, kGuestMac, 6);
+  memcpy(frame + 28, &options.guest_ip, 4);
+  memcpy(frame + 38, &options.guest_ip, 4);
+  bmcether_transmit(frame, sizeof(frame));
+  uint64_t give_up = now_ns() + 1000000000;
+  while (device.Sent() == 0 && now_ns() < give_up) {
+    usleep(1000);
+  }
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--frames N] [--rate FPS] [--burst N] "
+          "[--guest-rate FPS] [--unfiltered] [--pcap FILE] [--write FILE] "
+          "[--tap NAME] [--seconds S] [--guest-ip ADDR] [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *guest_ip = "192.168.64.64";
+  const char *pi_ip = "192.168.64.2";
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (!strcmp(argv[i], "--unfiltered")) {
+      options.unfiltered = true;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--rate")) {
+      options.rate = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--burst")) {
+      options.burst = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--guest-rate")) {
+      options.guest_rate = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--pcap")) {
+      options.pcap = argv[++i];
+    } else if (!strcmp(argv[i], "--write")) {
+      options.write = argv[++i];
+    } else if (!strcmp(argv[i], "--tap")) {
+      options.tap = argv[++i];
+    } else if (!strcmp(argv[i], "--seconds")) {
+      options.seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--guest-ip")) {
+      guest_ip = argv[++i];
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.burst == 0 ||
+      inet_pton(AF_INET, guest_ip, &options.guest_ip) != 1 ||
+      inet_pton(AF_INET, pi_ip, &options.pi_ip) != 1) {
+    usage(argv[0]);
+  }
+  if (options.pcap && !read_pcap(options.pcap, &capture)) {
+    fprintf(stderr, "cannot read %s\n", options.pcap);
+    return 1;
+  }
+  if (options.write && !device.writer_.Open(options.write)) {
+    fprintf(stderr, "cannot write %s\n", options.write);
+    return 1;
+  }
+  if (options.tap && (device.tap_ = open_tap(options.tap)) < 0) {
+    fprintf(stderr, "cannot open TAP %s: %s\n", options.tap,
+                strerror(errno));
+    return 1;
+  }
+
+  modem_host_set_net_device(&device);
+  if (!bmcether_activate()) {
+    fprintf(stderr, "bridge activation failed\n");
+    return 1;
+  }
+  modem_host_start_tasks();
+  bmcether_set_mac(kGuestMac);
+  bmcether_set_receive(options.unfiltered
+                           ? BMCETHER_RX_ENABLE | BMCETHER_RX_PROMISCUOUS
+                           : kReceiveFlags);
+  // The pcap backend never learns the C64's address.
+  if (!options.unfiltered) {
+    announce_guest();
+  }
+
+  pthread_t feeder;
+  pthread_create(&feeder, 0,
+                 options.tap      ? feed_tap
+                 : options.pcap ? feed_capture
+                                  : feed_synthetic,
+                 0);
+
+  uint64_t start = now_ns();
+  uint64_t next = start;
+  uint64_t interval = options.guest_rate ? 1000000000ull / options.guest_rate
+                                         : 0;
+  for (;;) {
+    if (interval) {
+      sleep_until(next);
+      next += interval;
+    }
+    bool done = __atomic_load_n(&feeder_done, __ATOMIC_ACQUIRE);
+    if (!guest_poll() && done) {
+      break;
+    }
+  }
+  pthread_join(feeder, 0);
+  double elapsed = (now_ns() - start) / 1e9;
+  // Let the task send what the guest answered last.
+  usleep(10000);
+
+  struct bmcether_stats stats;
+  bmcether_get_stats(&stats);
+  printf("elapsed_s %.3f\n", elapsed);
+  printf("rx_frames %u\nrx_filtered %u\nrx_dropped %u\nrx_delivered %u\n"
+         "rx_bytes %u\ntx_frames %u\ntx_dropped %u\ntx_bytes %u\n",
+         (unsigned)stats.rx_frames, (unsigned)stats.rx_filtered,
+         (unsigned)stats.rx_dropped, (unsigned)stats.rx_delivered,
+         (unsigned)stats.rx_bytes, (unsigned)stats.tx_frames,
+         (unsigned)stats.tx_dropped, (unsigned)stats.tx_bytes);
+  printf("guest_read %u\n", report.read);
+  printf("guest_ns_per_frame %.0f\n",
+         report.read ? (double)report.busy_ns / report.read : 0.0);
+  printf("guest_busy_ms %.2f\n", report.busy_ns / 1e6);
+  printf("tx_untranslated %u\n", device.Untranslated());
+  if (options.tap) {
+    printf("answered %u\n", report.answered);
+    return device.Untranslated() ? 1 : 0;
+  }
+  if (!capture.empty()) {
+    return device.Untranslated() ? 1 : 0;
+  }
+
+  // Only frames for the C64 and broadcasts should reach the program,
+  // and broadcasts only half the time name the C64 but all are accepted.
+  unsigned wanted = offered[kForGuest] + offered[kBroadcastArp];
+  unsigned got = report.accepted[kForGuest] + report.accepted[kBroadcastArp];
+  unsigned unwanted = 0;
+  for (int category = 0; category < kCategories; ++category) {
+    printf("offered_%s %u accepted %u\n", kCategoryNames[category],
+           offered[category], report.accepted[category]);
+    if (category != kForGuest && category != kBroadcastArp) {
+      unwanted += report.accepted[category];
+    }
+  }
+  printf("wanted %u\nwanted_lost %u\nunwanted_accepted %u\n"
+         "rx_untranslated %u\n",
+         wanted, wanted - got, unwanted, report.untranslated);
+  return unwanted || report.untranslated || device.Untranslated() ? 1 : 0;
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""Check the lazy GCR conversion of sector images against converting
+them all at once.
+
+The Pi converts a D64, D71 or X64 to GCR one track at a time, when the
+drive head first gets there (fsimage_dxx_load_half_track). For each
+image built here, --gcr-check attaches two copies, converts one that
+way and the other on attach, reads and writes every sector of both
+with some tracks of the first still pending, and compares every half
+track once all are converted. The CRC of the result must also match
+the golden one recorded here, so a change to what a track encodes to
+shows up even if both ways change together.
+"""
+
+import argparse
+import os
+import re
+import struct
+import subprocess
+import sys
+import tempfile
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..", "..")
+
+
+def sectors_on(track):
+    if track <= 17:
+        return 21
+    if track <= 24:
+        return 19
+    if track <= 30:
+        return 18
+    return 17
+
+
+class Image:
+    """Sector data that differs in every sector, the same every run."""
+
+    def __init__(self, tracks, sides=1):
+        self.sectors = [sectors_on(t) for t in range(1, tracks + 1)]
+        self.sectors *= sides
+        self.data = bytearray()
+        state = len(self.sectors)
+        for _ in range(sum(self.sectors) * 256):
+            state = (state * 1103515245 + 12345) & 0x7fffffff
+            self.data.append(state >> 16 & 0xff)
+
+    def bam(self, track, disk_id, flags=0x41):
+        at = sum(self.sectors[:track - 1]) * 256
+        self.data[at + 3] = flags
+        self.data[at + 0xa2:at + 0xa4] = disk_id
+
+
+def d64(tracks=35, errors=False, disk_id=b"ID"):
+    image = Image(tracks)
+    image.bam(18, disk_id)
+    if errors:
+        # Every error the GCR encoder puts on a sector, each on a few
+        # sectors; the rest read back fine.
+        codes = [2, 3, 4, 5, 9, 11, 15]
+        blocks = sum(image.sectors)
+        image.data += bytes(codes[i // 37 % len(codes)] if i % 37 == 5
+                            else 1 for i in range(blocks))
+    return image.data
+
+
+def d71(double_sided):
+    image = Image(35, 2)
+    # VICE takes bit 7 of the BAM's flags clear as double sided.
+    image.bam(18, b"S1", 0x41 if double_sided else 0x80)
+    image.bam(53, b"S2")
+    return image.data
+
+
+def x64():
+    header = bytearray(64)
+    header[0:4] = b"C\x15\x41\x64"
+    header[4:6] = b"\x01\x02"
+    header[6:8] = struct.pack("BB", 0, 35)
+    return header + d64(disk_id=b"X6")
+
+
+IMAGES = [
+    ("35 track D64", "d64", d64, 0xc7510c44),
+    ("40 track D64", "d64", lambda: d64(40), 0x62664427),
+    ("D64 with errors", "d64", lambda: d64(errors=True), 0xfb46a1c6),
+    ("double sided D71", "d71", lambda: d71(True), 0x3aeb028f),
+    ("D71, side one only", "d71", lambda: d71(False), 0x5633bc19),
+    ("X64", "x64", x64, 0x28c7797e),
+]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--boot", default=os.path.join(
+        ROOT, "third_party", "vice-3.3", "data"))
+    arguments = parser.parse_args()
+
+    binary = os.path.join(HERE, "bmc64-headless-C64")
+    if not os.path.exists(binary):
+        raise SystemExit("build it first: ./make_headless.sh")
+
+    failed = 0
+    with tempfile.TemporaryDirectory() as directory:
+        for name, extension, build, golden in IMAGES:
+            path = os.path.join(directory, "test." + extension)
+            with open(path, "wb") as f:
+                f.write(build())
+            output = subprocess.run(
+                [binary, "--boot", arguments.boot, "--gcr-check", path],
+                stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                universal_newlines=True).stdout
+            match = re.search(r"^gcr +(\w+)( DIFFERENT)?$", output, re.M)
+            converted = re.search(r"(\d+) tracks converted as the head",
+                                  output)
+            if not match or not converted:
+                raise SystemExit("no GCR report for {}:\n{}".format(
+                    name, output))
+            crc = int(match.group(1), 16)
+            same = not match.group(2)
+            ok = same and crc == golden
+            failed += not ok
+            print("{}: {}: {} tracks converted by the head, {}, crc {:08x}{}"
+                  .format("ok" if ok else "FAILED", name,
+                          converted.group(1),
+                          "the same both ways" if same
+                          else "LAZY AND EAGER DIFFER",
+                          crc, "" if crc == golden
+                          else ", golden {:08x}".format(golden)))
+            if not same:
+                for line in output.splitlines():
+                    if "differs" in line or " reads " in line:
+                        print("  " + line)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
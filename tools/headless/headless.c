@@ -0,0 +1,793 @@
+/*
+ * headless.c - run the Pi port on the build machine for benchmarking
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// Boots one machine with no display, runs it flat out for a number of
+// emulated seconds and reports how fast that went, where the time was
+// spent and a CRC of what was drawn. See tools/HEADLESS_BENCH.md.
+
+#include "headless_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(RASPI_C128)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+#include "circle.h"
+#include "emux_api.h"
+#include "headless.h"
+#include "input_record.h"
+#include "keycodes.h"
+
+#if defined(RASPI_C64)
+#define MACHINE_NAME "C64"
+#elif defined(RASPI_C128)
+#define MACHINE_NAME "C128"
+#elif defined(RASPI_VIC20)
+#define MACHINE_NAME "VIC20"
+#elif defined(RASPI_PLUS4)
+#define MACHINE_NAME "PLUS4"
+#elif defined(RASPI_PET)
+#define MACHINE_NAME "PET"
+#else
+#error "RASPI_[model] NOT DEFINED"
+#endif
+
+#define MAX_VICE_ARGS 64
+#define MAX_KEYCODE 0x200
+
+// Every machine is at the READY prompt by then. The C128 takes longest,
+// it looks for a boot disk first.
+#define TYPEIN_FRAME 400
+
+extern int main_program(int argc, char **argv);
+extern int circle_cycles_per_sec();
+extern void mem_get_basic_text(uint16_t *start, uint16_t *end);
+extern uint8_t mem_read(uint16_t addr);
+extern int fsimage_dxx_check_lazy_gcr(const char *lazy_name,
+                                      const char *eager_name, uint32_t *crc);
+extern int rotation_skip_check;
+extern void rotation_skip_check_counts(unsigned long *checked,
+                                       unsigned long *taken,
+                                       unsigned long *differ);
+extern unsigned long rotation_skip_fuzz(unsigned long runs, uint32_t seed,
+                                        unsigned long *taken);
+#if defined(RASPI_C128)
+extern int vdc_draw_helper_poll(void);
+#endif
+
+struct host_options host_options;
+struct host_stats host_stats;
+
+enum script_type { SCRIPT_KEY, SCRIPT_JOY };
+
+struct script_event {
+  unsigned long frame;
+  int type;
+  long key;
+  int port;
+  int value;
+};
+
+static const char *boot_path = ".";
+static const char *dump_path;
+static const char *dump_vdc_path;
+static double emulated_seconds = 10;
+static int seconds_given;
+static unsigned long target_frames;
+static unsigned long frame;
+static unsigned long check_every;
+static int no_raster_cache;
+
+static struct script_event *script;
+static int script_len;
+static int script_pos;
+
+static const char *gcr_check_path;
+static unsigned long rotation_fuzz_runs;
+static const char *typein_path;
+static int typein_mode;
+
+static struct input_replay replay;
+static struct input_record_entry replay_next;
+static int replay_pending;
+// Our frame that the recording's frame 0 follows
+static unsigned long replay_start = 1;
+
+// Wall time of each frame in microseconds
+static uint32_t *frame_us;
+static unsigned long frame_us_cap;
+static uint64_t last_frame_start;
+
+static uint64_t run_start;
+static uint64_t present_ns;
+static uint64_t prof_start[HEADLESS_PROF_NUM];
+static uint64_t prof_ns[HEADLESS_PROF_NUM];
+static int prof_depth[HEADLESS_PROF_NUM];
+
+static uint32_t crc_table[8][256];
+static uint32_t frame_crc;
+static uint32_t run_crc;
+// Samples since the last check
+static uint32_t audio_crc;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void headless_prof_begin(int slot) {
+  // Drive and sound code can be re-entered through the CPU they are
+  // synced with. Only the outermost call is timed.
+  if (prof_depth[slot]++ == 0) {
+    prof_start[slot] = now_ns();
+  }
+}
+
+void headless_prof_end(int slot) {
+  if (--prof_depth[slot] == 0) {
+    prof_ns[slot] += now_ns() - prof_start[slot];
+  }
+}
+
+const char *headless_boot_path(void) { return boot_path; }
+
+static void crc_init(void) {
+  uint32_t i, j, c;
+  for (i = 0; i < 256; i++) {
+    c = i;
+    for (j = 0; j < 8; j++) {
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    crc_table[0][i] = c;
+  }
+  for (i = 0; i < 256; i++) {
+    for (j = 1; j < 8; j++) {
+      c = crc_table[j - 1][i];
+      crc_table[j][i] = crc_table[0][c & 0xff] ^ (c >> 8);
+    }
+  }
+}
+
+// Slicing by 8 (little endian hosts). Hashing every frame a byte at a
+// time cost as much as emulating it and swamped the other timings.
+static uint32_t crc_update(uint32_t crc, const uint8_t *buf, int len) {
+  uint32_t lo, hi;
+  crc = ~crc;
+  while (len >= 8) {
+    memcpy(&lo, buf, 4);
+    memcpy(&hi, buf + 4, 4);
+    lo ^= crc;
+    crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+          crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+          crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+          crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+    buf += 8;
+    len -= 8;
+  }
+  while (len--) {
+    crc = crc_table[0][(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+// Pitch padding is not part of the image so only width bytes of each
+// row are included.
+static uint32_t crc_layer(uint32_t crc, int layer) {
+  int w, h, pitch, y;
+  const uint8_t *pixels = host_fbl_pixels(layer, &w, &h, &pitch);
+  if (!pixels) {
+    return crc;
+  }
+  for (y = 0; y < h; y++) {
+    crc = crc_update(crc, pixels + y * pitch, w);
+  }
+  return crc;
+}
+
+void host_sound_written(const int16_t *samples, size_t n) {
+  audio_crc = crc_update(audio_crc, (const uint8_t *)samples,
+                         n * sizeof(*samples));
+}
+
+static void dump_layer(const char *path, int layer) {
+  int w, h, pitch, y;
+  const uint8_t *pixels = host_fbl_pixels(layer, &w, &h, &pitch);
+  FILE *fp;
+
+  if (!pixels || !(fp = fopen(path, "wb"))) {
+    fprintf(stderr, "could not write %s\n", path);
+    return;
+  }
+  // Palette indices as grey levels. Enough to eyeball a mismatch.
+  fprintf(fp, "P5\n%d %d\n255\n", w, h);
+  for (y = 0; y < h; y++) {
+    fwrite(pixels + y * pitch, 1, w, fp);
+  }
+  fclose(fp);
+}
+
+#if defined(RASPI_C128)
+// Stands in for the helper core, which draws VDC lines on the Pi. Once
+// it has polled, the VDC hands every line to it.
+static void *vdc_helper(void *arg) {
+  (void)arg;
+  for (;;) {
+    if (vdc_draw_helper_poll() == 0) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+#endif
+
+static void print_slot(const char *name, uint64_t ns, uint64_t total) {
+  printf("%-8s %9.3f s %5.1f%%\n", name, ns / 1e9,
+         total ? 100.0 * ns / total : 0.0);
+}
+
+static int compare_us(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+// Frame time spread, to spot stutter that an average fps hides.
+static void report_frame_times(void) {
+  unsigned long n = frame > 1 ? frame - 1 : 0, worst = 0, i;
+  uint32_t *sorted;
+
+  if (n == 0) {
+    return;
+  }
+  for (i = 1; i < n; i++) {
+    if (frame_us[i] > frame_us[worst]) {
+      worst = i;
+    }
+  }
+  sorted = (uint32_t *)malloc(n * sizeof(*sorted));
+  memcpy(sorted, frame_us, n * sizeof(*sorted));
+  qsort(sorted, n, sizeof(*sorted), compare_us);
+  printf("frame_ms median %.3f p99 %.3f max %.3f at %lu\n",
+         sorted[n / 2] / 1e3, sorted[n * 99 / 100] / 1e3,
+         frame_us[worst] / 1e3, worst + 2);
+  free(sorted);
+}
+
+// The program in BASIC memory, to compare type ins with each other.
+static void report_basic(void) {
+  uint16_t start, end, addr;
+  uint32_t crc = 0;
+  uint8_t b;
+
+  mem_get_basic_text(&start, &end);
+  for (addr = start; addr < end; addr++) {
+    b = mem_read(addr);
+    crc = crc_update(crc, &b, 1);
+  }
+  printf("basic    $%04x-$%04x %08x\n", start, end, crc);
+}
+
+static void report(void) {
+  uint64_t wall = now_ns() - run_start;
+  uint64_t accounted = present_ns;
+  double fps_real = host_options.ntsc ? 60.0 : 50.0;
+  double fps = frame / (wall / 1e9);
+  int i;
+
+  for (i = 0; i < HEADLESS_PROF_NUM; i++) {
+    accounted += prof_ns[i];
+  }
+
+  printf("machine  %s %s\n", MACHINE_NAME, host_options.ntsc ? "NTSC" : "PAL");
+  printf("frames   %lu\n", frame);
+  printf("emulated %9.3f s\n", frame / fps_real);
+  printf("wall     %9.3f s\n", wall / 1e9);
+  printf("fps      %9.1f (%.0f%% of real time)\n", fps,
+         100.0 * fps / fps_real);
+  print_slot("cpu", accounted < wall ? wall - accounted : 0, wall);
+  print_slot("video", prof_ns[HEADLESS_PROF_VIDEO], wall);
+  print_slot("sound", prof_ns[HEADLESS_PROF_SOUND], wall);
+  print_slot("drive", prof_ns[HEADLESS_PROF_DRIVE], wall);
+  print_slot("present", present_ns, wall);
+  printf("samples  %lu\n", host_stats.samples);
+  report_frame_times();
+  printf("crc      %08x\n", frame_crc);
+  printf("crc_all  %08x\n", run_crc);
+  if (typein_path) {
+    report_basic();
+  }
+  if (rotation_skip_check) {
+    unsigned long checked, taken, differ;
+    rotation_skip_check_counts(&checked, &taken, &differ);
+    printf("rotation %lu catch-ups, %lu skipped ahead, %lu differ\n",
+           checked, taken, differ);
+  }
+  fflush(stdout);
+}
+
+static void run_script(void) {
+  while (script_pos < script_len && script[script_pos].frame <= frame) {
+    struct script_event *ev = &script[script_pos++];
+    if (ev->type == SCRIPT_KEY) {
+      if (ev->value) {
+        emu_key_pressed(ev->key);
+      } else {
+        emu_key_released(ev->key);
+      }
+    } else {
+      emu_joy_interrupt_abs(ev->port,
+                            ev->port == 1 ? JOYDEV_GPIO_0 : JOYDEV_GPIO_1,
+                            ev->value & 0x01, ev->value & 0x02,
+                            ev->value & 0x04, ev->value & 0x08,
+                            ev->value & 0x10, 0, 0);
+    }
+  }
+}
+
+// Recorded paths start with the volume (SD:, USB:, ...). Everything
+// comes from the boot dir here.
+static const char *replay_path(const char *path) {
+  static char full[INPUT_RECORD_MAX_PATH + 256];
+  const char *colon = strchr(path, ':');
+  snprintf(full, sizeof(full), "%s%s", boot_path, colon ? colon + 1 : path);
+  return full;
+}
+
+static void replay_attach(struct input_record_entry *e) {
+  const char *path = replay_path(e->path);
+  int result = 0;
+
+  switch (e->kind) {
+  case INPUT_RECORD_ATTACH_DISK:
+    result = emux_attach_disk_image(e->unit, (char *)path);
+    break;
+  case INPUT_RECORD_ATTACH_TAPE:
+    result = emux_attach_tape_image((char *)path);
+    break;
+  case INPUT_RECORD_ATTACH_CART:
+    result = emux_attach_cart(e->unit, (char *)path);
+    break;
+  case INPUT_RECORD_AUTOSTART:
+    result = emux_autostart_file((char *)path);
+    break;
+  }
+  if (result < 0) {
+    fprintf(stderr, "replay: could not attach %s at frame %lu\n", path,
+            frame);
+  }
+}
+
+// Recorded frames count from the reset that started the recording and
+// the event was applied after that frame was drawn. A version 2
+// recording opens with the settings and images the Pi had, all at frame
+// 0, then that reset; they are restored on our first frame and the
+// reset done there, so frame N of the recording is our frame N + 1
+// after it. Version 1 recordings have neither and count from power on.
+static void run_replay(void) {
+  while (replay_pending && replay_next.frame + replay_start <= frame) {
+    switch (replay_next.type) {
+    case INPUT_RECORD_ATTACH:
+      replay_attach(&replay_next);
+      break;
+    case INPUT_RECORD_SETTING:
+      if (emux_apply_recorded_setting(replay_next.path,
+                                      replay_next.value) < 0) {
+        fprintf(stderr, "replay: could not set %s to %d\n",
+                replay_next.path, replay_next.value);
+      }
+      break;
+    case INPUT_RECORD_RESET:
+      emux_reset(0);
+      replay_start = frame + 1;
+      break;
+    case INPUT_RECORD_END:
+      if (!seconds_given) {
+        target_frames = frame;
+      }
+      break;
+    default:
+      replay_next.event.timestamp = circle_get_ticks();
+      input_queue_push(&pending_emu_input, &replay_next.event);
+      break;
+    }
+    replay_pending = input_replay_next(&replay, &replay_next);
+  }
+}
+
+// Copies src to a new temporary file, whose name goes in dst.
+static int copy_to_temp(const char *src, char *dst) {
+  char buf[4096];
+  size_t n;
+  int fd;
+  FILE *in, *out;
+
+  strcpy(dst, "/tmp/bmc64-gcr-XXXXXX");
+  fd = mkstemp(dst);
+  in = fopen(src, "rb");
+  out = fd < 0 ? NULL : fdopen(fd, "wb");
+  while (in && out && (n = fread(buf, 1, sizeof(buf), in)) > 0) {
+    fwrite(buf, 1, n, out);
+  }
+  if (in) {
+    fclose(in);
+  }
+  if (!out || fclose(out)) {
+    return -1;
+  }
+  return in ? 0 : -1;
+}
+
+// Converts the image to GCR lazily and all at once and compares, on
+// copies as the check writes to both. Exits with the result.
+static void gcr_check(void) {
+  char lazy[32] = "", eager[32] = "";
+  uint32_t crc = 0;
+  int bad = -1;
+
+  if (copy_to_temp(gcr_check_path, lazy) == 0 &&
+      copy_to_temp(gcr_check_path, eager) == 0) {
+    bad = fsimage_dxx_check_lazy_gcr(lazy, eager, &crc);
+  }
+  unlink(lazy);
+  unlink(eager);
+  if (bad < 0) {
+    fprintf(stderr, "could not attach %s\n", gcr_check_path);
+    exit(1);
+  }
+  printf("gcr      %08x%s\n", crc, bad ? " DIFFERENT" : "");
+  exit(bad ? 1 : 0);
+}
+
+void host_frame_ready(int layer1, int layer2) {
+  uint64_t start;
+
+  // Status bar and OSD layers are presented separately. Only the
+  // emulated display marks the end of a frame.
+  if (layer1 != FB_LAYER_VIC) {
+    return;
+  }
+
+  start = now_ns();
+  if (frame == 0) {
+    // Boot (ROM loading, filter tables) is not part of the run.
+    run_start = start;
+    memset(prof_ns, 0, sizeof(prof_ns));
+    // The menu has applied its Raster Line Cache setting by now.
+    if (no_raster_cache) {
+      emux_set_video_cache(0);
+    }
+    if (gcr_check_path) {
+      gcr_check();
+    }
+  } else {
+    if (frame > frame_us_cap) {
+      frame_us_cap = frame_us_cap ? frame_us_cap * 2 : 4096;
+      frame_us = (uint32_t *)realloc(frame_us,
+                                     frame_us_cap * sizeof(*frame_us));
+    }
+    frame_us[frame - 1] = (start - last_frame_start) / 1000;
+  }
+  last_frame_start = start;
+  frame++;
+
+  frame_crc = crc_layer(0, layer1);
+  if (layer2 >= 0) {
+    frame_crc = crc_layer(frame_crc, layer2);
+  }
+  run_crc = crc_update(run_crc, (const uint8_t *)&frame_crc,
+                       sizeof(frame_crc));
+
+  if (check_every && frame % check_every == 0) {
+    printf("check %lu %08x %08x\n", frame, frame_crc, audio_crc);
+    audio_crc = 0;
+  }
+
+  // Events are queued here and drained by the emulator right after
+  // this returns, the same as key presses from the USB stack.
+  run_script();
+  run_replay();
+  if (typein_path && frame == TYPEIN_FRAME &&
+      emux_type_text_file((char *)typein_path, typein_mode) < 0) {
+    fprintf(stderr, "could not type in %s\n", typein_path);
+    exit(1);
+  }
+
+  present_ns += now_ns() - start;
+
+  if (frame >= target_frames) {
+    report();
+    if (dump_path) {
+      dump_layer(dump_path, FB_LAYER_VIC);
+    }
+    if (dump_vdc_path) {
+      dump_layer(dump_vdc_path, FB_LAYER_VDC);
+    }
+    exit(0);
+  }
+}
+
+static long key_from_name(const char *name) {
+  long k;
+  for (k = 0; k < MAX_KEYCODE; k++) {
+    if (!strcmp(keycode_to_string(k), name)) {
+      return k;
+    }
+  }
+  return -1;
+}
+
+static int joy_from_names(char *names) {
+  static const char *bits[] = {"up", "down", "left", "right", "fire"};
+  int value = 0, i;
+  char *tok;
+
+  for (tok = strtok(names, "+"); tok; tok = strtok(NULL, "+")) {
+    if (!strcmp(tok, "none")) {
+      continue;
+    }
+    for (i = 0; i < 5; i++) {
+      if (!strcmp(tok, bits[i])) {
+        value |= 1 << i;
+        break;
+      }
+    }
+    if (i == 5) {
+      return -1;
+    }
+  }
+  return value;
+}
+
+// One event per line:
+//   <frame> key <name> down|up
+//   <frame> joy <port> <up+down+left+right+fire|none>
+// Key names are the ones used for key bindings (see keycodes.c).
+// Blank lines and lines starting with # are ignored.
+static int load_script(const char *path) {
+  FILE *fp = fopen(path, "r");
+  char line[256], what[16], arg[64], state[64];
+  int cap = 0, lineno = 0;
+  unsigned long at;
+
+  if (!fp) {
+    fprintf(stderr, "could not open %s\n", path);
+    return -1;
+  }
+
+  while (fgets(line, sizeof(line), fp)) {
+    struct script_event ev;
+    lineno++;
+    if (line[0] == '#' || line[strspn(line, " \t\r\n")] == '\0') {
+      continue;
+    }
+    if (sscanf(line, "%lu %15s %63s %63s", &at, what, arg, state) != 4) {
+      goto bad;
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.frame = at;
+    if (!strcmp(what, "key")) {
+      ev.type = SCRIPT_KEY;
+      ev.key = key_from_name(arg);
+      if (ev.key < 0) {
+        goto bad;
+      }
+      if (!strcmp(state, "down")) {
+        ev.value = 1;
+      } else if (strcmp(state, "up")) {
+        goto bad;
+      }
+    } else if (!strcmp(what, "joy")) {
+      ev.type = SCRIPT_JOY;
+      ev.port = atoi(arg);
+      ev.value = joy_from_names(state);
+      if (ev.port < 1 || ev.port > 2 || ev.value < 0) {
+        goto bad;
+      }
+    } else {
+      goto bad;
+    }
+    if (script_len > 0 && at < script[script_len - 1].frame) {
+      fprintf(stderr, "%s:%d: events must be in frame order\n", path,
+              lineno);
+      fclose(fp);
+      return -1;
+    }
+    if (script_len == cap) {
+      cap = cap ? cap * 2 : 64;
+      script = (struct script_event *)realloc(script, cap * sizeof(ev));
+    }
+    script[script_len++] = ev;
+  }
+  fclose(fp);
+  return 0;
+
+bad:
+  fprintf(stderr, "%s:%d: bad event: %s", path, lineno, line);
+  fclose(fp);
+  return -1;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr,
+          "usage: %s [options] [workload] [-- vice options]\n"
+          "  --boot DIR      stands in for the SD card root; machine ROMs\n"
+          "                  are read from DIR/" MACHINE_NAME " (default .)\n"
+          "  --seconds N     emulated seconds to run (default 10)\n"
+          "  --ntsc          NTSC timing (default PAL)\n"
+          "  --input FILE    scripted key and joystick events\n"
+          "  --replay FILE   input recorded on the Pi (input.bmr); runs\n"
+          "                  to the end of the recording unless\n"
+          "                  --seconds is given\n"
+          "  --check N       print video and audio CRCs every N frames\n"
+          "                  (default 50 with --replay, else off)\n"
+          "  --type-in FILE  tokenize a BASIC listing into memory at\n"
+          "                  frame %d and report the program's CRC\n"
+          "  --type-keys FILE  same, typed through the keyboard buffer\n"
+          "  --raster-skip   same as the raster_skip kernel option\n"
+          "  --no-raster-cache  draw every line, as with the menu's\n"
+          "                  Raster Line Cache off\n"
+          "  --dump FILE     write the last VIC frame as a PGM\n"
+          "  --gcr-check IMAGE  convert a D64, D71 or X64 to GCR track by\n"
+          "                  track and all at once, compare and exit\n"
+          "  --rotation-check  step every bit beside each 1541 rotation\n"
+          "                  skip and count where they differ\n"
+          "  --rotation-fuzz N  run the rotation skip against stepping\n"
+          "                  every bit on N made up tracks and exit\n"
+#if defined(RASPI_C128)
+          "  --dump-vdc FILE write the last VDC frame as a PGM\n"
+          "  --vdc-helper    draw VDC lines on a second thread, as the\n"
+          "                  Pi's helper core does\n"
+#endif
+          "workload is any PRG, D64, CRT, ... VICE can autostart.\n",
+          prog, TYPEIN_FRAME);
+}
+
+int main(int argc, char **argv) {
+  char *vice_argv[MAX_VICE_ARGS];
+  int vice_argc = 0;
+  const char *workload = NULL;
+  int raster_skip = 0;
+#if defined(RASPI_C128)
+  int vdc_helper_thread = 0;
+#endif
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--")) {
+      i++;
+      break;
+    } else if (!strcmp(argv[i], "--boot") && i + 1 < argc) {
+      boot_path = argv[++i];
+    } else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) {
+      emulated_seconds = atof(argv[++i]);
+      seconds_given = 1;
+    } else if (!strcmp(argv[i], "--ntsc")) {
+      host_options.ntsc = 1;
+    } else if (!strcmp(argv[i], "--input") && i + 1 < argc) {
+      if (load_script(argv[++i]) < 0) {
+        return 1;
+      }
+    } else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+      if (input_replay_open(&replay, argv[++i]) < 0) {
+        fprintf(stderr, "%s is not an input recording\n", argv[i]);
+        return 1;
+      }
+      replay_pending = input_replay_next(&replay, &replay_next);
+      if (!check_every) {
+        check_every = 50;
+      }
+    } else if (!strcmp(argv[i], "--check") && i + 1 < argc) {
+      check_every = strtoul(argv[++i], NULL, 10);
+    } else if (!strcmp(argv[i], "--type-in") && i + 1 < argc) {
+      typein_path = argv[++i];
+      typein_mode = EMUX_TYPEIN_TOKENIZE;
+    } else if (!strcmp(argv[i], "--type-keys") && i + 1 < argc) {
+      typein_path = argv[++i];
+      typein_mode = EMUX_TYPEIN_KEYBOARD;
+    } else if (!strcmp(argv[i], "--raster-skip")) {
+      raster_skip = 1;
+    } else if (!strcmp(argv[i], "--no-raster-cache")) {
+      no_raster_cache = 1;
+    } else if (!strcmp(argv[i], "--dump") && i + 1 < argc) {
+      dump_path = argv[++i];
+    } else if (!strcmp(argv[i], "--gcr-check") && i + 1 < argc) {
+      gcr_check_path = argv[++i];
+    } else if (!strcmp(argv[i], "--rotation-check")) {
+      rotation_skip_check = 1;
+    } else if (!strcmp(argv[i], "--rotation-fuzz") && i + 1 < argc) {
+      rotation_fuzz_runs = strtoul(argv[++i], NULL, 10);
+#if defined(RASPI_C128)
+    } else if (!strcmp(argv[i], "--dump-vdc") && i + 1 < argc) {
+      dump_vdc_path = argv[++i];
+    } else if (!strcmp(argv[i], "--vdc-helper")) {
+      vdc_helper_thread = 1;
+#endif
+    } else if (argv[i][0] == '-' || workload) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      workload = argv[i];
+    }
+  }
+
+  if (rotation_fuzz_runs) {
+    unsigned long taken;
+    unsigned long differ = rotation_skip_fuzz(rotation_fuzz_runs, 1, &taken);
+    printf("rotation fuzz %lu tracks, %lu skipped ahead, %lu differ\n",
+           rotation_fuzz_runs, taken, differ);
+    return differ ? 1 : 0;
+  }
+
+  if (emulated_seconds <= 0) {
+    usage(argv[0]);
+    return 1;
+  }
+  target_frames = emulated_seconds * (host_options.ntsc ? 60 : 50) + 0.5;
+  if (target_frames == 0) {
+    target_frames = 1;
+  }
+  if (replay.fp && !seconds_given) {
+    // Stopped by the recording's end marker
+    target_frames = (unsigned long)-1;
+  }
+
+  // VICE logs to stdout. Keep it in order with the report if the
+  // emulator dies.
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  crc_init();
+
+  // Same arguments viceemulatorcore.cpp passes on the Pi.
+  vice_argv[vice_argc++] = (char *)"vice";
+  vice_argv[vice_argc++] = (char *)(host_options.ntsc ? "-ntsc" : "-pal");
+  vice_argv[vice_argc++] = (char *)"-sounddev";
+  vice_argv[vice_argc++] = (char *)"raspi";
+#if !defined(RASPI_C64)
+  vice_argv[vice_argc++] = (char *)"-soundoutput";
+  vice_argv[vice_argc++] = (char *)"1";
+#endif
+  vice_argv[vice_argc++] = (char *)"-soundsync";
+  vice_argv[vice_argc++] = (char *)"0";
+  vice_argv[vice_argc++] = (char *)"-refresh";
+  vice_argv[vice_argc++] = (char *)"1";
+#if defined(RASPI_PLUS4)
+  vice_argv[vice_argc++] = (char *)"+TEDvcache";
+#endif
+  for (; i < argc && vice_argc < MAX_VICE_ARGS - 2; i++) {
+    vice_argv[vice_argc++] = argv[i];
+  }
+  if (workload) {
+    vice_argv[vice_argc++] = (char *)workload;
+  }
+  vice_argv[vice_argc] = NULL;
+
+  host_resid_init(circle_cycles_per_sec());
+  emu_machine_init(raster_skip, 0);
+  if (replay.fp && replay.machine_class != emux_machine_class) {
+    fprintf(stderr, "recording is for another machine\n");
+    return 1;
+  }
+#if defined(RASPI_C128)
+  if (vdc_helper_thread) {
+    pthread_t helper;
+    pthread_create(&helper, NULL, vdc_helper, NULL);
+  }
+#endif
+  main_program(vice_argc, vice_argv);
+
+  // main_program only comes back if the machine could not start.
+  fprintf(stderr, "emulator exited after %lu frames; are the ROMs in %s/%s?\n",
+          frame, boot_path, MACHINE_NAME);
+  return 1;
+}
@@ -0,0 +1,179 @@
+#!/usr/bin/env python3
+"""Run a corpus of workloads through the headless BMC64 binaries."""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+
+SLOTS = ("cpu", "video", "sound", "drive", "present")
+
+
+def read_corpus(path):
+    """Corpus lines are:
+    machine workload [seconds=N] [input=FILE] [replay=FILE] [ntsc]
+
+    Use - as the workload to just boot to the ready prompt. Relative
+    paths are taken from the corpus file's directory. A replay runs to
+    the end of the recording unless seconds is given.
+    """
+    base = os.path.dirname(os.path.abspath(path))
+    entries = []
+    with open(path) as corpus:
+        for lineno, line in enumerate(corpus, 1):
+            fields = line.split("#", 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) < 2:
+                raise SystemExit("{}:{}: need machine and workload".format(
+                    path, lineno))
+            entry = {"machine": fields[0], "workload": None, "input": None,
+                     "replay": None, "seconds": None, "ntsc": False}
+            if fields[1] != "-":
+                entry["workload"] = os.path.join(base, fields[1])
+            for option in fields[2:]:
+                if option == "ntsc":
+                    entry["ntsc"] = True
+                elif option.startswith("seconds="):
+                    entry["seconds"] = float(option[8:])
+                elif option.startswith("input="):
+                    entry["input"] = os.path.join(base, option[6:])
+                elif option.startswith("replay="):
+                    entry["replay"] = os.path.join(base, option[7:])
+                else:
+                    raise SystemExit("{}:{}: unknown option {}".format(
+                        path, lineno, option))
+            entry["name"] = "{}:{}".format(
+                fields[0], os.path.basename(fields[1]))
+            if entry["replay"]:
+                entry["name"] += ":" + os.path.basename(entry["replay"])
+            if entry["ntsc"]:
+                entry["name"] += ":ntsc"
+            entries.append(entry)
+    return entries
+
+
+def parse_report(output):
+    result = {"checks": []}
+    for line in output.splitlines():
+        fields = line.split()
+        if len(fields) < 2:
+            continue
+        key = fields[0]
+        if key == "check" and len(fields) == 4:
+            # frame, video CRC, audio CRC
+            result["checks"].append(fields[1:])
+        elif key == "frame_ms" and len(fields) == 9:
+            result["frame_ms_median"] = float(fields[2])
+            result["frame_ms_p99"] = float(fields[4])
+            result["frame_ms_max"] = float(fields[6])
+            result["frame_ms_max_at"] = int(fields[8])
+        elif key in SLOTS or key in ("emulated", "wall", "fps"):
+            result[key] = float(fields[1])
+        elif key in ("frames", "samples"):
+            result[key] = int(fields[1])
+        elif key in ("crc", "crc_all"):
+            result[key] = fields[1]
+    return result
+
+
+def run(entry, args):
+    binary = os.path.join(args.bin_dir,
+                          "bmc64-headless-{}".format(entry["machine"]))
+    command = [binary, "--boot", args.boot]
+    if entry["seconds"] or not entry["replay"]:
+        command += ["--seconds", str(entry["seconds"] or args.seconds)]
+    if entry["replay"]:
+        command += ["--replay", entry["replay"]]
+    if entry["ntsc"]:
+        command.append("--ntsc")
+    if entry["input"]:
+        command += ["--input", entry["input"]]
+    if entry["workload"]:
+        command.append(entry["workload"])
+    process = subprocess.run(command, stdout=subprocess.PIPE,
+                             stderr=subprocess.PIPE, universal_newlines=True)
+    if process.returncode != 0:
+        sys.stderr.write(process.stderr)
+        return None
+    return parse_report(process.stdout)
+
+
+def first_mismatch(old, new):
+    """Frame of the first periodic check that differs, or None."""
+    for before, after in zip(old.get("checks", []), new["checks"]):
+        if before != after:
+            what = "video" if before[1] != after[1] else "audio"
+            return "{} at frame {}".format(what, after[0])
+    return None
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("corpus", help="corpus file, see read_corpus")
+    parser.add_argument("--boot", default=".",
+                        help="directory holding the machine ROM "
+                             "directories (default: .)")
+    parser.add_argument("--bin-dir",
+                        default=os.path.dirname(os.path.abspath(__file__)),
+                        help="where the bmc64-headless-* binaries are "
+                             "(default: next to this script)")
+    parser.add_argument("--seconds", type=float, default=10.0,
+                        help="emulated seconds per workload unless the "
+                             "corpus says otherwise (default: 10)")
+    parser.add_argument("--baseline",
+                        help="JSON from an earlier --save; report fps "
+                             "change and fail on any framebuffer or "
+                             "audio CRC mismatch")
+    parser.add_argument("--save", help="write results as JSON")
+    args = parser.parse_args()
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    results = {}
+    failed = 0
+    print("{:<32} {:>8} {:>6} {:>6} {:>6} {:>6} {:>6} {:>6} {:>6} "
+          "{:>6}  {}".format("workload", "fps", "speed", *SLOTS, "p99ms",
+                             "maxms", "crc_all"))
+    for entry in read_corpus(args.corpus):
+        result = run(entry, args)
+        if result is None:
+            print("{:<32} FAILED".format(entry["name"]))
+            failed += 1
+            continue
+        results[entry["name"]] = result
+        realtime = 60.0 if entry["ntsc"] else 50.0
+        shares = [100.0 * result[slot] / result["wall"] for slot in SLOTS]
+        line = "{:<32} {:>8.1f} {:>5.0f}% {:>5.1f}% {:>5.1f}% {:>5.1f}% " \
+               "{:>5.1f}% {:>5.1f}% {:>6.2f} {:>6.2f}  {}".format(
+                   entry["name"], result["fps"],
+                   100.0 * result["fps"] / realtime, *shares,
+                   result.get("frame_ms_p99", 0),
+                   result.get("frame_ms_max", 0), result["crc_all"])
+        old = baseline.get(entry["name"])
+        if old:
+            line += "  {:+.1f}%".format(
+                100.0 * (result["fps"] - old["fps"]) / old["fps"])
+            mismatch = first_mismatch(old, result)
+            if old["crc_all"] != result["crc_all"] or mismatch:
+                line += "  CRC MISMATCH (was {})".format(old["crc_all"])
+                if mismatch:
+                    line += ", first {}".format(mismatch)
+                failed += 1
+        print(line)
+        sys.stdout.flush()
+
+    if args.save:
+        with open(args.save, "w") as f:
+            json.dump(results, f, indent=2, sort_keys=True)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
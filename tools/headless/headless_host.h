@@ -0,0 +1,48 @@
+/*
+ * headless_host.h - shared state between the harness and the stand in
+ *                   kernel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#ifndef HEADLESS_HOST_H
+#define HEADLESS_HOST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct host_options {
+  int ntsc;
+};
+
+struct host_stats {
+  // Samples handed to the null audio sink, per channel.
+  unsigned long samples;
+};
+
+extern struct host_options host_options;
+extern struct host_stats host_stats;
+
+// Called by circle_frames_ready_fbl once the emulator has finished
+// drawing into the given layers. layer2 is -1 when unused.
+void host_frame_ready(int layer1, int layer2);
+
+// Called by the null audio sink with every buffer VICE writes. n is the
+// number of int16 values, all channels.
+void host_sound_written(const int16_t *samples, size_t n);
+
+// Builds the reSID tables the kernel's other cores normally prepare.
+#ifdef __cplusplus
+extern "C"
+#endif
+void host_resid_init(int cycles_per_second);
+
+// Pixels of an allocated layer, or NULL. Pitch is in bytes.
+const uint8_t *host_fbl_pixels(int layer, int *width, int *height,
+                               int *pitch);
+
+#endif
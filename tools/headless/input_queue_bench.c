@@ -0,0 +1,296 @@
+/*
+ * input_queue_bench.c - stress the lock free input queue
+ *                       (third_party/common/input_queue.c) with several
+ *                       producer threads and one consumer
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// Producers stand in for the USB, GPIO and UI code, each on its own
+// thread, and the main thread drains the queue the way the emulator's
+// main loop does. Every event carries its producer and a running number
+// in several fields, so the consumer can tell a torn copy from a whole
+// one.
+//
+// A timer signal stands in for an interrupt handler. It pushes too,
+// from whichever thread it lands on, often in the middle of another
+// push. That is what exercises the queue on a host with one CPU, where
+// the threads otherwise rarely stop halfway through a push.
+//
+// The first run retries a push that found the ring full, so every
+// thread's events must come out, in the order they were pushed. The
+// second gives up as the real producers do. Then every event whose push
+// succeeded must come out, in order, and the drops must match the
+// queue's overflow count. The interrupt always gives up.
+
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "input_queue.h"
+
+#define MAX_PRODUCERS 16
+
+// Interrupt period
+#define IRQ_US 20
+
+#define STALL_NS 5000000000ULL
+
+struct producer {
+  pthread_t thread;
+  int id;
+  int retry;
+  unsigned long events;
+  // Pushes that found the ring full, and of those the events given up
+  unsigned long full;
+  unsigned long dropped;
+  uint64_t push_ns;
+};
+
+static struct input_queue queue;
+static int num_producers = 4;
+static unsigned long events_each = 2000000;
+static volatile int go;
+static volatile int producers_done;
+
+// The interrupt's events, pushed and dropped. Its producer number is
+// num_producers.
+static unsigned long irq_events;
+static unsigned long irq_full;
+static int irq_busy;
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void make_event(struct input_event *ev, int id, unsigned long n) {
+  memset(ev, 0, sizeof(*ev));
+  ev->timestamp = (uint32_t)n;
+  ev->type = INPUT_EVENT_KEY;
+  ev->source = (uint8_t)id;
+  ev->port = (uint8_t)(n * 7);
+  ev->device = id;
+  ev->key = (long)n;
+  ev->value = (int)(n ^ 0x5a5a5a5a);
+  ev->dx = (int16_t)(n + id);
+  ev->dy = (int16_t)(n - id);
+}
+
+static void irq_handler(int sig) {
+  struct input_event ev;
+
+  (void)sig;
+  // One at a time, or its events could go in out of order.
+  if (__atomic_exchange_n(&irq_busy, 1, __ATOMIC_ACQUIRE)) {
+    return;
+  }
+  make_event(&ev, num_producers, irq_events);
+  if (input_queue_push(&queue, &ev) < 0) {
+    irq_full++;
+  }
+  irq_events++;
+  __atomic_store_n(&irq_busy, 0, __ATOMIC_RELEASE);
+}
+
+static void irq_timer(int usec) {
+  struct itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  timer.it_interval.tv_usec = usec;
+  timer.it_value.tv_usec = usec;
+  setitimer(ITIMER_REAL, &timer, NULL);
+}
+
+static void *produce(void *arg) {
+  struct producer *p = (struct producer *)arg;
+  struct input_event ev;
+  unsigned long n;
+  uint64_t start;
+
+  while (!__atomic_load_n(&go, __ATOMIC_ACQUIRE)) {
+    sched_yield();
+  }
+  start = now_ns();
+  for (n = 0; n < p->events; n++) {
+    make_event(&ev, p->id, n);
+    while (input_queue_push(&queue, &ev) < 0) {
+      p->full++;
+      if (!p->retry) {
+        p->dropped++;
+        break;
+      }
+      sched_yield();
+    }
+  }
+  p->push_ns = now_ns() - start;
+  __atomic_fetch_add(&producers_done, 1, __ATOMIC_RELEASE);
+  return NULL;
+}
+
+// Runs the producers and drains the queue until they are done and it is
+// empty. Returns 0 if every check passed.
+static int run(const char *name, int retry) {
+  struct producer producers[MAX_PRODUCERS];
+  long next[MAX_PRODUCERS + 1];
+  unsigned long received = 0, full = 0, dropped = 0, bad = 0;
+  uint32_t overflow_before = input_queue_overflow(&queue);
+  struct input_event ev, expected;
+  uint64_t start, elapsed, last_pop, push_ns = 0;
+  unsigned long expected_events;
+  int i, draining = 0, ok = 1;
+
+  go = 0;
+  producers_done = 0;
+  irq_events = 0;
+  irq_full = 0;
+  next[num_producers] = 0;
+  for (i = 0; i < num_producers; i++) {
+    producers[i].id = i;
+    producers[i].retry = retry;
+    producers[i].events = events_each;
+    producers[i].full = 0;
+    producers[i].dropped = 0;
+    next[i] = 0;
+    pthread_create(&producers[i].thread, NULL, produce, &producers[i]);
+  }
+
+  start = now_ns();
+  last_pop = start;
+  irq_timer(IRQ_US);
+  __atomic_store_n(&go, 1, __ATOMIC_RELEASE);
+  for (;;) {
+    if (!input_queue_pop(&queue, &ev)) {
+      if (!draining) {
+        if (__atomic_load_n(&producers_done, __ATOMIC_ACQUIRE) ==
+            num_producers) {
+          // Stop the interrupt, let one in flight finish, then take
+          // whatever is left.
+          irq_timer(0);
+          while (__atomic_load_n(&irq_busy, __ATOMIC_ACQUIRE)) {
+            sched_yield();
+          }
+          draining = 1;
+        } else if (now_ns() - last_pop > STALL_NS) {
+          // A lost or doubled slot leaves producers spinning on a ring
+          // that never drains.
+          printf("%s: nothing came out for %d s, %lu received\n", name,
+                 (int)(STALL_NS / 1000000000), received);
+          printf("INPUT QUEUE CHECKS FAILED\n");
+          exit(1);
+        } else {
+          // The main loop has a frame to run meanwhile.
+          sched_yield();
+        }
+        continue;
+      }
+      break;
+    }
+    last_pop = now_ns();
+    received++;
+    if (ev.device < 0 || ev.device > num_producers) {
+      if (bad++ < 5) {
+        printf("  event from no producer: %d\n", ev.device);
+      }
+      continue;
+    }
+    make_event(&expected, ev.device, ev.key);
+    if (memcmp(&ev, &expected, sizeof(ev)) != 0) {
+      if (bad++ < 5) {
+        printf("  torn event: producer %d number %ld\n", ev.device, ev.key);
+      }
+    }
+    // Without drops the numbers follow on; with them they only rise.
+    if (retry && ev.device < num_producers ? ev.key != next[ev.device]
+                                           : ev.key < next[ev.device]) {
+      if (bad++ < 5) {
+        printf("  producer %d: got %ld, expected %s%ld\n", ev.device, ev.key,
+               retry && ev.device < num_producers ? "" : "at least ",
+               next[ev.device]);
+      }
+    }
+    next[ev.device] = ev.key + 1;
+  }
+  elapsed = now_ns() - start;
+
+  for (i = 0; i < num_producers; i++) {
+    pthread_join(producers[i].thread, NULL);
+    full += producers[i].full;
+    dropped += producers[i].dropped;
+    push_ns += producers[i].push_ns;
+  }
+
+  full += irq_full;
+  dropped += irq_full;
+  expected_events = (unsigned long)num_producers * events_each + irq_events;
+
+  printf("%s: %d producers x %lu events and %lu from the interrupt, "
+         "%lu received, %lu dropped, %.1f M events/s, %.0f ns a push\n",
+         name, num_producers, events_each, irq_events, received, dropped,
+         received / (elapsed / 1e3), (double)push_ns /
+         ((unsigned long)num_producers * events_each));
+
+  if (bad) {
+    printf("  %lu events torn or out of order\n", bad);
+    ok = 0;
+  }
+  if (received + dropped != expected_events) {
+    printf("  %ld events lost\n",
+           (long)(expected_events - received - dropped));
+    ok = 0;
+  }
+  if (input_queue_overflow(&queue) - overflow_before != full) {
+    printf("  overflow counted %u, producers found the ring full %lu "
+           "times\n", input_queue_overflow(&queue) - overflow_before, full);
+    ok = 0;
+  }
+  if (input_queue_high_water(&queue) > INPUT_QUEUE_SIZE) {
+    printf("  high water %u is past the ring's %d slots\n",
+           input_queue_high_water(&queue), INPUT_QUEUE_SIZE);
+    ok = 0;
+  }
+  return ok ? 0 : -1;
+}
+
+static void usage(const char *prog) {
+  fprintf(stderr, "usage: %s [--producers N] [--events N]\n", prog);
+  exit(2);
+}
+
+int main(int argc, char **argv) {
+  int i, failed = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--producers")) {
+      num_producers = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--events")) {
+      events_each = strtoul(argv[++i], NULL, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (num_producers < 1 || num_producers > MAX_PRODUCERS ||
+      events_each == 0) {
+    usage(argv[0]);
+  }
+
+  signal(SIGALRM, irq_handler);
+  failed |= run("retrying", 1);
+  failed |= run("dropping", 0);
+  printf("high water %u of %d\n", input_queue_high_water(&queue),
+         INPUT_QUEUE_SIZE);
+  printf("%s\n", failed ? "INPUT QUEUE CHECKS FAILED"
+                        : "input queue checks passed");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,318 @@
+/*
+ * log_bench.cc - time serial logging from the emulation core written
+ *                straight to the UART, as new_io.cpp did, against the
+ *                log ring (src/bmclog.cpp)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The main thread stands in for the emulation core and runs 50 frames a
+// second, logging a few lines of VICE's length in each. CSerialDevice
+// takes as long as a polled UART at --baud would, so a line written
+// straight out costs what it did on the Pi. The bench logs the same
+// frames twice: before the log task runs, when bmclog.cpp still writes
+// straight to the UART, and once the task has started.
+//
+// It then checks the ring itself. Several threads log numbered lines at
+// once and every line that comes out of the UART must be whole and in
+// each thread's order. A burst far larger than the ring must lose only
+// whole lines, as many as the drop counter says. Lines below their
+// subsystem's level must not come out at all.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modem_host.h"
+
+#include "../../src/bmclog.h"
+
+extern "C" {
+#include "../../third_party/common/circle.h"
+}
+
+namespace {
+
+const unsigned kFrameUs = 20000;
+const unsigned kProducers = 3;
+
+struct Options {
+  unsigned baud = 115200;
+  unsigned frames = 100;
+  unsigned perFrame = 3;
+  unsigned lines = 2000;  // a thread, in the order check
+  unsigned burst = 4000;
+} options;
+
+FILE *uart;
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Producer p's line n, 30 to 90 characters with the newline.
+int make_line(char *line, unsigned p, unsigned n) {
+  unsigned pad = 20 + (n * 7 + p * 13) % 60;
+  int length = sprintf(line, "p%u %06u ", p, n);
+  for (unsigned i = 0; i < pad; ++i) {
+    line[length++] = 'a' + (n + i) % 26;
+  }
+  line[length++] = '\n';
+  line[length] = '\0';
+  return length;
+}
+
+void wait_drained() {
+  LogStats stats;
+  do {
+    usleep(1000);
+    LogGetStats(&stats);
+  } while (stats.written < stats.lines);
+}
+
+struct FrameTimes {
+  double meanUs;
+  double maxUs;
+  unsigned late;  // frames whose logging ran past the frame
+};
+
+FrameTimes log_frames(unsigned seed) {
+  FrameTimes times = {0, 0, 0};
+  char line[128];
+  uint64_t total = 0;
+  uint64_t next = now_ns();
+  for (unsigned frame = 0; frame < options.frames; ++frame) {
+    uint64_t frame_start = now_ns();
+    for (unsigned i = 0; i < options.perFrame; ++i) {
+      int length = make_line(line, seed, frame * options.perFrame + i);
+      uint64_t start = now_ns();
+      LogWrite(CIRCLE_LOG_BMC64, CIRCLE_LOG_ALL, line, length);
+      uint64_t elapsed = now_ns() - start;
+      total += elapsed;
+      if (elapsed / 1e3 > times.maxUs) {
+        times.maxUs = elapsed / 1e3;
+      }
+    }
+    if (now_ns() - frame_start > kFrameUs * 1000ull) {
+      ++times.late;
+    }
+    next += kFrameUs * 1000ull;
+    uint64_t now = now_ns();
+    if (next > now) {
+      usleep((useconds_t)((next - now) / 1000));
+    } else {
+      next = now;
+    }
+  }
+  times.meanUs = total / 1e3 / (options.frames * options.perFrame);
+  return times;
+}
+
+void report(const char *name, const FrameTimes &times) {
+  printf("%s: %u lines, %.1f us a line on average, at most %.1f us, "
+         "%u of %u frames late\n",
+         name, options.frames * options.perFrame, times.meanUs, times.maxUs,
+         times.late, options.frames);
+}
+
+struct Producer {
+  unsigned id;
+  unsigned lines;
+};
+
+void *produce(void *arg) {
+  Producer *producer = (Producer *)arg;
+  char line[128];
+  for (unsigned n = 0; n < producer->lines; ++n) {
+    int length = make_line(line, producer->id, n);
+    LogWrite(CIRCLE_LOG_BMC64, CIRCLE_LOG_ALL, line, length);
+  }
+  return 0;
+}
+
+// Reads what the UART wrote from offset on. Every line has to be one
+// make_line made, each producer's in order. Returns the lines seen.
+unsigned check_uart(long offset, unsigned producers, bool *ok) {
+  fflush(uart);
+  fseek(uart, offset, SEEK_SET);
+  int last[kProducers + 1];
+  for (unsigned p = 0; p <= kProducers; ++p) {
+    last[p] = -1;
+  }
+  unsigned seen = 0;
+  char line[256];
+  char expected[128];
+  while (fgets(line, sizeof line, uart)) {
+    if (strncmp(line, "log: ", 5) == 0) {
+      continue;
+    }
+    unsigned p;
+    unsigned n;
+    if (sscanf(line, "p%u %u ", &p, &n) != 2 || p >= producers) {
+      printf("  bad line: %s", line);
+      *ok = false;
+      continue;
+    }
+    make_line(expected, p, n);
+    if (strcmp(line, expected) != 0) {
+      printf("  torn line: %s", line);
+      *ok = false;
+    }
+    if ((int)n <= last[p]) {
+      printf("  out of order: p%u %u after %d\n", p, n, last[p]);
+      *ok = false;
+    }
+    last[p] = n;
+    ++seen;
+  }
+  fseek(uart, 0, SEEK_END);
+  return seen;
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--baud N] [--frames N] [--per-frame N] [--lines N]\n"
+          "          [--burst N]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--baud")) {
+      options.baud = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--per-frame")) {
+      options.perFrame = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--lines")) {
+      options.lines = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--burst")) {
+      options.burst = strtoul(argv[++i], 0, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.baud == 0 || options.frames == 0 || options.perFrame == 0) {
+    usage(argv[0]);
+  }
+
+  uart = tmpfile();
+  if (uart == 0) {
+    perror("tmpfile");
+    return 1;
+  }
+  modem_host_serial_file = uart;
+  modem_host_serial_baud = options.baud;
+  CSerialDevice serial;
+  LogInit(&serial);
+  printf("%u lines a frame at 50 Hz, UART at %u baud\n", options.perFrame,
+         options.baud);
+
+  unsigned framed = options.frames * options.perFrame;
+  bool ok = true;
+  long offset = ftell(uart);
+  report("straight to the UART", log_frames(0));
+  ok = check_uart(offset, 1, &ok) == framed && ok;
+
+  StartLogWriter();
+  modem_host_start_tasks();
+  usleep(50000);
+
+  offset = ftell(uart);
+  FrameTimes ring_times = log_frames(1);
+  uint64_t logged = now_ns();
+  wait_drained();
+  report("log ring", ring_times);
+  printf("log ring: out of the UART %.0f ms after the last line was "
+         "logged\n",
+         (now_ns() - logged) / 1e6);
+  LogStats stats;
+  LogGetStats(&stats);
+  printf("log ring: at most %u bytes queued of 65536\n", stats.maxQueued);
+  // These are producer 1's lines.
+  ok = check_uart(offset, 2, &ok) == framed && ok;
+  offset = ftell(uart);
+
+  // Several producers at once. They outrun any UART, so what does not
+  // fit in the ring is dropped; a faster UART only makes the check
+  // quicker.
+  modem_host_serial_baud = 4000000;
+  LogStats before;
+  LogGetStats(&before);
+  pthread_t threads[kProducers];
+  Producer producers[kProducers];
+  for (unsigned p = 0; p < kProducers; ++p) {
+    producers[p].id = p;
+    producers[p].lines = options.lines;
+    pthread_create(&threads[p], 0, produce, &producers[p]);
+  }
+  for (unsigned p = 0; p < kProducers; ++p) {
+    pthread_join(threads[p], 0);
+  }
+  wait_drained();
+  LogGetStats(&stats);
+  bool lines_ok = true;
+  unsigned seen = check_uart(offset, kProducers, &lines_ok);
+  unsigned dropped = stats.dropped - before.dropped;
+  printf("%u producers: %u lines logged, %u came out, %u dropped, %s\n",
+         kProducers, kProducers * options.lines, seen, dropped,
+         lines_ok ? "all whole and in order" : "LINES WRONG");
+  ok = lines_ok && seen + dropped == kProducers * options.lines && ok;
+
+  // A burst at the real UART speed overflows the ring.
+  modem_host_serial_baud = options.baud;
+  offset = ftell(uart);
+  LogGetStats(&before);
+  Producer burst = {0, options.burst};
+  uint64_t start = now_ns();
+  produce(&burst);
+  double burst_ms = (now_ns() - start) / 1e6;
+  wait_drained();
+  LogGetStats(&stats);
+  lines_ok = true;
+  seen = check_uart(offset, 1, &lines_ok);
+  dropped = stats.dropped - before.dropped;
+  printf("burst: %u lines logged in %.1f ms, %u came out, %u dropped "
+         "(%llu bytes), %s\n",
+         options.burst, burst_ms, seen, dropped,
+         stats.droppedBytes - before.droppedBytes,
+         lines_ok && seen + dropped == options.burst
+             ? "the counter accounts for every line lost"
+             : "LINES WRONG");
+  ok = lines_ok && seen + dropped == options.burst && ok;
+
+  // Lines below their subsystem's level never reach the ring.
+  offset = ftell(uart);
+  LogSetLevels("bmc64:errors");
+  LogGetStats(&before);
+  char line[128];
+  int length = make_line(line, 0, 0);
+  LogWrite(CIRCLE_LOG_BMC64, CIRCLE_LOG_ALL, line, length);
+  LogWrite(CIRCLE_LOG_BMC64, CIRCLE_LOG_ERRORS, line, length);
+  wait_drained();
+  LogGetStats(&stats);
+  lines_ok = true;
+  seen = check_uart(offset, 1, &lines_ok);
+  printf("bmc64:errors: %u of 2 lines filtered, %u came out\n",
+         stats.filtered - before.filtered, seen);
+  ok = lines_ok && seen == 1 && stats.filtered - before.filtered == 1 && ok;
+
+  printf("%s\n", ok ? "log ring checks passed" : "LOG RING CHECKS FAILED");
+  fflush(stdout);
+  // The log task is still polling.
+  _exit(ok ? 0 : 1);
+}
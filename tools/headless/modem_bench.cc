@@ -0,0 +1,334 @@
+/*
+ * modem_bench.cc - drive src/bmcmodem.cpp from a paced stand in for the
+ *                  emulated ACIA and time the emulation side calls
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// Dials a TCP echo peer (tools/modem_transport_probe.py --echo) through
+// the Hayes command set, then for --seconds writes one byte and polls
+// for one byte every 8N1 character time at --bps, as the ACIA does from
+// the emulation core. Every echoed byte is checked against what was
+// sent. The report gives throughput against the line rate and the cost
+// of bmcmodem_getc and bmcmodem_putc as seen by the emulation core.
+//
+// Each dial reports how long it took from the final CR to CONNECT, what
+// the emulation core's calls cost meanwhile and the worst it fell behind
+// its character clock. --dials hangs up with DTR and dials again.
+// --abort-after presses a key that long into the dial and reports how
+// soon NO CARRIER comes back. --dns-delay makes every uncached lookup
+// take that long, as over a slow Wi-Fi link.
+//
+// With --drain the peer is modem_transport_probe.py --bbs-stream instead.
+// After the dial the bench only reads, as fast as it can, until it has
+// the given number of bytes, and reports MB/s through the receive path
+// with a CRC32 to compare against the one the probe prints.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "modem_host.h"
+
+extern "C" {
+#include "../../third_party/vice-3.3/src/rs232drv/rs232bmc.h"
+}
+
+namespace {
+
+uint64_t now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Skips '+' so the data never looks like an escape and 0xff so the
+// stream stays clear of Telnet.
+uint8_t pattern(unsigned long index) {
+  uint8_t byte = (uint8_t)((index * 31 + index / 251) % 251);
+  return byte == '+' ? '*' : byte;
+}
+
+uint32_t crc32(uint32_t crc, uint8_t byte) {
+  crc ^= byte;
+  for (int bit = 0; bit < 8; ++bit) {
+    crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+  }
+  return crc;
+}
+
+int drain(unsigned long expected) {
+  const uint64_t idle_timeout = 5000000000ull;
+  unsigned long received = 0;
+  uint32_t crc = 0xffffffff;
+  uint64_t task_start = modem_host_task_cpu_ns();
+  uint64_t first = 0, last = now_ns();
+
+  while (received < expected) {
+    uint8_t byte;
+    int got = bmcmodem_getc(0, &byte);
+    if (got < 0) {
+      fprintf(stderr, "modem read failed\n");
+      return 1;
+    }
+    if (got == 0) {
+      if (now_ns() - last > idle_timeout) {
+        break;
+      }
+      continue;
+    }
+    last = now_ns();
+    if (received++ == 0) {
+      first = last;
+    }
+    crc = crc32(crc, byte);
+  }
+
+  double elapsed = (last - first) / 1e9;
+  printf("received %lu\n", received);
+  printf("crc32 %08x\n", ~crc);
+  printf("mb_per_s %.2f\n", elapsed > 0 ? received / elapsed / 1e6 : 0.0);
+  // What the network task spent filtering and queueing each byte.
+  printf("task_ns_per_byte %.1f\n",
+         received ? (double)(modem_host_task_cpu_ns() - task_start) /
+                        received
+                  : 0.0);
+  bmcmodem_close(0);
+  return received == expected ? 0 : 1;
+}
+
+struct CallTimes {
+  std::vector<uint32_t> samples;
+
+  void Add(uint64_t ns) {
+    samples.push_back(ns > 0xffffffffu ? 0xffffffffu : (uint32_t)ns);
+  }
+
+  void Print(const char *name) {
+    if (samples.empty()) {
+      printf("%s_ns none\n", name);
+      return;
+    }
+    uint64_t total = 0;
+    for (uint32_t ns : samples) {
+      total += ns;
+    }
+    std::sort(samples.begin(), samples.end());
+    printf("%s_ns avg %.0f p99 %u max %u calls %zu\n", name,
+           (double)total / samples.size(),
+           samples[samples.size() * 99 / 100], samples.back(),
+           samples.size());
+  }
+};
+
+void print_dials(const std::vector<double> &dial_ms, CallTimes &times,
+                 uint64_t worst_late) {
+  printf("dial_ms");
+  for (double ms : dial_ms) {
+    printf(" %.1f", ms);
+  }
+  printf("\n");
+  times.Print("dial_call");
+  printf("dial_worst_late_us %.0f\n", worst_late / 1e3);
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--host ADDR] [--port N] [--bps N] [--seconds S] "
+          "[--drain BYTES] [--dials N] [--abort-after MS] "
+          "[--dns-delay MS] [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  const char *host = "127.0.0.1";
+  unsigned port = 6502;
+  unsigned bps = 38400;
+  double seconds = 10;
+  unsigned long drain_bytes = 0;
+  unsigned dials = 1;
+  uint64_t abort_after = 0;
+
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--host")) {
+      host = argv[++i];
+    } else if (!strcmp(argv[i], "--port")) {
+      port = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--bps")) {
+      bps = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--seconds")) {
+      seconds = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--drain")) {
+      drain_bytes = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--dials")) {
+      dials = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "--abort-after")) {
+      abort_after = strtoull(argv[++i], 0, 0) * 1000000;
+    } else if (!strcmp(argv[i], "--dns-delay")) {
+      modem_host_dns_delay_ms = atoi(argv[++i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (bps == 0 || seconds <= 0 || dials == 0) {
+    usage(argv[0]);
+  }
+
+  bmcmodem_init();
+  modem_host_start_tasks();
+  if (bmcmodem_open(0) < 0) {
+    fprintf(stderr, "modem open failed\n");
+    return 1;
+  }
+  // DTR up, receiver enabled.
+  bmcmodem_set_status(3);
+
+  char dial[128];
+  snprintf(dial, sizeof dial, "ATDT%s:%u\r", host, port);
+
+  // One 8N1 character time.
+  const uint64_t tick = 10000000000ull / bps;
+  const uint64_t dial_timeout = 10000000000ull;
+  const uint64_t drain_timeout = 3000000000ull;
+  const uint64_t data_ns = (uint64_t)(seconds * 1e9);
+
+  CallTimes getc_times, putc_times, dial_times;
+  unsigned long sent = 0, received = 0, mismatched = 0, late = 0;
+  size_t dial_sent = 0;
+  unsigned dials_done = 0;
+  std::vector<double> dial_ms;
+  std::string reply;
+  bool connected = false;
+  uint64_t start = now_ns(), data_start = 0, last_receive = 0;
+  uint64_t dial_end = 0, aborted = 0, dial_worst_late = 0;
+  uint64_t next = start;
+
+  for (;;) {
+    uint64_t now;
+    while ((now = now_ns()) < next) {
+    }
+    if (now - next > tick) {
+      ++late;
+    }
+    if (!connected && now - next > dial_worst_late) {
+      dial_worst_late = now - next;
+    }
+    next += tick;
+
+    uint8_t byte;
+    uint64_t before = now_ns();
+    int got = bmcmodem_getc(0, &byte);
+    uint64_t after = now_ns();
+    (connected ? getc_times : dial_times).Add(after - before);
+    if (got < 0) {
+      fprintf(stderr, "modem read failed\n");
+      return 1;
+    }
+    if (got == 1) {
+      if (!connected) {
+        reply += (char)byte;
+        if (reply.find("CONNECT\r\n") != std::string::npos) {
+          if (aborted) {
+            printf("abort_ms none, connected %.1f ms after the key\n",
+                   (after - aborted) / 1e6);
+            return 1;
+          }
+          dial_ms.push_back((after - dial_end) / 1e6);
+          if (++dials_done < dials) {
+            // Hang up with DTR and go round again.
+            bmcmodem_set_status(1);
+            bmcmodem_set_status(3);
+            reply.clear();
+            dial_sent = 0;
+            dial_end = 0;
+            start = after;
+            continue;
+          }
+          print_dials(dial_ms, dial_times, dial_worst_late);
+          if (drain_bytes) {
+            return drain(drain_bytes);
+          }
+          connected = true;
+          data_start = after;
+          late = 0;
+        } else if (aborted && reply.find("NO CARRIER") != std::string::npos) {
+          print_dials(dial_ms, dial_times, dial_worst_late);
+          printf("abort_ms %.1f\n", (after - aborted) / 1e6);
+          return 0;
+        } else if (reply.find("NO CARRIER") != std::string::npos ||
+                   reply.find("ERROR") != std::string::npos) {
+          fprintf(stderr, "dial failed, is the echo peer listening on "
+                          "%s:%u?\n", host, port);
+          return 1;
+        }
+      } else {
+        if (byte != pattern(received)) {
+          ++mismatched;
+        }
+        ++received;
+        last_receive = after;
+      }
+    }
+
+    if (!connected) {
+      if (dial[dial_sent] != '\0') {
+        before = now_ns();
+        bmcmodem_putc(0, (uint8_t)dial[dial_sent++]);
+        after = now_ns();
+        dial_times.Add(after - before);
+        if (dial[dial_sent] == '\0') {
+          dial_end = after;
+        }
+      } else if (abort_after && !aborted && after - dial_end >= abort_after) {
+        bmcmodem_putc(0, ' ');
+        aborted = now_ns();
+      }
+      if (after - start > dial_timeout) {
+        fprintf(stderr, "no CONNECT within 10 seconds\n");
+        return 1;
+      }
+      continue;
+    }
+
+    if (after - data_start < data_ns) {
+      before = now_ns();
+      bmcmodem_putc(0, pattern(sent));
+      putc_times.Add(now_ns() - before);
+      ++sent;
+    } else if (received >= sent ||
+               after - data_start - data_ns > drain_timeout) {
+      break;
+    }
+  }
+
+  double elapsed = (last_receive - data_start) / 1e9;
+  printf("bps %u\n", bps);
+  printf("line_bytes_per_s %u\n", bps / 10);
+  printf("sent %lu\n", sent);
+  printf("received %lu\n", received);
+  printf("lost %lu\n", sent - (received < sent ? received : sent));
+  printf("mismatched %lu\n", mismatched);
+  printf("throughput_bytes_per_s %.0f\n",
+         elapsed > 0 ? received / elapsed : 0.0);
+  printf("late_ticks %lu\n", late);
+  getc_times.Print("getc");
+  putc_times.Print("putc");
+  bmcmodem_close(0);
+  return received == sent && mismatched == 0 ? 0 : 1;
+}
@@ -0,0 +1,297 @@
+/*
+ * modem_host.cc - POSIX stand in for the Circle networking, timer and
+ *                 task classes, the FatFs calls used by the network
+ *                 services, the A/V capture and the save writer, and the
+ *                 UART the serial log writes to
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include "modem_host.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+bool modem_host_verbose;
+unsigned modem_host_dns_delay_ms;
+unsigned modem_host_send_buffer;
+unsigned modem_host_write_stall_ms;
+unsigned modem_host_write_kb_per_s;
+FILE *modem_host_serial_file;
+unsigned modem_host_serial_baud = 115200;
+
+CLogger *CLogger::Get() {
+  static CLogger logger;
+  return &logger;
+}
+
+void CLogger::Write(const char *source, TLogSeverity, const char *message,
+                    ...) {
+  if (!modem_host_verbose) {
+    return;
+  }
+  va_list args;
+  va_start(args, message);
+  fprintf(stderr, "%s: ", source);
+  vfprintf(stderr, message, args);
+  fputc('\n', stderr);
+  va_end(args);
+}
+
+u64 CTimer::GetClockTicks64() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (u64)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+CNetSubSystem *CNetSubSystem::Get() {
+  static CNetSubSystem net;
+  return &net;
+}
+
+boolean CDNSClient::Resolve(const char *hostname, CIPAddress *address) {
+  struct addrinfo hints, *result;
+  usleep(modem_host_dns_delay_ms * 1000);
+  memset(&hints, 0, sizeof hints);
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(hostname, 0, &hints, &result) != 0) {
+    return false;
+  }
+  address->address_ =
+      ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+  freeaddrinfo(result);
+  return true;
+}
+
+CSocket::CSocket(CNetSubSystem *, int) {
+  fd_ = socket(AF_INET, SOCK_STREAM, 0);
+}
+
+CSocket::~CSocket() {
+  if (fd_ >= 0) {
+    close(fd_);
+  }
+}
+
+int CSocket::Connect(CIPAddress &address, u16 port) {
+  struct sockaddr_in peer;
+  memset(&peer, 0, sizeof peer);
+  peer.sin_family = AF_INET;
+  peer.sin_port = htons(port);
+  peer.sin_addr.s_addr = address.address_;
+  if (fd_ < 0 || connect(fd_, (struct sockaddr *)&peer, sizeof peer) < 0) {
+    return -NET_ERROR_CONNECTION_RESET;
+  }
+  // Circle's TCP sends each segment as soon as it is queued.
+  int one = 1;
+  setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  return 0;
+}
+
+int CSocket::Bind(u16 port) {
+  struct sockaddr_in local;
+  memset(&local, 0, sizeof local);
+  local.sin_family = AF_INET;
+  local.sin_port = htons(port);
+  local.sin_addr.s_addr = htonl(INADDR_ANY);
+  int one = 1;
+  setsockopt(fd_, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+  if (fd_ < 0 || bind(fd_, (struct sockaddr *)&local, sizeof local) < 0) {
+    return -NET_ERROR_CONNECTION_RESET;
+  }
+  return 0;
+}
+
+int CSocket::Listen(unsigned backlog) {
+  return listen(fd_, (int)backlog) < 0 ? -NET_ERROR_CONNECTION_RESET : 0;
+}
+
+CSocket *CSocket::Accept(CIPAddress *address, u16 *port) {
+  struct sockaddr_in peer;
+  socklen_t size = sizeof peer;
+  int fd = accept(fd_, (struct sockaddr *)&peer, &size);
+  if (fd < 0) {
+    return 0;
+  }
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+  if (modem_host_send_buffer != 0) {
+    setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &modem_host_send_buffer,
+               sizeof modem_host_send_buffer);
+  }
+  address->address_ = peer.sin_addr.s_addr;
+  *port = ntohs(peer.sin_port);
+  return new CSocket(fd);
+}
+
+int CSocket::Send(const void *buffer, unsigned length, int flags) {
+  ssize_t sent = send(fd_, buffer, length, flags | MSG_NOSIGNAL);
+  if (sent < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK
+               ? -NET_ERROR_WOULD_BLOCK
+               : -NET_ERROR_CONNECTION_RESET;
+  }
+  return (int)sent;
+}
+
+// Circle returns 0 when a non blocking receive finds nothing and an
+// error once the peer has gone.
+int CSocket::Receive(void *buffer, unsigned length, int flags) {
+  ssize_t count = recv(fd_, buffer, length, flags);
+  if (count < 0) {
+    return errno == EAGAIN || errno == EWOULDBLOCK
+               ? 0
+               : -NET_ERROR_CONNECTION_RESET;
+  }
+  return count == 0 ? -NET_ERROR_CONNECTION_RESET : (int)count;
+}
+
+static CNetDevice *net_device;
+static CNetDeviceLayer::TFrameTap *frame_tap;
+static void *frame_tap_param;
+
+void modem_host_set_net_device(CNetDevice *device) { net_device = device; }
+
+CNetDevice *CNetDevice::GetNetDevice(TNetDeviceType type) {
+  return type == NetDeviceTypeEthernet ? net_device : 0;
+}
+
+void CNetDeviceLayer::SetFrameTap(TFrameTap *handler, void *param) {
+  frame_tap_param = param;
+  __atomic_store_n(&frame_tap, handler, __ATOMIC_RELEASE);
+}
+
+void modem_host_receive_frame(const void *frame, unsigned length) {
+  CNetDeviceLayer::TFrameTap *tap =
+      __atomic_load_n(&frame_tap, __ATOMIC_ACQUIRE);
+  if (tap != 0) {
+    (*tap)(frame, length, frame_tap_param);
+  }
+}
+
+static std::vector<CTask *> &tasks() {
+  static std::vector<CTask *> list;
+  return list;
+}
+
+CTask::CTask(unsigned) { tasks().push_back(this); }
+
+static void *task_main(void *task) {
+  ((CTask *)task)->Run();
+  return 0;
+}
+
+static std::vector<pthread_t> &threads() {
+  static std::vector<pthread_t> list;
+  return list;
+}
+
+void modem_host_start_tasks() {
+  for (CTask *task : tasks()) {
+    pthread_t thread;
+    pthread_create(&thread, 0, task_main, task);
+    threads().push_back(thread);
+  }
+  tasks().clear();
+}
+
+uint64_t modem_host_task_cpu_ns() {
+  uint64_t total = 0;
+  for (pthread_t thread : threads()) {
+    clockid_t clock;
+    struct timespec used;
+    if (pthread_getcpuclockid(thread, &clock) == 0 &&
+        clock_gettime(clock, &used) == 0) {
+      total += (uint64_t)used.tv_sec * 1000000000 + used.tv_nsec;
+    }
+  }
+  return total;
+}
+
+CScheduler *CScheduler::Get() {
+  static CScheduler scheduler;
+  return &scheduler;
+}
+
+void CScheduler::MsSleep(unsigned milliseconds) {
+  usleep(milliseconds * 1000);
+}
+
+void CScheduler::Yield() { sched_yield(); }
+
+FRESULT f_open(FIL *file, const char *path, BYTE mode) {
+  // Only what bmccapture.cpp and save_bench.cc ask for: a new file to
+  // write.
+  if (mode != (FA_WRITE | FA_CREATE_NEW)) {
+    return FR_DISK_ERR;
+  }
+  file->file = fopen(path, "wbx");
+  if (file->file == 0) {
+    return errno == EEXIST ? FR_EXIST : FR_DISK_ERR;
+  }
+  return FR_OK;
+}
+
+FRESULT f_write(FIL *file, const void *buffer, UINT length, UINT *written) {
+  unsigned stall = __atomic_exchange_n(&modem_host_write_stall_ms, 0,
+                                       __ATOMIC_RELAXED);
+  if (stall) {
+    usleep(stall * 1000);
+  }
+  if (modem_host_write_kb_per_s) {
+    usleep((useconds_t)(length * 1000000ull / 1024 /
+                        modem_host_write_kb_per_s));
+  }
+  *written = fwrite(buffer, 1, length, file->file);
+  return *written == length ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_sync(FIL *file) {
+  return fflush(file->file) == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+FRESULT f_close(FIL *file) {
+  int result = fclose(file->file);
+  file->file = 0;
+  return result == 0 ? FR_OK : FR_DISK_ERR;
+}
+
+static pthread_mutex_t fatfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void CGlueFatFsLock(void) { pthread_mutex_lock(&fatfs_lock); }
+
+void CGlueFatFsUnlock(void) { pthread_mutex_unlock(&fatfs_lock); }
+
+int CSerialDevice::Write(const void *buffer, size_t count) {
+  struct timespec until;
+  clock_gettime(CLOCK_MONOTONIC, &until);
+  uint64_t ns = count * 10 * 1000000000ull / modem_host_serial_baud;
+  until.tv_sec += ns / 1000000000;
+  until.tv_nsec += ns % 1000000000;
+  if (until.tv_nsec >= 1000000000) {
+    ++until.tv_sec;
+    until.tv_nsec -= 1000000000;
+  }
+  fwrite(buffer, 1, count,
+         modem_host_serial_file ? modem_host_serial_file : stdout);
+  while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0) == EINTR) {
+  }
+  return (int)count;
+}
@@ -0,0 +1,194 @@
+/*
+ * modem_host.h - the slice of the Circle and FatFs API that src/bmcmodem.cpp,
+ *                src/bmcether.cpp, src/bmcmonitor.cpp, src/bmcnetdisk.cpp,
+ *                src/bmcstream.cpp, src/bmccapture.cpp, src/bmcsave.cpp and
+ *                src/bmclog.cpp use, backed by POSIX sockets, threads and
+ *                stdio
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#ifndef MODEM_HOST_H
+#define MODEM_HOST_H
+
+#include <netinet/in.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+
+typedef uint8_t u8;
+typedef int16_t s16;
+typedef uint16_t u16;
+typedef uint32_t u32;
+typedef uint64_t u64;
+typedef bool boolean;
+
+#define FRAME_BUFFER_SIZE 1600
+
+#define NET_ERROR_WOULD_BLOCK 8
+#define NET_ERROR_CONNECTION_RESET 10
+
+enum TLogSeverity { LogPanic, LogError, LogWarning, LogNotice, LogDebug };
+
+class CLogger {
+public:
+  static CLogger *Get();
+  void Write(const char *source, TLogSeverity severity, const char *message,
+             ...) __attribute__((format(printf, 4, 5)));
+};
+
+class CTimer {
+public:
+  // Microseconds, like the Pi's free running system timer.
+  static u64 GetClockTicks64();
+};
+
+class CNetSubSystem {
+public:
+  static CNetSubSystem *Get();
+  boolean IsRunning() const { return true; }
+};
+
+class CIPAddress {
+public:
+  CIPAddress() : address_(0) {}
+  void Set(const CIPAddress &address) { address_ = address.address_; }
+  void CopyTo(u8 *buffer) const { memcpy(buffer, &address_, 4); }
+  u32 address_;  // network order
+};
+
+class CDNSClient {
+public:
+  explicit CDNSClient(CNetSubSystem *) {}
+  boolean Resolve(const char *hostname, CIPAddress *address);
+};
+
+class CSocket {
+public:
+  CSocket(CNetSubSystem *, int protocol);
+  ~CSocket();
+  int Connect(CIPAddress &address, u16 port);
+  int Bind(u16 port);
+  int Listen(unsigned backlog = 4);
+  // Blocks until a client connects.
+  CSocket *Accept(CIPAddress *address, u16 *port);
+  int Send(const void *buffer, unsigned length, int flags);
+  int Receive(void *buffer, unsigned length, int flags);
+
+private:
+  explicit CSocket(int fd) : fd_(fd) {}
+  int fd_;
+};
+
+// Tasks become threads once modem_host_start_tasks is called, so they
+// run beside the caller the way the network task runs beside the
+// emulation core on the Pi.
+enum TNetDeviceType { NetDeviceTypeEthernet, NetDeviceTypeWLAN };
+
+class CMACAddress {
+public:
+  explicit CMACAddress(const u8 *address) { memcpy(address_, address, 6); }
+  void CopyTo(u8 *buffer) const { memcpy(buffer, address_, 6); }
+
+private:
+  u8 address_[6];
+};
+
+// Whatever the bench hands to modem_host_set_net_device, as Ethernet.
+class CNetDevice {
+public:
+  virtual ~CNetDevice() {}
+  virtual const CMACAddress *GetMACAddress() const = 0;
+  virtual boolean SendFrame(const void *buffer, unsigned length) = 0;
+  static CNetDevice *GetNetDevice(TNetDeviceType type);
+};
+
+// As added by src/patches/circle_netdevlayer_tap_patch.diff.
+class CNetDeviceLayer {
+public:
+  typedef void TFrameTap(const void *pFrame, unsigned nLength, void *pParam);
+  static void SetFrameTap(TFrameTap *handler, void *param);
+};
+
+class CTask {
+public:
+  explicit CTask(unsigned stackSize = 0x8000);
+  virtual ~CTask() {}
+  virtual void Run() = 0;
+  void SetName(const char *) {}
+};
+
+class CScheduler {
+public:
+  static CScheduler *Get();
+  void MsSleep(unsigned milliseconds);
+  void Yield();
+};
+
+void modem_host_start_tasks();
+
+// FatFs, as far as writing a new file goes, onto the host's file system.
+typedef unsigned UINT;
+typedef unsigned char BYTE;
+typedef enum { FR_OK = 0, FR_DISK_ERR = 1, FR_EXIST = 8 } FRESULT;
+#define FA_WRITE 0x02
+#define FA_CREATE_NEW 0x04
+
+struct FIL {
+  FILE *file;
+};
+
+FRESULT f_open(FIL *file, const char *path, BYTE mode);
+FRESULT f_write(FIL *file, const void *buffer, UINT length, UINT *written);
+FRESULT f_sync(FIL *file);
+FRESULT f_close(FIL *file);
+
+// As in src/circle_glue.h.
+void CGlueFatFsLock(void);
+void CGlueFatFsUnlock(void);
+
+// The polled UART: Write returns once the last character would have
+// gone out at modem_host_serial_baud, 10 bits a character. The caller
+// sleeps rather than spins, so on a host with one CPU the time goes to
+// whoever else runs, as it would on another core of the Pi.
+class CSerialDevice {
+public:
+  int Write(const void *buffer, size_t count);
+};
+
+void modem_host_set_net_device(CNetDevice *device);
+
+// Shows the frame tap a received frame, as CNetDeviceLayer::Process
+// does on the Pi.
+void modem_host_receive_frame(const void *frame, unsigned length);
+
+// CPU time used so far by the task threads.
+uint64_t modem_host_task_cpu_ns();
+
+// Logger output goes to stderr when set.
+extern bool modem_host_verbose;
+
+// Added to every CDNSClient::Resolve.
+extern unsigned modem_host_dns_delay_ms;
+
+// The next f_write takes this long, once, like a card stopping to erase.
+extern unsigned modem_host_write_stall_ms;
+
+// Every f_write takes as long as a card writing this many KB a second
+// would, when not 0.
+extern unsigned modem_host_write_kb_per_s;
+
+// Where CSerialDevice writes, stdout when 0, and how fast.
+extern FILE *modem_host_serial_file;
+extern unsigned modem_host_serial_baud;
+
+// SO_SNDBUF for accepted sockets when not 0. Linux otherwise grows the
+// buffer to megabytes, where Circle's TCP holds a window's worth.
+extern unsigned modem_host_send_buffer;
+
+#endif
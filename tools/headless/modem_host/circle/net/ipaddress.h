@@ -0,0 +1 @@
+#include "modem_host.h"
@@ -0,0 +1,422 @@
+/*
+ * monitor_bench.cc - serve the remote binary monitor (src/bmcmonitor.cpp)
+ *                    from a toy machine over a real TCP socket
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The bench stands in for the machine side, arch/raspi/monitorarch.c,
+// so the protocol can be tried from tools/remote_monitor.py without a
+// Pi. A listener task serves --port the way it does on the Pi and the
+// main thread is the emulation core. It runs 50 frames a second and
+// services requests at the end of each frame, where the real machine
+// takes its trap. When a checkpoint or a Stop request stops it, it
+// serves the client from a loop the way uimon_get_in does.
+//
+// The machine is a toy 6502: 1000 instructions a frame loop over
+// $c000-$c0ff, each loading from $0800+(PC&$ff) and storing to
+// $0900+(PC&$ff), so exec, load and store checkpoints all have
+// something to hit. The frame count is kept little endian at $0400. Of
+// the two banks, "ram" is the plain 64K that goes out in place and
+// "cpu" (the default) sees an I/O area at $d000-$dfff.
+//
+// The report gives how long the emulation core spent in requests per
+// frame, which is the cost a client adds on the Pi.
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modem_host.h"
+
+#include "../../src/bmcmonitor.h"
+
+extern "C" {
+#include "../../third_party/vice-3.3/src/arch/raspi/monitorbmc.h"
+}
+
+namespace {
+
+const unsigned kInstructionsPerFrame = 1000;
+const unsigned kFrameUs = 20000;
+const unsigned kCyclesPerFrame = 19656;
+const unsigned kProgramStart = 0xc000;
+const unsigned kFrameCounter = 0x0400;
+const unsigned kMaxCheckpoints = 64;
+
+enum { kBankCpu, kBankRam };
+enum { kRegA, kRegX, kRegY, kRegPC, kRegSP, kRegFlags, kRegisterCount };
+
+const char *const kBankNames[] = {"cpu", "ram", 0};
+const char *const kRegisterNames[] = {"A", "X", "Y", "PC", "SP", "FL"};
+const unsigned kRegisterBits[] = {8, 8, 8, 16, 8, 8};
+
+struct Checkpoint {
+  int number;
+  unsigned start;
+  unsigned end;
+  int ops;
+  int stop;
+  uint32_t hits;
+};
+
+struct Machine {
+  uint8_t ram[0x10000];
+  unsigned regs[kRegisterCount];
+  uint32_t frame;
+  uint64_t clock;
+  Checkpoint checkpoints[kMaxCheckpoints];
+  unsigned checkpoint_count;
+  int next_checkpoint;
+  bool stop_requested;
+  bool stopped;
+  char snapshot[64];
+} machine;
+
+struct Options {
+  unsigned port = 6510;
+  double seconds = 10;
+} options;
+
+struct Stats {
+  unsigned frames;
+  unsigned services;
+  unsigned stops;
+  uint64_t service_ns;
+  uint64_t max_service_ns;
+} stats;
+
+uint64_t now_ns() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// SIGTERM ends the run early, with the report.
+volatile sig_atomic_t terminated;
+
+void terminate(int) { terminated = 1; }
+
+bool running(uint64_t deadline) { return !terminated && now_ns() < deadline; }
+
+uint8_t read_cpu(unsigned addr) {
+  if (addr >= 0xd000 && addr < 0xe000) {
+    return (uint8_t)(addr & 0x3f);
+  }
+  return machine.ram[addr];
+}
+
+// Counts the hits on every checkpoint covering addr for op and reports
+// whether one of them stops the machine.
+bool check(unsigned addr, int op) {
+  bool stop = false;
+  for (unsigned i = 0; i < machine.checkpoint_count; ++i) {
+    Checkpoint *cp = &machine.checkpoints[i];
+    if ((cp->ops & op) && addr >= cp->start && addr <= cp->end) {
+      ++cp->hits;
+      stop |= cp->stop != 0;
+    }
+  }
+  return stop;
+}
+
+// Returns whether a load or store checkpoint stopped the machine. Exec
+// checkpoints are looked at before the instruction, as VICE does.
+bool execute(bool checked) {
+  unsigned pc = machine.regs[kRegPC];
+  bool stop = false;
+  unsigned low = pc & 0xff;
+  machine.regs[kRegA] = machine.ram[0x0800 + low];
+  stop |= checked && check(0x0800 + low, BMCMONITOR_OP_LOAD);
+  machine.ram[0x0900 + low] = (uint8_t)machine.regs[kRegX];
+  stop |= checked && check(0x0900 + low, BMCMONITOR_OP_STORE);
+  machine.regs[kRegX] = (machine.regs[kRegX] + 1) & 0xff;
+  machine.regs[kRegFlags] = machine.regs[kRegA] == 0 ? 0x22 : 0x20;
+  machine.regs[kRegPC] = kProgramStart + ((low + 1) & 0xff);
+  machine.clock += 4;
+  return stop;
+}
+
+// As uimon_get_in: serve the client until it says to go on, then do
+// what it asked. Stepping stops again, a disconnect goes on.
+void monitor(uint64_t deadline) {
+  ++stats.stops;
+  machine.stopped = true;
+  bool report = true;
+  while (machine.stopped) {
+    if (report) {
+      bmcmonitor_notify_stopped(BMCMONITOR_MEMSPACE_COMPUTER);
+      report = false;
+    }
+    int action = BMCMONITOR_NONE;
+    int count = 0;
+    while (action == BMCMONITOR_NONE && bmcmonitor_connected() &&
+           running(deadline)) {
+      action = bmcmonitor_service(1, &count);
+      if (action == BMCMONITOR_NONE) {
+        usleep(1000);
+      }
+    }
+    while (!bmcmonitor_idle()) {
+      usleep(100);
+    }
+    switch (action) {
+    case BMCMONITOR_STEP:
+    case BMCMONITOR_NEXT:
+      while (count-- > 0) {
+        execute(false);
+      }
+      report = true;
+      break;
+    default:
+      machine.stopped = false;
+      break;
+    }
+  }
+}
+
+void run_frame(uint64_t deadline) {
+  for (unsigned i = 0; i < kInstructionsPerFrame; ++i) {
+    if (check(machine.regs[kRegPC], BMCMONITOR_OP_EXEC) ||
+        machine.stop_requested) {
+      machine.stop_requested = false;
+      monitor(deadline);
+    }
+    if (execute(true)) {
+      monitor(deadline);
+    }
+  }
+  ++machine.frame;
+  memcpy(&machine.ram[kFrameCounter], &machine.frame, 4);
+  machine.clock = (uint64_t)machine.frame * kCyclesPerFrame;
+}
+
+void usage(const char *program) {
+  fprintf(stderr, "usage: %s [--port N] [--seconds S] [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+// The machine side, as monitorarch.c provides it on the Pi. Only the
+// computer's memory space exists.
+extern "C" {
+
+void monitor_arch_info(int, struct bmcmonitor_info *info) {
+  info->machine = 0x01;  // VICE_MACHINE_C64
+  info->frame = machine.frame;
+  info->clock = machine.clock;
+  info->pc = (uint16_t)machine.regs[kRegPC];
+}
+
+const uint8_t *monitor_arch_ram(int memspace, int bank) {
+  return memspace == BMCMONITOR_MEMSPACE_COMPUTER && bank == kBankRam
+             ? machine.ram
+             : 0;
+}
+
+int monitor_arch_read(int memspace, int bank, uint16_t start, uint8_t *data,
+                      unsigned int length) {
+  if (memspace != BMCMONITOR_MEMSPACE_COMPUTER || bank > kBankRam) {
+    return 0;
+  }
+  for (unsigned i = 0; i < length; ++i) {
+    unsigned addr = (start + i) & 0xffff;
+    data[i] = bank == kBankRam ? machine.ram[addr] : read_cpu(addr);
+  }
+  return 1;
+}
+
+int monitor_arch_write(int memspace, int bank, uint16_t start,
+                       const uint8_t *data, unsigned int length) {
+  if (memspace != BMCMONITOR_MEMSPACE_COMPUTER || bank > kBankRam) {
+    return 0;
+  }
+  for (unsigned i = 0; i < length; ++i) {
+    machine.ram[(start + i) & 0xffff] = data[i];
+  }
+  return 1;
+}
+
+const char **monitor_arch_bank_list(int memspace) {
+  return memspace == BMCMONITOR_MEMSPACE_COMPUTER ? (const char **)kBankNames
+                                                  : 0;
+}
+
+int monitor_arch_bank_number(int, const char *name) {
+  for (int i = 0; kBankNames[i] != 0; ++i) {
+    if (!strcmp(kBankNames[i], name)) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+int monitor_arch_registers(int memspace, struct bmcmonitor_register *regs,
+                           int max) {
+  if (memspace != BMCMONITOR_MEMSPACE_COMPUTER) {
+    return -1;
+  }
+  int count = 0;
+  for (; count < kRegisterCount && count < max; ++count) {
+    regs[count].name = kRegisterNames[count];
+    regs[count].id = count;
+    regs[count].bits = kRegisterBits[count];
+    regs[count].flags = count == kRegFlags ? BMCMONITOR_REGISTER_FLAGS : 0;
+    regs[count].value = machine.regs[count];
+  }
+  return count;
+}
+
+int monitor_arch_set_register(int memspace, unsigned int id, uint32_t value) {
+  if (memspace != BMCMONITOR_MEMSPACE_COMPUTER || id >= kRegisterCount) {
+    return 0;
+  }
+  machine.regs[id] = value & ((1u << kRegisterBits[id]) - 1);
+  return 1;
+}
+
+int monitor_arch_checkpoint_add(int memspace, uint16_t start, uint16_t end,
+                                int ops, int stop) {
+  if (memspace != BMCMONITOR_MEMSPACE_COMPUTER ||
+      machine.checkpoint_count == kMaxCheckpoints) {
+    return 0;
+  }
+  Checkpoint *cp = &machine.checkpoints[machine.checkpoint_count++];
+  cp->number = ++machine.next_checkpoint;
+  cp->start = start;
+  cp->end = end;
+  cp->ops = ops;
+  cp->stop = stop;
+  cp->hits = 0;
+  return cp->number;
+}
+
+int monitor_arch_checkpoint_delete(int number) {
+  for (unsigned i = 0; i < machine.checkpoint_count; ++i) {
+    if (machine.checkpoints[i].number == number) {
+      memmove(&machine.checkpoints[i], &machine.checkpoints[i + 1],
+              (machine.checkpoint_count - i - 1) * sizeof(Checkpoint));
+      --machine.checkpoint_count;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int monitor_arch_checkpoint_next(int after, struct bmcmonitor_checkpoint *cp) {
+  // Kept in the order they were added, which is number order.
+  for (unsigned i = 0; i < machine.checkpoint_count; ++i) {
+    const Checkpoint *found = &machine.checkpoints[i];
+    if (found->number > after) {
+      cp->number = found->number;
+      cp->memspace = BMCMONITOR_MEMSPACE_COMPUTER;
+      cp->start = (uint16_t)found->start;
+      cp->end = (uint16_t)found->end;
+      cp->ops = found->ops;
+      cp->stop = found->stop;
+      cp->enabled = 1;
+      cp->hits = found->hits;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void monitor_arch_stop(void) { machine.stop_requested = true; }
+
+// RAM then the registers, which is enough to tell two apart.
+const char *monitor_arch_snapshot(void) {
+  FILE *file = fopen(machine.snapshot, "wb");
+  if (file == 0) {
+    return 0;
+  }
+  bool ok = fwrite(machine.ram, 1, sizeof machine.ram, file) ==
+                sizeof machine.ram &&
+            fwrite(machine.regs, sizeof machine.regs, 1, file) == 1;
+  return fclose(file) == 0 && ok ? machine.snapshot : 0;
+}
+
+void monitor_arch_vsync(void) {
+  if (!bmcmonitor_pending()) {
+    return;
+  }
+  int count;
+  uint64_t start = now_ns();
+  bmcmonitor_service(0, &count);
+  uint64_t used = now_ns() - start;
+  ++stats.services;
+  stats.service_ns += used;
+  if (used > stats.max_service_ns) {
+    stats.max_service_ns = used;
+  }
+}
+
+}  // extern "C"
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--port")) {
+      options.port = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--seconds")) {
+      options.seconds = atof(argv[++i]);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.port == 0 || options.port > 65535 || options.seconds <= 0) {
+    usage(argv[0]);
+  }
+
+  for (unsigned addr = 0; addr < sizeof machine.ram; ++addr) {
+    machine.ram[addr] = (uint8_t)(addr ^ (addr >> 8));
+  }
+  machine.regs[kRegPC] = kProgramStart;
+  machine.regs[kRegSP] = 0xff;
+  snprintf(machine.snapshot, sizeof machine.snapshot,
+           "/tmp/bmc64-monitor-bench-%d.vsf", (int)getpid());
+
+  signal(SIGTERM, terminate);
+  StartRemoteMonitor(CNetSubSystem::Get(), options.port);
+  modem_host_start_tasks();
+  printf("serving port %u for %.1f s\n", options.port, options.seconds);
+  fflush(stdout);
+
+  uint64_t start = now_ns();
+  uint64_t deadline = start + (uint64_t)(options.seconds * 1e9);
+  uint64_t next = start;
+  while (running(deadline)) {
+    run_frame(deadline);
+    monitor_arch_vsync();
+    ++stats.frames;
+    next += kFrameUs * 1000ull;
+    uint64_t now = now_ns();
+    if (next > now) {
+      usleep((useconds_t)((next - now) / 1000));
+    } else {
+      next = now;
+    }
+  }
+
+  printf("frames %u, stops %u, frames with requests %u\n", stats.frames,
+         stats.stops, stats.services);
+  printf("emulation core in requests: mean %.1f us, max %.1f us\n",
+         stats.services ? stats.service_ns / 1e3 / stats.services : 0.0,
+         stats.max_service_ns / 1e3);
+  unlink(machine.snapshot);
+  // The listener task is still blocked in accept.
+  fflush(stdout);
+  _exit(0);
+}
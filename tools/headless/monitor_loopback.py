@@ -0,0 +1,201 @@
+#!/usr/bin/env python3
+"""Run every remote monitor command against bmc64-monitor-bench over
+loopback and time the round trips."""
+
+import argparse
+import os
+import socket
+import struct
+import subprocess
+import sys
+import time
+
+sys.path.insert(0, os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                                ".."))
+
+import remote_monitor  # noqa: E402
+from remote_monitor import MonitorError, RemoteMonitor  # noqa: E402
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+PROGRAM_START = 0xc000
+FRAME_COUNTER = 0x0400
+
+
+def free_port():
+    probe = socket.socket()
+    probe.bind(("127.0.0.1", 0))
+    port = probe.getsockname()[1]
+    probe.close()
+    return port
+
+
+def connect(port, timeout):
+    deadline = time.monotonic() + timeout
+    while True:
+        try:
+            return RemoteMonitor("127.0.0.1", port)
+        except ConnectionRefusedError:
+            if time.monotonic() > deadline:
+                raise
+            time.sleep(0.05)
+
+
+def expect(condition, message):
+    if not condition:
+        raise AssertionError(message)
+    print("ok: " + message)
+
+
+def expect_status(status, call, *arguments):
+    try:
+        call(*arguments)
+    except MonitorError as error:
+        if error.status == status:
+            return
+        raise
+    raise AssertionError("expected status {}".format(status))
+
+
+def timed(count, call, *arguments):
+    start = time.perf_counter()
+    for _ in range(count):
+        call(*arguments)
+    return (time.perf_counter() - start) / count
+
+
+def run(monitor, rounds):
+    info = monitor.info()
+    expect(info["version"] == 1 and not info["stopped"],
+           "info: protocol 1, running")
+
+    banks = monitor.banks()
+    expect(set(banks) == {"cpu", "ram"}, "banks: cpu and ram")
+    ram = banks["ram"]
+
+    # The toy machine fills RAM with addr ^ (addr >> 8) and runs from
+    # $c000, storing into $0900-$09ff, so stay clear of those.
+    data = monitor.read(0x1000, 256, ram)
+    expect(data == bytes(((0x1000 + i) ^ ((0x1000 + i) >> 8)) & 0xff
+                         for i in range(256)), "read ram while running")
+    expect(monitor.read(0xd010, 16) == bytes(range(0x10, 0x20)),
+           "cpu bank sees i/o")
+    expect(monitor.read(0xd010, 16, ram)[0] == 0xc0, "ram bank does not")
+    expect(len(monitor.read(0, 0x10000, ram)) == 0x10000, "read all 64K")
+    expect_status(2, monitor.read, 0xff00, 0x200, ram)
+    expect_status(3, monitor.read, 0, 16, ram, 3)
+
+    before = struct.unpack("<I", monitor.read(FRAME_COUNTER, 4, ram))[0]
+    time.sleep(0.2)
+    after = struct.unpack("<I", monitor.read(FRAME_COUNTER, 4, ram))[0]
+    expect(after > before, "frames advance while running")
+
+    pattern = bytes(range(200, 256)) * 8
+    monitor.write(0x2000, pattern)
+    expect(monitor.read(0x2000, len(pattern), ram) == pattern,
+           "write then read back")
+
+    registers = {r["name"]: r for r in monitor.registers()}
+    expect(set(registers) == {"A", "X", "Y", "PC", "SP", "FL"},
+           "registers: 6502 set")
+    monitor.set_register(registers["Y"]["id"], 0x42)
+    expect({r["name"]: r["value"] for r in monitor.registers()}["Y"] == 0x42,
+           "set register")
+
+    expect_status(4, monitor.resume)
+    expect_status(1, monitor.request, 0x7f)
+
+    trace = monitor.add_checkpoint(0x0900, 0x09ff,
+                                   remote_monitor.OP_STORE, stop=False)
+    time.sleep(0.1)
+    hits = {cp["number"]: cp for cp in monitor.checkpoints()}[trace]["hits"]
+    expect(hits > 0, "store trace counts hits ({})".format(hits))
+
+    stop_at = monitor.add_checkpoint(PROGRAM_START + 0x80)
+    event = monitor.wait_stopped(2.0)
+    expect(event["pc"] == PROGRAM_START + 0x80,
+           "exec checkpoint stops at ${:04x}".format(event["pc"]))
+    expect(monitor.info()["stopped"], "info: stopped")
+    monitor.delete_checkpoint(stop_at)
+    expect_status(3, monitor.delete_checkpoint, stop_at)
+
+    monitor.step(3)
+    event = monitor.wait_stopped(2.0)
+    expect(event["pc"] == PROGRAM_START + 0x83, "step 3")
+    pc = registers["PC"]["id"]
+    monitor.set_register(pc, PROGRAM_START + 0x10)
+    monitor.step()
+    expect(monitor.wait_stopped(2.0)["pc"] == PROGRAM_START + 0x11,
+           "set PC then step")
+
+    frame = monitor.info()["frame"]
+    time.sleep(0.1)
+    expect(monitor.info()["frame"] == frame, "frames hold while stopped")
+
+    stopped_rtt = timed(rounds, monitor.info)
+    stopped_read = timed(max(rounds // 10, 1), monitor.read, 0, 0x10000, ram)
+
+    snapshot = monitor.snapshot()
+    expect(len(snapshot) > 0x10000 and
+           snapshot[0x2000:0x2000 + len(pattern)] == pattern,
+           "snapshot holds the written bytes")
+
+    monitor.resume()
+    time.sleep(0.1)
+    expect(not monitor.info()["stopped"], "continue")
+    monitor.stop()
+    monitor.wait_stopped(2.0)
+    expect(monitor.info()["stopped"], "stop request")
+    monitor.delete_checkpoint(trace)
+    expect(monitor.checkpoints() == [], "no checkpoints left")
+    monitor.resume()
+
+    running_rtt = timed(max(rounds // 10, 1), monitor.info)
+    running_read = timed(max(rounds // 20, 1), monitor.read, 0, 0x10000, ram)
+
+    # Several requests in flight land in one frame.
+    start = time.perf_counter()
+    ids = [monitor.send(remote_monitor.READ_MEMORY,
+                        struct.pack("<BBHHI", 0, 0, ram, 0, 0x10000))
+           for _ in range(4)]
+    for request_id in ids:
+        monitor.reply(request_id)
+    pipelined = time.perf_counter() - start
+
+    print()
+    print("stopped: info round trip {:.3f} ms, 64K read {:.3f} ms "
+          "({:.1f} MB/s)".format(stopped_rtt * 1e3, stopped_read * 1e3,
+                                 0x10000 / stopped_read / 1e6))
+    print("running: info round trip {:.3f} ms, 64K read {:.3f} ms".format(
+        running_rtt * 1e3, running_read * 1e3))
+    print("running: 4 pipelined 64K reads {:.3f} ms".format(pipelined * 1e3))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--bench", default=os.path.join(
+        HERE, "bmc64-monitor-bench"))
+    parser.add_argument("--rounds", type=int, default=200,
+                        help="round trips to time while stopped "
+                             "(default: 200)")
+    arguments = parser.parse_args()
+
+    if not os.path.exists(arguments.bench):
+        raise SystemExit("build it first: make -C {} monitor-bench".format(
+            HERE))
+    port = free_port()
+    bench = subprocess.Popen([arguments.bench, "--port", str(port),
+                              "--seconds", "30"], stdout=subprocess.PIPE,
+                             universal_newlines=True)
+    try:
+        with connect(port, 5.0) as monitor:
+            run(monitor, arguments.rounds)
+    finally:
+        bench.terminate()
+        report = bench.communicate()[0]
+    print(report.split("\n", 1)[1], end="")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
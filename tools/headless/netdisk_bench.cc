@@ -0,0 +1,270 @@
+/*
+ * netdisk_bench.cc - load a file from a D64 on tools/netdisk_server.py
+ *                    through the NET: volume's cache (src/bmcnetdisk.cpp)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The main thread stands in for the emulation core and reads the image
+// the way a 1541 LOAD does: the directory chain from track 18 sector 1,
+// then the file's sectors one at a time by their links. It reads 256
+// bytes per sector, as VICE's disk image code does, so each read is a
+// cache lookup and the network waits are what the read-ahead saves.
+// The load runs twice, cold and then from the cache.
+//
+// --write then rewrites --write-blocks blocks from the end of the image
+// the way a SAVE does, one sector at a time, and waits for them with
+// NetDiskSync; the caller checks the image on the server afterwards.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modem_host.h"
+
+#include "../../src/bmcnetdisk.h"
+
+namespace {
+
+const unsigned kSectorSize = 256;
+
+struct Options {
+  const char *server = 0;
+  const char *image = 0;
+  const char *file = 0;
+  const char *out = 0;
+  bool readAhead = true;
+  unsigned writeBlocks = 0;
+} options;
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+unsigned sectors_on(unsigned track) {
+  return track <= 17 ? 21 : track <= 24 ? 19 : track <= 30 ? 18 : 17;
+}
+
+unsigned offset_of(unsigned track, unsigned sector) {
+  unsigned offset = 0;
+  for (unsigned t = 1; t < track; ++t) {
+    offset += sectors_on(t) * kSectorSize;
+  }
+  return offset + sector * kSectorSize;
+}
+
+bool read_sector(int file, unsigned track, unsigned sector, uint8_t *data) {
+  if (track < 1 || track > 42 || sector >= sectors_on(track)) {
+    fprintf(stderr, "bad link %u/%u\n", track, sector);
+    return false;
+  }
+  int result = NetDiskRead(file, offset_of(track, sector), data, kSectorSize);
+  if (result != (int)kSectorSize) {
+    fprintf(stderr, "read %u/%u failed: %d\n", track, sector, result);
+    return false;
+  }
+  return true;
+}
+
+// Names on the disk are PETSCII padded with $a0; plain ASCII letters,
+// digits and punctuation compare as is.
+bool name_matches(const uint8_t *entry, const char *name) {
+  unsigned length = strlen(name);
+  if (length > 16) {
+    return false;
+  }
+  for (unsigned i = 0; i < 16; ++i) {
+    uint8_t want = i < length ? (uint8_t)name[i] : 0xa0;
+    if (entry[i] != want) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns the bytes loaded, or -1.
+long load(int file, uint8_t *out, unsigned capacity) {
+  uint8_t sector[kSectorSize];
+  unsigned track = 18;
+  unsigned index = 1;
+  unsigned first_track = 0;
+  unsigned first_sector = 0;
+  while (track != 0 && first_track == 0) {
+    if (!read_sector(file, track, index, sector)) {
+      return -1;
+    }
+    for (unsigned entry = 0; entry < 8; ++entry) {
+      const uint8_t *bytes = sector + entry * 32;
+      if ((bytes[2] & 0x07) != 0 && name_matches(bytes + 5, options.file)) {
+        first_track = bytes[3];
+        first_sector = bytes[4];
+        break;
+      }
+    }
+    track = sector[0];
+    index = sector[1];
+  }
+  if (first_track == 0) {
+    fprintf(stderr, "%s is not in the directory\n", options.file);
+    return -1;
+  }
+
+  long loaded = 0;
+  track = first_track;
+  index = first_sector;
+  while (track != 0) {
+    if (!read_sector(file, track, index, sector)) {
+      return -1;
+    }
+    unsigned used = sector[0] == 0 ? sector[1] - 1 : kSectorSize - 2;
+    if (loaded + used > capacity) {
+      fprintf(stderr, "file is too long\n");
+      return -1;
+    }
+    memcpy(out + loaded, sector + 2, used);
+    loaded += used;
+    track = sector[0];
+    index = sector[1];
+  }
+  return loaded;
+}
+
+void report(const char *what, uint64_t elapsed_ns, const NetDiskStats &before,
+            const NetDiskStats &after) {
+  printf("%s: %.1f ms, %u blocks read, %u fetched in %u requests, "
+         "%.1f ms waiting\n",
+         what, elapsed_ns / 1e6, after.blocksRead - before.blocksRead,
+         after.blocksFetched - before.blocksFetched,
+         after.fetches - before.fetches,
+         (after.readWaitUs - before.readWaitUs +
+          after.writeWaitUs - before.writeWaitUs) / 1e3);
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s --server host:port --image NET:/path.d64 --file NAME\n"
+          "          [--out FILE] [--no-readahead] [--write-blocks N]\n"
+          "          [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (!strcmp(argv[i], "--no-readahead")) {
+      options.readAhead = false;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--server")) {
+      options.server = argv[++i];
+    } else if (!strcmp(argv[i], "--image")) {
+      options.image = argv[++i];
+    } else if (!strcmp(argv[i], "--file")) {
+      options.file = argv[++i];
+    } else if (!strcmp(argv[i], "--out")) {
+      options.out = argv[++i];
+    } else if (!strcmp(argv[i], "--write-blocks")) {
+      options.writeBlocks = strtoul(argv[++i], 0, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.server == 0 || options.image == 0 || options.file == 0 ||
+      !NetDiskIsPath(options.image)) {
+    usage(argv[0]);
+  }
+
+  StartNetDisk(CNetSubSystem::Get(), options.server);
+  NetDiskSetReadAhead(options.readAhead);
+  modem_host_start_tasks();
+
+  static uint8_t data[0x30000];
+  NetDiskStats before;
+  NetDiskStats after;
+  long loaded = 0;
+  for (int pass = 0; pass < 2; ++pass) {
+    NetDiskGetStats(&before);
+    uint64_t start = now_ns();
+    int file = NetDiskOpen(options.image, false);
+    if (file < 0) {
+      fprintf(stderr, "cannot open %s: %s\n", options.image,
+              strerror(-file));
+      return 1;
+    }
+    loaded = load(file, data, sizeof data);
+    NetDiskClose(file);
+    if (loaded < 0) {
+      return 1;
+    }
+    uint64_t elapsed = now_ns() - start;
+    NetDiskGetStats(&after);
+    printf("loaded %ld bytes\n", loaded);
+    report(pass == 0 ? "cold load" : "cached load", elapsed, before, after);
+  }
+  if (options.out != 0) {
+    FILE *out = fopen(options.out, "wb");
+    if (out == 0 || fwrite(data, 1, loaded, out) != (size_t)loaded) {
+      perror(options.out);
+      return 1;
+    }
+    fclose(out);
+  }
+
+  if (options.writeBlocks > 0) {
+    int file = NetDiskOpen(options.image, true);
+    if (file < 0) {
+      fprintf(stderr, "cannot open %s to write: %s\n", options.image,
+              strerror(-file));
+      return 1;
+    }
+    unsigned blocks = NetDiskSize(file) / kSectorSize;
+    if (options.writeBlocks > blocks) {
+      options.writeBlocks = blocks;
+    }
+    NetDiskGetStats(&before);
+    uint64_t start = now_ns();
+    uint8_t sector[kSectorSize];
+    for (unsigned block = blocks - options.writeBlocks; block < blocks;
+         ++block) {
+      for (unsigned i = 0; i < kSectorSize; ++i) {
+        sector[i] = (uint8_t)(block ^ i);
+      }
+      int result =
+          NetDiskWrite(file, block * kSectorSize, sector, kSectorSize);
+      if (result != (int)kSectorSize) {
+        fprintf(stderr, "write of block %u failed: %d\n", block, result);
+        return 1;
+      }
+    }
+    uint64_t queued = now_ns() - start;
+    int synced = NetDiskSync(file);
+    uint64_t elapsed = now_ns() - start;
+    NetDiskClose(file);
+    NetDiskGetStats(&after);
+    printf("wrote %u blocks: queued in %.1f ms, on the server after %.1f ms, "
+           "%.1f ms waiting for queue space, %u errors%s\n",
+           options.writeBlocks, queued / 1e6, elapsed / 1e6,
+           (after.writeWaitUs - before.writeWaitUs) / 1e3,
+           after.writeErrors - before.writeErrors,
+           synced < 0 ? ", sync failed" : "");
+    if (synced < 0 || after.writeErrors != before.writeErrors) {
+      return 1;
+    }
+  }
+
+  // The network task is still polling.
+  fflush(stdout);
+  _exit(0);
+}
@@ -0,0 +1,216 @@
+#!/usr/bin/env python3
+"""Time LOADs from a D64 on netdisk_server.py through bmc64-netdisk-bench,
+with and without track read-ahead, at several simulated network latencies,
+then check a SAVE-style write reaches the image."""
+
+import argparse
+import os
+import re
+import shutil
+import signal
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SERVER = os.path.join(HERE, "..", "netdisk_server.py")
+SECTOR = 256
+INTERLEAVE = 10
+FILE_NAME = "DEMO"
+
+
+def sectors_on(track):
+    if track <= 17:
+        return 21
+    if track <= 24:
+        return 19
+    if track <= 30:
+        return 18
+    return 17
+
+
+def offset_of(track, sector):
+    return (sum(sectors_on(t) for t in range(1, track)) + sector) * SECTOR
+
+
+def build_d64(blocks):
+    """A 35 track D64 holding one PRG of the given length in blocks, its
+    sectors laid out at the 1541's interleave the way the DOS saves."""
+    image = bytearray(offset_of(36, 0))
+    payload = bytes((i * 7 + (i >> 8)) & 0xff for i in range((blocks - 1) *
+                                                              254 + 100))
+    chain = []
+    used = set()
+    tracks = [t for t in range(1, 36) if t != 18]
+    track_index = 0
+    sector = 0
+    while len(chain) < blocks:
+        track = tracks[track_index]
+        count = sectors_on(track)
+        free = [s for s in range(count) if (track, s) not in used]
+        if not free:
+            track_index += 1
+            sector = 0
+            continue
+        while (track, sector % count) in used:
+            sector += 1
+        sector %= count
+        used.add((track, sector))
+        chain.append((track, sector))
+        sector += INTERLEAVE
+    for index, (track, sector) in enumerate(chain):
+        data = payload[index * 254:(index + 1) * 254]
+        at = offset_of(track, sector)
+        if index + 1 < len(chain):
+            image[at:at + 2] = bytes(chain[index + 1])
+        else:
+            image[at:at + 2] = bytes((0, len(data) + 1))
+        image[at + 2:at + 2 + len(data)] = data
+
+    # BAM at 18/0 pointing at one directory sector at 18/1.
+    bam = offset_of(18, 0)
+    image[bam:bam + 4] = bytes((18, 1, 0x41, 0))
+    image[bam + 0x90:bam + 0xa0] = b"NETDISK".ljust(16, b"\xa0")
+    directory = offset_of(18, 1)
+    image[directory:directory + 2] = bytes((0, 0xff))
+    entry = directory + 2
+    image[entry] = 0x82
+    image[entry + 1:entry + 3] = bytes(chain[0])
+    image[entry + 3:entry + 19] = FILE_NAME.encode().ljust(16, b"\xa0")
+    image[entry + 28:entry + 30] = bytes((blocks & 0xff, blocks >> 8))
+    return bytes(image), payload
+
+
+def free_port():
+    probe = socket.socket()
+    probe.bind(("127.0.0.1", 0))
+    port = probe.getsockname()[1]
+    probe.close()
+    return port
+
+
+def wait_for(port, timeout):
+    deadline = time.monotonic() + timeout
+    while True:
+        try:
+            socket.create_connection(("127.0.0.1", port), 0.2).close()
+            return
+        except OSError:
+            if time.monotonic() > deadline:
+                raise
+            time.sleep(0.05)
+
+
+def expect(condition, message):
+    if not condition:
+        raise AssertionError(message)
+    print("ok: " + message)
+
+
+def run_bench(bench, port, extra):
+    result = subprocess.run(
+        [bench, "--server", "127.0.0.1:{}".format(port),
+         "--image", "NET:/test.d64", "--file", FILE_NAME] + extra,
+        stdout=subprocess.PIPE, universal_newlines=True, timeout=300)
+    if result.returncode != 0:
+        raise AssertionError("bench failed:\n" + result.stdout)
+    return result.stdout
+
+
+def parse(report, what):
+    for line in report.splitlines():
+        match = re.match(what + r": ([\d.]+) ms, .* in (\d+) requests", line)
+        if match:
+            return {"ms": float(match.group(1)),
+                    "fetches": int(match.group(2))}
+    raise AssertionError("no {} line in:\n{}".format(what, report))
+
+
+class Server:
+    def __init__(self, root, port, latency):
+        self.process = subprocess.Popen(
+            [sys.executable, SERVER, "--bind", "127.0.0.1", "--port",
+             str(port), "--latency", str(latency), root],
+            stdout=subprocess.PIPE, universal_newlines=True)
+        wait_for(port, 5.0)
+
+    def stop(self):
+        self.process.send_signal(signal.SIGINT)
+        return self.process.communicate(timeout=10)[0]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--bench", default=os.path.join(
+        HERE, "bmc64-netdisk-bench"))
+    parser.add_argument("--blocks", type=int, default=160,
+                        help="length of the test file (default: 160)")
+    parser.add_argument("--latency", default="0,5,20,50",
+                        help="round trip delays in ms (default: 0,5,20,50)")
+    arguments = parser.parse_args()
+    if not os.path.exists(arguments.bench):
+        raise SystemExit("build it first: make -C {} netdisk-bench".format(
+            HERE))
+
+    root = tempfile.mkdtemp(prefix="bmc64-netdisk-")
+    try:
+        image, payload = build_d64(arguments.blocks)
+        path = os.path.join(root, "test.d64")
+        with open(path, "wb") as out:
+            out.write(image)
+        loaded = os.path.join(root, "loaded.prg")
+
+        rows = []
+        for latency in [float(ms) for ms in arguments.latency.split(",")]:
+            port = free_port()
+            server = Server(root, port, latency)
+            try:
+                plain = run_bench(arguments.bench, port,
+                                  ["--no-readahead", "--out", loaded])
+                with open(loaded, "rb") as data:
+                    expect(data.read() == payload,
+                           "{} ms, no read-ahead: file intact".format(latency))
+                ahead = run_bench(arguments.bench, port, ["--out", loaded])
+                with open(loaded, "rb") as data:
+                    expect(data.read() == payload,
+                           "{} ms, read-ahead: file intact".format(latency))
+            finally:
+                server.stop()
+            rows.append((latency, parse(plain, "cold load"),
+                         parse(ahead, "cold load"),
+                         parse(ahead, "cached load")))
+
+        port = free_port()
+        server = Server(root, port, 5)
+        try:
+            report = run_bench(arguments.bench, port, ["--write-blocks", "40"])
+        finally:
+            server.stop()
+        with open(path, "rb") as data:
+            written = data.read()
+        blocks = len(image) // SECTOR
+        expected = image[:(blocks - 40) * SECTOR] + b"".join(
+            bytes((block ^ i) & 0xff for i in range(SECTOR))
+            for block in range(blocks - 40, blocks))
+        expect(written == expected, "40 written blocks reached the image")
+
+        print()
+        print("{} block file at interleave {}:".format(arguments.blocks,
+                                                      INTERLEAVE))
+        print("latency | no read-ahead        | read-ahead           | cached")
+        for latency, plain, ahead, cached in rows:
+            print("{:5.0f} ms | {:7.1f} ms {:4d} reqs | {:7.1f} ms {:4d} reqs "
+                  "| {:6.1f} ms".format(latency, plain["ms"], plain["fetches"],
+                                        ahead["ms"], ahead["fetches"],
+                                        cached["ms"]))
+        print(report.splitlines()[-1])
+    finally:
+        shutil.rmtree(root)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
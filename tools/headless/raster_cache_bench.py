@@ -0,0 +1,144 @@
+#!/usr/bin/env python3
+"""Time raster line drawing with the raster cache on and off.
+
+Runs each machine on static content (the READY prompt) and on scrolling
+content (a BASIC loop printing lines) with Raster Line Cache on, as it
+is by default, and with --no-raster-cache. Reports the time spent
+drawing raster lines and the share of lines the cache reused, and fails
+if the cache changes any frame drawn: it is meant to be a pure
+optimization.
+
+The Plus/4 is left out; VICE keeps the TED cache off because it does
+not work.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..", "..")
+
+SCROLL = [
+    '10 print i;"scrolling text, every line drawn is new";:i=i+1:goto 10',
+    'run',
+]
+
+# The C128's 80 column screen, on the VDC.
+SCROLL_80 = ['5 graphic 5'] + SCROLL
+
+# A still 80 column screen switched to 40 column double pixel mode and
+# back, and to a wider character cell, part way down a frame. SYS
+# 52684,value,register writes a VDC register. The columns are always
+# down to 40 while double pixel mode is on: 80 double width columns
+# overrun VICE's line buffer.
+DOUBLE_PIXEL = [
+    '10 graphic 5:print chr$(147);:for i=1 to 20:print i;"double pixel":next',
+    '20 sys 52684,40,1:sys 52684,87,25:sleep 1:sys 52684,71,25:'
+    'sys 52684,80,1:sleep 1',
+    '30 sys 52684,137,22:sleep 1:sys 52684,120,22:sleep 1:goto 20',
+    'run',
+]
+
+WORKLOADS = [
+    ("C64", "static", None),
+    ("C64", "scrolling", SCROLL),
+    ("C128", "static", None),
+    ("C128", "scrolling", SCROLL),
+    ("C128", "80 columns", SCROLL_80),
+    ("C128", "double pixel", DOUBLE_PIXEL),
+    ("VIC20", "static", None),
+    ("VIC20", "scrolling", SCROLL),
+    ("PET", "static", None),
+    ("PET", "scrolling", SCROLL),
+]
+
+
+def run(binary, boot, listing, seconds, cache):
+    command = [binary, "--boot", boot, "--seconds", str(seconds)]
+    if listing:
+        command += ["--type-keys", listing]
+    if not cache:
+        command.append("--no-raster-cache")
+    output = subprocess.run(
+        command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True, check=True).stdout
+    result = {"reused": {}}
+    for line in output.splitlines():
+        match = re.match(r"video +([\d.]+) s", line)
+        if match:
+            result["video"] = float(match.group(1))
+        match = re.match(r"frames +(\d+)", line)
+        if match:
+            result["frames"] = int(match.group(1))
+        match = re.match(r"crc_all +(\w+)", line)
+        if match:
+            result["crc_all"] = match.group(1)
+        # The last period logged for each chip
+        match = re.match(r"(\w+) cache: (\d+)% of lines reused", line)
+        if match:
+            result["reused"][match.group(1)] = int(match.group(2))
+    if "crc_all" not in result:
+        raise SystemExit("no report from {}:\n{}".format(binary, output))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--boot", default=os.path.join(
+        ROOT, "third_party", "vice-3.3", "data"))
+    parser.add_argument("--seconds", type=float, default=60,
+                        help="emulated seconds a run (default: 60)")
+    parser.add_argument("--runs", type=int, default=3,
+                        help="runs each way; the fastest counts "
+                        "(default: 3)")
+    arguments = parser.parse_args()
+
+    failed = 0
+    rows = []
+    with tempfile.TemporaryDirectory() as directory:
+        for machine, name, lines in WORKLOADS:
+            binary = os.path.join(HERE, "bmc64-headless-" + machine)
+            if not os.path.exists(binary):
+                raise SystemExit("build it first: ./make_headless.sh")
+            listing = None
+            if lines:
+                listing = os.path.join(directory, "listing.txt")
+                with open(listing, "w") as f:
+                    f.write("\n".join(lines) + "\n")
+
+            off = [run(binary, arguments.boot, listing, arguments.seconds,
+                       False) for _ in range(arguments.runs)]
+            on = [run(binary, arguments.boot, listing, arguments.seconds,
+                      True) for _ in range(arguments.runs)]
+            same = all(r["crc_all"] == off[0]["crc_all"] for r in off + on)
+            if not same:
+                failed += 1
+            off_ms = min(r["video"] for r in off) * 1e3 / off[0]["frames"]
+            on_ms = min(r["video"] for r in on) * 1e3 / on[0]["frames"]
+            reused = ", ".join("{} {}%".format(chip, pct) for chip, pct
+                               in sorted(on[0]["reused"].items()))
+            rows.append((machine, name, off_ms, on_ms, reused, same))
+            print("{} {}: {:.3f} ms a frame drawing lines, {:.3f} ms with "
+                  "the cache ({}){}".format(
+                      machine, name, off_ms, on_ms, reused,
+                      "" if same else ", FRAMES DIFFER"))
+
+    print("\n| Machine | Content | Cache off | Cache on | Saved | Reused |")
+    print("| --- | --- | ---: | ---: | ---: | --- |")
+    for machine, name, off_ms, on_ms, reused, same in rows:
+        print("| {} | {} | {:.3f} ms | {:.3f} ms | {:.0f}% | {} |".format(
+            machine, name, off_ms, on_ms, 100 * (1 - on_ms / off_ms),
+            reused))
+
+    print("raster cache checks passed" if not failed
+          else "RASTER CACHE CHECKS FAILED")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,39 @@
+/*
+ * resid_host.cc - reSID table setup normally done by the kernel
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// BMC64's reSID expects its filter and resampling tables to have been
+// built by cores 2 and 3 before VICE opens the SID. Do the same work
+// here, on one core, with the parameters ViceEmulatorCore uses.
+
+#include "headless_host.h"
+
+#include "resid/filter.h"
+#include "resid/sid.h"
+
+#define SAMPLE_RATE 44100
+
+extern "C" void host_resid_init(int cycles_per_second) {
+  // Must match ViceEmulatorCore
+  const double pass_band_freq = 13230;
+  const reSID::sampling_method methods[] = {
+      reSID::SAMPLE_RESAMPLE, reSID::SAMPLE_RESAMPLE_FASTMEM};
+
+  // Both models at once. Constructing either model's filter alone
+  // touches the other model's tables.
+  reSID::Filter filter;
+
+  for (int partition = 0; partition <= 2; partition++) {
+    for (unsigned i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+      reSID::SID::ComputeSamplingTable(cycles_per_second, methods[i],
+                                       SAMPLE_RATE, pass_band_freq, 0.97,
+                                       partition);
+    }
+  }
+}
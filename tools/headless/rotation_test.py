@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Check the 1541 rotation skip against stepping every bit.
+
+Catching up on rotation nobody watched, rotation_1541_simple starts at
+the last sync mark, where the read shifter's state is known, instead of
+stepping every bit since the drive last looked. This runs the skip two
+ways and fails if it ever gives a different result from the bit loop:
+
+- --rotation-fuzz runs both from the same state on made up tracks:
+  random bytes, random bytes with sync marks of any length, all ones,
+  all ones but one bit and all zeros, some only a few bytes long so one
+  catch-up spans several revolutions;
+- --rotation-check steps every bit beside each skip in a real session:
+  a BASIC program writes a sequential file to a blank D64 on the true
+  drive, reads it back and saves a file named after the result, with
+  each of the drive idle methods.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..", "..")
+
+NUMBERS = 400
+
+PROGRAM = [
+    '10 open 1,8,2,"@0:data,s,w"',
+    '20 for i=1 to {}:print#1,i:next:close 1'.format(NUMBERS),
+    '30 open 1,8,2,"data,s,r":s=0',
+    '40 input#1,a:s=s+a:if st=0 then 40',
+    '50 close 1:r$="bad":if s={} then r$="good"'.format(
+        NUMBERS * (NUMBERS + 1) // 2),
+    '60 open 1,8,2,"@0:"+r$+",s,w":close 1',
+    # The drive only writes a track back to the image once the head
+    # leaves it, so leave the directory track.
+    '70 open 1,8,2,"data,s,r":get#1,a$:close 1',
+    'run',
+]
+
+# Drive idle methods: none, skip cycles, trap idle.
+IDLE_METHODS = [0, 1, 2]
+
+
+def sectors_on(track):
+    if track <= 17:
+        return 21
+    if track <= 24:
+        return 19
+    if track <= 30:
+        return 18
+    return 17
+
+
+def offset_of(track, sector):
+    return (sum(sectors_on(t) for t in range(1, track)) + sector) * 256
+
+
+def blank_d64():
+    """A formatted, empty 35 track D64."""
+    image = bytearray(offset_of(36, 0))
+    bam = offset_of(18, 0)
+    image[bam:bam + 4] = bytes((18, 1, 0x41, 0))
+    for track in range(1, 36):
+        free = set(range(sectors_on(track)))
+        if track == 18:
+            free -= {0, 1}
+        bits = sum(1 << sector for sector in free)
+        image[bam + 4 * track:bam + 4 * track + 4] = bytes(
+            (len(free), bits & 0xff, bits >> 8 & 0xff, bits >> 16))
+    image[bam + 0x90:bam + 0xab] = (b"ROTATION".ljust(16, b"\xa0") +
+                                    b"\xa0\xa0RT\xa02A\xa0\xa0\xa0\xa0")
+    directory = offset_of(18, 1)
+    image[directory:directory + 2] = bytes((0, 0xff))
+    return image
+
+
+def file_names(path):
+    """The names in the first directory sector."""
+    with open(path, "rb") as f:
+        image = f.read()
+    directory = offset_of(18, 1)
+    names = []
+    for entry in range(8):
+        at = directory + entry * 32
+        if image[at + 2] & 0x80:
+            names.append(image[at + 5:at + 21].rstrip(b"\xa0").decode(
+                "ascii", "replace").lower())
+    return names
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--boot", default=os.path.join(
+        ROOT, "third_party", "vice-3.3", "data"))
+    parser.add_argument("--tracks", type=int, default=50000,
+                        help="made up tracks to fuzz (default: 50000)")
+    parser.add_argument("--seconds", type=float, default=60,
+                        help="emulated seconds a session (default: 60)")
+    arguments = parser.parse_args()
+
+    binary = os.path.join(HERE, "bmc64-headless-C64")
+    if not os.path.exists(binary):
+        raise SystemExit("build it first: ./make_headless.sh")
+
+    failed = 0
+
+    def expect(condition, message):
+        nonlocal failed
+        print(("ok: " if condition else "FAILED: ") + message)
+        if not condition:
+            failed += 1
+
+    output = subprocess.run(
+        [binary, "--rotation-fuzz", str(arguments.tracks)],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True).stdout
+    match = re.search(r"rotation fuzz (\d+) tracks, (\d+) skipped ahead, "
+                      r"(\d+) differ", output)
+    if not match:
+        raise SystemExit("no fuzz report:\n" + output)
+    expect(match.group(3) == "0" and match.group(2) != "0",
+           "fuzz: {} of {} tracks skipped ahead, {} differ".format(
+               match.group(2), match.group(1), match.group(3)))
+
+    with tempfile.TemporaryDirectory() as directory:
+        listing = os.path.join(directory, "rotation.txt")
+        with open(listing, "w") as f:
+            f.write("\n".join(PROGRAM) + "\n")
+        for method in IDLE_METHODS:
+            image = os.path.join(directory, "idle{}.d64".format(method))
+            with open(image, "wb") as f:
+                f.write(blank_d64())
+            output = subprocess.run(
+                [binary, "--boot", arguments.boot,
+                 "--seconds", str(arguments.seconds),
+                 "--type-keys", listing, "--rotation-check",
+                 "--", "-drive8idle", str(method), "-8", image],
+                stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                universal_newlines=True).stdout
+            match = re.search(r"^rotation (\d+) catch-ups, (\d+) skipped "
+                              r"ahead, (\d+) differ$", output, re.M)
+            if not match:
+                raise SystemExit("no rotation report:\n" + output)
+            names = file_names(image)
+            expect(match.group(3) == "0" and match.group(2) != "0",
+                   "idle method {}: {} catch-ups, {} skipped ahead, {} "
+                   "differ".format(method, match.group(1), match.group(2),
+                                   match.group(3)))
+            expect("good" in names,
+                   "idle method {}: file read back as written".format(method))
+            for line in output.splitlines():
+                if "Rotation skip differs" in line:
+                    print("  " + line)
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
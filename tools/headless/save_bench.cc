@@ -0,0 +1,288 @@
+/*
+ * save_bench.cc - time a snapshot save written at close, as new_io.cpp
+ *                 did, against one left to the save writer
+ *                 (src/bmcsave.cpp)
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The main thread stands in for the emulation core and runs 50 frames a
+// second. Partway through it saves a snapshot the way VICE and new_io.cpp
+// do: stdio hands the state over 1 KB at a time, and new_io.cpp appends
+// it to a buffer it doubles as it fills. The close then either writes
+// the buffer to the card itself, as it used to, or hands it to the save
+// writer. f_write is held to --card-kb-per-s, a card's speed, so the
+// close costs what it would on the Pi; the serialization is the host's
+// memcpy and realloc, faster than a Pi's.
+//
+// The emulation thread's time in the save is the freeze. With the save
+// writer the bench then follows the progress the status bar would show,
+// saves again and loads the file straight away, which has to wait for
+// the writer, and checks that what it read is what was saved.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "modem_host.h"
+
+#include "../../src/bmcsave.h"
+
+extern "C" void circle_save_begin(const char *path);
+extern "C" void circle_save_end(void);
+extern "C" int circle_save_progress(void);
+
+namespace {
+
+const unsigned kFrameUs = 20000;
+const unsigned kStdioBuffer = 1024;
+const unsigned kSaveFrame = 25;
+
+struct Options {
+  const char *dir = ".";
+  unsigned kb = 16 * 1024 + 128;
+  unsigned card = 4000;
+  unsigned frames = 400;
+} options;
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Byte i of a snapshot; seed tells two saves apart.
+uint8_t state_byte(unsigned seed, unsigned i) {
+  return (uint8_t)(i * 131 + (i >> 10) * 7 + seed);
+}
+
+struct SaveTimes {
+  double serialize_ms;
+  double close_ms;
+};
+
+// As new_io.cpp's _write grows a file opened write only.
+void append(char *&contents, unsigned &allocated, unsigned &size,
+            const uint8_t *data, unsigned length) {
+  if (contents == 0) {
+    allocated = 1024;
+    contents = (char *)malloc(allocated);
+  }
+  while (size + length >= allocated) {
+    allocated *= 2;
+    contents = (char *)realloc(contents, allocated);
+  }
+  memcpy(contents + size, data, length);
+  size += length;
+}
+
+bool save(const char *path, unsigned seed, bool background,
+          SaveTimes *times) {
+  uint64_t start = now_ns();
+  circle_save_begin(path);
+  FIL file;
+  CGlueFatFsLock();
+  FRESULT result = f_open(&file, path, FA_WRITE | FA_CREATE_NEW);
+  CGlueFatFsUnlock();
+  if (result != FR_OK) {
+    circle_save_end();
+    return false;
+  }
+
+  char *contents = 0;
+  unsigned allocated = 0;
+  unsigned size = 0;
+  uint8_t chunk[kStdioBuffer];
+  unsigned total = options.kb * 1024;
+  for (unsigned at = 0; at < total; at += kStdioBuffer) {
+    for (unsigned i = 0; i < kStdioBuffer; ++i) {
+      chunk[i] = state_byte(seed, at + i);
+    }
+    append(contents, allocated, size, chunk, kStdioBuffer);
+  }
+  uint64_t serialized = now_ns();
+
+  if (!background || !SaveTakeFile(path, &file, contents, size)) {
+    UINT written = 0;
+    CGlueFatFsLock();
+    result = f_write(&file, contents, size, &written);
+    f_close(&file);
+    CGlueFatFsUnlock();
+    free(contents);
+  }
+  circle_save_end();
+  uint64_t closed = now_ns();
+
+  times->serialize_ms = (serialized - start) / 1e6;
+  times->close_ms = (closed - serialized) / 1e6;
+  return result == FR_OK;
+}
+
+// What a load reads, compared with what was saved.
+bool check(const char *path, unsigned seed) {
+  FILE *file = fopen(path, "rb");
+  if (file == 0) {
+    return false;
+  }
+  unsigned total = options.kb * 1024;
+  bool same = true;
+  unsigned at = 0;
+  uint8_t chunk[64 * 1024];
+  size_t got;
+  while ((got = fread(chunk, 1, sizeof chunk, file)) > 0) {
+    for (size_t i = 0; i < got && same; ++i) {
+      same = chunk[i] == state_byte(seed, at + i);
+    }
+    at += got;
+  }
+  fclose(file);
+  return same && at == total;
+}
+
+void report(const char *name, const SaveTimes &times) {
+  double blocked = times.serialize_ms + times.close_ms;
+  printf("%s: %u KB, serialize %.1f ms, close %.1f ms, emulation thread "
+         "blocked %.1f ms, %u frames missed\n",
+         name, options.kb, times.serialize_ms, times.close_ms, blocked,
+         (unsigned)(blocked * 1000 / kFrameUs));
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--dir DIR] [--kb KB] [--card-kb-per-s N] [--frames N]\n"
+          "          [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--dir")) {
+      options.dir = argv[++i];
+    } else if (!strcmp(argv[i], "--kb")) {
+      options.kb = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--card-kb-per-s")) {
+      options.card = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = strtoul(argv[++i], 0, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.kb == 0 || options.frames <= kSaveFrame) {
+    usage(argv[0]);
+  }
+
+  modem_host_write_kb_per_s = options.card;
+  StartSaveWriter();
+  modem_host_start_tasks();
+  printf("%u KB snapshot, card writes %u KB/s\n", options.kb, options.card);
+
+  char sync_path[1024];
+  char background_path[1024];
+  char load_path[1024];
+  snprintf(sync_path, sizeof sync_path, "%s/sync.vsf", options.dir);
+  snprintf(background_path, sizeof background_path, "%s/background.vsf",
+           options.dir);
+  snprintf(load_path, sizeof load_path, "%s/load.vsf", options.dir);
+
+  SaveTimes sync_times;
+  if (!save(sync_path, 1, false, &sync_times)) {
+    fprintf(stderr, "cannot save %s\n", sync_path);
+    return 1;
+  }
+  report("written at close", sync_times);
+  bool ok = check(sync_path, 1);
+
+  // Frames at 50 Hz with the save in one of them, following the
+  // progress the status bar shows.
+  SaveTimes background_times;
+  uint64_t next = now_ns();
+  uint64_t handed = 0;
+  uint64_t written = 0;
+  int first_progress = -1;
+  int last_progress = -1;
+  unsigned progress_frames = 0;
+  uint64_t max_late_ns = 0;
+  for (unsigned n = 0; n < options.frames; ++n) {
+    uint64_t begin = now_ns();
+    if (begin > next && begin - next > max_late_ns && n != kSaveFrame) {
+      max_late_ns = begin - next;
+    }
+    if (n == kSaveFrame) {
+      if (!save(background_path, 2, true, &background_times)) {
+        fprintf(stderr, "cannot save %s\n", background_path);
+        return 1;
+      }
+      handed = now_ns();
+    } else if (handed != 0 && written == 0) {
+      int progress = circle_save_progress();
+      if (progress < 0) {
+        written = now_ns();
+      } else {
+        if (first_progress < 0) {
+          first_progress = progress;
+        }
+        last_progress = progress;
+        ++progress_frames;
+      }
+    }
+    next += kFrameUs * 1000ull;
+    uint64_t now = now_ns();
+    if (next > now) {
+      usleep((useconds_t)((next - now) / 1000));
+    } else {
+      next = now;
+    }
+  }
+  while (circle_save_progress() >= 0) {
+    usleep(1000);
+  }
+  if (written == 0) {
+    written = now_ns();
+  }
+  report("save writer", background_times);
+  printf("save writer: written %.0f ms after the hand over, progress %d%% "
+         "to %d%% over %u frames, other frames at most %.2f ms late\n",
+         (written - handed) / 1e6, first_progress, last_progress,
+         progress_frames, max_late_ns / 1e6);
+  ok = check(background_path, 2) && ok;
+
+  // A load of the file straight after it was saved.
+  SaveTimes load_times;
+  if (!save(load_path, 3, true, &load_times)) {
+    fprintf(stderr, "cannot save %s\n", load_path);
+    return 1;
+  }
+  uint64_t start = now_ns();
+  SaveWaitFor(load_path);
+  double waited_ms = (now_ns() - start) / 1e6;
+  bool loaded = check(load_path, 3);
+  printf("load straight after the save: waited %.0f ms, %s\n", waited_ms,
+         loaded ? "read as saved" : "READ WRONG");
+  ok = loaded && ok;
+
+  SaveStats stats;
+  SaveGetStats(&stats);
+  printf("writer: %u taken, %u written, %u failed, %llu KB, %.0f ms in "
+         "f_write and f_close, at most %.1f ms a piece\n",
+         stats.taken, stats.written, stats.failed, stats.bytes / 1024,
+         stats.writeUs / 1e3, stats.maxWriteUs / 1e3);
+  printf("files %s\n", ok ? "match what was saved" : "DO NOT MATCH");
+  fflush(stdout);
+  // The writer task is still polling.
+  _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,224 @@
+/*
+ * stream_bench.cc - stream a synthetic C64 display through the frame
+ *                   stream (src/bmcstream.cpp) to tools/stream_viewer.py
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+// The main thread stands in for the emulation core. It draws a 384x272
+// indexed frame 50 times a second into a padded buffer, the way VICE
+// draws into the VIC layer, and hands it to the stream when a viewer
+// wants it. A second thread stands in for core 3 and polls the encoder
+// between frames; --no-helper leaves the encoding to the network task,
+// and --helper-after N starts it N frames into the stream, so it takes
+// the encoder over from the network task while frames are going out.
+//
+// The scene is the one in c64_scene.h. Frame n of the scene is the n'th
+// frame after the viewer connected, which is the number the stream
+// gives it.
+//
+// The report gives the time the emulation thread spent in the stream
+// per frame, which is what it costs on the Pi, and where the frames
+// the viewer did not get were dropped.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "c64_scene.h"
+#include "modem_host.h"
+
+#include "../../src/bmcstream.h"
+
+namespace {
+
+const unsigned kWidth = kSceneWidth;
+const unsigned kHeight = kSceneHeight;
+const unsigned kPitch = 512;
+const unsigned kLeft = 16;
+const unsigned kTop = 8;
+const unsigned kFrameUs = 20000;
+
+struct Options {
+  unsigned port = 6464;
+  unsigned frames = 500;
+  unsigned divider = 1;
+  double wait = 10;
+  unsigned send_buffer = 16384;
+  bool helper = true;
+  unsigned helper_after = 0;
+} options;
+
+uint8_t pixels[kPitch * (kHeight + 2 * kTop)];
+uint16_t palette[256];
+volatile bool stopping;
+
+uint64_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t thread_cpu_ns(pthread_t thread) {
+  clockid_t clock;
+  struct timespec used;
+  if (pthread_getcpuclockid(thread, &clock) != 0 ||
+      clock_gettime(clock, &used) != 0) {
+    return 0;
+  }
+  return (uint64_t)used.tv_sec * 1000000000 + used.tv_nsec;
+}
+
+void *helper_main(void *) {
+  while (!stopping) {
+    if (!FrameStreamHelperPoll()) {
+      usleep(100);
+    }
+  }
+  return 0;
+}
+
+void usage(const char *program) {
+  fprintf(stderr,
+          "usage: %s [--port N] [--frames N] [--divider N] [--wait S]\n"
+          "          [--send-buffer BYTES] [--no-helper] [--helper-after N]\n"
+          "          [--verbose]\n",
+          program);
+  exit(2);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "--verbose")) {
+      modem_host_verbose = true;
+    } else if (!strcmp(argv[i], "--no-helper")) {
+      options.helper = false;
+    } else if (i + 1 == argc) {
+      usage(argv[0]);
+    } else if (!strcmp(argv[i], "--port")) {
+      options.port = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--frames")) {
+      options.frames = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--divider")) {
+      options.divider = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--wait")) {
+      options.wait = atof(argv[++i]);
+    } else if (!strcmp(argv[i], "--send-buffer")) {
+      options.send_buffer = strtoul(argv[++i], 0, 0);
+    } else if (!strcmp(argv[i], "--helper-after")) {
+      options.helper_after = strtoul(argv[++i], 0, 0);
+    } else {
+      usage(argv[0]);
+    }
+  }
+  if (options.port == 0 || options.port > 65535 || options.frames == 0 ||
+      options.divider == 0) {
+    usage(argv[0]);
+  }
+
+  scene_palette(palette);
+
+  // So a slow viewer holds the network task up as it does on the Pi.
+  modem_host_send_buffer = options.send_buffer;
+  StartFrameStream(CNetSubSystem::Get(), options.port, options.divider);
+  modem_host_start_tasks();
+  pthread_t helper;
+  bool helper_running = options.helper && options.helper_after == 0;
+  if (helper_running) {
+    pthread_create(&helper, 0, helper_main, 0);
+  }
+  printf("streaming port %u, every %u frames, %s\n", options.port,
+         options.divider, options.helper ? "helper encodes" :
+                                           "network task encodes");
+  fflush(stdout);
+
+  // Frames until a viewer connects count as frame 0 again.
+  uint64_t start = now_ns();
+  uint64_t next = start;
+  uint64_t deadline = start + (uint64_t)(options.wait * 1e9);
+  uint64_t stream_ns = 0;
+  uint64_t max_stream_ns = 0;
+  uint64_t draw_ns = 0;
+  uint64_t busy_start = 0;
+  uint64_t helper_start = 0;
+  uint64_t tasks_start = 0;
+  unsigned n = 0;
+  bool connected = false;
+  while (n < options.frames) {
+    if (options.helper && !helper_running && n == options.helper_after &&
+        connected) {
+      pthread_create(&helper, 0, helper_main, 0);
+      helper_running = true;
+    }
+    uint64_t begin = now_ns();
+    draw_scene(pixels + kTop * kPitch + kLeft, kPitch, n);
+    uint64_t drawn = now_ns();
+    bool wanted = FrameStreamWanted();
+    if (wanted) {
+      FrameStreamCapture(pixels, kPitch, kLeft, kTop, kWidth, kHeight,
+                         palette);
+    }
+    uint64_t used = now_ns() - drawn;
+    if (!connected && wanted) {
+      connected = true;
+      busy_start = begin;
+      helper_start = helper_running ? thread_cpu_ns(helper) : 0;
+      tasks_start = modem_host_task_cpu_ns();
+    }
+    if (connected) {
+      draw_ns += drawn - begin;
+      stream_ns += used;
+      if (used > max_stream_ns) {
+        max_stream_ns = used;
+      }
+      ++n;
+    } else if (drawn > deadline) {
+      fprintf(stderr, "no viewer connected\n");
+      return 1;
+    }
+    next += kFrameUs * 1000ull;
+    uint64_t now = now_ns();
+    if (next > now) {
+      usleep((useconds_t)((next - now) / 1000));
+    } else {
+      next = now;
+    }
+  }
+  // Let the last packets go out.
+  usleep(200000);
+  double seconds = (now_ns() - busy_start) / 1e9;
+  stopping = true;
+
+  FrameStreamStats stats;
+  FrameStreamGetStats(&stats);
+  printf("frames %u, captured %u, dropped at capture %u, too large %u\n", n,
+         stats.captured, stats.captureDrops, stats.tooLarge);
+  printf("encoded %u, key frames %u, dropped for the network %u\n",
+         stats.encoded, stats.keyFrames, stats.encodeDrops);
+  printf("sent %llu bytes, %.0f bytes/frame, %.1f KB/s\n", stats.bytesSent,
+         stats.encoded ? (double)stats.bytesSent / stats.encoded : 0.0,
+         stats.bytesSent / 1024.0 / seconds);
+  printf("emulation thread in the stream: mean %.2f us, max %.2f us per "
+         "frame (drawing the scene %.1f us)\n",
+         stream_ns / 1e3 / n, max_stream_ns / 1e3, draw_ns / 1e3 / n);
+  printf("encode: mean %.1f us, max %u us per frame\n",
+         stats.encoded ? (double)stats.encodeUs / stats.encoded : 0.0,
+         stats.maxEncodeUs);
+  printf("cpu: helper %.1f%%, network task %.1f%%\n",
+         helper_running
+             ? (thread_cpu_ns(helper) - helper_start) / 1e7 / seconds
+             : 0.0,
+         (modem_host_task_cpu_ns() - tasks_start) / 1e7 / seconds);
+  // The network task is still polling.
+  fflush(stdout);
+  _exit(0);
+}
@@ -0,0 +1,196 @@
+#!/usr/bin/env python3
+"""Stream bmc64-stream-bench's synthetic C64 display to the viewer's
+decoder over loopback, check the decoded frames against the scene and
+report bandwidth, drops and CPU time with and without the helper, and
+with a viewer too slow to keep up."""
+
+import argparse
+import os
+import re
+import socket
+import subprocess
+import sys
+import time
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+sys.path.insert(0, os.path.join(HERE, ".."))
+
+import stream_viewer  # noqa: E402
+
+WIDTH = 384
+HEIGHT = 272
+
+
+def scene_row(y, n):
+    """Row y of frame n, as draw_scene in stream_bench.cc draws it."""
+    if y < 36 or y >= 236:
+        return bytes([1 if ((y + n) & 63) < 4 else 14]) * WIDTH
+    border = 1 if ((y + n) & 63) < 4 else 14
+    row = bytearray([border]) * WIDTH
+    cy = (y - 36) >> 3
+    shift = 2 * n if cy in (22, 23) else 0
+    line = ((y - 36) & 7) * 2
+    for x in range(32, 352):
+        xs = x - 32 + shift
+        cx = (xs >> 3) % 40
+        h = cx * 7 + cy * 13
+        row[x] = 14 if ((h * 0x9e37) >> ((xs & 7) + line)) & 1 else 6
+    sx = 24 + (n * 3) % 300
+    sy = 50 + (n * 2) % 150
+    if sy <= y < sy + 21:
+        for x in range(sx, sx + 24):
+            if ((x - sx) ^ (y - sy)) & 4 == 0:
+                row[x] = 2
+    return bytes(row)
+
+
+def scene(n):
+    return b"".join(scene_row(y, n) for y in range(HEIGHT))
+
+
+def free_port():
+    probe = socket.socket()
+    probe.bind(("127.0.0.1", 0))
+    port = probe.getsockname()[1]
+    probe.close()
+    return port
+
+
+def connect(port, timeout, buffer):
+    """buffer limits the receive window, so a slow reader pushes back
+    within a few frames instead of after megabytes."""
+    deadline = time.monotonic() + timeout
+    while True:
+        sock = socket.socket()
+        if buffer:
+            sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, buffer)
+        sock.settimeout(0.5)
+        try:
+            sock.connect(("127.0.0.1", port))
+            return sock
+        except OSError:
+            sock.close()
+            if time.monotonic() > deadline:
+                raise
+            time.sleep(0.05)
+
+
+def expect(condition, message):
+    if not condition:
+        raise AssertionError(message)
+    print("ok: " + message)
+
+
+def run(bench, frames, divider, helper, throttle_ms, check_every,
+        helper_after=0):
+    port = free_port()
+    command = [bench, "--port", str(port), "--frames", str(frames),
+               "--divider", str(divider)]
+    if not helper:
+        command.append("--no-helper")
+    if helper_after:
+        command += ["--helper-after", str(helper_after)]
+    process = subprocess.Popen(command, stdout=subprocess.PIPE,
+                               universal_newlines=True)
+    sock = connect(port, 5.0, 32768 if throttle_ms else 0)
+    sock.settimeout(10.0)
+    decoder = stream_viewer.Decoder()
+    received = []
+    checked = 0
+    wrong = []
+    for kind, body in stream_viewer.messages(sock):
+        if not decoder.message(kind, body):
+            continue
+        received.append(decoder.frame)
+        if (len(received) - 1) % check_every == 0:
+            checked += 1
+            if bytes(decoder.pixels) != scene(decoder.frame):
+                wrong.append(decoder.frame)
+        if throttle_ms:
+            time.sleep(throttle_ms / 1000.0)
+    if decoder.frame is not None and received[-1] != received[
+            (len(received) - 1) // check_every * check_every]:
+        checked += 1
+        if bytes(decoder.pixels) != scene(decoder.frame):
+            wrong.append(decoder.frame)
+    sock.close()
+    report = process.communicate(timeout=30)[0]
+    if process.returncode != 0:
+        raise AssertionError("bench failed:\n" + report)
+
+    name = "divider {}, {}{}".format(
+        divider, "helper from frame {}".format(helper_after) if helper_after
+        else "helper" if helper else "no helper",
+        ", viewer {} ms/frame".format(throttle_ms) if throttle_ms else "")
+    expect(received and received[0] == 0 and not wrong,
+           "{}: {} of {} frames decoded as drawn".format(
+               name, checked, len(received)))
+    expect(all(b > a and (b - a) % divider == 0
+               for a, b in zip(received, received[1:])),
+           "{}: frames in order".format(name))
+    expect(decoder.palette[6] == (0x31, 0x28, 0x7b),
+           "{}: palette blue".format(name))
+    return name, len(received), report
+
+
+def field(report, pattern):
+    match = re.search(pattern, report)
+    if not match:
+        raise AssertionError("no {!r} in:\n{}".format(pattern, report))
+    return match.groups()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--bench", default=os.path.join(
+        HERE, "bmc64-stream-bench"))
+    parser.add_argument("--frames", type=int, default=500,
+                        help="frames per run, 50 a second (default: 500)")
+    parser.add_argument("--check-every", type=int, default=25,
+                        help="compare every n'th decoded frame with the "
+                        "scene (default: 25)")
+    arguments = parser.parse_args()
+    if not os.path.exists(arguments.bench):
+        raise SystemExit("build it first: make -C {} stream-bench".format(
+            HERE))
+
+    rows = []
+    # The third run hands the encoder from the network task to the
+    # helper halfway through, and checks every frame around it.
+    for divider, helper, throttle, after in (
+            (1, True, 0, 0), (2, True, 0, 0), (1, False, 0, 0),
+            (1, True, 0, arguments.frames // 2), (1, True, 60, 0)):
+        name, received, report = run(arguments.bench, arguments.frames,
+                                     divider, helper, throttle,
+                                     1 if after else arguments.check_every,
+                                     after)
+        encoded, drops = field(report, r"encoded (\d+), .* network (\d+)")
+        capture_drops = field(report, r"dropped at capture (\d+)")[0]
+        per_frame, rate = field(report, r"(\d+) bytes/frame, ([\d.]+) KB/s")
+        mean, worst = field(report, r"stream: mean ([\d.]+) us, "
+                            r"max ([\d.]+) us")
+        encode = field(report, r"encode: mean ([\d.]+) us")[0]
+        helper_cpu, task_cpu = field(report, r"helper ([\d.]+)%, "
+                                     r"network task ([\d.]+)%")
+        if throttle:
+            expect(int(drops) > 0, name + ": frames dropped, not queued")
+        expect(float(worst) < 1000, name + ": emulation thread never waits")
+        rows.append((name, received, int(capture_drops) + int(drops),
+                     per_frame, rate, mean, worst, encode, helper_cpu,
+                     task_cpu))
+
+    print()
+    print("{} frames of a 384x272 C64 display at 50 Hz:".format(
+        arguments.frames))
+    print("{:37} | {:>5} | {:>5} | {:>6} | {:>7} | {:>15} | {:>6} | {:>5} "
+          "| {:>5}".format("run", "sent", "drops", "B/fr", "KB/s",
+                           "emu us mean/max", "enc us", "help%", "net%"))
+    for row in rows:
+        print("{:37} | {:5d} | {:5d} | {:>6} | {:>7} | {:>7}/{:<7} | {:>6} "
+              "| {:>5} | {:>5}".format(*row))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,177 @@
+#!/usr/bin/env python3
+"""Check and time the fast BASIC type in against the headless binaries.
+
+Types listings into a booted machine with --type-in (tokenized straight
+into memory) and --type-keys (typed through the keyboard buffer, so the
+ROM tokenizes it) and compares the programs that end up in BASIC memory.
+"""
+
+import argparse
+import os
+import re
+import subprocess
+import sys
+import tempfile
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..", "..")
+
+# Lines a keyboard can enter: under 80 characters and all lower case
+# outside strings, as typed on the machine. Strings are mixed case.
+V2_LINES = [
+    '10 rem type in test',
+    '20 print "Hello, World";:print chr$(13)',
+    '30 for i=1 to 10 step 2:?i;:next i',
+    '40 data 1,2,"Three",four:read a,b,c$,d$',
+    '50 if a<>b then gosub 100:on a goto 60,70',
+    '60 poke 53280,peek(53281) and 15:sys 64738',
+    '70 a=abs(-1)+int(2.5)+sgn(3)+sqr(4)+rnd(0)+len("x")',
+    '80 b$=left$("Left",2)+mid$("Middle",2,1)+right$("Right",1)',
+    '90 open 1,8,15,"I0":print#1,"v":get#1,x$:close 1',
+    '100 def fn f(x)=x*x:dim d(10):restore:return',
+    '110 ? tab(5) spc(2) not a or b:wait 198,1:end',
+]
+
+C128_LINES = [
+    '120 do:loop until a=1:while b:wend',
+    '130 color 0,1:graphic 1,1:draw 1,10,10 to 20,20',
+    '140 dopen#1,"File",w:dclose#1:directory',
+    '150 sprite 1,1,2:movspr 1,100,100:fast:slow',
+    '160 trap 200:resume next:help:key 1,"Run"',
+]
+
+
+def shout(line):
+    """Upper case outside strings and REMs, as a listing copied from a
+    magazine that kept its strings' case would be."""
+    code, rem, comment = line.partition(" rem ")
+    parts = code.split('"')
+    for i in range(0, len(parts), 2):
+        parts[i] = parts[i].upper()
+    return '"'.join(parts) + rem.upper() + comment
+
+
+def run(binary, boot, path, keys, seconds):
+    option = "--type-keys" if keys else "--type-in"
+    output = subprocess.run(
+        [binary, "--boot", boot, "--seconds", str(seconds), option, path],
+        stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True, check=True).stdout
+    result = {}
+    for line in output.splitlines():
+        match = re.match(r"basic +\$(\w+)-\$(\w+) (\w+)$", line)
+        if match:
+            result["basic"] = match.group(3)
+            result["bytes"] = int(match.group(2), 16) - int(match.group(1), 16)
+        match = re.match(r"Type in: tokenized (\d+) lines .* in (\d+) us", line)
+        if match:
+            result["lines"] = int(match.group(1))
+            result["us"] = int(match.group(2))
+        match = re.match(r"Type in: (\d+) bytes in (\d+) ms \((\d+) frames\)",
+                         line)
+        if match:
+            result["ms"] = int(match.group(2))
+            result["frames"] = int(match.group(3))
+    if "basic" not in result:
+        raise SystemExit("no BASIC report from {}:\n{}".format(binary, output))
+    return result
+
+
+def write_listing(directory, name, lines):
+    path = os.path.join(directory, name)
+    with open(path, "w") as listing:
+        listing.write("\n".join(lines) + "\n")
+    return path
+
+
+def big_listing(lines, size):
+    """Numbered copies of lines, about size bytes of text in all."""
+    listing = []
+    total = 0
+    number = 10
+    while total < size:
+        for line in lines:
+            text = "{} {}".format(number, line.split(" ", 1)[1])
+            listing.append(text)
+            total += len(text) + 1
+            number += 10
+    return listing
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--boot", default=os.path.join(
+        ROOT, "third_party", "vice-3.3", "data"))
+    parser.add_argument("--size", type=int, default=10 * 1024,
+                        help="bytes in the timed listing (default: 10240)")
+    arguments = parser.parse_args()
+
+    failed = 0
+
+    def expect(condition, message):
+        nonlocal failed
+        print(("ok: " if condition else "FAILED: ") + message)
+        if not condition:
+            failed += 1
+
+    with tempfile.TemporaryDirectory() as directory:
+        for machine, lines in (("C64", V2_LINES),
+                               ("C128", V2_LINES + C128_LINES)):
+            binary = os.path.join(HERE, "bmc64-headless-" + machine)
+            if not os.path.exists(binary):
+                raise SystemExit("build it first: ./make_headless.sh")
+
+            lower = write_listing(directory, "lower.txt", lines)
+            upper = write_listing(directory, "upper.txt",
+                                  [line.upper() for line in lines])
+            mixed = write_listing(directory, "mixed.txt",
+                                  [shout(line) for line in lines])
+            plain = write_listing(directory, "plain.txt",
+                                  [line.lower() for line in lines])
+
+            typed = run(binary, arguments.boot, lower, True, 30)
+            tokenized = run(binary, arguments.boot, lower, False, 10)
+            expect(tokenized["basic"] == typed["basic"],
+                   "{}: tokenized like the ROM ({} bytes)".format(
+                       machine, tokenized["bytes"]))
+            expect(run(binary, arguments.boot, mixed, False, 10)["basic"] ==
+                   tokenized["basic"],
+                   "{}: upper case keywords, strings kept".format(machine))
+            expect(run(binary, arguments.boot, upper, False, 10)["basic"] ==
+                   run(binary, arguments.boot, plain, False, 10)["basic"],
+                   "{}: all upper case listing".format(machine))
+
+            # A line number alone deletes that line, if there is one.
+            deleting = write_listing(directory, "delete.txt",
+                                     lines + ["20", "40 ", "45"])
+            kept = write_listing(directory, "kept.txt",
+                                 [line for line in lines
+                                  if line.split(" ", 1)[0] not in
+                                  ("20", "40")])
+            tokenized = run(binary, arguments.boot, deleting, False, 10)
+            expect(tokenized["basic"] ==
+                   run(binary, arguments.boot, deleting, True, 30)["basic"]
+                   and tokenized["basic"] ==
+                   run(binary, arguments.boot, kept, False, 10)["basic"],
+                   "{}: line numbers alone delete lines".format(machine))
+
+            # The timed listing.
+            big = write_listing(directory, "big.txt",
+                                big_listing(lines, arguments.size))
+            size = os.path.getsize(big)
+            tokenized = run(binary, arguments.boot, big, False, 10)
+            typed = run(binary, arguments.boot, big, True, 300)
+            expect(tokenized["basic"] == typed["basic"],
+                   "{}: {} byte listing, both ways the same".format(
+                       machine, size))
+            print("{}: {} bytes, {} lines: tokenized in {} us, typed in "
+                  "{} frames ({:.1f} s emulated, {} ms here)".format(
+                      machine, size, tokenized["lines"], tokenized["us"],
+                      typed["frames"], typed["frames"] / 50.0, typed["ms"]))
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Replay one C128 session through both VDC drawing paths and compare.
+
+Runs the headless C128 twice on the same input: once drawing VDC lines
+straight away, as the Pi does until the helper core shows up, and once
+with --vdc-helper, which hands them to a second thread the way the
+helper core does. Every frame drawn must be the same both ways, and so
+must the last VDC frame, byte for byte.
+
+The input is a BASIC program typed in through the keyboard buffer that
+works the VDC's registers and RAM: 80 column text with attributes,
+scrolling (block copies), clears (block fills), writes through the data
+register, smooth scrolling, bitmap and double pixel modes and colours.
+--replay runs an input recording from the Pi (input.bmr) instead.
+"""
+
+import argparse
+import filecmp
+import os
+import subprocess
+import sys
+import tempfile
+
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+ROOT = os.path.join(HERE, "..", "..")
+
+# SYS 52684,value,register is the editor's routine that writes a VDC
+# register.
+PROGRAM = [
+    '10 graphic 5:print chr$(147);',
+    '20 for i=1 to 40:print i;chr$(18);"reverse";chr$(146);'
+    '" scrolling the eighty column screen";:next',
+    '30 for i=0 to 15:color 5,i+1:print "colour";i;:next:print',
+    '40 sys 52684,0,18:sys 52684,0,19:for i=0 to 255:sys 52684,i,31:next',
+    '50 for i=0 to 7:sys 52684,i,24:sleep 1:next:sys 52684,0,24',
+    '60 sys 52684,199,25:sleep 1:sys 52684,40,1:sys 52684,87,25:sleep 1:'
+    'sys 52684,71,25:sys 52684,80,1',
+    '70 for i=0 to 15:sys 52684,i*16+15-i,26:next',
+    '80 print chr$(147);"done"',
+    'run',
+]
+
+
+def run(binary, boot, workload, seconds, helper, dump):
+    command = [binary, "--boot", boot, "--check", "1", "--dump-vdc", dump]
+    # The helper path never uses the raster cache, so the direct one
+    # must not either; the cache has its own bench.
+    command.append("--vdc-helper" if helper else "--no-raster-cache")
+    if seconds:
+        command += ["--seconds", str(seconds)]
+    command += workload
+    output = subprocess.run(
+        command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True).stdout
+    checks = [line for line in output.splitlines()
+              if line.startswith("check ")]
+    if not checks:
+        raise SystemExit("no frames from {}:\n{}".format(binary, output))
+    deferred = "Drawing lines on helper core." in output
+    return checks, deferred
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("--boot", default=os.path.join(
+        ROOT, "third_party", "vice-3.3", "data"))
+    parser.add_argument("--replay", help="input recording to use instead "
+                        "of the built in program")
+    parser.add_argument("--seconds", type=float,
+                        help="emulated seconds (default: 40, or the "
+                        "recording's length)")
+    arguments = parser.parse_args()
+
+    binary = os.path.join(HERE, "bmc64-headless-C128")
+    if not os.path.exists(binary):
+        raise SystemExit("build it first: ./make_headless.sh")
+
+    failed = 0
+
+    def expect(condition, message):
+        nonlocal failed
+        print(("ok: " if condition else "FAILED: ") + message)
+        if not condition:
+            failed += 1
+
+    with tempfile.TemporaryDirectory() as directory:
+        seconds = arguments.seconds
+        if arguments.replay:
+            workload = ["--replay", arguments.replay]
+        else:
+            listing = os.path.join(directory, "vdc.txt")
+            with open(listing, "w") as f:
+                f.write("\n".join(PROGRAM) + "\n")
+            workload = ["--type-keys", listing]
+            seconds = seconds or 40
+
+        direct_dump = os.path.join(directory, "direct.pgm")
+        helper_dump = os.path.join(directory, "helper.pgm")
+        direct, direct_deferred = run(binary, arguments.boot, workload,
+                                      seconds, False, direct_dump)
+        helper, helper_deferred = run(binary, arguments.boot, workload,
+                                      seconds, True, helper_dump)
+
+        expect(not direct_deferred and helper_deferred,
+               "lines drawn directly, then on the helper thread")
+        differ = [(a, b) for a, b in zip(direct, helper) if a != b]
+        expect(len(direct) == len(helper) and not differ,
+               "{} frames the same both ways".format(len(direct)))
+        for a, b in differ[:5]:
+            print("  direct: {}\n  helper: {}".format(a, b))
+        expect(filecmp.cmp(direct_dump, helper_dump, shallow=False),
+               "last VDC frame the same byte for byte")
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,8 +6,14 @@ import socket
 import struct
 import sys
 import time
+import zlib
 
 
+TELNET_IAC = 255
+TELNET_NOP = 241
+TELNET_WILL = 251
+TELNET_ECHO = 1
+TELNET_SGA = 3
 DELETE = b"\x14"
 WIDTH_40 = b"4"
 BURST_SIZE = 2048
@@ -45,6 +51,61 @@ def print_tcp_info(connection, label):
         label, values[0], values[12], values[15]))
 
 
+def echo(connection):
+    """Stand in for a TCP echo service: return every byte until the
+    peer hangs up, then report the rate."""
+    total = 0
+    start = None
+    while True:
+        data = connection.recv(65536)
+        if not data:
+            break
+        if start is None:
+            start = time.monotonic()
+        connection.sendall(data)
+        total += len(data)
+    elapsed = time.monotonic() - start if start is not None else 0.0
+    print("echoed: {} bytes in {:.2f} s, {:.0f} bytes/s".format(
+        total, elapsed, total / elapsed if elapsed else 0.0))
+
+
+def bbs_stream(size):
+    """Synthetic BBS traffic: option offers up front, then screens of
+    colour codes and text with PETSCII pi (0xff, doubled on the wire) and
+    the odd IAC NOP mixed in. Returns the wire bytes and the exactly size
+    bytes the C64 should receive."""
+    wire = bytearray([TELNET_IAC, TELNET_WILL, TELNET_ECHO,
+                      TELNET_IAC, TELNET_WILL, TELNET_SGA])
+    payload = bytearray()
+    line = 0
+    while len(payload) < size:
+        text = b"\x1b[1;3%dmMSG %06d FROM SYSOP: THE QUICK BROWN FOX " \
+               b"JUMPS OVER THE LAZY DOG \x05" % (line % 8, line)
+        if line % 7 == 0:
+            text += b"\xff=3.14 "
+        text = (text + b"\r\n")[:size - len(payload)]
+        payload += text
+        wire += text.replace(b"\xff", b"\xff\xff")
+        if line % 50 == 0:
+            wire += bytes([TELNET_IAC, TELNET_NOP])
+        line += 1
+    return bytes(wire), bytes(payload)
+
+
+def stream(connection, size):
+    wire, payload = bbs_stream(size)
+    print("stream: {} payload bytes crc32 {:08x}".format(
+        len(payload), zlib.crc32(payload)))
+    start = time.monotonic()
+    connection.sendall(wire)
+    # Keep the connection until the modem has taken everything.
+    connection.shutdown(socket.SHUT_WR)
+    while connection.recv(65536):
+        pass
+    elapsed = time.monotonic() - start
+    print("sent: {} wire bytes in {:.2f} s".format(len(wire), elapsed))
+
+
 def main():
     parser = argparse.ArgumentParser(description=__doc__)
     parser.add_argument("--host", default="0.0.0.0",
@@ -63,6 +124,17 @@ def main():
                              "remaining payload")
     parser.add_argument("--tcp-nodelay", action="store_true",
                         help="disable Nagle on the accepted TCP connection")
+    parser.add_argument("--echo", action="store_true",
+                        help="echo everything back instead of running the "
+                             "prompts, for tools/headless/modem_bench")
+    parser.add_argument("--connections", type=int, default=1,
+                        help="with --echo, serve this many connections one "
+                             "after another, for modem_bench --dials "
+                             "(default: 1)")
+    parser.add_argument("--bbs-stream", type=int, metavar="BYTES",
+                        help="send this many payload bytes of synthetic "
+                             "Telnet BBS traffic as fast as possible, for "
+                             "modem_bench --drain")
     arguments = parser.parse_args()
 
     listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
@@ -77,6 +149,17 @@ def main():
         if arguments.tcp_nodelay:
             connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
             print("TCP_NODELAY enabled")
+        if arguments.echo or arguments.bbs_stream:
+            if arguments.echo:
+                echo(connection)
+                for _ in range(arguments.connections - 1):
+                    with listener.accept()[0] as another:
+                        echo(another)
+            else:
+                stream(connection, arguments.bbs_stream)
+            listener.close()
+            print("complete")
+            return
         send_all(connection, b"BMC64 transport probe\r\nPRESS DEL: ")
         receive_exact(connection, DELETE, arguments.timeout)
 
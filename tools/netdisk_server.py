@@ -0,0 +1,234 @@
+#!/usr/bin/env python3
+"""Serve a directory of disk images to BMC64's NET: volume (see NETDISK.md).
+
+    python3 netdisk_server.py ~/c64/disks
+    python3 netdisk_server.py --port 6581 --read-only --latency 20 ~/c64
+"""
+
+import argparse
+import os
+import socketserver
+import struct
+import sys
+import threading
+import time
+
+
+DEFAULT_PORT = 6581
+
+STAT = 0x01
+LIST = 0x02
+READ = 0x03
+WRITE = 0x04
+
+OK = 0
+UNKNOWN_COMMAND = 1
+BAD_REQUEST = 2
+NOT_FOUND = 3
+READ_ONLY = 4
+FAILED = 5
+
+HEADER = struct.Struct("<BBHI")
+MAX_BODY = 0x10000
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.requests = {}
+        self.bytes_read = 0
+        self.bytes_written = 0
+
+    def count(self, command, read=0, written=0):
+        with self.lock:
+            self.requests[command] = self.requests.get(command, 0) + 1
+            self.bytes_read += read
+            self.bytes_written += written
+
+    def snapshot(self):
+        with self.lock:
+            return dict(self.requests), self.bytes_read, self.bytes_written
+
+
+class RequestError(Exception):
+    def __init__(self, status):
+        super().__init__(status)
+        self.status = status
+
+
+class Handler(socketserver.BaseRequestHandler):
+    def setup(self):
+        self.config = self.server.config
+
+    def receive(self, length):
+        data = b""
+        while len(data) < length:
+            chunk = self.request.recv(length - len(data))
+            if not chunk:
+                raise EOFError
+            data += chunk
+        return data
+
+    def local(self, name):
+        """The file for a NET: path, or RequestError."""
+        try:
+            name = name.decode("utf-8")
+        except UnicodeDecodeError:
+            raise RequestError(BAD_REQUEST)
+        parts = [part for part in name.split("/") if part not in ("", ".")]
+        if ".." in parts:
+            raise RequestError(BAD_REQUEST)
+        return os.path.join(self.config.root, *parts)
+
+    def stat(self, body):
+        path = self.local(body)
+        if os.path.isdir(path):
+            return struct.pack("<BBHI", 1, 0, 0, 0)
+        if not os.path.isfile(path):
+            raise RequestError(NOT_FOUND)
+        writable = not self.config.read_only and os.access(path, os.W_OK)
+        return struct.pack("<BBHI", 0, 1 if writable else 0, 0,
+                           os.path.getsize(path))
+
+    def list(self, body):
+        path = self.local(body)
+        if not os.path.isdir(path):
+            raise RequestError(NOT_FOUND)
+        reply = b""
+        for name in sorted(os.listdir(path), key=str.lower):
+            encoded = name.encode("utf-8")
+            if name.startswith(".") or len(encoded) > 255:
+                continue
+            full = os.path.join(path, name)
+            directory = os.path.isdir(full)
+            size = 0 if directory else os.path.getsize(full)
+            entry = struct.pack("<IBB", size, 1 if directory else 0,
+                                len(encoded)) + encoded
+            if len(reply) + len(entry) > MAX_BODY:
+                break
+            reply += entry
+        return reply
+
+    def read(self, body):
+        if len(body) < 8:
+            raise RequestError(BAD_REQUEST)
+        offset, length = struct.unpack_from("<II", body)
+        if length > MAX_BODY:
+            raise RequestError(BAD_REQUEST)
+        path = self.local(body[8:])
+        if not os.path.isfile(path):
+            raise RequestError(NOT_FOUND)
+        with open(path, "rb") as image:
+            image.seek(offset)
+            data = image.read(length)
+        self.server.stats.count(READ, read=len(data))
+        return data
+
+    def write(self, body):
+        if len(body) < 8:
+            raise RequestError(BAD_REQUEST)
+        offset, path_length = struct.unpack_from("<IH", body)
+        if len(body) < 8 + path_length:
+            raise RequestError(BAD_REQUEST)
+        path = self.local(body[8:8 + path_length])
+        data = body[8 + path_length:]
+        if not os.path.isfile(path):
+            raise RequestError(NOT_FOUND)
+        if self.config.read_only:
+            raise RequestError(READ_ONLY)
+        # Images keep their size.
+        if offset + len(data) > os.path.getsize(path):
+            raise RequestError(BAD_REQUEST)
+        try:
+            with open(path, "r+b") as image:
+                image.seek(offset)
+                image.write(data)
+        except PermissionError:
+            raise RequestError(READ_ONLY)
+        self.server.stats.count(WRITE, written=len(data))
+        return b""
+
+    def handle(self):
+        handlers = {STAT: self.stat, LIST: self.list, READ: self.read,
+                    WRITE: self.write}
+        if self.config.verbose:
+            print("{}: connected".format(self.client_address[0]))
+        try:
+            while True:
+                command, _, request_id, length = HEADER.unpack(
+                    self.receive(HEADER.size))
+                if length > MAX_BODY + 512:
+                    break
+                body = self.receive(length)
+                if self.config.latency:
+                    time.sleep(self.config.latency / 1000.0)
+                status = OK
+                reply = b""
+                try:
+                    handler = handlers.get(command)
+                    if handler is None:
+                        raise RequestError(UNKNOWN_COMMAND)
+                    reply = handler(body)
+                except RequestError as error:
+                    status = error.status
+                except OSError:
+                    status = FAILED
+                if command in (STAT, LIST):
+                    self.server.stats.count(command)
+                if self.config.verbose:
+                    print("{}: command {} id {} -> status {}, {} bytes".format(
+                        self.client_address[0], command, request_id, status,
+                        len(reply)))
+                self.request.sendall(HEADER.pack(command, status, request_id,
+                                                 len(reply)) + reply)
+        except (EOFError, ConnectionError):
+            pass
+        if self.config.verbose:
+            print("{}: disconnected".format(self.client_address[0]))
+
+
+class Server(socketserver.ThreadingTCPServer):
+    allow_reuse_address = True
+    daemon_threads = True
+
+    def __init__(self, config):
+        super().__init__((config.bind, config.port), Handler)
+        self.config = config
+        self.stats = Stats()
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__, formatter_class=argparse.RawTextHelpFormatter)
+    parser.add_argument("root", help="directory to serve")
+    parser.add_argument("--bind", default="0.0.0.0")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT,
+                        help="default: {}".format(DEFAULT_PORT))
+    parser.add_argument("--read-only", action="store_true",
+                        help="refuse writes")
+    parser.add_argument("--latency", type=float, default=0,
+                        help="milliseconds to wait before each reply, to "
+                             "stand in for a slow network")
+    parser.add_argument("--verbose", action="store_true")
+    config = parser.parse_args()
+    config.root = os.path.abspath(config.root)
+    if not os.path.isdir(config.root):
+        raise SystemExit("{} is not a directory".format(config.root))
+
+    server = Server(config)
+    print("serving {} on port {}".format(config.root, config.port))
+    sys.stdout.flush()
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    requests, read, written = server.stats.snapshot()
+    print("requests: stat {} list {} read {} write {}; {} bytes read, "
+          "{} written".format(requests.get(STAT, 0), requests.get(LIST, 0),
+                              requests.get(READ, 0), requests.get(WRITE, 0),
+                              read, written))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
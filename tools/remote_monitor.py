@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+"""Client for the BMC64 remote binary monitor (see REMOTE_MONITOR.md)."""
+
+import argparse
+import socket
+import struct
+import sys
+
+
+DEFAULT_PORT = 6510
+
+INFO = 0x01
+READ_MEMORY = 0x02
+WRITE_MEMORY = 0x03
+BANKS = 0x04
+REGISTERS = 0x05
+SET_REGISTER = 0x06
+ADD_CHECKPOINT = 0x07
+DELETE_CHECKPOINT = 0x08
+LIST_CHECKPOINTS = 0x09
+STOP = 0x0a
+CONTINUE = 0x0b
+STEP = 0x0c
+SNAPSHOT = 0x0d
+STOPPED = 0x80
+
+STATUS = ("ok", "unknown command", "bad request", "bad address",
+          "machine is running", "failed", "busy")
+
+COMPUTER = 0
+CURRENT_BANK = 0xffff
+OP_LOAD = 0x01
+OP_STORE = 0x02
+OP_EXEC = 0x04
+
+HEADER = struct.Struct("<BBHI")
+
+
+class MonitorError(Exception):
+    def __init__(self, command, status):
+        self.command = command
+        self.status = status
+        name = STATUS[status] if status < len(STATUS) else str(status)
+        super().__init__("command 0x{:02x}: {}".format(command, name))
+
+
+class RemoteMonitor:
+    """One connection. Requests are answered in order; Stopped events
+    that arrive in between are kept in events."""
+
+    def __init__(self, host, port=DEFAULT_PORT, timeout=10.0):
+        self.connection = socket.create_connection((host, port), timeout)
+        self.connection.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.next_id = 1
+        self.events = []
+
+    def close(self):
+        self.connection.close()
+
+    def __enter__(self):
+        return self
+
+    def __exit__(self, *unused):
+        self.close()
+
+    def _receive_exact(self, length):
+        chunks = []
+        while length > 0:
+            chunk = self.connection.recv(min(length, 1 << 20))
+            if not chunk:
+                raise ConnectionError("monitor closed the connection")
+            chunks.append(chunk)
+            length -= len(chunk)
+        return b"".join(chunks)
+
+    def _receive(self):
+        command, status, request_id, length = HEADER.unpack(
+            self._receive_exact(HEADER.size))
+        return command, status, request_id, self._receive_exact(length)
+
+    def send(self, command, body=b""):
+        """Sends a request without waiting; returns its id."""
+        request_id = self.next_id
+        self.next_id = self.next_id % 0xffff + 1
+        self.connection.sendall(
+            HEADER.pack(command, 0, request_id, len(body)) + body)
+        return request_id
+
+    def reply(self, request_id):
+        while True:
+            command, status, reply_id, body = self._receive()
+            if command == STOPPED and reply_id == 0:
+                self.events.append(decode_stopped(body))
+                continue
+            if reply_id != request_id:
+                raise RuntimeError("reply {} for request {}".format(
+                    reply_id, request_id))
+            if status != 0:
+                raise MonitorError(command, status)
+            return body
+
+    def request(self, command, body=b""):
+        return self.reply(self.send(command, body))
+
+    def wait_stopped(self, timeout=None):
+        """Returns the next Stopped event."""
+        if not self.events:
+            old = self.connection.gettimeout()
+            self.connection.settimeout(timeout)
+            try:
+                command, status, reply_id, body = self._receive()
+            finally:
+                self.connection.settimeout(old)
+            if command != STOPPED or reply_id != 0:
+                raise RuntimeError("unexpected reply 0x{:02x}".format(command))
+            self.events.append(decode_stopped(body))
+        return self.events.pop(0)
+
+    def info(self):
+        (version, stopped, _, machine, frame, pc, _,
+         clock) = struct.unpack("<HBBIIHHQ", self.request(INFO))
+        return {"version": version, "stopped": bool(stopped),
+                "machine": machine, "frame": frame, "pc": pc,
+                "clock": clock}
+
+    def read(self, start, length, bank=CURRENT_BANK, memspace=COMPUTER):
+        return self.request(READ_MEMORY, struct.pack(
+            "<BBHHI", memspace, 0, bank, start, length))
+
+    def write(self, start, data, bank=CURRENT_BANK, memspace=COMPUTER):
+        self.request(WRITE_MEMORY, struct.pack(
+            "<BBHH", memspace, 0, bank, start) + bytes(data))
+
+    def banks(self, memspace=COMPUTER):
+        body = self.request(BANKS, bytes([memspace]))
+        banks = {}
+        offset = 0
+        while offset < len(body):
+            number, length = struct.unpack_from("<HB", body, offset)
+            offset += 3
+            banks[body[offset:offset + length].decode()] = number
+            offset += length
+        return banks
+
+    def registers(self, memspace=COMPUTER):
+        body = self.request(REGISTERS, bytes([memspace]))
+        registers = []
+        offset = 0
+        while offset < len(body):
+            number, bits, flags, length, value = struct.unpack_from(
+                "<BBBBI", body, offset)
+            offset += 8
+            registers.append({"name": body[offset:offset + length].decode(),
+                              "id": number, "bits": bits, "flags": flags,
+                              "value": value})
+            offset += length
+        return registers
+
+    def set_register(self, register, value, memspace=COMPUTER):
+        self.request(SET_REGISTER, struct.pack(
+            "<BBHI", memspace, register, 0, value))
+
+    def add_checkpoint(self, start, end=None, ops=OP_EXEC, stop=True,
+                       memspace=COMPUTER):
+        body = self.request(ADD_CHECKPOINT, struct.pack(
+            "<BBBBHH", memspace, ops, 1 if stop else 0, 0, start,
+            start if end is None else end))
+        return struct.unpack("<I", body)[0]
+
+    def delete_checkpoint(self, number):
+        self.request(DELETE_CHECKPOINT, struct.pack("<I", number))
+
+    def checkpoints(self):
+        body = self.request(LIST_CHECKPOINTS)
+        result = []
+        for offset in range(0, len(body), 16):
+            (number, memspace, ops, stop, enabled, start, end,
+             hits) = struct.unpack_from("<IBBBBHHI", body, offset)
+            result.append({"number": number, "memspace": memspace,
+                           "ops": ops, "stop": bool(stop),
+                           "enabled": bool(enabled), "start": start,
+                           "end": end, "hits": hits})
+        return result
+
+    def stop(self):
+        self.request(STOP)
+
+    def resume(self):
+        self.request(CONTINUE)
+
+    def step(self, count=1, over=False):
+        self.request(STEP, struct.pack("<HB", count, 1 if over else 0))
+
+    def snapshot(self):
+        return self.request(SNAPSHOT)
+
+
+def decode_stopped(body):
+    memspace, _, pc, frame, clock = struct.unpack("<BBHIQ", body)
+    return {"memspace": memspace, "pc": pc, "frame": frame, "clock": clock}
+
+
+def number(text):
+    return int(text, 0)
+
+
+def hexdump(start, data):
+    for offset in range(0, len(data), 16):
+        row = data[offset:offset + 16]
+        print("{:04x}  {:<47}  {}".format(
+            (start + offset) & 0xffff, " ".join("{:02x}".format(b)
+                                                for b in row),
+            "".join(chr(b) if 32 <= b < 127 else "." for b in row)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("host", help="BMC64 address")
+    parser.add_argument("--port", type=int, default=DEFAULT_PORT,
+                        help="remote_monitor port from cmdline.txt "
+                             "(default: {})".format(DEFAULT_PORT))
+    parser.add_argument("--memspace", type=int, default=COMPUTER,
+                        help="0 for the computer, 1-4 for drives 8-11")
+    parser.add_argument("--bank", default=None,
+                        help="bank name for read and write (default: the "
+                             "monitor's current bank)")
+    commands = parser.add_subparsers(dest="command", required=True)
+    commands.add_parser("info")
+    read = commands.add_parser("read")
+    read.add_argument("start", type=number)
+    read.add_argument("length", type=number)
+    read.add_argument("--output", help="write the bytes to a file")
+    write = commands.add_parser("write")
+    write.add_argument("start", type=number)
+    write.add_argument("bytes", type=number, nargs="+")
+    commands.add_parser("banks")
+    commands.add_parser("regs")
+    setreg = commands.add_parser("setreg")
+    setreg.add_argument("name")
+    setreg.add_argument("value", type=number)
+    brk = commands.add_parser("break")
+    brk.add_argument("start", type=number)
+    brk.add_argument("end", type=number, nargs="?")
+    brk.add_argument("--ops", default="x",
+                     help="any of l (load), s (store), x (exec)")
+    brk.add_argument("--trace", action="store_true",
+                     help="count hits without stopping")
+    delete = commands.add_parser("delete")
+    delete.add_argument("number", type=number)
+    commands.add_parser("list")
+    commands.add_parser("stop")
+    commands.add_parser("cont")
+    step = commands.add_parser("step")
+    step.add_argument("count", type=number, nargs="?", default=1)
+    step.add_argument("--over", action="store_true")
+    snapshot = commands.add_parser("snapshot")
+    snapshot.add_argument("output")
+    arguments = parser.parse_args()
+
+    with RemoteMonitor(arguments.host, arguments.port) as monitor:
+        bank = CURRENT_BANK
+        if arguments.bank is not None:
+            banks = monitor.banks(arguments.memspace)
+            if arguments.bank not in banks:
+                raise SystemExit("banks are: " + " ".join(banks))
+            bank = banks[arguments.bank]
+        space = arguments.memspace
+        command = arguments.command
+        if command == "info":
+            for key, value in monitor.info().items():
+                print("{}: {}".format(key, value))
+        elif command == "read":
+            data = monitor.read(arguments.start, arguments.length, bank,
+                                space)
+            if arguments.output:
+                with open(arguments.output, "wb") as output:
+                    output.write(data)
+            else:
+                hexdump(arguments.start, data)
+        elif command == "write":
+            monitor.write(arguments.start, arguments.bytes, bank, space)
+        elif command == "banks":
+            for name, bank_number in monitor.banks(space).items():
+                print("{:3} {}".format(bank_number, name))
+        elif command == "regs":
+            for register in monitor.registers(space):
+                print("{:>4} {:0{}x}".format(register["name"],
+                                             register["value"],
+                                             (register["bits"] + 3) // 4))
+        elif command == "setreg":
+            registers = {r["name"].lower(): r["id"]
+                         for r in monitor.registers(space)}
+            if arguments.name.lower() not in registers:
+                raise SystemExit("registers are: " + " ".join(registers))
+            monitor.set_register(registers[arguments.name.lower()],
+                                 arguments.value, space)
+        elif command == "break":
+            ops = ((OP_LOAD if "l" in arguments.ops else 0) |
+                   (OP_STORE if "s" in arguments.ops else 0) |
+                   (OP_EXEC if "x" in arguments.ops else 0))
+            print(monitor.add_checkpoint(arguments.start, arguments.end, ops,
+                                         not arguments.trace, space))
+        elif command == "delete":
+            monitor.delete_checkpoint(arguments.number)
+        elif command == "list":
+            for cp in monitor.checkpoints():
+                print("{:3} {:04x}-{:04x} {}{}{} {} hits {}".format(
+                    cp["number"], cp["start"], cp["end"],
+                    "l" if cp["ops"] & OP_LOAD else "-",
+                    "s" if cp["ops"] & OP_STORE else "-",
+                    "x" if cp["ops"] & OP_EXEC else "-",
+                    "stop" if cp["stop"] else "trace", cp["hits"]))
+        elif command == "stop":
+            monitor.stop()
+            print(monitor.wait_stopped(5.0))
+        elif command == "cont":
+            monitor.resume()
+        elif command == "step":
+            monitor.step(arguments.count, arguments.over)
+            print(monitor.wait_stopped(5.0))
+        elif command == "snapshot":
+            data = monitor.snapshot()
+            with open(arguments.output, "wb") as output:
+                output.write(data)
+            print("{} bytes".format(len(data)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
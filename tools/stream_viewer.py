@@ -0,0 +1,275 @@
+#!/usr/bin/env python3
+"""Viewer for the BMC64 frame stream (see FRAME_STREAM.md)."""
+
+import argparse
+import os
+import socket
+import struct
+import sys
+import time
+
+
+DEFAULT_PORT = 6464
+
+PALETTE = 0x01
+FRAME = 0x02
+KEY_FRAME = 0x01
+
+HEADER = struct.Struct("<BBHI")
+PALETTE_HEADER = struct.Struct("<HH")
+FRAME_HEADER = struct.Struct("<IHHHBB")
+ROW_HEADER = struct.Struct("<HHHH")
+
+
+class StreamError(Exception):
+    pass
+
+
+def unpack_span(data, count):
+    """Undo the run length code: a control byte below 128 is followed by
+    that many plus one literal bytes, one from 128 up by a byte repeated
+    that many less 125 times."""
+    out = bytearray()
+    at = 0
+    while at < len(data):
+        control = data[at]
+        if control < 128:
+            out += data[at + 1:at + 2 + control]
+            at += 2 + control
+        else:
+            out += data[at + 1:at + 2] * (control - 125)
+            at += 2
+    if len(out) != count:
+        raise StreamError("span decodes to {} pixels, not {}".format(
+            len(out), count))
+    return out
+
+
+class Decoder:
+    """Keeps the picture the messages so far describe: the width, height,
+    indexed pixels and the palette as RGB triples."""
+
+    def __init__(self):
+        self.width = 0
+        self.height = 0
+        self.pixels = bytearray()
+        self.palette = [(0, 0, 0)] * 256
+        self.frame = None
+        self.key = False
+        self.rows = 0
+
+    def message(self, kind, body):
+        """Applies one message. True when it completed a frame."""
+        if kind == PALETTE:
+            count = PALETTE_HEADER.unpack_from(body)[0]
+            for index in range(min(count, 256)):
+                at = PALETTE_HEADER.size + index * 3
+                self.palette[index] = tuple(body[at:at + 3])
+            return False
+        if kind != FRAME:
+            return False
+        frame, width, height, rows, flags, _ = FRAME_HEADER.unpack_from(body)
+        self.key = bool(flags & KEY_FRAME)
+        if self.key:
+            self.width = width
+            self.height = height
+            self.pixels = bytearray(width * height)
+        elif (width, height) != (self.width, self.height):
+            raise StreamError("delta frame {} without a key frame".format(
+                frame))
+        at = FRAME_HEADER.size
+        for _ in range(rows):
+            y, x, count, length = ROW_HEADER.unpack_from(body, at)
+            at += ROW_HEADER.size
+            if y >= height or x + count > width:
+                raise StreamError("span {},{} +{} in {}x{}".format(
+                    x, y, count, width, height))
+            start = y * width + x
+            self.pixels[start:start + count] = unpack_span(
+                body[at:at + length], count)
+            at += length
+        self.frame = frame
+        self.rows = rows
+        return True
+
+    def ppm(self):
+        rgb = bytearray(self.width * self.height * 3)
+        for channel in range(3):
+            table = bytes(colour[channel] for colour in self.palette)
+            rgb[channel::3] = self.pixels.translate(table)
+        return b"P6\n%d %d\n255\n" % (self.width, self.height) + rgb
+
+
+def read_exactly(sock, length):
+    data = bytearray()
+    while len(data) < length:
+        chunk = sock.recv(length - len(data))
+        if not chunk:
+            return None
+        data += chunk
+    return bytes(data)
+
+
+def messages(sock):
+    """Yields (type, body) until the stream ends."""
+    while True:
+        header = read_exactly(sock, HEADER.size)
+        if header is None:
+            return
+        kind, _, _, length = HEADER.unpack(header)
+        body = read_exactly(sock, length)
+        if body is None:
+            return
+        yield kind, body
+
+
+class Stats:
+    def __init__(self, divider):
+        self.divider = divider
+        self.start = time.monotonic()
+        self.frames = 0
+        self.key_frames = 0
+        self.missed = 0
+        self.bytes = 0
+        self.rows = 0
+        self.last = None
+
+    def frame(self, decoder, length):
+        self.frames += 1
+        self.key_frames += decoder.key
+        self.rows += decoder.rows
+        if self.last is not None:
+            gap = (decoder.frame - self.last) // self.divider - 1
+            self.missed += max(gap, 0)
+        self.last = decoder.frame
+
+    def report(self):
+        seconds = max(time.monotonic() - self.start, 1e-6)
+        return ("{} frames ({} key) in {:.1f} s, {:.1f} fps, {} missed, "
+                "{:.1f} KB/s, {:.0f} bytes and {:.1f} rows per frame".format(
+                    self.frames, self.key_frames, seconds,
+                    self.frames / seconds, self.missed,
+                    self.bytes / 1024.0 / seconds,
+                    self.bytes / max(self.frames, 1),
+                    self.rows / max(self.frames, 1)))
+
+
+def connect(address):
+    host, _, port = address.partition(":")
+    return socket.create_connection((host, int(port or DEFAULT_PORT)))
+
+
+def run_text(sock, arguments):
+    if arguments.dump:
+        os.makedirs(arguments.dump, exist_ok=True)
+    decoder = Decoder()
+    stats = Stats(arguments.divider)
+    for kind, body in messages(sock):
+        stats.bytes += HEADER.size + len(body)
+        if not decoder.message(kind, body):
+            continue
+        stats.frame(decoder, len(body))
+        if arguments.dump and stats.frames % arguments.dump_every == 0:
+            name = os.path.join(arguments.dump,
+                                "frame{:06d}.ppm".format(decoder.frame))
+            with open(name, "wb") as out:
+                out.write(decoder.ppm())
+        if arguments.verbose:
+            print("frame {} {}, {} rows, {} bytes".format(
+                decoder.frame, "key" if decoder.key else "delta",
+                decoder.rows, len(body)))
+        if arguments.frames and stats.frames >= arguments.frames:
+            break
+        if arguments.throttle:
+            time.sleep(arguments.throttle / 1000.0)
+    print(stats.report())
+
+
+def run_window(sock, arguments):
+    import threading
+    import tkinter
+
+    root = tkinter.Tk()
+    root.title("BMC64 " + arguments.address)
+    label = tkinter.Label(root, bd=0)
+    label.pack()
+    latest = {}
+    lock = threading.Lock()
+
+    # Decoding runs beside the window so a slow repaint only skips
+    # pictures, never messages.
+    def receive():
+        decoder = Decoder()
+        stats = Stats(arguments.divider)
+        for kind, body in messages(sock):
+            stats.bytes += HEADER.size + len(body)
+            if decoder.message(kind, body):
+                stats.frame(decoder, len(body))
+                with lock:
+                    latest["ppm"] = decoder.ppm()
+                    latest["stats"] = stats.report()
+        with lock:
+            latest["done"] = True
+
+    def refresh():
+        with lock:
+            ppm = latest.pop("ppm", None)
+            status = latest.get("stats")
+            done = latest.get("done")
+        if ppm is not None:
+            image = tkinter.PhotoImage(data=ppm, format="PPM")
+            if arguments.scale > 1:
+                image = image.zoom(arguments.scale)
+            label.configure(image=image)
+            label.image = image
+        if status:
+            root.title("BMC64 " + arguments.address + " - " + status)
+        if done:
+            print(status or "no frames")
+            root.destroy()
+            return
+        root.after(15, refresh)
+
+    threading.Thread(target=receive, daemon=True).start()
+    refresh()
+    root.mainloop()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument("address", help="host[:port], port {} by default"
+                        .format(DEFAULT_PORT))
+    parser.add_argument("--scale", type=int, default=2,
+                        help="window zoom (default: 2)")
+    parser.add_argument("--stats", action="store_true",
+                        help="no window, only decode and print statistics")
+    parser.add_argument("--frames", type=int, default=0,
+                        help="stop after this many frames")
+    parser.add_argument("--divider", type=int, default=1,
+                        help="the frame_stream_divider BMC64 runs with, "
+                        "to count missed frames (default: 1)")
+    parser.add_argument("--dump", metavar="DIR",
+                        help="write frames as PPM files to DIR")
+    parser.add_argument("--dump-every", type=int, default=1,
+                        help="with --dump, every n'th frame (default: 1)")
+    parser.add_argument("--throttle", type=float, default=0,
+                        help="wait this many ms after each frame, to try "
+                        "a slow viewer")
+    parser.add_argument("--verbose", action="store_true")
+    arguments = parser.parse_args()
+
+    sock = connect(arguments.address)
+    try:
+        if arguments.stats or arguments.dump:
+            run_text(sock, arguments)
+        else:
+            run_window(sock, arguments)
+    except KeyboardInterrupt:
+        pass
+    finally:
+        sock.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())